@@ -29,7 +29,8 @@
 GRUB_MOD_LICENSE ("GPLv3+");
 
 static const struct grub_arg_option options[] = {
-  {"hash", 'h', 0, N_("Specify hash to use."), N_("HASH"), ARG_TYPE_STRING},
+  {"hash", 'h', 0, N_("Specify hash to use, or a comma separated list."),
+   N_("HASH[,HASH...]"), ARG_TYPE_STRING},
   {"check", 'c', 0, N_("Check hashes of files with hash list FILE."),
    N_("FILE"), ARG_TYPE_STRING},
   {"prefix", 'p', 0, N_("Base directory for hash list."), N_("DIR"),
@@ -60,135 +61,283 @@ hextoval (char c)
   return -1;
 }
 
+/* Upper limit on the number of digests computed in one pass.  */
+#define MAX_HASHES 8
+
+/* Files are read in chunks of up to READ_BUF_SIZE bytes, so that large
+   files go to the disk in few requests and the digests run over long
+   stretches of data.  If that much memory isn't available, smaller
+   buffers down to MIN_READ_BUF_SIZE are tried.  */
+#define READ_BUF_SIZE (1024 * 1024)
+#define MIN_READ_BUF_SIZE 4096
+
+/* Parse the comma separated list of hash names in NAMES.  */
 static grub_err_t
-hash_file (grub_file_t file, const gcry_md_spec_t *hash, void *result)
+parse_hashes (const char *names, const gcry_md_spec_t **hashes,
+	      unsigned *nhashes)
 {
-  void *context;
-  grub_uint8_t *readbuf;
-#define BUF_SIZE 4096
-  readbuf = grub_malloc (BUF_SIZE);
-  if (!readbuf)
+  const char *p = names;
+
+  *nhashes = 0;
+  while (1)
+    {
+      const char *end = grub_strchr (p, ',');
+      grub_size_t len = end ? (grub_size_t) (end - p) : grub_strlen (p);
+      char name[64];
+
+      if (len == 0 || len >= sizeof (name))
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown hash");
+      if (*nhashes == MAX_HASHES)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "too many hashes");
+      grub_memcpy (name, p, len);
+      name[len] = '\0';
+
+      hashes[*nhashes] = grub_crypto_lookup_md_by_name (name);
+      if (!hashes[*nhashes])
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown hash");
+      if (hashes[*nhashes]->mdlen > GRUB_CRYPTO_MAX_MDLEN)
+	return grub_error (GRUB_ERR_BUG, "mdlen is too long");
+      (*nhashes)++;
+
+      if (!end)
+	return GRUB_ERR_NONE;
+      p = end + 1;
+    }
+}
+
+/* Compute the NHASHES digests in HASHES of FILE in a single pass, storing
+   them in RESULTS.  */
+static grub_err_t
+hash_file (grub_file_t file, const gcry_md_spec_t **hashes, unsigned nhashes,
+	   grub_uint8_t results[][GRUB_CRYPTO_MAX_MDLEN])
+{
+  void *contexts[MAX_HASHES];
+  grub_uint8_t *readbuf = NULL, *ctxbuf;
+  grub_size_t bufsize = READ_BUF_SIZE, ctxsize = 0;
+  grub_off_t size = grub_file_size (file);
+  unsigned i;
+
+  if (size != GRUB_FILE_SIZE_UNKNOWN && size < bufsize)
+    bufsize = ALIGN_UP (size, MIN_READ_BUF_SIZE);
+  if (bufsize < MIN_READ_BUF_SIZE)
+    bufsize = MIN_READ_BUF_SIZE;
+
+  for (i = 0; i < nhashes; i++)
+    ctxsize += ALIGN_UP (hashes[i]->contextsize, GRUB_CPU_SIZEOF_VOID_P);
+  ctxbuf = grub_zalloc (ctxsize);
+  if (!ctxbuf)
     return grub_errno;
-  context = grub_zalloc (hash->contextsize);
-  if (!readbuf || !context)
+
+  while (1)
+    {
+      readbuf = grub_malloc (bufsize);
+      if (readbuf || bufsize <= MIN_READ_BUF_SIZE)
+	break;
+      grub_errno = GRUB_ERR_NONE;
+      bufsize /= 2;
+    }
+  if (!readbuf)
     goto fail;
 
-  hash->init (context);
+  ctxsize = 0;
+  for (i = 0; i < nhashes; i++)
+    {
+      contexts[i] = ctxbuf + ctxsize;
+      ctxsize += ALIGN_UP (hashes[i]->contextsize, GRUB_CPU_SIZEOF_VOID_P);
+      hashes[i]->init (contexts[i]);
+    }
+
   while (1)
     {
       grub_ssize_t r;
-      r = grub_file_read (file, readbuf, BUF_SIZE);
+      r = grub_file_read (file, readbuf, bufsize);
       if (r < 0)
 	goto fail;
       if (r == 0)
 	break;
-      hash->write (context, readbuf, r);
+      for (i = 0; i < nhashes; i++)
+	hashes[i]->write (contexts[i], readbuf, r);
+    }
+
+  for (i = 0; i < nhashes; i++)
+    {
+      hashes[i]->final (contexts[i]);
+      grub_memcpy (results[i], hashes[i]->read (contexts[i]),
+		   hashes[i]->mdlen);
     }
-  hash->final (context);
-  grub_memcpy (result, hash->read (context), hash->mdlen);
 
   grub_free (readbuf);
-  grub_free (context);
+  grub_free (ctxbuf);
 
   return GRUB_ERR_NONE;
 
  fail:
   grub_free (readbuf);
-  grub_free (context);
+  grub_free (ctxbuf);
   return grub_errno;
 }
 
-static grub_err_t
-check_list (const gcry_md_spec_t *hash, const char *hashfilename,
-	    const char *prefix, int keep, int uncompress)
+/* One line of a hash list.  */
+struct check_entry
 {
-  grub_file_t hashlist, file;
-  char *buf = NULL;
+  unsigned hash;
   grub_uint8_t expected[GRUB_CRYPTO_MAX_MDLEN];
-  grub_uint8_t actual[GRUB_CRYPTO_MAX_MDLEN];
+};
+
+/* Hash the file named in the lines of ENTRIES, all of which refer to the
+   same file, and compare against the expected values.  */
+static grub_err_t
+check_file (const gcry_md_spec_t **hashes, const char *name,
+	    const char *prefix, int uncompress,
+	    struct check_entry *entries, unsigned nentries,
+	    int keep, unsigned *unread, unsigned *mismatch)
+{
+  const gcry_md_spec_t *used[MAX_HASHES];
+  grub_uint8_t actual[MAX_HASHES][GRUB_CRYPTO_MAX_MDLEN];
+  grub_file_t file;
   grub_err_t err;
   unsigned i;
+
+  if (!uncompress)
+    grub_file_filter_disable_compression ();
+  if (prefix)
+    {
+      char *filename;
+
+      filename = grub_xasprintf ("%s/%s", prefix, name);
+      if (!filename)
+	return grub_errno;
+      file = grub_file_open (filename);
+      grub_free (filename);
+    }
+  else
+    file = grub_file_open (name);
+  if (!file)
+    return grub_errno;
+
+  for (i = 0; i < nentries; i++)
+    used[i] = hashes[entries[i].hash];
+  err = hash_file (file, used, nentries, actual);
+  grub_file_close (file);
+  if (err)
+    {
+      grub_printf_ (N_("%s: READ ERROR\n"), name);
+      if (!keep)
+	return err;
+      grub_print_error ();
+      grub_errno = GRUB_ERR_NONE;
+      *unread += nentries;
+      return GRUB_ERR_NONE;
+    }
+
+  for (i = 0; i < nentries; i++)
+    {
+      if (grub_crypto_memcmp (entries[i].expected, actual[i],
+			      used[i]->mdlen) != 0)
+	{
+	  grub_printf_ (N_("%s: HASH MISMATCH\n"), name);
+	  if (!keep)
+	    return grub_error (GRUB_ERR_TEST_FAILURE,
+			       "hash of '%s' mismatches", name);
+	  (*mismatch)++;
+	  continue;
+	}
+      grub_printf_ (N_("%s: OK\n"), name);
+    }
+  return GRUB_ERR_NONE;
+}
+
+/* Check the files listed in HASHFILENAME.  With several hashes, the
+   length of each listed value tells which one it is, so no two may have
+   the same length.  Consecutive lines naming the same file are checked
+   together in a single read.  */
+static grub_err_t
+check_list (const gcry_md_spec_t **hashes, unsigned nhashes,
+	    const char *hashfilename, const char *prefix, int keep,
+	    int uncompress)
+{
+  grub_file_t hashlist;
+  char *buf = NULL, *pending = NULL;
+  struct check_entry entries[MAX_HASHES];
+  unsigned nentries = 0;
+  grub_err_t err = GRUB_ERR_NONE;
+  unsigned i, h;
   unsigned unread = 0, mismatch = 0;
 
-  if (hash->mdlen > GRUB_CRYPTO_MAX_MDLEN)
-    return grub_error (GRUB_ERR_BUG, "mdlen is too long");
+  for (h = 0; h < nhashes; h++)
+    for (i = h + 1; i < nhashes; i++)
+      if (hashes[h]->mdlen == hashes[i]->mdlen)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT,
+			   "hashes %s and %s can't be told apart "
+			   "in a hash list", hashes[h]->name,
+			   hashes[i]->name);
 
   hashlist = grub_file_open (hashfilename);
   if (!hashlist)
     return grub_errno;
-  
+
   while (grub_free (buf), (buf = grub_file_getline (hashlist)))
     {
-      const char *p = buf;
+      char *p = buf;
+      grub_size_t len = 0;
+
       while (grub_isspace (p[0]))
 	p++;
-      for (i = 0; i < hash->mdlen; i++)
+      while (hextoval (p[len]) >= 0)
+	len++;
+      for (h = 0; h < nhashes; h++)
+	if (len == 2 * hashes[h]->mdlen)
+	  break;
+      if (h == nhashes)
 	{
-	  int high, low;
-	  high = hextoval (*p++);
-	  low = hextoval (*p++);
-	  if (high < 0 || low < 0)
-	    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid hash list");
-	  expected[i] = (high << 4) | low;
+	  err = grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid hash list");
+	  break;
 	}
+      p += len;
       if ((p[0] != ' ' && p[0] != '\t') || (p[1] != ' ' && p[1] != '\t'))
-	return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid hash list");
-      p += 2;
-      if (prefix)
-	{
-	  char *filename;
-	  
-	  filename = grub_xasprintf ("%s/%s", prefix, p);
-	  if (!filename)
-	    return grub_errno;
-	  if (!uncompress)
-	    grub_file_filter_disable_compression ();
-	  file = grub_file_open (filename);
-	  grub_free (filename);
-	}
-      else
-	{
-	  if (!uncompress)
-	    grub_file_filter_disable_compression ();
-	  file = grub_file_open (p);
-	}
-      if (!file)
 	{
-	  grub_file_close (hashlist);
-	  grub_free (buf);
-	  return grub_errno;
+	  err = grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid hash list");
+	  break;
 	}
-      err = hash_file (file, hash, actual);
-      grub_file_close (file);
-      if (err)
+
+      if (pending && (grub_strcmp (pending, p + 2) != 0
+		      || nentries == MAX_HASHES))
 	{
-	  grub_printf_ (N_("%s: READ ERROR\n"), p);
-	  if (!keep)
-	    {
-	      grub_file_close (hashlist);
-	      grub_free (buf);
-	      return err;
-	    }
-	  grub_print_error ();
-	  grub_errno = GRUB_ERR_NONE;
-	  unread++;
-	  continue;
+	  err = check_file (hashes, pending, prefix, uncompress,
+			    entries, nentries, keep, &unread, &mismatch);
+	  grub_free (pending);
+	  pending = NULL;
+	  nentries = 0;
+	  if (err)
+	    break;
 	}
-      if (grub_crypto_memcmp (expected, actual, hash->mdlen) != 0)
+      if (!pending)
 	{
-	  grub_printf_ (N_("%s: HASH MISMATCH\n"), p);
-	  if (!keep)
+	  pending = grub_strdup (p + 2);
+	  if (!pending)
 	    {
-	      grub_file_close (hashlist);
-	      grub_free (buf);
-	      return grub_error (GRUB_ERR_TEST_FAILURE,
-				 "hash of '%s' mismatches", p);
+	      err = grub_errno;
+	      break;
 	    }
-	  mismatch++;
-	  continue;	  
 	}
-      grub_printf_ (N_("%s: OK\n"), p);
+
+      p -= len;
+      entries[nentries].hash = h;
+      for (i = 0; i < hashes[h]->mdlen; i++)
+	entries[nentries].expected[i] = (hextoval (p[2 * i]) << 4)
+	  | hextoval (p[2 * i + 1]);
+      nentries++;
     }
+
+  if (pending && !err)
+    err = check_file (hashes, pending, prefix, uncompress,
+		      entries, nentries, keep, &unread, &mismatch);
+  grub_free (pending);
+  grub_free (buf);
+  grub_file_close (hashlist);
+  if (err)
+    return err;
+
   if (mismatch || unread)
     return grub_error (GRUB_ERR_TEST_FAILURE,
 		       "%d files couldn't be read and hash "
@@ -203,11 +352,13 @@ grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
   struct grub_arg_list *state = ctxt->state;
   const char *hashname = NULL;
   const char *prefix = NULL;
-  const gcry_md_spec_t *hash;
+  const gcry_md_spec_t *hashes[MAX_HASHES];
+  unsigned nhashes;
   unsigned i;
   int keep = state[3].set;
   int uncompress = state[4].set;
   unsigned unread = 0;
+  grub_err_t err;
 
   for (i = 0; i < ARRAY_SIZE (aliases); i++)
     if (grub_strcmp (ctxt->extcmd->cmd->name, aliases[i].name) == 0)
@@ -218,12 +369,9 @@ grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
   if (!hashname)
     return grub_error (GRUB_ERR_BAD_ARGUMENT, "no hash specified");
 
-  hash = grub_crypto_lookup_md_by_name (hashname);
-  if (!hash)
-    return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown hash");
-
-  if (hash->mdlen > GRUB_CRYPTO_MAX_MDLEN)
-    return grub_error (GRUB_ERR_BUG, "mdlen is too long");
+  err = parse_hashes (hashname, hashes, &nhashes);
+  if (err)
+    return err;
 
   if (state[2].set)
     prefix = state[2].arg;
@@ -233,15 +381,15 @@ grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
       if (argc != 0)
 	return grub_error (GRUB_ERR_BAD_ARGUMENT,
 			   "--check is incompatible with file list");
-      return check_list (hash, state[1].arg, prefix, keep, uncompress);
+      return check_list (hashes, nhashes, state[1].arg, prefix, keep,
+			 uncompress);
     }
 
   for (i = 0; i < (unsigned) argc; i++)
     {
-      GRUB_PROPERLY_ALIGNED_ARRAY (result, GRUB_CRYPTO_MAX_MDLEN);
+      grub_uint8_t result[MAX_HASHES][GRUB_CRYPTO_MAX_MDLEN];
       grub_file_t file;
-      grub_err_t err;
-      unsigned j;
+      unsigned j, h;
       if (!uncompress)
 	grub_file_filter_disable_compression ();
       file = grub_file_open (args[i]);
@@ -254,7 +402,7 @@ grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
 	  unread++;
 	  continue;
 	}
-      err = hash_file (file, hash, result);
+      err = hash_file (file, hashes, nhashes, result);
       grub_file_close (file);
       if (err)
 	{
@@ -265,9 +413,12 @@ grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
 	  unread++;
 	  continue;
 	}
-      for (j = 0; j < hash->mdlen; j++)
-	grub_printf ("%02x", ((grub_uint8_t *) result)[j]);
-      grub_printf ("  %s\n", args[i]);
+      for (h = 0; h < nhashes; h++)
+	{
+	  for (j = 0; j < hashes[h]->mdlen; j++)
+	    grub_printf ("%02x", result[h][j]);
+	  grub_printf ("  %s\n", args[i]);
+	}
     }
 
   if (unread)
@@ -0,0 +1,85 @@
+/* pbkdf2_bench.c - measure PBKDF2 speed.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/command.h>
+#include <grub/crypto.h>
+#include <grub/dl.h>
+#include <grub/i18n.h>
+#include <grub/misc.h>
+#include <grub/time.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define BENCH_DEFAULT_ITERATIONS 20000
+
+static grub_err_t
+grub_cmd_pbkdf2_bench (grub_command_t cmd __attribute__ ((unused)),
+		       int argc, char **args)
+{
+  const gcry_md_spec_t *hashes[] = {
+    GRUB_MD_SHA1, GRUB_MD_SHA256, GRUB_MD_SHA512
+  };
+  grub_uint8_t DK[GRUB_CRYPTO_MAX_MDLEN];
+  unsigned int iterations = BENCH_DEFAULT_ITERATIONS;
+  grub_size_t i;
+
+  if (argc > 0)
+    iterations = grub_strtoul (args[0], 0, 0);
+  if (!iterations)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid iteration count"));
+
+  for (i = 0; i < ARRAY_SIZE (hashes); i++)
+    {
+      const gcry_md_spec_t *md = hashes[i];
+      grub_uint64_t start, elapsed;
+      gcry_err_code_t err;
+
+      start = grub_get_time_ms ();
+      err = grub_crypto_pbkdf2 (md, (const grub_uint8_t *) "password", 8,
+				(const grub_uint8_t *) "salt", 4,
+				iterations, DK, md->mdlen);
+      elapsed = grub_get_time_ms () - start;
+      if (err)
+	return grub_crypto_gcry_error (err);
+
+      grub_printf ("PBKDF2-%s: ", md->name);
+      if (elapsed)
+	grub_printf ("%llu iterations/s\n",
+		     (unsigned long long) grub_divmod64 (iterations * 1000ULL,
+							 elapsed, 0));
+      else
+	grub_printf_ (N_("too fast to measure\n"));
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_command_t cmd;
+
+GRUB_MOD_INIT(pbkdf2_bench)
+{
+  cmd = grub_register_command ("pbkdf2_bench", grub_cmd_pbkdf2_bench,
+			       N_("[ITERATIONS]"),
+			       N_("Measure PBKDF2 speed for each hash."));
+}
+
+GRUB_MOD_FINI(pbkdf2_bench)
+{
+  grub_unregister_command (cmd);
+}
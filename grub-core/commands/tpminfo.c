@@ -0,0 +1,58 @@
+/* tpminfo.c - TPM measurement statistics  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/command.h>
+#include <grub/i18n.h>
+#include <grub/tpm.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static grub_err_t
+grub_cmd_tpminfo (struct grub_command *cmd __attribute__ ((unused)),
+		  int argc __attribute__ ((unused)),
+		  char *argv[] __attribute__ ((unused)))
+{
+  grub_uint64_t events, bytes, time_ms;
+
+  grub_tpm_get_stats (&events, &bytes, &time_ms);
+  if (events)
+    grub_printf_ (N_("TPM measurements: %llu events, %llu bytes,"
+		     " %llu ms\n"), (unsigned long long) events,
+		  (unsigned long long) bytes, (unsigned long long) time_ms);
+  else
+    grub_printf ("%s\n", _("No TPM measurements made"));
+
+  return 0;
+}
+
+static grub_command_t cmd_tpminfo;
+
+GRUB_MOD_INIT(tpminfo)
+{
+  cmd_tpminfo =
+    grub_register_command ("tpminfo", grub_cmd_tpminfo,
+			   0, N_("Show TPM measurement statistics."));
+}
+
+GRUB_MOD_FINI(tpminfo)
+{
+  grub_unregister_command (cmd_tpminfo);
+}
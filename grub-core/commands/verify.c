@@ -33,9 +33,15 @@
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+struct grub_verify_sig;
+
 struct grub_verified
 {
   grub_file_t file;
+  /* Detached signature and its parsed form, NULL once consumed.  */
+  grub_file_t sig;
+  struct grub_verify_sig *vs;
+  /* Whole verified file, for consumers that don't read it in one go.  */
   void *buf;
 };
 typedef struct grub_verified *grub_verified_t;
@@ -459,229 +465,411 @@ rsa_pad (gcry_mpi_t *hmpi, grub_uint8_t *hval,
   return ret;
 }
 
-static grub_err_t
-grub_verify_signature_real (char *buf, grub_size_t size,
-			    grub_file_t f, grub_file_t sig,
-			    struct grub_public_key *pkey)
+/* A detached signature whose packet has been parsed, waiting for the
+   signed data to be fed into HASH_CONTEXT.  */
+struct grub_verify_sig
 {
-  grub_size_t len;
+  const gcry_md_spec_t *hash;
+  void *hash_context;
   grub_uint8_t v;
+  struct signature_v4_header v4;
+  grub_uint8_t *hashed_sub;
+  grub_uint8_t pk;
+  grub_uint64_t keyid;
+  grub_uint8_t hash_start[2];
+  gcry_mpi_t mpis[10];
+  /* Signature MPIs as found in the packet.  */
+  grub_uint8_t *sigdata;
+  grub_size_t sigdata_len;
+};
+
+static void
+verify_sig_free (struct grub_verify_sig *vs)
+{
+  grub_size_t i;
+
+  if (!vs)
+    return;
+  for (i = 0; i < ARRAY_SIZE (vs->mpis); i++)
+    if (vs->mpis[i])
+      gcry_mpi_release (vs->mpis[i]);
+  grub_free (vs->hashed_sub);
+  grub_free (vs->sigdata);
+  grub_free (vs->hash_context);
+  grub_free (vs);
+}
+
+/* Read the signature packet from SIG.  Everything but the signed data
+   is consumed here, so the data itself can be hashed as it goes by.  */
+static struct grub_verify_sig *
+verify_sig_parse (grub_file_t sig)
+{
+  grub_size_t len;
   grub_uint8_t h;
   grub_uint8_t t;
-  grub_uint8_t pk;
-  const gcry_md_spec_t *hash;
-  struct signature_v4_header v4;
   grub_err_t err;
   grub_size_t i;
-  gcry_mpi_t mpis[10];
   grub_uint8_t type = 0;
+  grub_uint16_t unhashed_sub;
+  grub_ssize_t rem;
+  grub_uint8_t *readbuf = NULL;
+  struct grub_verify_sig *vs;
 
   err = read_packet_header (sig, &type, &len);
   if (err)
-    return err;
+    return NULL;
 
   if (type != 0x2)
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+    {
+      grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+      return NULL;
+    }
 
-  if (grub_file_read (sig, &v, sizeof (v)) != sizeof (v))
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  vs = grub_zalloc (sizeof (*vs));
+  if (!vs)
+    return NULL;
 
-  if (v != 4)
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  if (grub_file_read (sig, &vs->v, sizeof (vs->v)) != sizeof (vs->v))
+    goto fail;
 
-  if (grub_file_read (sig, &v4, sizeof (v4)) != sizeof (v4))
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  if (vs->v != 4)
+    goto fail;
+
+  if (grub_file_read (sig, &vs->v4, sizeof (vs->v4)) != sizeof (vs->v4))
+    goto fail;
+
+  h = vs->v4.hash;
+  t = vs->v4.type;
+  vs->pk = vs->v4.pkeyalgo;
 
-  h = v4.hash;
-  t = v4.type;
-  pk = v4.pkeyalgo;
-  
   if (t != 0)
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+    goto fail;
 
   if (h >= ARRAY_SIZE (hashes) || hashes[h] == NULL)
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, "unknown hash");
+    {
+      grub_error (GRUB_ERR_BAD_SIGNATURE, "unknown hash");
+      goto fail;
+    }
 
-  if (pk >= ARRAY_SIZE (pkalgos) || pkalgos[pk].name == NULL)
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  if (vs->pk >= ARRAY_SIZE (pkalgos) || pkalgos[vs->pk].name == NULL)
+    goto fail;
 
-  hash = grub_crypto_lookup_md_by_name (hashes[h]);
-  if (!hash)
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, "hash `%s' not loaded", hashes[h]);
+  vs->hash = grub_crypto_lookup_md_by_name (hashes[h]);
+  if (!vs->hash)
+    {
+      grub_error (GRUB_ERR_BAD_SIGNATURE, "hash `%s' not loaded", hashes[h]);
+      goto fail;
+    }
 
   grub_dprintf ("crypt", "alive\n");
 
-  {
-    void *context = NULL;
-    unsigned char *hval;
-    grub_ssize_t rem = grub_be_to_cpu16 (v4.hashed_sub);
-    grub_uint32_t headlen = grub_cpu_to_be32 (rem + 6);
-    grub_uint8_t s;
-    grub_uint16_t unhashed_sub;
-    grub_ssize_t r;
-    grub_uint8_t hash_start[2];
-    gcry_mpi_t hmpi;
-    grub_uint64_t keyid = 0;
-    struct grub_public_subkey *sk;
-    grub_uint8_t *readbuf = NULL;
-
-    context = grub_zalloc (hash->contextsize);
-    readbuf = grub_zalloc (READBUF_SIZE);
-    if (!context || !readbuf)
-      goto fail;
+  rem = grub_be_to_cpu16 (vs->v4.hashed_sub);
+  vs->hash_context = grub_zalloc (vs->hash->contextsize);
+  vs->hashed_sub = grub_malloc (rem ? : 1);
+  readbuf = grub_zalloc (READBUF_SIZE);
+  if (!vs->hash_context || !vs->hashed_sub || !readbuf)
+    goto fail;
 
-    hash->init (context);
-    if (buf)
-      hash->write (context, buf, size);
-    else 
-      while (1)
-	{
-	  r = grub_file_read (f, readbuf, READBUF_SIZE);
-	  if (r < 0)
-	    goto fail;
-	  if (r == 0)
-	    break;
-	  hash->write (context, readbuf, r);
-	}
+  if (grub_file_read (sig, vs->hashed_sub, rem) != rem)
+    goto fail;
 
-    hash->write (context, &v, sizeof (v));
-    hash->write (context, &v4, sizeof (v4));
-    while (rem)
+  if (grub_file_read (sig, &unhashed_sub, sizeof (unhashed_sub))
+      != sizeof (unhashed_sub))
+    goto fail;
+  {
+    grub_uint8_t *ptr;
+    grub_uint32_t l;
+    rem = grub_be_to_cpu16 (unhashed_sub);
+    if (rem > READBUF_SIZE)
+      goto fail;
+    if (grub_file_read (sig, readbuf, rem) != rem)
+      goto fail;
+    for (ptr = readbuf; ptr < readbuf + rem; ptr += l)
       {
-	r = grub_file_read (sig, readbuf,
-			    rem < READBUF_SIZE ? rem : READBUF_SIZE);
-	if (r < 0)
-	  goto fail;
-	if (r == 0)
-	  break;
-	hash->write (context, readbuf, r);
-	rem -= r;
+	if (*ptr < 192)
+	  l = *ptr++;
+	else if (*ptr < 255)
+	  {
+	    if (ptr + 1 >= readbuf + rem)
+	      break;
+	    l = (((ptr[0] & ~192) << GRUB_CHAR_BIT) | ptr[1]) + 192;
+	    ptr += 2;
+	  }
+	else
+	  {
+	    if (ptr + 5 >= readbuf + rem)
+	      break;
+	    l = grub_be_to_cpu32 (grub_get_unaligned32 (ptr + 1));
+	    ptr += 5;
+	  }
+	if (*ptr == 0x10 && l >= 8)
+	  vs->keyid = grub_get_unaligned64 (ptr + 1);
       }
-    hash->write (context, &v, sizeof (v));
-    s = 0xff;
-    hash->write (context, &s, sizeof (s));
-    hash->write (context, &headlen, sizeof (headlen));
-    r = grub_file_read (sig, &unhashed_sub, sizeof (unhashed_sub));
-    if (r != sizeof (unhashed_sub))
-      goto fail;
+  }
+
+  if (grub_file_read (sig, vs->hash_start, sizeof (vs->hash_start))
+      != sizeof (vs->hash_start))
+    goto fail;
+
+  grub_dprintf ("crypt", "@ %x\n", (int)grub_file_tell (sig));
+
+  for (i = 0; i < pkalgos[vs->pk].nmpisig; i++)
     {
-      grub_uint8_t *ptr;
-      grub_uint32_t l;
-      rem = grub_be_to_cpu16 (unhashed_sub);
-      if (rem > READBUF_SIZE)
+      grub_uint16_t l;
+      grub_size_t lb;
+      grub_uint8_t *sigdata;
+      if (grub_file_read (sig, &l, sizeof (l)) != sizeof (l))
 	goto fail;
-      r = grub_file_read (sig, readbuf, rem);
-      if (r != rem)
+      lb = (grub_be_to_cpu16 (l) + 7) / 8;
+      grub_dprintf ("crypt", "l = 0x%04x\n", grub_be_to_cpu16 (l));
+      if (lb > READBUF_SIZE - sizeof (grub_uint16_t))
 	goto fail;
-      for (ptr = readbuf; ptr < readbuf + rem; ptr += l)
-	{
-	  if (*ptr < 192)
-	    l = *ptr++;
-	  else if (*ptr < 255)
-	    {
-	      if (ptr + 1 >= readbuf + rem)
-		break;
-	      l = (((ptr[0] & ~192) << GRUB_CHAR_BIT) | ptr[1]) + 192;
-	      ptr += 2;
-	    }
-	  else
-	    {
-	      if (ptr + 5 >= readbuf + rem)
-		break;
-	      l = grub_be_to_cpu32 (grub_get_unaligned32 (ptr + 1));
-	      ptr += 5;
-	    }
-	  if (*ptr == 0x10 && l >= 8)
-	    keyid = grub_get_unaligned64 (ptr + 1);
-	}
+      if (grub_file_read (sig, readbuf + sizeof (grub_uint16_t), lb) != (grub_ssize_t) lb)
+	goto fail;
+      grub_memcpy (readbuf, &l, sizeof (l));
+
+      if (gcry_mpi_scan (&vs->mpis[i], GCRYMPI_FMT_PGP,
+			 readbuf, lb + sizeof (grub_uint16_t), 0))
+	goto fail;
+
+      sigdata = grub_realloc (vs->sigdata, vs->sigdata_len
+			      + lb + sizeof (grub_uint16_t));
+      if (!sigdata)
+	goto fail;
+      grub_memcpy (sigdata + vs->sigdata_len, readbuf,
+		   lb + sizeof (grub_uint16_t));
+      vs->sigdata = sigdata;
+      vs->sigdata_len += lb + sizeof (grub_uint16_t);
     }
 
-    hash->final (context);
+  grub_free (readbuf);
+  vs->hash->init (vs->hash_context);
+  return vs;
 
-    grub_dprintf ("crypt", "alive\n");
+ fail:
+  grub_free (readbuf);
+  verify_sig_free (vs);
+  if (!grub_errno)
+    grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  return NULL;
+}
 
-    hval = hash->read (context);
+static inline void
+verify_sig_write (struct grub_verify_sig *vs, const void *buf, grub_size_t size)
+{
+  vs->hash->write (vs->hash_context, buf, size);
+}
 
-    if (grub_file_read (sig, hash_start, sizeof (hash_start)) != sizeof (hash_start))
-      goto fail;
-    if (grub_memcmp (hval, hash_start, sizeof (hash_start)) != 0)
-      goto fail;
+/* Signatures already checked against a trusted key during this boot, so
+   that files read again (configfile, fonts, modules) don't need another
+   RSA or DSA operation.  A hit requires the same digest, the same
+   signature and the same trusted subkey: the data itself is always hashed
+   again, only the public key operation is skipped.  */
+#define VERIFY_CACHE_SIZE 32
 
-    grub_dprintf ("crypt", "@ %x\n", (int)grub_file_tell (sig));
+struct verify_cache_entry
+{
+  const struct grub_public_subkey *sk;
+  const gcry_md_spec_t *hash;
+  grub_uint8_t digest[GRUB_CRYPTO_MAX_MDLEN];
+  grub_uint8_t *sigdata;
+  grub_size_t sigdata_len;
+};
 
-    for (i = 0; i < pkalgos[pk].nmpisig; i++)
-      {
-	grub_uint16_t l;
-	grub_size_t lb;
-	grub_dprintf ("crypt", "alive\n");
-	if (grub_file_read (sig, &l, sizeof (l)) != sizeof (l))
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-	lb = (grub_be_to_cpu16 (l) + 7) / 8;
-	grub_dprintf ("crypt", "l = 0x%04x\n", grub_be_to_cpu16 (l));
-	if (lb > READBUF_SIZE - sizeof (grub_uint16_t))
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-	if (grub_file_read (sig, readbuf + sizeof (grub_uint16_t), lb) != (grub_ssize_t) lb)
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-	grub_memcpy (readbuf, &l, sizeof (l));
-	grub_dprintf ("crypt", "alive\n");
+static struct verify_cache_entry verify_cache[VERIFY_CACHE_SIZE];
+static unsigned verify_cache_next;
 
-	if (gcry_mpi_scan (&mpis[i], GCRYMPI_FMT_PGP,
-			   readbuf, lb + sizeof (grub_uint16_t), 0))
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-      }
+static int
+verify_cache_lookup (const struct grub_verify_sig *vs,
+		     const struct grub_public_subkey *sk,
+		     const grub_uint8_t *hval)
+{
+  unsigned i;
+
+  for (i = 0; i < VERIFY_CACHE_SIZE; i++)
+    if (verify_cache[i].sk == sk
+	&& verify_cache[i].hash == vs->hash
+	&& verify_cache[i].sigdata_len == vs->sigdata_len
+	&& grub_memcmp (verify_cache[i].digest, hval, vs->hash->mdlen) == 0
+	&& grub_memcmp (verify_cache[i].sigdata, vs->sigdata,
+			vs->sigdata_len) == 0)
+      return 1;
+  return 0;
+}
 
-    if (pkey)
-      sk = grub_crypto_pk_locate_subkey (keyid, pkey);
-    else
-      sk = grub_crypto_pk_locate_subkey_in_trustdb (keyid);
-    if (!sk)
-      {
-	/* TRANSLATORS: %08x is 32-bit key id.  */
-	grub_error (GRUB_ERR_BAD_SIGNATURE, N_("public key %08x not found"),
-		    keyid);
-	goto fail;
-      }
+static void
+verify_cache_add (const struct grub_verify_sig *vs,
+		  const struct grub_public_subkey *sk,
+		  const grub_uint8_t *hval)
+{
+  struct verify_cache_entry *e = &verify_cache[verify_cache_next];
+  grub_uint8_t *sigdata;
 
-    if (pkalgos[pk].pad (&hmpi, hval, hash, sk))
-      goto fail;
-    if (!*pkalgos[pk].algo)
-      {
-	grub_dl_load (pkalgos[pk].module);
-	grub_errno = GRUB_ERR_NONE;
-      }
+  if (vs->hash->mdlen > GRUB_CRYPTO_MAX_MDLEN)
+    return;
 
-    if (!*pkalgos[pk].algo)
-      {
-	grub_error (GRUB_ERR_BAD_SIGNATURE, N_("module `%s' isn't loaded"),
-		    pkalgos[pk].module);
-	goto fail;
-      }
-    if ((*pkalgos[pk].algo)->verify (0, hmpi, mpis, sk->mpis, 0, 0))
-      goto fail;
+  sigdata = grub_malloc (vs->sigdata_len);
+  if (!sigdata)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  grub_memcpy (sigdata, vs->sigdata, vs->sigdata_len);
+
+  grub_free (e->sigdata);
+  e->sk = sk;
+  e->hash = vs->hash;
+  grub_memcpy (e->digest, hval, vs->hash->mdlen);
+  e->sigdata = sigdata;
+  e->sigdata_len = vs->sigdata_len;
+  verify_cache_next = (verify_cache_next + 1) % VERIFY_CACHE_SIZE;
+}
+
+/* Must be called whenever a trusted key goes away.  */
+static void
+verify_cache_flush (void)
+{
+  unsigned i;
+
+  for (i = 0; i < VERIFY_CACHE_SIZE; i++)
+    grub_free (verify_cache[i].sigdata);
+  grub_memset (verify_cache, 0, sizeof (verify_cache));
+  verify_cache_next = 0;
+}
+
+/* Hash the signature trailer after the data and check the result against
+   PKEY, or against the trusted keys if PKEY is NULL.  */
+static grub_err_t
+verify_sig_finish (struct grub_verify_sig *vs, struct grub_public_key *pkey)
+{
+  const gcry_md_spec_t *hash = vs->hash;
+  void *context = vs->hash_context;
+  grub_uint16_t rem = grub_be_to_cpu16 (vs->v4.hashed_sub);
+  grub_uint32_t headlen = grub_cpu_to_be32 (rem + 6);
+  grub_uint8_t s;
+  unsigned char *hval;
+  gcry_mpi_t hmpi;
+  struct grub_public_subkey *sk;
+  grub_uint8_t pk = vs->pk;
+  int verified;
+
+  hash->write (context, &vs->v, sizeof (vs->v));
+  hash->write (context, &vs->v4, sizeof (vs->v4));
+  hash->write (context, vs->hashed_sub, rem);
+  hash->write (context, &vs->v, sizeof (vs->v));
+  s = 0xff;
+  hash->write (context, &s, sizeof (s));
+  hash->write (context, &headlen, sizeof (headlen));
+  hash->final (context);
+
+  hval = hash->read (context);
 
-    grub_free (context);
-    grub_free (readbuf);
+  if (grub_memcmp (hval, vs->hash_start, sizeof (vs->hash_start)) != 0)
+    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
+  if (pkey)
+    sk = grub_crypto_pk_locate_subkey (vs->keyid, pkey);
+  else
+    sk = grub_crypto_pk_locate_subkey_in_trustdb (vs->keyid);
+  if (!sk)
+    /* TRANSLATORS: %08x is 32-bit key id.  */
+    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("public key %08x not found"),
+		       vs->keyid);
+
+  /* Keys passed in by the caller may be freed at any time, only results
+     for the trusted keys are remembered.  */
+  if (!pkey && verify_cache_lookup (vs, sk, hval))
     return GRUB_ERR_NONE;
 
-  fail:
-    grub_free (context);
-    grub_free (readbuf);
-    if (!grub_errno)
-      return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
-    return grub_errno;
-  }
+  if (pkalgos[pk].pad (&hmpi, hval, hash, sk))
+    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  if (!*pkalgos[pk].algo)
+    {
+      grub_dl_load (pkalgos[pk].module);
+      grub_errno = GRUB_ERR_NONE;
+    }
+
+  if (!*pkalgos[pk].algo)
+    {
+      gcry_mpi_release (hmpi);
+      return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("module `%s' isn't loaded"),
+			 pkalgos[pk].module);
+    }
+  verified = !(*pkalgos[pk].algo)->verify (0, hmpi, vs->mpis, sk->mpis, 0, 0);
+  gcry_mpi_release (hmpi);
+  if (!verified)
+    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+
+  if (!pkey)
+    verify_cache_add (vs, sk, hval);
+
+  return GRUB_ERR_NONE;
 }
 
 grub_err_t
 grub_verify_signature (grub_file_t f, grub_file_t sig,
 		       struct grub_public_key *pkey)
 {
-  return grub_verify_signature_real (0, 0, f, sig, pkey);
+  struct grub_verify_sig *vs;
+  grub_uint8_t *readbuf;
+  grub_ssize_t r;
+  grub_err_t err;
+
+  vs = verify_sig_parse (sig);
+  if (!vs)
+    return grub_errno;
+
+  readbuf = grub_malloc (READBUF_SIZE);
+  if (!readbuf)
+    {
+      verify_sig_free (vs);
+      return grub_errno;
+    }
+
+  while ((r = grub_file_read (f, readbuf, READBUF_SIZE)) > 0)
+    verify_sig_write (vs, readbuf, r);
+  grub_free (readbuf);
+
+  if (r < 0)
+    err = grub_errno ? : grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  else
+    err = verify_sig_finish (vs, pkey);
+  verify_sig_free (vs);
+  return err;
+}
+
+/* Add PK to the trusted keys, unless all of its subkeys are trusted
+   already, as happens each time a configuration file adding keys is read
+   again.  The list would otherwise grow and slow down every lookup.  */
+static void
+trust_key (struct grub_public_key *pk)
+{
+  struct grub_public_subkey *sk, *tsk;
+  struct grub_public_key *tpk;
+
+  for (sk = pk->subkeys; sk; sk = sk->next)
+    {
+      for (tpk = grub_pk_trusted; tpk; tpk = tpk->next)
+	{
+	  for (tsk = tpk->subkeys; tsk; tsk = tsk->next)
+	    if (grub_memcmp (tsk->fingerprint, sk->fingerprint,
+			     sizeof (sk->fingerprint)) == 0)
+	      break;
+	  if (tsk)
+	    break;
+	}
+      if (!tpk)
+	break;
+    }
+
+  if (pk->subkeys && !sk)
+    {
+      free_pk (pk);
+      return;
+    }
+
+  pk->next = grub_pk_trusted;
+  grub_pk_trusted = pk;
 }
 
 static grub_err_t
@@ -708,8 +896,7 @@ grub_cmd_trust (grub_extcmd_context_t ctxt,
     }
   grub_file_close (pkf);
 
-  pk->next = grub_pk_trusted;
-  grub_pk_trusted = pk;
+  trust_key (pk);
 
   return GRUB_ERR_NONE;
 }
@@ -764,8 +951,7 @@ grub_cmd_trust_var (grub_command_t cmd __attribute__ ((unused)),
       return grub_errno;
     }
 
-  pk->next = grub_pk_trusted;
-  grub_pk_trusted = pk;
+  trust_key (pk);
 
   grub_free(data);
   return GRUB_ERR_NONE;
@@ -817,6 +1003,7 @@ grub_cmd_distrust (grub_command_t cmd  __attribute__ ((unused)),
       if (!sk)
 	continue;
       next = (*pkey)->next;
+      verify_cache_flush ();
       free_pk (*pkey);
       *pkey = next;
       return GRUB_ERR_NONE;
@@ -887,21 +1074,109 @@ grub_cmd_verify_signature (grub_extcmd_context_t ctxt,
 
 static int sec = 0;
 
+/* Amount of data read from the disk and hashed in one go when verifying
+   straight into the caller's buffer, small enough for the hash to find
+   it still in cache.  */
+#define VERIFY_STREAM_CHUNK (256 * 1024)
+
 static void
 verified_free (grub_verified_t verified)
 {
   if (verified)
     {
+      verify_sig_free (verified->vs);
+      if (verified->sig)
+	grub_file_close (verified->sig);
       grub_free (verified->buf);
       grub_free (verified);
     }
 }
 
+/* Read the whole underlying file into BUF, hashing it on the way, and
+   check the signature.  On failure BUF is cleared so that no unverified
+   data is left behind for the caller.  */
+static grub_err_t
+verified_check (grub_verified_t verified, char *buf, grub_size_t size)
+{
+  grub_size_t done = 0;
+  grub_err_t err;
+
+  if (!verified->vs)
+    {
+      /* The parsed signature is consumed by every check, start over.  */
+      grub_file_seek (verified->sig, 0);
+      verified->vs = verify_sig_parse (verified->sig);
+      if (!verified->vs)
+	return grub_errno;
+    }
+
+  grub_file_seek (verified->file, 0);
+  while (done < size)
+    {
+      grub_size_t chunk = size - done;
+      grub_ssize_t r;
+
+      if (chunk > VERIFY_STREAM_CHUNK)
+	chunk = VERIFY_STREAM_CHUNK;
+      r = grub_file_read (verified->file, buf + done, chunk);
+      if (r <= 0)
+	{
+	  if (!grub_errno)
+	    grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
+			verified->file->name);
+	  break;
+	}
+      verify_sig_write (verified->vs, buf + done, r);
+      done += r;
+    }
+
+  if (done == size)
+    err = verify_sig_finish (verified->vs, NULL);
+  else
+    err = grub_errno;
+  verify_sig_free (verified->vs);
+  verified->vs = NULL;
+
+  if (err)
+    grub_memset (buf, 0, size);
+  return err;
+}
+
 static grub_ssize_t
 verified_read (struct grub_file *file, char *buf, grub_size_t len)
 {
   grub_verified_t verified = file->data;
 
+  /* A consumer reading the entire file in one call gets it verified
+     directly in its own buffer, the file is never held twice.  The data
+     is only returned once the signature has been checked.  */
+  if (!verified->buf && file->offset == 0 && len == file->size)
+    {
+      if (verified_check (verified, buf, len))
+	return -1;
+      return len;
+    }
+
+  /* Anything else needs the whole verified file at hand first.  */
+  if (!verified->buf)
+    {
+      if (file->size >> (sizeof (grub_size_t) * GRUB_CHAR_BIT - 1))
+	{
+	  grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		      "big file signature isn't implemented yet");
+	  return -1;
+	}
+      verified->buf = grub_malloc (file->size);
+      if (!verified->buf)
+	return -1;
+      if (verified_check (verified, verified->buf, file->size))
+	{
+	  grub_free (verified->buf);
+	  verified->buf = NULL;
+	  return -1;
+	}
+    }
+
   grub_memcpy (buf, (char *) verified->buf + file->offset, len);
   return len;
 }
@@ -934,7 +1209,6 @@ grub_pubkey_open (grub_file_t io, const char *filename)
 {
   grub_file_t sig;
   char *fsuf, *ptr;
-  grub_err_t err;
   grub_file_filter_t curfilt[GRUB_FILE_FILTER_MAX];
   grub_file_t ret;
   grub_verified_t verified;
@@ -961,60 +1235,43 @@ grub_pubkey_open (grub_file_t io, const char *filename)
   if (!sig)
     return NULL;
 
-  ret = grub_malloc (sizeof (*ret));
-  if (!ret)
-    {
-      grub_file_close (sig);
-      return NULL;
-    }
-  *ret = *io;
-
-  ret->fs = &verified_fs;
-  ret->not_easily_seekable = 0;
-  if (ret->size >> (sizeof (grub_size_t) * GRUB_CHAR_BIT - 1))
-    {
-      grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
-		  "big file signature isn't implemented yet");
-      grub_file_close (sig);
-      grub_free (ret);
-      return NULL;
-    }
-  verified = grub_malloc (sizeof (*verified));
+  verified = grub_zalloc (sizeof (*verified));
   if (!verified)
     {
       grub_file_close (sig);
-      grub_free (ret);
       return NULL;
     }
-  verified->buf = grub_malloc (ret->size);
-  if (!verified->buf)
+  verified->sig = sig;
+
+  /* Reject malformed signatures right away.  Whether the data matches is
+     only known once the data has been read, see verified_read.  */
+  verified->vs = verify_sig_parse (sig);
+  if (!verified->vs)
     {
-      grub_file_close (sig);
-      grub_free (verified);
-      grub_free (ret);
+      verified_free (verified);
       return NULL;
     }
-  if (grub_file_read (io, verified->buf, ret->size) != (grub_ssize_t) ret->size)
+
+  ret = grub_malloc (sizeof (*ret));
+  if (!ret)
     {
-      if (!grub_errno)
-	grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
-		    filename);
-      grub_file_close (sig);
       verified_free (verified);
-      grub_free (ret);
       return NULL;
     }
+  *ret = *io;
 
-  err = grub_verify_signature_real (verified->buf, ret->size, 0, sig, NULL);
-  grub_file_close (sig);
-  if (err)
+  ret->fs = &verified_fs;
+  ret->not_easily_seekable = 0;
+  verified->file = io;
+  ret->data = verified;
+
+  /* Nothing will ever be read from an empty file, check it now.  */
+  if (ret->size == 0 && verified_check (verified, NULL, 0))
     {
       verified_free (verified);
       grub_free (ret);
       return NULL;
     }
-  verified->file = io;
-  ret->data = verified;
   return ret;
 }
 
@@ -1093,6 +1350,7 @@ GRUB_MOD_INIT(verify)
 
 GRUB_MOD_FINI(verify)
 {
+  verify_cache_flush ();
   grub_file_filter_unregister (GRUB_FILE_FILTER_PUBKEY);
   grub_unregister_extcmd (cmd);
   grub_unregister_extcmd (cmd_trust);
@@ -46,6 +46,9 @@ static const struct grub_arg_option options[] =
 
 /* Our irreducible polynom is x^128+x^7+x^2+x+1. Lowest byte of it is:  */
 #define GF_POLYNOM 0x87
+/* Number of bytes of XTS tweaks computed ahead of one cipher call.  */
+#define GRUB_CRYPTODISK_BATCH_SIZE (32 * 1024)
+
 static inline int GF_PER_SECTOR (const struct grub_cryptodisk *dev)
 {
   return 1U << (dev->log_sector_size - GRUB_CRYPTODISK_GF_LOG_BYTES);
@@ -221,6 +224,59 @@ lrw_xor (const struct lrw_sector *sec,
 		   dev->lrw_precalc, sec->low_byte * GRUB_CRYPTODISK_GF_BYTES);
 }
 
+/* Compute the IV of SECTOR into IV, which holds SZ 32-bit words.  */
+static gcry_err_code_t
+grub_cryptodisk_make_iv (struct grub_cryptodisk *dev, grub_disk_addr_t sector,
+			 grub_uint32_t *iv, grub_size_t sz)
+{
+  grub_memset (iv, 0, sz * sizeof (iv[0]));
+  switch (dev->mode_iv)
+    {
+    case GRUB_CRYPTODISK_MODE_IV_NULL:
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64_HASH:
+      {
+	grub_uint64_t tmp;
+	grub_uint8_t *ctx = (grub_uint8_t *) dev->iv_hash_ctx
+	  + dev->iv_hash->contextsize;
+
+	/* The first context already has the prefix hashed in.  */
+	grub_memcpy (ctx, dev->iv_hash_ctx, dev->iv_hash->contextsize);
+	tmp = grub_cpu_to_le64 (sector << dev->log_sector_size);
+	dev->iv_hash->write (ctx, &tmp, sizeof (tmp));
+	dev->iv_hash->final (ctx);
+
+	grub_memcpy (iv, dev->iv_hash->read (ctx),
+		     sz * sizeof (iv[0]) < dev->iv_hash->mdlen
+		     ? sz * sizeof (iv[0]) : dev->iv_hash->mdlen);
+      }
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_PLAIN64:
+      iv[1] = grub_cpu_to_le32 (sector >> 32);
+      /* FALLTHROUGH */
+    case GRUB_CRYPTODISK_MODE_IV_PLAIN:
+      iv[0] = grub_cpu_to_le32 (sector & 0xFFFFFFFF);
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64:
+      iv[1] = grub_cpu_to_le32 (sector >> (32 - dev->log_sector_size));
+      iv[0] = grub_cpu_to_le32 ((sector << dev->log_sector_size)
+				& 0xFFFFFFFF);
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_BENBI:
+      {
+	grub_uint64_t num = (sector << dev->benbi_log) + 1;
+	iv[sz - 2] = grub_cpu_to_be32 (num >> 32);
+	iv[sz - 1] = grub_cpu_to_be32 (num & 0xFFFFFFFF);
+      }
+      break;
+    case GRUB_CRYPTODISK_MODE_IV_ESSIV:
+      iv[0] = grub_cpu_to_le32 (sector & 0xFFFFFFFF);
+      return grub_crypto_ecb_encrypt (dev->essiv_cipher, iv, iv,
+				      dev->cipher->cipher->blocksize);
+    }
+  return GPG_ERR_NO_ERROR;
+}
+
 static gcry_err_code_t
 grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 			   grub_uint8_t * data, grub_size_t len,
@@ -228,8 +284,10 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 {
   grub_size_t i;
   gcry_err_code_t err;
+  grub_size_t blocksize = dev->cipher->cipher->blocksize;
+  grub_size_t sector_size = 1U << dev->log_sector_size;
 
-  if (dev->cipher->cipher->blocksize > GRUB_CRYPTO_MAX_CIPHER_BLOCKSIZE)
+  if (blocksize > GRUB_CRYPTO_MAX_CIPHER_BLOCKSIZE)
     return GPG_ERR_INV_ARG;
 
   /* The only mode without IV.  */
@@ -237,10 +295,31 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
     return (do_encrypt ? grub_crypto_ecb_encrypt (dev->cipher, data, data, len)
 	    : grub_crypto_ecb_decrypt (dev->cipher, data, data, len));
 
-  for (i = 0; i < len; i += (1U << dev->log_sector_size))
+  if (dev->mode_iv == GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64_HASH)
+    {
+      if (!dev->iv_hash_ctx)
+	{
+	  dev->iv_hash_ctx = grub_zalloc (2 * dev->iv_hash->contextsize);
+	  if (!dev->iv_hash_ctx)
+	    return GPG_ERR_OUT_OF_MEMORY;
+	}
+      /* Hash the prefix once per request instead of once per sector.  */
+      dev->iv_hash->init (dev->iv_hash_ctx);
+      dev->iv_hash->write (dev->iv_hash_ctx, dev->iv_prefix,
+			   dev->iv_prefix_len);
+    }
+
+  if (dev->mode == GRUB_CRYPTODISK_MODE_XTS && !dev->tweak)
     {
-      grub_size_t sz = ((dev->cipher->cipher->blocksize
-			 + sizeof (grub_uint32_t) - 1)
+      dev->tweak = grub_malloc (sector_size > GRUB_CRYPTODISK_BATCH_SIZE
+				? sector_size : GRUB_CRYPTODISK_BATCH_SIZE);
+      if (!dev->tweak)
+	return GPG_ERR_OUT_OF_MEMORY;
+    }
+
+  for (i = 0; i < len; i += sector_size)
+    {
+      grub_size_t sz = ((blocksize + sizeof (grub_uint32_t) - 1)
 			/ sizeof (grub_uint32_t));
       grub_uint32_t iv[(GRUB_CRYPTO_MAX_CIPHER_BLOCKSIZE + 3) / 4];
 
@@ -256,65 +335,19 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 	    }
 	}
 
-      grub_memset (iv, 0, sizeof (iv));
-      switch (dev->mode_iv)
-	{
-	case GRUB_CRYPTODISK_MODE_IV_NULL:
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64_HASH:
-	  {
-	    grub_uint64_t tmp;
-	    void *ctx;
-
-	    ctx = grub_zalloc (dev->iv_hash->contextsize);
-	    if (!ctx)
-	      return GPG_ERR_OUT_OF_MEMORY;
-
-	    tmp = grub_cpu_to_le64 (sector << dev->log_sector_size);
-	    dev->iv_hash->init (ctx);
-	    dev->iv_hash->write (ctx, dev->iv_prefix, dev->iv_prefix_len);
-	    dev->iv_hash->write (ctx, &tmp, sizeof (tmp));
-	    dev->iv_hash->final (ctx);
-
-	    grub_memcpy (iv, dev->iv_hash->read (ctx), sizeof (iv));
-	    grub_free (ctx);
-	  }
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_PLAIN64:
-	  iv[1] = grub_cpu_to_le32 (sector >> 32);
-	  /* FALLTHROUGH */
-	case GRUB_CRYPTODISK_MODE_IV_PLAIN:
-	  iv[0] = grub_cpu_to_le32 (sector & 0xFFFFFFFF);
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64:
-	  iv[1] = grub_cpu_to_le32 (sector >> (32 - dev->log_sector_size));
-	  iv[0] = grub_cpu_to_le32 ((sector << dev->log_sector_size)
-				    & 0xFFFFFFFF);
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_BENBI:
-	  {
-	    grub_uint64_t num = (sector << dev->benbi_log) + 1;
-	    iv[sz - 2] = grub_cpu_to_be32 (num >> 32);
-	    iv[sz - 1] = grub_cpu_to_be32 (num & 0xFFFFFFFF);
-	  }
-	  break;
-	case GRUB_CRYPTODISK_MODE_IV_ESSIV:
-	  iv[0] = grub_cpu_to_le32 (sector & 0xFFFFFFFF);
-	  err = grub_crypto_ecb_encrypt (dev->essiv_cipher, iv, iv,
-					 dev->cipher->cipher->blocksize);
-	  if (err)
-	    return err;
-	}
+      err = grub_cryptodisk_make_iv (dev, sector, iv, sz);
+      if (err)
+	return err;
 
       switch (dev->mode)
 	{
 	case GRUB_CRYPTODISK_MODE_CBC:
 	  if (do_encrypt)
 	    err = grub_crypto_cbc_encrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size), iv);
+					   sector_size, iv);
 	  else
 	    err = grub_crypto_cbc_decrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size), iv);
+					   sector_size, iv);
 	  if (err)
 	    return err;
 	  break;
@@ -322,40 +355,66 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 	case GRUB_CRYPTODISK_MODE_PCBC:
 	  if (do_encrypt)
 	    err = grub_crypto_pcbc_encrypt (dev->cipher, data + i, data + i,
-					    (1U << dev->log_sector_size), iv);
+					    sector_size, iv);
 	  else
 	    err = grub_crypto_pcbc_decrypt (dev->cipher, data + i, data + i,
-					    (1U << dev->log_sector_size), iv);
+					    sector_size, iv);
 	  if (err)
 	    return err;
 	  break;
 	case GRUB_CRYPTODISK_MODE_XTS:
 	  {
-	    unsigned j;
-	    err = grub_crypto_ecb_encrypt (dev->secondary_cipher, iv, iv,
-					   dev->cipher->cipher->blocksize);
-	    if (err)
-	      return err;
-	    
-	    for (j = 0; j < (1U << dev->log_sector_size);
-		 j += dev->cipher->cipher->blocksize)
+	    grub_size_t nsec = 1, k, j;
+
+	    /* Take as many sectors as fit into the tweak buffer, without
+	       crossing into another rekey zone, and run the cipher over
+	       all of them at once.  */
+	    while (((nsec + 1) << dev->log_sector_size)
+		   <= GRUB_CRYPTODISK_BATCH_SIZE
+		   && i + (nsec << dev->log_sector_size) < len
+		   && (!dev->rekey
+		       || ((sector + nsec) >> dev->rekey_shift)
+		       == (sector >> dev->rekey_shift)))
+	      nsec++;
+
+	    for (k = 0; k < nsec; k++)
 	      {
-		grub_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
-		if (do_encrypt)
-		  err = grub_crypto_ecb_encrypt (dev->cipher, data + i + j, 
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
-		else
-		  err = grub_crypto_ecb_decrypt (dev->cipher, data + i + j, 
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
+		grub_uint8_t *tweak = dev->tweak + (k << dev->log_sector_size);
+
+		if (k)
+		  {
+		    err = grub_cryptodisk_make_iv (dev, sector + k, iv, sz);
+		    if (err)
+		      return err;
+		  }
+		err = grub_crypto_ecb_encrypt (dev->secondary_cipher, iv, iv,
+					       blocksize);
 		if (err)
 		  return err;
-		grub_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
-		gf_mul_x ((grub_uint8_t *) iv);
+
+		for (j = 0; j < sector_size; j += blocksize)
+		  {
+		    grub_memcpy (tweak + j, iv, blocksize);
+		    gf_mul_x ((grub_uint8_t *) iv);
+		  }
 	      }
+
+	    grub_crypto_xor (data + i, data + i, dev->tweak,
+			     nsec << dev->log_sector_size);
+	    if (do_encrypt)
+	      err = grub_crypto_ecb_encrypt (dev->cipher, data + i, data + i,
+					     nsec << dev->log_sector_size);
+	    else
+	      err = grub_crypto_ecb_decrypt (dev->cipher, data + i, data + i,
+					     nsec << dev->log_sector_size);
+	    if (err)
+	      return err;
+	    grub_crypto_xor (data + i, data + i, dev->tweak,
+			     nsec << dev->log_sector_size);
+
+	    /* The loop advances past the last sector of the batch.  */
+	    i += (nsec - 1) << dev->log_sector_size;
+	    sector += nsec - 1;
 	  }
 	  break;
 	case GRUB_CRYPTODISK_MODE_LRW:
@@ -367,12 +426,10 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 
 	    if (do_encrypt)
 	      err = grub_crypto_ecb_encrypt (dev->cipher, data + i, 
-					     data + i,
-					     (1U << dev->log_sector_size));
+					     data + i, sector_size);
 	    else
 	      err = grub_crypto_ecb_decrypt (dev->cipher, data + i, 
-					     data + i,
-					     (1U << dev->log_sector_size));
+					     data + i, sector_size);
 	    if (err)
 	      return err;
 	    lrw_xor (&sec, dev, data + i);
@@ -381,10 +438,10 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 	case GRUB_CRYPTODISK_MODE_ECB:
 	  if (do_encrypt)
 	    err = grub_crypto_ecb_encrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size));
+					   sector_size);
 	  else
 	    err = grub_crypto_ecb_decrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size));
+					   sector_size);
 	  if (err)
 	    return err;
 	  break;
@@ -468,6 +525,160 @@ grub_cryptodisk_setkey (grub_cryptodisk_t dev, grub_uint8_t *key, grub_size_t ke
   return GPG_ERR_NO_ERROR;
 }
 
+/* Configure DEV for cipher CIPHERNAME in mode CIPHERMODE, given in the
+   dm-crypt "mode-iv" form (e.g. "xts-plain64" or "cbc-essiv:sha256").
+   Any ciphers DEV already had are released first.  */
+grub_err_t
+grub_cryptodisk_setcipher (grub_cryptodisk_t dev, const char *ciphername,
+			   const char *ciphermode)
+{
+  const char *cipheriv = NULL;
+  grub_crypto_cipher_handle_t cipher = NULL, secondary_cipher = NULL;
+  grub_crypto_cipher_handle_t essiv_cipher = NULL;
+  const gcry_md_spec_t *essiv_hash = NULL;
+  const struct gcry_cipher_spec *ciph;
+  grub_cryptodisk_mode_t mode;
+  grub_cryptodisk_mode_iv_t mode_iv = GRUB_CRYPTODISK_MODE_IV_PLAIN64;
+  int benbi_log = 0;
+
+  ciph = grub_crypto_lookup_cipher_by_name (ciphername);
+  if (!ciph)
+    return grub_error (GRUB_ERR_FILE_NOT_FOUND, "Cipher %s isn't available",
+		       ciphername);
+
+  /* Configure the cipher used for the bulk data.  */
+  cipher = grub_crypto_cipher_open (ciph);
+  if (!cipher)
+    return grub_errno;
+
+  /* Configure the cipher mode.  */
+  if (grub_strcmp (ciphermode, "ecb") == 0)
+    {
+      mode = GRUB_CRYPTODISK_MODE_ECB;
+      mode_iv = GRUB_CRYPTODISK_MODE_IV_PLAIN;
+      cipheriv = NULL;
+    }
+  else if (grub_strcmp (ciphermode, "plain") == 0)
+    {
+      mode = GRUB_CRYPTODISK_MODE_CBC;
+      mode_iv = GRUB_CRYPTODISK_MODE_IV_PLAIN;
+      cipheriv = NULL;
+    }
+  else if (grub_memcmp (ciphermode, "cbc-", sizeof ("cbc-") - 1) == 0)
+    {
+      mode = GRUB_CRYPTODISK_MODE_CBC;
+      cipheriv = ciphermode + sizeof ("cbc-") - 1;
+    }
+  else if (grub_memcmp (ciphermode, "pcbc-", sizeof ("pcbc-") - 1) == 0)
+    {
+      mode = GRUB_CRYPTODISK_MODE_PCBC;
+      cipheriv = ciphermode + sizeof ("pcbc-") - 1;
+    }
+  else if (grub_memcmp (ciphermode, "xts-", sizeof ("xts-") - 1) == 0)
+    {
+      mode = GRUB_CRYPTODISK_MODE_XTS;
+      cipheriv = ciphermode + sizeof ("xts-") - 1;
+      secondary_cipher = grub_crypto_cipher_open (ciph);
+      if (!secondary_cipher)
+	goto fail;
+      if (cipher->cipher->blocksize != GRUB_CRYPTODISK_GF_BYTES)
+	{
+	  grub_error (GRUB_ERR_BAD_ARGUMENT, "Unsupported XTS block size: %d",
+		      cipher->cipher->blocksize);
+	  goto fail;
+	}
+      if (secondary_cipher->cipher->blocksize != GRUB_CRYPTODISK_GF_BYTES)
+	{
+	  grub_error (GRUB_ERR_BAD_ARGUMENT, "Unsupported XTS block size: %d",
+		      secondary_cipher->cipher->blocksize);
+	  goto fail;
+	}
+    }
+  else if (grub_memcmp (ciphermode, "lrw-", sizeof ("lrw-") - 1) == 0)
+    {
+      mode = GRUB_CRYPTODISK_MODE_LRW;
+      cipheriv = ciphermode + sizeof ("lrw-") - 1;
+      if (cipher->cipher->blocksize != GRUB_CRYPTODISK_GF_BYTES)
+	{
+	  grub_error (GRUB_ERR_BAD_ARGUMENT, "Unsupported LRW block size: %d",
+		      cipher->cipher->blocksize);
+	  goto fail;
+	}
+    }
+  else
+    {
+      grub_error (GRUB_ERR_BAD_ARGUMENT, "Unknown cipher mode: %s",
+		  ciphermode);
+      goto fail;
+    }
+
+  /* "plain" is a prefix of "plain64", so test the longer one first.  */
+  if (cipheriv == NULL);
+  else if (grub_memcmp (cipheriv, "plain64", sizeof ("plain64") - 1) == 0)
+      mode_iv = GRUB_CRYPTODISK_MODE_IV_PLAIN64;
+  else if (grub_memcmp (cipheriv, "plain", sizeof ("plain") - 1) == 0)
+      mode_iv = GRUB_CRYPTODISK_MODE_IV_PLAIN;
+  else if (grub_memcmp (cipheriv, "benbi", sizeof ("benbi") - 1) == 0)
+    {
+      if (cipher->cipher->blocksize & (cipher->cipher->blocksize - 1)
+	  || cipher->cipher->blocksize == 0)
+	grub_error (GRUB_ERR_BAD_ARGUMENT, "Unsupported benbi blocksize: %d",
+		    cipher->cipher->blocksize);
+	/* FIXME should we return an error here? */
+      for (benbi_log = 0; 
+	   (cipher->cipher->blocksize << benbi_log) < GRUB_DISK_SECTOR_SIZE;
+	   benbi_log++);
+      mode_iv = GRUB_CRYPTODISK_MODE_IV_BENBI;
+    }
+  else if (grub_memcmp (cipheriv, "null", sizeof ("null") - 1) == 0)
+      mode_iv = GRUB_CRYPTODISK_MODE_IV_NULL;
+  else if (grub_memcmp (cipheriv, "essiv:", sizeof ("essiv:") - 1) == 0)
+    {
+      const char *hash_str = cipheriv + 6;
+
+      mode_iv = GRUB_CRYPTODISK_MODE_IV_ESSIV;
+
+      /* Configure the hash and cipher used for ESSIV.  */
+      essiv_hash = grub_crypto_lookup_md_by_name (hash_str);
+      if (!essiv_hash)
+	{
+	  grub_error (GRUB_ERR_FILE_NOT_FOUND,
+		      "Couldn't load %s hash", hash_str);
+	  goto fail;
+	}
+      essiv_cipher = grub_crypto_cipher_open (ciph);
+      if (!essiv_cipher)
+	goto fail;
+    }
+  else
+    {
+      grub_error (GRUB_ERR_BAD_ARGUMENT, "Unknown IV mode: %s",
+		  cipheriv);
+      goto fail;
+    }
+
+  grub_crypto_cipher_close (dev->cipher);
+  grub_crypto_cipher_close (dev->secondary_cipher);
+  grub_crypto_cipher_close (dev->essiv_cipher);
+  grub_free (dev->lrw_precalc);
+  dev->lrw_precalc = NULL;
+
+  dev->cipher = cipher;
+  dev->secondary_cipher = secondary_cipher;
+  dev->essiv_cipher = essiv_cipher;
+  dev->essiv_hash = essiv_hash;
+  dev->mode = mode;
+  dev->mode_iv = mode_iv;
+  dev->benbi_log = benbi_log;
+  return GRUB_ERR_NONE;
+
+ fail:
+  grub_crypto_cipher_close (cipher);
+  grub_crypto_cipher_close (secondary_cipher);
+  grub_crypto_cipher_close (essiv_cipher);
+  return grub_errno;
+}
+
 static int
 grub_cryptodisk_iterate (grub_disk_dev_iterate_hook_t hook, void *hook_data,
 			 grub_disk_pull_t pull)
@@ -816,6 +1027,11 @@ cryptodisk_close (grub_cryptodisk_t dev)
   grub_crypto_cipher_close (dev->cipher);
   grub_crypto_cipher_close (dev->secondary_cipher);
   grub_crypto_cipher_close (dev->essiv_cipher);
+  grub_free (dev->iv_hash_ctx);
+  grub_free (dev->tweak);
+  if (dev->rekey_ctx)
+    grub_memset (dev->rekey_ctx, 0, dev->rekey_ctx_size);
+  grub_free (dev->rekey_ctx);
   grub_free (dev);
 }
 
@@ -24,9 +24,13 @@
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
 #include <grub/partition.h>
-#ifdef GRUB_UTIL
+#include <grub/crypto.h>
+#include <grub/time.h>
 #include <grub/i18n.h>
+#ifdef GRUB_UTIL
 #include <grub/util/misc.h>
+#else
+#include <grub/command.h>
 #endif
 
 GRUB_MOD_LICENSE ("GPLv3+");
@@ -36,6 +40,7 @@ static struct grub_diskfilter_vg *array_list;
 grub_raid5_recover_func_t grub_raid5_recover_func;
 grub_raid6_recover_func_t grub_raid6_recover_func;
 grub_diskfilter_t grub_diskfilter_list;
+unsigned int grub_diskfilter_generation;
 static int inscnt = 0;
 static int lv_num = 0;
 
@@ -123,6 +128,32 @@ is_valid_diskfilter_name (const char *name)
 	  || grub_memcmp (name, "ldm/", sizeof ("ldm/") - 1) == 0);
 }
 
+/* Disks and partitions that no diskfilter recognized, so that rescans
+   don't probe them again.  Only valid for the diskfilter generation they
+   were found in.  */
+struct nonmember
+{
+  struct nonmember *next;
+  enum grub_disk_dev_id dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t part_start;
+  grub_uint64_t part_size;
+};
+static struct nonmember *nonmember_list;
+static unsigned int nonmember_generation;
+
+static void
+free_nonmembers (void)
+{
+  struct nonmember *nm;
+
+  while ((nm = nonmember_list))
+    {
+      nonmember_list = nm->next;
+      grub_free (nm);
+    }
+}
+
 /* Helper for scan_disk.  */
 static int
 scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
@@ -132,6 +163,8 @@ scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
   grub_disk_addr_t start_sector;
   struct grub_diskfilter_pv_id id;
   grub_diskfilter_t diskfilter;
+  struct nonmember *nm;
+  int cacheable = 1;
 
   grub_dprintf ("diskfilter", "Scanning for DISKFILTER devices on disk %s\n",
 		name);
@@ -152,6 +185,18 @@ scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
 	  return 0;
     }
 
+  if (nonmember_generation != grub_diskfilter_generation)
+    {
+      free_nonmembers ();
+      nonmember_generation = grub_diskfilter_generation;
+    }
+
+  for (nm = nonmember_list; nm; nm = nm->next)
+    if (nm->disk_id == disk->id && nm->dev_id == disk->dev->id
+	&& nm->part_start == grub_partition_get_start (disk->partition)
+	&& nm->part_size == grub_disk_get_size (disk))
+      return 0;
+
   for (diskfilter = grub_diskfilter_list; diskfilter; diskfilter = diskfilter->next)
     {
 #ifdef GRUB_UTIL
@@ -171,6 +216,11 @@ scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
       if (arr && id.uuidlen)
 	grub_free (id.uuid);
 
+      /* Errors that may go away on retry.  */
+      if (arr || grub_errno == GRUB_ERR_READ_ERROR
+	  || grub_errno == GRUB_ERR_OUT_OF_MEMORY)
+	cacheable = 0;
+
       /* This error usually means it's not diskfilter, no need to display
 	 it.  */
       if (grub_errno != GRUB_ERR_OUT_OF_RANGE)
@@ -179,6 +229,22 @@ scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
       grub_errno = GRUB_ERR_NONE;
     }
 
+  if (! cacheable)
+    return 0;
+
+  nm = grub_malloc (sizeof (*nm));
+  if (! nm)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+  nm->dev_id = disk->dev->id;
+  nm->disk_id = disk->id;
+  nm->part_start = grub_partition_get_start (disk->partition);
+  nm->part_size = grub_disk_get_size (disk);
+  nm->next = nonmember_list;
+  nonmember_list = nm;
+
   return 0;
 }
 
@@ -575,9 +641,130 @@ validate_segment (struct grub_diskfilter_segment *seg)
 
 }
 
+/* Mirror reads are spread over the members in units of this many
+   sectors.  */
+#define MIRROR_SPREAD_SECTORS	2048
+/* A member read taking this long, in ms, marks the member as slow.  */
+#define MIRROR_SLOW_MS		1000
+
+static const char *
+node_name (const struct grub_diskfilter_node *node)
+{
+  if (node->pv && node->pv->name)
+    return node->pv->name;
+  if (node->pv && node->pv->disk)
+    return node->pv->disk->name;
+  if (node->lv)
+    return node->lv->fullname;
+  return node->name ? : "?";
+}
+
+/* Order in which mirror copies are tried: healthy members first, then
+   the slow ones and those which failed last.  */
+static int
+mirror_node_rank (const struct grub_diskfilter_node *node)
+{
+  if (node->read_errors)
+    return 2;
+  return node->slow ? 1 : 0;
+}
+
 static grub_err_t
-read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
-	      grub_size_t size, char *buf)
+read_mirror_node (struct grub_diskfilter_node *node, grub_disk_addr_t sector,
+		  grub_size_t size, char *buf)
+{
+  grub_uint64_t start, elapsed;
+  grub_err_t err;
+
+  start = grub_get_time_ms ();
+  err = grub_diskfilter_read_node (node, sector, size, buf);
+  elapsed = grub_get_time_ms () - start;
+
+  node->reads++;
+  node->read_sectors += size;
+  node->read_ms += elapsed;
+  if (err == GRUB_ERR_READ_ERROR || err == GRUB_ERR_UNKNOWN_DEVICE)
+    {
+      if (! node->read_errors)
+	grub_dprintf ("diskfilter", "member %s failed, avoiding it\n",
+		      node_name (node));
+      node->read_errors++;
+    }
+  if (elapsed >= MIRROR_SLOW_MS && ! node->slow)
+    {
+      grub_dprintf ("diskfilter", "member %s took %" PRIuGRUB_UINT64_T
+		    " ms, avoiding it\n", node_name (node), elapsed);
+      node->slow = 1;
+    }
+  return err;
+}
+
+/* Read from a mirror, every member of which holds the whole range.
+   Consecutive units go to different members, and members which were
+   slow or failed before are only used if no other one can be read.  */
+static grub_err_t
+read_segment_mirror (struct grub_diskfilter_segment *seg,
+		     grub_disk_addr_t sector, grub_size_t size, char *buf)
+{
+  while (size)
+    {
+      grub_uint64_t ofs, first, tried = 0;
+      grub_size_t len;
+      unsigned int i;
+      int rank;
+      grub_err_t err = GRUB_ERR_NONE;
+
+      first = grub_divmod64 (sector, MIRROR_SPREAD_SECTORS, &ofs);
+      grub_divmod64 (first, seg->node_count, &first);
+      len = MIRROR_SPREAD_SECTORS - ofs;
+      if (len > size)
+	len = size;
+
+      for (rank = 0; rank < 3; rank++)
+	{
+	  for (i = 0; i < seg->node_count; i++)
+	    {
+	      unsigned int k;
+
+	      k = first + i;
+	      if (k >= seg->node_count)
+		k -= seg->node_count;
+
+	      /* Don't retry a member which just failed.  */
+	      if (mirror_node_rank (&seg->nodes[k]) != rank
+		  || (i < 64 && (tried & (1ULL << i))))
+		continue;
+	      if (i < 64)
+		tried |= 1ULL << i;
+
+	      if (grub_errno == GRUB_ERR_READ_ERROR
+		  || grub_errno == GRUB_ERR_UNKNOWN_DEVICE)
+		grub_errno = GRUB_ERR_NONE;
+
+	      err = read_mirror_node (&seg->nodes[k], sector, len, buf);
+	      if (! err)
+		break;
+	      if (err != GRUB_ERR_READ_ERROR && err != GRUB_ERR_UNKNOWN_DEVICE)
+		return err;
+	    }
+	  if (i < seg->node_count)
+	    break;
+	}
+
+      if (err)
+	return err;
+
+      buf += len << GRUB_DISK_SECTOR_BITS;
+      sector += len;
+      size -= len;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+read_segment_chunks (struct grub_diskfilter_segment *seg,
+		     grub_disk_addr_t sector, grub_size_t size, char *buf)
 {
   grub_err_t err;
   switch (seg->type)
@@ -626,48 +813,74 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 	while (1)
 	  {
 	    grub_size_t read_size;
+	    grub_disk_addr_t first_sector = read_sector;
+	    grub_uint64_t first_disk = disknr, tried = 0;
+	    int rank;
 
 	    read_size = seg->stripe_size - b;
 	    if (read_size > size)
 	      read_size = size;
 
+	    /* With several copies, try the healthy members first.  */
 	    err = 0;
-	    for (i = 0; i < near; i++)
+	    for (rank = 0; rank < 3; rank++)
 	      {
-		unsigned int k;
-
-		k = disknr;
-		err = 0;
-		for (j = 0; j < far; j++)
+		disknr = first_disk;
+		read_sector = first_sector;
+		for (i = 0; i < near; i++)
 		  {
-		    if (grub_errno == GRUB_ERR_READ_ERROR
-			|| grub_errno == GRUB_ERR_UNKNOWN_DEVICE)
-		      grub_errno = GRUB_ERR_NONE;
-
-		    err = grub_diskfilter_read_node (&seg->nodes[k],
-						     read_sector
-						     + j * far_ofs + b,
-						     read_size,
-						     buf);
+		    unsigned int k;
+
+		    k = disknr;
+		    if (near * far > 1
+			&& (mirror_node_rank (&seg->nodes[k]) != rank
+			    || (i < 64 && (tried & (1ULL << i)))))
+		      goto next_copy;
+		    if (i < 64)
+		      tried |= 1ULL << i;
+
+		    err = 0;
+		    for (j = 0; j < far; j++)
+		      {
+			if (grub_errno == GRUB_ERR_READ_ERROR
+			    || grub_errno == GRUB_ERR_UNKNOWN_DEVICE)
+			  grub_errno = GRUB_ERR_NONE;
+
+			if (near * far > 1)
+			  err = read_mirror_node (&seg->nodes[k],
+						  read_sector
+						  + j * far_ofs + b,
+						  read_size, buf);
+			else
+			  err = grub_diskfilter_read_node (&seg->nodes[k],
+							   read_sector
+							   + j * far_ofs + b,
+							   read_size,
+							   buf);
+			if (! err)
+			  break;
+			else if (err != GRUB_ERR_READ_ERROR
+				 && err != GRUB_ERR_UNKNOWN_DEVICE)
+			  return err;
+			k++;
+			if (k == seg->node_count)
+			  k = 0;
+		      }
+
 		    if (! err)
 		      break;
-		    else if (err != GRUB_ERR_READ_ERROR
-			     && err != GRUB_ERR_UNKNOWN_DEVICE)
-		      return err;
-		    k++;
-		    if (k == seg->node_count)
-		      k = 0;
+
+		  next_copy:
+		    disknr++;
+		    if (disknr == seg->node_count)
+		      {
+			disknr = 0;
+			read_sector += ofs;
+		      }
 		  }
 
-		if (! err)
+		if (i < near || near * far == 1)
 		  break;
-
-		disknr++;
-		if (disknr == seg->node_count)
-		  {
-		    disknr = 0;
-		    read_sector += ofs;
-		  }
 	      }
 
 	    if (err)
@@ -851,6 +1064,341 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
     }
 }
 
+/* Largest read issued to a single member when planning by stripes, in
+   sectors.  */
+#define STRIPE_READ_MAX	(1 << 11)
+
+/* Whether read_segment_stripes knows the layout of SEG: striping, parity
+   RAID and RAID10 with near copies only.  */
+static int
+stripe_plan_supported (const struct grub_diskfilter_segment *seg)
+{
+  switch (seg->type)
+    {
+    case GRUB_DISKFILTER_STRIPED:
+      return seg->node_count > 1;
+    case GRUB_DISKFILTER_RAID4:
+    case GRUB_DISKFILTER_RAID5:
+    case GRUB_DISKFILTER_RAID6:
+      return 1;
+    case GRUB_DISKFILTER_RAID10:
+      {
+	unsigned int i;
+
+	if ((seg->layout >> 8) != 1 || (seg->layout & 0xFF) == 0)
+	  return 0;
+	/* Leave picking a copy to read_segment_chunks once a member
+	   misbehaved.  */
+	for (i = 0; i < seg->node_count; i++)
+	  if (mirror_node_rank (&seg->nodes[i]))
+	    return 0;
+	return 1;
+      }
+    default:
+      return 0;
+    }
+}
+
+/* Find which data chunk member DISK holds in stripe ROW.  Return 0 if it
+   holds parity or a redundant copy there instead.  For the parity levels
+   *P is set to the member holding P in that stripe.  */
+static int
+stripe_chunk (const struct grub_diskfilter_segment *seg, grub_uint64_t row,
+	      unsigned int disk, grub_uint64_t *chunk, unsigned int *p)
+{
+  grub_uint64_t rem;
+  unsigned int n, k, idx;
+
+  if (seg->type == GRUB_DISKFILTER_STRIPED)
+    {
+      *chunk = row * seg->node_count + disk;
+      return 1;
+    }
+
+  if (seg->type == GRUB_DISKFILTER_RAID10)
+    {
+      /* Only the first of the near copies is used here.  */
+      *chunk = grub_divmod64 (row * seg->node_count + disk,
+			      seg->layout & 0xFF, &rem);
+      return rem == 0;
+    }
+
+  /* n = 1 for level 4 and 5, 2 for level 6.  */
+  n = seg->type / 3;
+
+  if (seg->type >= 5)
+    {
+      grub_divmod64 (row, seg->node_count, &rem);
+      *p = rem;
+      if (! (seg->layout & GRUB_RAID_LAYOUT_RIGHT_MASK))
+	*p = seg->node_count - 1 - *p;
+    }
+  else
+    *p = seg->node_count - n;
+
+  /* P and Q are on consecutive members.  */
+  k = disk + seg->node_count - *p;
+  if (k >= seg->node_count)
+    k -= seg->node_count;
+  if (k < n)
+    return 0;
+
+  if (seg->type >= 5 && (seg->layout & GRUB_RAID_LAYOUT_SYMMETRIC_MASK))
+    idx = k - n;
+  else
+    {
+      /* Data chunks are in member order, skipping the parity.  */
+      idx = disk;
+      for (k = 0; k < n; k++)
+	if ((*p + k) % seg->node_count < disk)
+	  idx--;
+    }
+
+  *chunk = row * (seg->node_count - n) + idx;
+  return 1;
+}
+
+/* Read LEN sectors starting at START from member DISK and scatter the
+   chunks they hold into BUF, which starts at segment sector SECTOR.  */
+static grub_err_t
+read_member_run (struct grub_diskfilter_segment *seg, unsigned int disk,
+		 grub_disk_addr_t start, grub_size_t len,
+		 grub_disk_addr_t sector, char *buf, char *tmp)
+{
+  grub_uint64_t row, ofs, chunk;
+  unsigned int p;
+  grub_err_t err;
+
+  row = grub_divmod64 (start, seg->stripe_size, &ofs);
+
+  /* Within a single chunk the data can go straight to its place.  */
+  if (ofs + len <= seg->stripe_size)
+    {
+      stripe_chunk (seg, row, disk, &chunk, &p);
+      return grub_diskfilter_read_node (&seg->nodes[disk], start, len,
+					buf + ((chunk * seg->stripe_size + ofs
+						- sector)
+					       << GRUB_DISK_SECTOR_BITS));
+    }
+
+  err = grub_diskfilter_read_node (&seg->nodes[disk], start, len, tmp);
+  if (err)
+    return err;
+
+  while (len)
+    {
+      grub_size_t piece;
+
+      piece = seg->stripe_size - ofs;
+      if (piece > len)
+	piece = len;
+
+      stripe_chunk (seg, row, disk, &chunk, &p);
+      grub_memcpy (buf + ((chunk * seg->stripe_size + ofs - sector)
+			  << GRUB_DISK_SECTOR_BITS),
+		   tmp, piece << GRUB_DISK_SECTOR_BITS);
+
+      tmp += piece << GRUB_DISK_SECTOR_BITS;
+      len -= piece;
+      row++;
+      ofs = 0;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+/* Read a range spanning several chunks with one read per member and
+   contiguous run of its chunks, instead of one read per chunk.  Members
+   that fail are reconstructed afterwards: from the parity and the data
+   already read for stripes covered completely, and through
+   read_segment_chunks otherwise.  */
+static grub_err_t
+read_segment_stripes (struct grub_diskfilter_segment *seg,
+		      grub_disk_addr_t sector, grub_size_t size, char *buf,
+		      char *tmp, grub_size_t tmp_size, grub_uint8_t *failed)
+{
+  grub_disk_addr_t end = sector + size;
+  grub_uint64_t row0, row1, row, chunk, per_row, data_per_row;
+  unsigned int disk, p, n = 0, nfailed = 0;
+  grub_err_t err;
+
+  /* Express the first and last chunk as member stripes.  */
+  row0 = grub_divmod64 (sector, seg->stripe_size, 0);
+  row1 = grub_divmod64 (end - 1, seg->stripe_size, 0);
+  per_row = seg->node_count;
+  if (seg->type == GRUB_DISKFILTER_RAID10)
+    {
+      row0 *= seg->layout & 0xFF;
+      row1 *= seg->layout & 0xFF;
+    }
+  else if (seg->type != GRUB_DISKFILTER_STRIPED)
+    {
+      n = seg->type / 3;
+      per_row -= n;
+    }
+  row0 = grub_divmod64 (row0, per_row, 0);
+  row1 = grub_divmod64 (row1, per_row, 0);
+  data_per_row = (seg->node_count - n) * seg->stripe_size;
+
+  for (disk = 0; disk < seg->node_count; disk++)
+    {
+      grub_disk_addr_t run_start = 0;
+      grub_size_t run_len = 0;
+
+      for (row = row0; row <= row1 + 1; row++)
+	{
+	  grub_disk_addr_t s = 0, e = 0, ms = 0;
+	  int have = 0;
+
+	  if (row <= row1 && stripe_chunk (seg, row, disk, &chunk, &p))
+	    {
+	      s = chunk * seg->stripe_size;
+	      e = s + seg->stripe_size;
+	      ms = row * seg->stripe_size;
+	      if (s < sector)
+		{
+		  ms += sector - s;
+		  s = sector;
+		}
+	      if (e > end)
+		e = end;
+	      have = (s < e);
+	    }
+
+	  if (run_len && (! have || run_start + run_len != ms
+			  || run_len + (e - s) > tmp_size))
+	    {
+	      err = read_member_run (seg, disk, run_start, run_len,
+				     sector, buf, tmp);
+	      run_len = 0;
+	      if (err && (seg->type == GRUB_DISKFILTER_STRIPED
+			  || (err != GRUB_ERR_READ_ERROR
+			      && err != GRUB_ERR_UNKNOWN_DEVICE)))
+		return err;
+	      if (err)
+		{
+		  grub_errno = GRUB_ERR_NONE;
+		  failed[disk] = 1;
+		  nfailed++;
+		  break;
+		}
+	    }
+
+	  if (have)
+	    {
+	      if (! run_len)
+		run_start = ms;
+	      run_len += e - s;
+	    }
+	}
+    }
+
+  if (! nfailed)
+    return GRUB_ERR_NONE;
+
+  for (disk = 0; disk < seg->node_count; disk++)
+    {
+      if (! failed[disk])
+	continue;
+
+      for (row = row0; row <= row1; row++)
+	{
+	  grub_disk_addr_t s, e, ofs;
+	  char *dest;
+
+	  if (! stripe_chunk (seg, row, disk, &chunk, &p))
+	    continue;
+
+	  s = chunk * seg->stripe_size;
+	  e = s + seg->stripe_size;
+	  if (s < sector)
+	    s = sector;
+	  if (e > end)
+	    e = end;
+	  if (s >= e)
+	    continue;
+
+	  ofs = s - chunk * seg->stripe_size;
+	  dest = buf + ((s - sector) << GRUB_DISK_SECTOR_BITS);
+
+	  /* With a single member missing and the whole stripe in BUF, P
+	     and the data already read are all that is needed.  */
+	  if (n && nfailed == 1 && row * data_per_row >= sector
+	      && (row + 1) * data_per_row <= end)
+	    {
+	      err = grub_diskfilter_read_node (&seg->nodes[p],
+					       row * seg->stripe_size + ofs,
+					       e - s, dest);
+	      if (! err)
+		{
+		  unsigned int other, q;
+		  grub_uint64_t other_chunk;
+
+		  for (other = 0; other < seg->node_count; other++)
+		    if (other != disk
+			&& stripe_chunk (seg, row, other, &other_chunk, &q))
+		      grub_crypto_xor (dest, dest,
+				       buf + ((other_chunk * seg->stripe_size
+					       + ofs - sector)
+					      << GRUB_DISK_SECTOR_BITS),
+				       (e - s) << GRUB_DISK_SECTOR_BITS);
+		  continue;
+		}
+	      if (err != GRUB_ERR_READ_ERROR && err != GRUB_ERR_UNKNOWN_DEVICE)
+		return err;
+	      grub_errno = GRUB_ERR_NONE;
+	    }
+
+	  err = read_segment_chunks (seg, s, e - s, dest);
+	  if (err)
+	    return err;
+	}
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
+	      grub_size_t size, char *buf)
+{
+  grub_uint64_t b;
+  grub_size_t tmp_size;
+  grub_uint8_t *failed;
+  char *tmp;
+  grub_err_t err;
+
+  if (seg->type == GRUB_DISKFILTER_MIRROR)
+    return read_segment_mirror (seg, sector, size, buf);
+
+  /* A range within one chunk is a single read already.  */
+  grub_divmod64 (sector, seg->stripe_size, &b);
+  if (! stripe_plan_supported (seg) || b + size <= seg->stripe_size)
+    return read_segment_chunks (seg, sector, size, buf);
+
+  tmp_size = STRIPE_READ_MAX;
+  if (tmp_size < seg->stripe_size)
+    tmp_size = seg->stripe_size;
+  if (tmp_size > size)
+    tmp_size = size;
+
+  tmp = grub_malloc (tmp_size << GRUB_DISK_SECTOR_BITS);
+  failed = grub_zalloc (seg->node_count);
+  if (! tmp || ! failed)
+    {
+      grub_free (tmp);
+      grub_free (failed);
+      grub_errno = GRUB_ERR_NONE;
+      return read_segment_chunks (seg, sector, size, buf);
+    }
+
+  err = read_segment_stripes (seg, sector, size, buf, tmp, tmp_size, failed);
+
+  grub_free (tmp);
+  grub_free (failed);
+  return err;
+}
+
 static grub_err_t
 read_lv (struct grub_diskfilter_lv *lv, grub_disk_addr_t sector,
 	 grub_size_t size, char *buf)
@@ -1293,6 +1841,8 @@ free_array (void)
     }
 
   array_list = 0;
+
+  free_nonmembers ();
 }
 
 #ifdef GRUB_UTIL
@@ -1321,6 +1871,55 @@ grub_diskfilter_get_pv_from_disk (grub_disk_t disk,
 }
 #endif
 
+#ifndef GRUB_UTIL
+static grub_err_t
+grub_cmd_mirrorstat (grub_command_t cmd __attribute__ ((unused)),
+		     int argc __attribute__ ((unused)),
+		     char **args __attribute__ ((unused)))
+{
+  struct grub_diskfilter_vg *vg;
+  struct grub_diskfilter_lv *lv;
+  unsigned int i, j;
+
+  for (vg = array_list; vg; vg = vg->next)
+    for (lv = vg->lvs; lv; lv = lv->next)
+      for (i = 0; i < lv->segment_count; i++)
+	{
+	  struct grub_diskfilter_segment *seg = &lv->segments[i];
+
+	  if (seg->type != GRUB_DISKFILTER_MIRROR
+	      && seg->type != GRUB_DISKFILTER_RAID10)
+	    continue;
+
+	  if (lv->segment_count > 1)
+	    grub_printf ("%s (%u):\n", lv->fullname, i);
+	  else
+	    grub_printf ("%s:\n", lv->fullname);
+
+	  for (j = 0; j < seg->node_count; j++)
+	    {
+	      struct grub_diskfilter_node *node = &seg->nodes[j];
+
+	      grub_printf_ (N_("  %s: %llu reads, %llu KiB, %llu ms average,"
+			       " %u errors%s\n"), node_name (node),
+			    (unsigned long long) node->reads,
+			    (unsigned long long) node->read_sectors >> 1,
+			    (unsigned long long) (node->reads
+						  ? grub_divmod64 (node->read_ms,
+								   node->reads,
+								   0)
+						  : 0),
+			    node->read_errors,
+			    node->slow ? _(", slow") : "");
+	    }
+	}
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_command_t cmd_mirrorstat;
+#endif
+
 static struct grub_disk_dev grub_diskfilter_dev =
   {
     .name = "diskfilter",
@@ -1341,10 +1940,18 @@ static struct grub_disk_dev grub_diskfilter_dev =
 GRUB_MOD_INIT(diskfilter)
 {
   grub_disk_dev_register (&grub_diskfilter_dev);
+#ifndef GRUB_UTIL
+  cmd_mirrorstat =
+    grub_register_command ("mirrorstat", grub_cmd_mirrorstat, 0,
+			   N_("Show read statistics of mirror members."));
+#endif
 }
 
 GRUB_MOD_FINI(diskfilter)
 {
+#ifndef GRUB_UTIL
+  grub_unregister_command (cmd_mirrorstat);
+#endif
   grub_disk_dev_unregister (&grub_diskfilter_dev);
   free_array ();
 }
@@ -137,29 +137,118 @@ const char *algorithms[] = {
 
 #define MAX_PASSPHRASE 256
 
+/* Number of derived zone keys remembered per device.  Reads tend to
+   alternate between a handful of zones (filesystem metadata and the
+   file being read), so a few entries avoid nearly all derivations.  */
+#define GELI_KEY_CACHE_SIZE 8
+
+struct geli_rekey_ctx
+{
+  grub_uint64_t zones[GELI_KEY_CACHE_SIZE];
+  grub_uint8_t keys[GELI_KEY_CACHE_SIZE][GRUB_CRYPTO_MAX_MDLEN];
+  unsigned int used;
+  unsigned int next;
+  /* Hash states after absorbing the inner and outer HMAC pads of the
+     rekey key, followed by a working context.  */
+  grub_uint8_t *inner;
+  grub_uint8_t *outer;
+  grub_uint8_t *work;
+};
+
+static struct geli_rekey_ctx *
+geli_rekey_ctx (struct grub_cryptodisk *dev)
+{
+  const gcry_md_spec_t *md = dev->hash;
+  struct geli_rekey_ctx *ctx = dev->rekey_ctx;
+  grub_uint8_t pad[128];
+  grub_size_t hdrsize, ctxsize, size;
+  unsigned int i;
+
+  if (ctx)
+    return ctx;
+
+  if (md->blocksize > sizeof (pad)
+      || sizeof (dev->rekey_key) > md->blocksize)
+    return NULL;
+
+  hdrsize = ALIGN_UP (sizeof (*ctx), 16);
+  ctxsize = ALIGN_UP (md->contextsize, 16);
+  size = hdrsize + 3 * ctxsize;
+  ctx = grub_zalloc (size);
+  if (!ctx)
+    return NULL;
+  ctx->inner = (grub_uint8_t *) ctx + hdrsize;
+  ctx->outer = ctx->inner + ctxsize;
+  ctx->work = ctx->outer + ctxsize;
+
+  grub_memset (pad, 0, md->blocksize);
+  grub_memcpy (pad, dev->rekey_key, sizeof (dev->rekey_key));
+  for (i = 0; i < md->blocksize; i++)
+    pad[i] ^= 0x36;
+  md->init (ctx->inner);
+  md->write (ctx->inner, pad, md->blocksize);
+  for (i = 0; i < md->blocksize; i++)
+    pad[i] ^= 0x36 ^ 0x5c;
+  md->init (ctx->outer);
+  md->write (ctx->outer, pad, md->blocksize);
+  grub_memset (pad, 0, sizeof (pad));
+
+  dev->rekey_ctx = ctx;
+  dev->rekey_ctx_size = size;
+  return ctx;
+}
+
 static gcry_err_code_t
 geli_rekey (struct grub_cryptodisk *dev, grub_uint64_t zoneno)
 {
-  gcry_err_code_t gcry_err;
+  const gcry_md_spec_t *md = dev->hash;
+  struct geli_rekey_ctx *ctx;
   const struct {
     char magic[4];
     grub_uint64_t zone;
   } GRUB_PACKED tohash
       = { {'e', 'k', 'e', 'y'}, grub_cpu_to_le64 (zoneno) };
-  GRUB_PROPERLY_ALIGNED_ARRAY (key, GRUB_CRYPTO_MAX_MDLEN);
+  grub_uint8_t *key;
+  unsigned int i;
 
-  if (dev->hash->mdlen > GRUB_CRYPTO_MAX_MDLEN)
+  if (md->mdlen > GRUB_CRYPTO_MAX_MDLEN)
     return GPG_ERR_INV_ARG;
 
+  ctx = geli_rekey_ctx (dev);
+  if (!ctx)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return GPG_ERR_OUT_OF_MEMORY;
+    }
+
+  for (i = 0; i < ctx->used; i++)
+    if (ctx->zones[i] == zoneno)
+      return grub_cryptodisk_setkey (dev, ctx->keys[i],
+				     dev->rekey_derived_size);
+
   grub_dprintf ("geli", "rekeying %" PRIuGRUB_UINT64_T " keysize=%d\n",
 		zoneno, dev->rekey_derived_size);
-  gcry_err = grub_crypto_hmac_buffer (dev->hash, dev->rekey_key, 64,
-				      &tohash, sizeof (tohash), key);
-  if (gcry_err)
-    return gcry_err;
 
-  return grub_cryptodisk_setkey (dev, (grub_uint8_t *) key,
-				 dev->rekey_derived_size); 
+  i = ctx->next;
+  ctx->next = (ctx->next + 1) % GELI_KEY_CACHE_SIZE;
+  if (ctx->used < GELI_KEY_CACHE_SIZE)
+    ctx->used++;
+  key = ctx->keys[i];
+  ctx->zones[i] = zoneno;
+
+  /* HMAC (rekey_key, "ekey" || zone), starting from the saved pad
+     states.  */
+  grub_memcpy (ctx->work, ctx->inner, md->contextsize);
+  md->write (ctx->work, &tohash, sizeof (tohash));
+  md->final (ctx->work);
+  grub_memcpy (key, md->read (ctx->work), md->mdlen);
+  grub_memcpy (ctx->work, ctx->outer, md->contextsize);
+  md->write (ctx->work, key, md->mdlen);
+  md->final (ctx->work);
+  grub_memcpy (key, md->read (ctx->work), md->mdlen);
+  grub_memset (ctx->work, 0, md->contextsize);
+
+  return grub_cryptodisk_setkey (dev, key, dev->rekey_derived_size);
 }
 
 static inline gcry_err_code_t
@@ -563,6 +652,12 @@ recover_key (grub_disk_t source, grub_cryptodisk_t dev)
 		       sizeof (geli_cipher_key));
 	  dev->rekey_derived_size = real_keysize;
 	  dev->last_rekey = -1;
+	  if (dev->rekey_ctx)
+	    {
+	      grub_memset (dev->rekey_ctx, 0, dev->rekey_ctx_size);
+	      grub_free (dev->rekey_ctx);
+	      dev->rekey_ctx = NULL;
+	    }
 	  COMPILE_TIME_ASSERT (sizeof (dev->rekey_key)
 		       >= sizeof (geli_cipher_key));
 	}
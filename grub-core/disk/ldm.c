@@ -607,8 +607,8 @@ make_vg (grub_disk_t disk,
 		goto fail2;
 	      lv->segments->nodes = t;
 	    }
-	  lv->segments->nodes[lv->segments->node_count].pv = 0;
-	  lv->segments->nodes[lv->segments->node_count].start = 0;
+	  grub_memset (&lv->segments->nodes[lv->segments->node_count], 0,
+		       sizeof (lv->segments->nodes[0]));
 	  lv->segments->nodes[lv->segments->node_count++].lv = comp;
 	  comp->next = vg->lvs;
 	  vg->lvs = comp;
@@ -632,7 +632,7 @@ make_vg (grub_disk_t disk,
 	  grub_disk_addr_t start, size;
 
 	  grub_uint8_t *ptr;
-	  part.name = 0;
+	  grub_memset (&part, 0, sizeof (part));
 	  if (grub_memcmp (vblk[i].magic, LDM_VBLK_MAGIC,
 			   sizeof (vblk[i].magic)) != 0)
 	    continue;
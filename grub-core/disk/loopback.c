@@ -176,6 +176,12 @@ grub_loopback_open (const char *name, grub_disk_t disk)
 
   disk->id = dev->id;
 
+  /* Reads of a plain file on a disk are already cached by the disk
+     layer, don't cache them a second time under the loop device.
+     Decompressed or network-backed files still benefit from it.  */
+  disk->nocache = (dev->file->device && dev->file->device->disk
+		   && !dev->file->not_easily_seekable);
+
   disk->data = dev;
 
   return 0;
@@ -0,0 +1,988 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/cryptodisk.h>
+#include <grub/types.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/dl.h>
+#include <grub/err.h>
+#include <grub/disk.h>
+#include <grub/crypto.h>
+#include <grub/partition.h>
+#include <grub/i18n.h>
+#include <grub/json.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define MAX_PASSPHRASE 256
+
+#define LUKS_MAGIC_1ST "LUKS\xBA\xBE"
+#define LUKS_MAGIC_2ND "SKUL\xBA\xBE"
+
+/* Limits on the binary header's hdr_size, which covers the JSON area.  */
+#define LUKS2_HDR_SIZE_MIN 0x4000
+#define LUKS2_HDR_SIZE_MAX 0x400000
+
+/* Upper bound on decoded salts and digests.  */
+#define LUKS2_MAX_BINARY 128
+
+/* Keyslots, segments and digests are referenced through 64-bit masks.  */
+#define LUKS2_MAX_OBJECTS 64
+
+/* On disk LUKS2 binary header.  The JSON metadata follows it.  */
+struct grub_luks2_header
+{
+  char magic[6];
+  grub_uint16_t version;
+  grub_uint64_t hdr_size;
+  grub_uint64_t seqid;
+  char label[48];
+  char csum_alg[32];
+  grub_uint8_t salt[64];
+  char uuid[40];
+  char subsystem[48];
+  grub_uint64_t hdr_offset;
+  char _padding[184];
+  grub_uint8_t csum[64];
+  char _padding4096[7 * 512];
+} GRUB_PACKED;
+typedef struct grub_luks2_header grub_luks2_header_t;
+
+enum grub_luks2_kdf_type
+{
+  LUKS2_KDF_TYPE_ARGON2I,
+  LUKS2_KDF_TYPE_ARGON2ID,
+  LUKS2_KDF_TYPE_PBKDF2
+};
+
+struct grub_luks2_keyslot
+{
+  grub_uint64_t key_size;
+  grub_int64_t priority;
+  struct
+  {
+    const char *encryption;
+    grub_uint64_t offset;
+    grub_uint64_t size;
+    grub_uint64_t key_size;
+  } area;
+  struct
+  {
+    const char *hash;
+    grub_uint64_t stripes;
+  } af;
+  struct
+  {
+    enum grub_luks2_kdf_type type;
+    const char *salt;
+    union
+    {
+      struct
+      {
+	grub_uint64_t time;
+	grub_uint64_t memory;
+	grub_uint64_t cpus;
+      } argon2;
+      struct
+      {
+	const char *hash;
+	grub_uint64_t iterations;
+      } pbkdf2;
+    } u;
+  } kdf;
+};
+typedef struct grub_luks2_keyslot grub_luks2_keyslot_t;
+
+struct grub_luks2_segment
+{
+  grub_uint64_t offset;
+  const char *size;
+  const char *encryption;
+  grub_uint64_t sector_size;
+};
+typedef struct grub_luks2_segment grub_luks2_segment_t;
+
+struct grub_luks2_digest
+{
+  /* Bitmasks of the keyslots and segments this digest covers.  */
+  grub_uint64_t keyslots;
+  grub_uint64_t segments;
+  const char *salt;
+  const char *digest;
+  const char *hash;
+  grub_uint64_t iterations;
+};
+typedef struct grub_luks2_digest grub_luks2_digest_t;
+
+gcry_err_code_t AF_merge (const gcry_md_spec_t * hash, grub_uint8_t * src,
+			  grub_uint8_t * dst, grub_size_t blocksize,
+			  grub_size_t blocknumbers);
+
+static int
+base64_value (char c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
+}
+
+/* Decode the padded base64 string IN into OUT, which has room for
+   OUTMAX bytes.  */
+static grub_err_t
+luks2_base64_decode (const char *in, grub_uint8_t *out, grub_size_t outmax,
+		     grub_size_t *outlen)
+{
+  grub_size_t len = grub_strlen (in), i, n = 0;
+
+  if (len % 4)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "invalid base64 length");
+
+  for (i = 0; i < len; i += 4)
+    {
+      int v[4], k, pad = 0;
+      grub_uint32_t w;
+
+      for (k = 0; k < 4; k++)
+	{
+	  if (in[i + k] == '=' && i + 4 == len && k >= 2
+	      && (k == 3 || in[i + 3] == '='))
+	    {
+	      v[k] = 0;
+	      pad++;
+	      continue;
+	    }
+	  v[k] = base64_value (in[i + k]);
+	  if (v[k] < 0)
+	    return grub_error (GRUB_ERR_BAD_ARGUMENT,
+			       "invalid base64 character");
+	}
+
+      if (n + 3 - pad > outmax)
+	return grub_error (GRUB_ERR_OUT_OF_RANGE, "base64 value too long");
+      w = (v[0] << 18) | (v[1] << 12) | (v[2] << 6) | v[3];
+      out[n++] = w >> 16;
+      if (pad < 2)
+	out[n++] = w >> 8;
+      if (pad < 1)
+	out[n++] = w;
+    }
+
+  *outlen = n;
+  return GRUB_ERR_NONE;
+}
+
+/* Split a dm-crypt cipher specification such as "aes-xts-plain64" into
+   the cipher name and the mode.  */
+static grub_err_t
+luks2_split_encryption (const char *encryption, char *cipher,
+			char *mode, grub_size_t size)
+{
+  const char *dash = grub_strchr (encryption, '-');
+
+  if (!dash || (grub_size_t) (dash - encryption) >= size
+      || grub_strlen (dash + 1) >= size)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "invalid encryption `%s'",
+		       encryption);
+
+  grub_memcpy (cipher, encryption, dash - encryption);
+  cipher[dash - encryption] = '\0';
+  grub_strcpy (mode, dash + 1);
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+luks2_setcipher (grub_cryptodisk_t crypt, const char *encryption)
+{
+  char cipher[32], mode[32];
+
+  if (luks2_split_encryption (encryption, cipher, mode, sizeof (cipher)))
+    return grub_errno;
+  return grub_cryptodisk_setcipher (crypt, cipher, mode);
+}
+
+/* Turn the array of object indices VALUE, given as strings, into a
+   bitmask.  */
+static grub_err_t
+luks2_parse_indices (grub_uint64_t *out, const grub_json_t *value)
+{
+  grub_size_t i, size;
+
+  *out = 0;
+  if (grub_json_getsize (&size, value))
+    return grub_errno;
+  for (i = 0; i < size; i++)
+    {
+      grub_json_t child;
+      grub_uint64_t idx;
+
+      if (grub_json_getchild (&child, value, i)
+	  || grub_json_getuint64 (&idx, &child, NULL))
+	return grub_errno;
+      if (idx >= LUKS2_MAX_OBJECTS)
+	return grub_error (GRUB_ERR_OUT_OF_RANGE, "index %" PRIuGRUB_UINT64_T
+			   " too large", idx);
+      *out |= 1ULL << idx;
+    }
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+luks2_parse_keyslot (grub_luks2_keyslot_t *out, const grub_json_t *keyslot)
+{
+  grub_json_t area, af, kdf;
+  const char *type;
+
+  if (grub_json_getstring (&type, keyslot, "type"))
+    return grub_errno;
+  if (grub_strcmp (type, "luks2"))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT,
+		       "unsupported keyslot type %s", type);
+  if (grub_json_getuint64 (&out->key_size, keyslot, "key_size"))
+    return grub_errno;
+  if (grub_json_getint64 (&out->priority, keyslot, "priority"))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      out->priority = 1;
+    }
+
+  if (grub_json_getvalue (&area, keyslot, "area")
+      || grub_json_getstring (&type, &area, "type"))
+    return grub_errno;
+  if (grub_strcmp (type, "raw"))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT,
+		       "unsupported keyslot area type %s", type);
+  if (grub_json_getuint64 (&out->area.offset, &area, "offset")
+      || grub_json_getuint64 (&out->area.size, &area, "size")
+      || grub_json_getstring (&out->area.encryption, &area, "encryption")
+      || grub_json_getuint64 (&out->area.key_size, &area, "key_size"))
+    return grub_errno;
+
+  if (grub_json_getvalue (&kdf, keyslot, "kdf")
+      || grub_json_getstring (&type, &kdf, "type")
+      || grub_json_getstring (&out->kdf.salt, &kdf, "salt"))
+    return grub_errno;
+  if (grub_strcmp (type, "argon2i") == 0 || grub_strcmp (type, "argon2id") == 0)
+    {
+      out->kdf.type = (type[6] == 'i' && type[7] == 'd')
+	? LUKS2_KDF_TYPE_ARGON2ID : LUKS2_KDF_TYPE_ARGON2I;
+      if (grub_json_getuint64 (&out->kdf.u.argon2.time, &kdf, "time")
+	  || grub_json_getuint64 (&out->kdf.u.argon2.memory, &kdf, "memory")
+	  || grub_json_getuint64 (&out->kdf.u.argon2.cpus, &kdf, "cpus"))
+	return grub_errno;
+    }
+  else if (grub_strcmp (type, "pbkdf2") == 0)
+    {
+      out->kdf.type = LUKS2_KDF_TYPE_PBKDF2;
+      if (grub_json_getstring (&out->kdf.u.pbkdf2.hash, &kdf, "hash")
+	  || grub_json_getuint64 (&out->kdf.u.pbkdf2.iterations, &kdf,
+				  "iterations"))
+	return grub_errno;
+    }
+  else
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "unsupported KDF type %s", type);
+
+  if (grub_json_getvalue (&af, keyslot, "af")
+      || grub_json_getstring (&type, &af, "type"))
+    return grub_errno;
+  if (grub_strcmp (type, "luks1"))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "unsupported AF type %s", type);
+  if (grub_json_getuint64 (&out->af.stripes, &af, "stripes")
+      || grub_json_getstring (&out->af.hash, &af, "hash"))
+    return grub_errno;
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+luks2_parse_segment (grub_luks2_segment_t *out, const grub_json_t *segment)
+{
+  const char *type, *iv_tweak;
+
+  if (grub_json_getstring (&type, segment, "type"))
+    return grub_errno;
+  if (grub_strcmp (type, "crypt"))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT,
+		       "unsupported segment type %s", type);
+  if (grub_json_getuint64 (&out->offset, segment, "offset")
+      || grub_json_getstring (&out->size, segment, "size")
+      || grub_json_getstring (&out->encryption, segment, "encryption")
+      || grub_json_getuint64 (&out->sector_size, segment, "sector_size")
+      || grub_json_getstring (&iv_tweak, segment, "iv_tweak"))
+    return grub_errno;
+  if (grub_strcmp (iv_tweak, "0"))
+    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		       "unsupported IV tweak %s", iv_tweak);
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+luks2_parse_digest (grub_luks2_digest_t *out, const grub_json_t *digest)
+{
+  grub_json_t keyslots, segments;
+  const char *type;
+
+  if (grub_json_getstring (&type, digest, "type"))
+    return grub_errno;
+  if (grub_strcmp (type, "pbkdf2"))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT,
+		       "unsupported digest type %s", type);
+
+  if (grub_json_getvalue (&keyslots, digest, "keyslots")
+      || luks2_parse_indices (&out->keyslots, &keyslots)
+      || grub_json_getvalue (&segments, digest, "segments")
+      || luks2_parse_indices (&out->segments, &segments)
+      || grub_json_getstring (&out->salt, digest, "salt")
+      || grub_json_getstring (&out->digest, digest, "digest")
+      || grub_json_getstring (&out->hash, digest, "hash")
+      || grub_json_getuint64 (&out->iterations, digest, "iterations"))
+    return grub_errno;
+
+  return GRUB_ERR_NONE;
+}
+
+/* Find the member of object PARENT whose key is the index IDX.  */
+static grub_err_t
+luks2_get_indexed (grub_json_t *out, const grub_json_t *parent,
+		   grub_uint64_t idx)
+{
+  grub_size_t i, size;
+
+  if (grub_json_getsize (&size, parent))
+    return grub_errno;
+  for (i = 0; i < size; i++)
+    {
+      grub_json_t child;
+      grub_uint64_t key;
+
+      if (grub_json_getchild (&child, parent, i)
+	  || grub_json_getuint64 (&key, &child, NULL))
+	return grub_errno;
+      if (key == idx)
+	return grub_json_getchild (out, &child, 0);
+    }
+  return grub_error (GRUB_ERR_FILE_NOT_FOUND,
+		     "no object with index %" PRIuGRUB_UINT64_T, idx);
+}
+
+/* Parse keyslot KEYSLOT_IDX, the n-th member of the "keyslots" object,
+   together with the digest covering it and the first segment covered by
+   that digest.  */
+static grub_err_t
+luks2_get_keyslot (grub_luks2_keyslot_t *k, grub_luks2_digest_t *d,
+		   grub_luks2_segment_t *s, grub_uint64_t *slot,
+		   const grub_json_t *root, grub_size_t keyslot_idx)
+{
+  grub_json_t keyslots, keyslot, digests, digest, segments, segment;
+  grub_uint64_t segment_idx;
+  grub_size_t i, size;
+
+  if (grub_json_getvalue (&keyslots, root, "keyslots")
+      || grub_json_getchild (&keyslot, &keyslots, keyslot_idx)
+      || grub_json_getuint64 (slot, &keyslot, NULL)
+      || grub_json_getchild (&keyslot, &keyslot, 0)
+      || luks2_parse_keyslot (k, &keyslot))
+    return grub_errno;
+  if (*slot >= LUKS2_MAX_OBJECTS)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "keyslot index too large");
+
+  if (grub_json_getvalue (&digests, root, "digests")
+      || grub_json_getsize (&size, &digests))
+    return grub_errno;
+  for (i = 0; i < size; i++)
+    {
+      if (grub_json_getchild (&digest, &digests, i)
+	  || grub_json_getchild (&digest, &digest, 0)
+	  || luks2_parse_digest (d, &digest))
+	return grub_errno;
+      if (d->keyslots & (1ULL << *slot))
+	break;
+    }
+  if (i == size)
+    return grub_error (GRUB_ERR_FILE_NOT_FOUND,
+		       "no digest for keyslot %" PRIuGRUB_UINT64_T, *slot);
+  if (!d->segments)
+    return grub_error (GRUB_ERR_FILE_NOT_FOUND,
+		       "digest for keyslot %" PRIuGRUB_UINT64_T
+		       " has no segment", *slot);
+
+  for (segment_idx = 0; !(d->segments & (1ULL << segment_idx)); segment_idx++);
+  if (grub_json_getvalue (&segments, root, "segments")
+      || luks2_get_indexed (&segment, &segments, segment_idx)
+      || luks2_parse_segment (s, &segment))
+    return grub_errno;
+
+  return GRUB_ERR_NONE;
+}
+
+/* Offsets at which the secondary binary header may be, one for each
+   allowed header size.  They are tried when the primary header cannot
+   tell where it is.  */
+static const grub_uint64_t luks2_hdr2_offsets[] =
+  {
+    0x4000, 0x8000, 0x10000, 0x20000, 0x40000, 0x80000, 0x100000, 0x200000,
+    0x400000
+  };
+
+/* Verify the checksum of header HDR, which covers HDR itself with the
+   checksum zeroed and its JSON area AREA.  */
+static grub_err_t
+luks2_verify_checksum (grub_luks2_header_t *hdr, const char *area,
+		       grub_size_t area_size)
+{
+  char csum_alg[sizeof (hdr->csum_alg) + 1];
+  grub_uint8_t csum[sizeof (hdr->csum)];
+  const gcry_md_spec_t *hash;
+  void *ctx;
+  int mismatch;
+
+  grub_memcpy (csum_alg, hdr->csum_alg, sizeof (hdr->csum_alg));
+  csum_alg[sizeof (hdr->csum_alg)] = '\0';
+  hash = grub_crypto_lookup_md_by_name (csum_alg);
+  if (!hash)
+    return grub_error (GRUB_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
+		       csum_alg);
+  if (hash->mdlen > sizeof (csum))
+    return grub_error (GRUB_ERR_BAD_FS, "checksum too long");
+
+  ctx = grub_malloc (hash->contextsize);
+  if (!ctx)
+    return grub_errno;
+
+  grub_memcpy (csum, hdr->csum, sizeof (csum));
+  grub_memset (hdr->csum, 0, sizeof (hdr->csum));
+  hash->init (ctx);
+  hash->write (ctx, hdr, sizeof (*hdr));
+  hash->write (ctx, area, area_size);
+  hash->final (ctx);
+  grub_memcpy (hdr->csum, csum, sizeof (csum));
+
+  mismatch = grub_memcmp (hash->read (ctx), csum, hash->mdlen) != 0;
+  grub_free (ctx);
+  if (mismatch)
+    return grub_error (GRUB_ERR_BAD_FS, "LUKS2 header checksum mismatch");
+
+  return GRUB_ERR_NONE;
+}
+
+/* Read the binary header at OFFSET, which should start with MAGIC, and
+   the JSON area behind it into a new buffer AREA.  Return
+   GRUB_ERR_BAD_SIGNATURE without setting grub_errno if there is no LUKS2
+   header there.  */
+static grub_err_t
+luks2_read_copy (grub_disk_t disk, grub_uint64_t offset, const char *magic,
+		 grub_luks2_header_t *hdr, char **area)
+{
+  grub_uint64_t hdr_size;
+  grub_err_t err;
+
+  *area = NULL;
+  err = grub_disk_read (disk, 0, offset, sizeof (*hdr), hdr);
+  if (err)
+    return err;
+  if (grub_memcmp (hdr->magic, magic, sizeof (hdr->magic))
+      || grub_be_to_cpu16 (hdr->version) != 2)
+    return GRUB_ERR_BAD_SIGNATURE;
+
+  hdr_size = grub_be_to_cpu64 (hdr->hdr_size);
+  if (hdr_size < LUKS2_HDR_SIZE_MIN || hdr_size > LUKS2_HDR_SIZE_MAX)
+    return grub_error (GRUB_ERR_BAD_FS, "invalid LUKS2 header size");
+  if (grub_be_to_cpu64 (hdr->hdr_offset) != offset)
+    return grub_error (GRUB_ERR_BAD_FS, "invalid LUKS2 header offset");
+
+  *area = grub_malloc (hdr_size - sizeof (*hdr));
+  if (!*area)
+    return grub_errno;
+  err = grub_disk_read (disk, 0, offset + sizeof (*hdr),
+			hdr_size - sizeof (*hdr), *area);
+  if (!err)
+    err = luks2_verify_checksum (hdr, *area, hdr_size - sizeof (*hdr));
+  if (err)
+    {
+      grub_free (*area);
+      *area = NULL;
+    }
+  return err;
+}
+
+/* Read both binary headers and their JSON areas, and parse the JSON area
+   of the valid header with the higher sequence ID, or that of the other
+   valid header if it does not parse.  */
+static grub_err_t
+luks2_read_header (grub_disk_t disk, grub_luks2_header_t *outhdr,
+		   grub_json_t **json)
+{
+  grub_luks2_header_t hdr[2];
+  char *area[2];
+  grub_err_t err[2];
+  unsigned int i, first;
+
+  err[0] = luks2_read_copy (disk, 0, LUKS_MAGIC_1ST, &hdr[0], &area[0]);
+  if (err[0])
+    grub_dprintf ("luks2", "primary header is invalid: %s\n",
+		  grub_errno ? grub_errmsg : "no signature");
+  grub_errno = GRUB_ERR_NONE;
+
+  if (!err[0])
+    err[1] = luks2_read_copy (disk, grub_be_to_cpu64 (hdr[0].hdr_size),
+			      LUKS_MAGIC_2ND, &hdr[1], &area[1]);
+  else
+    for (i = 0, err[1] = GRUB_ERR_BAD_SIGNATURE;
+	 i < ARRAY_SIZE (luks2_hdr2_offsets)
+	   && err[1] == GRUB_ERR_BAD_SIGNATURE; i++)
+      err[1] = luks2_read_copy (disk, luks2_hdr2_offsets[i], LUKS_MAGIC_2ND,
+				&hdr[1], &area[1]);
+  if (err[1])
+    grub_dprintf ("luks2", "secondary header is invalid: %s\n",
+		  grub_errno ? grub_errmsg : "no signature");
+  grub_errno = GRUB_ERR_NONE;
+
+  if (err[0] && err[1])
+    {
+      for (i = 0; i < 2; i++)
+	if (err[i] != GRUB_ERR_BAD_SIGNATURE
+	    && err[i] != GRUB_ERR_OUT_OF_RANGE)
+	  return grub_error (GRUB_ERR_BAD_FS, "no valid LUKS2 header");
+      return GRUB_ERR_BAD_SIGNATURE;
+    }
+
+  first = err[0] || (!err[1] && grub_be_to_cpu64 (hdr[1].seqid)
+		     > grub_be_to_cpu64 (hdr[0].seqid));
+  for (i = 0; i < 2; i++)
+    {
+      unsigned int c = first ^ i;
+
+      if (err[c])
+	continue;
+      if (grub_json_parse (json, area[c], grub_be_to_cpu64 (hdr[c].hdr_size)
+			   - sizeof (hdr[c])) == GRUB_ERR_NONE)
+	{
+	  grub_memcpy (outhdr, &hdr[c], sizeof (hdr[c]));
+	  break;
+	}
+      grub_dprintf ("luks2", "%s JSON area is invalid: %s\n",
+		    c ? "secondary" : "primary", grub_errmsg);
+      grub_errno = GRUB_ERR_NONE;
+    }
+
+  grub_free (area[0]);
+  grub_free (area[1]);
+  if (i == 2)
+    return grub_error (GRUB_ERR_BAD_FS, "invalid LUKS2 JSON metadata");
+
+  return GRUB_ERR_NONE;
+}
+
+/* Set up CRYPT for reading segment S, once the keys are known or just
+   to describe the device.  */
+static grub_err_t
+luks2_configure_segment (grub_cryptodisk_t crypt, grub_disk_t disk,
+			 const grub_luks2_segment_t *s)
+{
+  int log_sector_size;
+
+  for (log_sector_size = GRUB_DISK_SECTOR_BITS; log_sector_size <= 12;
+       log_sector_size++)
+    if (s->sector_size == 1ULL << log_sector_size)
+      break;
+  if (log_sector_size > 12)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT,
+		       "unsupported sector size %" PRIuGRUB_UINT64_T,
+		       s->sector_size);
+  if (s->offset % s->sector_size)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "unaligned segment offset");
+
+  if (luks2_setcipher (crypt, s->encryption))
+    return grub_errno;
+
+  crypt->log_sector_size = log_sector_size;
+  crypt->offset = s->offset >> GRUB_DISK_SECTOR_BITS;
+  if (grub_strcmp (s->size, "dynamic") == 0)
+    {
+      grub_disk_addr_t size = grub_disk_get_size (disk);
+
+      if (size == GRUB_DISK_SIZE_UNKNOWN)
+	crypt->total_length = GRUB_DISK_SIZE_UNKNOWN;
+      else if (size < crypt->offset)
+	return grub_error (GRUB_ERR_BAD_FS, "segment beyond end of disk");
+      else
+	crypt->total_length = (size - crypt->offset)
+	  >> (log_sector_size - GRUB_DISK_SECTOR_BITS);
+    }
+  else
+    {
+      grub_uint64_t size;
+      char *end;
+
+      size = grub_strtoull (s->size, &end, 10);
+      if (grub_errno || *end)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "invalid segment size");
+      crypt->total_length = size >> log_sector_size;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_cryptodisk_t
+luks2_scan (grub_disk_t disk, const char *check_uuid, int check_boot)
+{
+  grub_cryptodisk_t cryptodisk;
+  grub_luks2_header_t header;
+  grub_json_t *json = NULL, segments, segment;
+  grub_luks2_segment_t s;
+  char uuid[sizeof (header.uuid) + 1];
+  grub_size_t i, j;
+  grub_err_t err;
+
+  if (check_boot)
+    return NULL;
+
+  err = luks2_read_header (disk, &header, &json);
+  if (err)
+    {
+      if (err == GRUB_ERR_BAD_SIGNATURE || err == GRUB_ERR_OUT_OF_RANGE)
+	grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+
+  for (i = 0, j = 0; i < sizeof (header.uuid) && header.uuid[i]; i++)
+    if (header.uuid[i] != '-')
+      uuid[j++] = header.uuid[i];
+  uuid[j] = '\0';
+
+  if (check_uuid && grub_strcasecmp (check_uuid, uuid) != 0)
+    {
+      grub_dprintf ("luks2", "%s != %s\n", uuid, check_uuid);
+      grub_json_free (json);
+      return NULL;
+    }
+
+  cryptodisk = grub_zalloc (sizeof (*cryptodisk));
+  if (!cryptodisk)
+    {
+      grub_json_free (json);
+      return NULL;
+    }
+
+  /* Describe the device by its first segment, so that its ciphers are
+     known before it is opened.  The segment used for reading is set
+     again once a keyslot has been unlocked.  */
+  if (grub_json_getvalue (&segments, json, "segments")
+      || grub_json_getchild (&segment, &segments, 0)
+      || grub_json_getchild (&segment, &segment, 0)
+      || luks2_parse_segment (&s, &segment)
+      || luks2_configure_segment (cryptodisk, disk, &s))
+    {
+      grub_json_free (json);
+      grub_crypto_cipher_close (cryptodisk->cipher);
+      grub_crypto_cipher_close (cryptodisk->secondary_cipher);
+      grub_crypto_cipher_close (cryptodisk->essiv_cipher);
+      grub_free (cryptodisk);
+      return NULL;
+    }
+  grub_json_free (json);
+
+  COMPILE_TIME_ASSERT (sizeof (cryptodisk->uuid) >= sizeof (uuid));
+  grub_memcpy (cryptodisk->uuid, uuid, sizeof (uuid));
+  cryptodisk->modname = "luks2";
+  return cryptodisk;
+}
+
+static grub_err_t
+luks2_verify_key (const grub_luks2_digest_t *d, grub_uint8_t *candidate_key,
+		  grub_size_t candidate_key_len)
+{
+  grub_uint8_t candidate_digest[GRUB_CRYPTO_MAX_MDLEN];
+  grub_uint8_t digest[LUKS2_MAX_BINARY], salt[LUKS2_MAX_BINARY];
+  grub_size_t saltlen, digestlen;
+  const gcry_md_spec_t *hash;
+  gcry_err_code_t gcry_err;
+
+  if (luks2_base64_decode (d->digest, digest, sizeof (digest), &digestlen)
+      || luks2_base64_decode (d->salt, salt, sizeof (salt), &saltlen))
+    return grub_errno;
+  if (digestlen > sizeof (candidate_digest))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "digest too long");
+
+  hash = grub_crypto_lookup_md_by_name (d->hash);
+  if (!hash)
+    return grub_error (GRUB_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
+		       d->hash);
+
+  gcry_err = grub_crypto_pbkdf2 (hash, candidate_key, candidate_key_len,
+				 salt, saltlen, d->iterations,
+				 candidate_digest, digestlen);
+  if (gcry_err)
+    return grub_crypto_gcry_error (gcry_err);
+
+  if (grub_crypto_memcmp (candidate_digest, digest, digestlen) != 0)
+    return grub_error (GRUB_ERR_ACCESS_DENIED, "mismatching digests");
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+luks2_decrypt_key (grub_uint8_t *out_key, grub_disk_t disk,
+		   grub_cryptodisk_t crypt, const grub_luks2_keyslot_t *k,
+		   const grub_uint8_t *passphrase, grub_size_t passphraselen)
+{
+  grub_uint8_t area_key[GRUB_CRYPTODISK_MAX_KEYLEN];
+  grub_uint8_t salt[LUKS2_MAX_BINARY];
+  grub_uint8_t *split_key = NULL;
+  grub_size_t saltlen, split_key_len;
+  const gcry_md_spec_t *hash;
+  gcry_err_code_t gcry_err;
+  grub_err_t err;
+
+  if (k->key_size > GRUB_CRYPTODISK_MAX_KEYLEN
+      || k->area.key_size > GRUB_CRYPTODISK_MAX_KEYLEN)
+    return grub_error (GRUB_ERR_BAD_FS, "key is too long");
+  if (k->key_size == 0 || k->af.stripes == 0
+      || k->af.stripes > k->area.size / k->key_size)
+    return grub_error (GRUB_ERR_BAD_FS, "key material exceeds keyslot area");
+  split_key_len = k->key_size * k->af.stripes;
+
+  if (luks2_base64_decode (k->kdf.salt, salt, sizeof (salt), &saltlen))
+    return grub_errno;
+
+  switch (k->kdf.type)
+    {
+    case LUKS2_KDF_TYPE_ARGON2I:
+    case LUKS2_KDF_TYPE_ARGON2ID:
+      if (k->kdf.u.argon2.time > GRUB_UINT_MAX
+	  || k->kdf.u.argon2.memory > GRUB_UINT_MAX
+	  || k->kdf.u.argon2.cpus > GRUB_UINT_MAX)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "invalid Argon2 parameters");
+      grub_dprintf ("luks2", "Argon2 with %" PRIuGRUB_UINT64_T " KiB, %"
+		    PRIuGRUB_UINT64_T " passes, %" PRIuGRUB_UINT64_T
+		    " lanes\n", k->kdf.u.argon2.memory,
+		    k->kdf.u.argon2.time, k->kdf.u.argon2.cpus);
+      gcry_err = grub_crypto_argon2 (k->kdf.type == LUKS2_KDF_TYPE_ARGON2ID
+				     ? GRUB_CRYPTO_ARGON2ID
+				     : GRUB_CRYPTO_ARGON2I,
+				     passphrase, passphraselen, salt, saltlen,
+				     NULL, 0, NULL, 0,
+				     k->kdf.u.argon2.time,
+				     k->kdf.u.argon2.memory,
+				     k->kdf.u.argon2.cpus,
+				     area_key, k->area.key_size);
+      if (gcry_err == GPG_ERR_OUT_OF_MEMORY)
+	return grub_error (GRUB_ERR_OUT_OF_MEMORY,
+			   "not enough memory for Argon2 (%" PRIuGRUB_UINT64_T
+			   " KiB)", k->kdf.u.argon2.memory);
+      break;
+    case LUKS2_KDF_TYPE_PBKDF2:
+      if (k->kdf.u.pbkdf2.iterations > GRUB_UINT_MAX)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "invalid PBKDF2 iterations");
+      hash = grub_crypto_lookup_md_by_name (k->kdf.u.pbkdf2.hash);
+      if (!hash)
+	return grub_error (GRUB_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
+			   k->kdf.u.pbkdf2.hash);
+      gcry_err = grub_crypto_pbkdf2 (hash, passphrase, passphraselen,
+				     salt, saltlen,
+				     k->kdf.u.pbkdf2.iterations,
+				     area_key, k->area.key_size);
+      break;
+    default:
+      return grub_error (GRUB_ERR_BAD_ARGUMENT, "unsupported KDF");
+    }
+  if (gcry_err)
+    return grub_crypto_gcry_error (gcry_err);
+
+  grub_dprintf ("luks2", "KDF done\n");
+
+  /* The keyslot area is always encrypted in 512 byte sectors.  */
+  err = luks2_setcipher (crypt, k->area.encryption);
+  if (err)
+    return err;
+  crypt->log_sector_size = GRUB_DISK_SECTOR_BITS;
+  gcry_err = grub_cryptodisk_setkey (crypt, area_key, k->area.key_size);
+  grub_memset (area_key, 0, sizeof (area_key));
+  if (gcry_err)
+    return grub_crypto_gcry_error (gcry_err);
+
+  split_key = grub_malloc (split_key_len);
+  if (!split_key)
+    return grub_errno;
+
+  /* Read and decrypt the key material from the disk.  */
+  err = grub_disk_read (disk, 0, k->area.offset, split_key_len, split_key);
+  if (err)
+    goto fail;
+
+  gcry_err = grub_cryptodisk_decrypt (crypt, split_key, split_key_len, 0);
+  if (gcry_err)
+    {
+      err = grub_crypto_gcry_error (gcry_err);
+      goto fail;
+    }
+
+  hash = grub_crypto_lookup_md_by_name (k->af.hash);
+  if (!hash)
+    {
+      err = grub_error (GRUB_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
+			k->af.hash);
+      goto fail;
+    }
+
+  /* Merge the decrypted key material to get the candidate master key.  */
+  gcry_err = AF_merge (hash, split_key, out_key, k->key_size, k->af.stripes);
+  if (gcry_err)
+    err = grub_crypto_gcry_error (gcry_err);
+
+ fail:
+  grub_memset (split_key, 0, split_key_len);
+  grub_free (split_key);
+  return err;
+}
+
+static grub_err_t
+luks2_recover_key (grub_disk_t disk, grub_cryptodisk_t crypt)
+{
+  grub_uint8_t candidate_key[GRUB_CRYPTODISK_MAX_KEYLEN];
+  char passphrase[MAX_PASSPHRASE] = "";
+  grub_luks2_keyslot_t keyslot;
+  grub_luks2_digest_t digest;
+  grub_luks2_segment_t segment;
+  grub_luks2_header_t header;
+  grub_json_t *json = NULL, keyslots;
+  grub_size_t i, size;
+  grub_uint64_t slot;
+  grub_int64_t priority;
+  gcry_err_code_t gcry_err;
+  char *part;
+  grub_err_t err;
+
+  err = luks2_read_header (disk, &header, &json);
+  if (err)
+    return err;
+
+  if (grub_json_getvalue (&keyslots, json, "keyslots")
+      || grub_json_getsize (&size, &keyslots))
+    {
+      err = grub_errno;
+      goto out;
+    }
+
+  grub_puts_ (N_("Attempting to decrypt master key..."));
+
+  /* Get the passphrase from the user.  */
+  part = NULL;
+  if (disk->partition)
+    part = grub_partition_get_name (disk->partition);
+  grub_printf_ (N_("Enter passphrase for %s%s%s (%s): "), disk->name,
+		disk->partition ? "," : "", part ? : "",
+		crypt->uuid);
+  grub_free (part);
+  if (!grub_password_get (passphrase, MAX_PASSPHRASE))
+    {
+      err = grub_error (GRUB_ERR_BAD_ARGUMENT, "Passphrase not supplied");
+      goto out;
+    }
+
+  /* Try high priority keyslots first.  Priority 0 means the keyslot
+     must only be used when asked for explicitly.  */
+  for (priority = 2; priority > 0; priority--)
+    for (i = 0; i < size; i++)
+      {
+	err = luks2_get_keyslot (&keyslot, &digest, &segment, &slot,
+				 json, i);
+	if (err)
+	  {
+	    grub_dprintf ("luks2", "Skipping keyslot %" PRIuGRUB_SIZE
+			  ": %s\n", i, grub_errmsg);
+	    grub_errno = GRUB_ERR_NONE;
+	    continue;
+	  }
+	if (keyslot.priority != priority)
+	  continue;
+
+	grub_dprintf ("luks2", "Trying keyslot %" PRIuGRUB_UINT64_T "\n",
+		      slot);
+
+	err = luks2_decrypt_key (candidate_key, disk, crypt, &keyslot,
+				 (const grub_uint8_t *) passphrase,
+				 grub_strlen (passphrase));
+	if (err)
+	  {
+	    grub_dprintf ("luks2", "Decryption with keyslot %"
+			  PRIuGRUB_UINT64_T " failed: %s\n", slot,
+			  grub_errmsg);
+	    if (err == GRUB_ERR_OUT_OF_MEMORY)
+	      grub_print_error ();
+	    grub_errno = GRUB_ERR_NONE;
+	    continue;
+	  }
+
+	err = luks2_verify_key (&digest, candidate_key, keyslot.key_size);
+	if (err)
+	  {
+	    grub_dprintf ("luks2", "Could not open keyslot %"
+			  PRIuGRUB_UINT64_T ": %s\n", slot, grub_errmsg);
+	    grub_errno = GRUB_ERR_NONE;
+	    continue;
+	  }
+
+	/* TRANSLATORS: It's a cryptographic key slot: one element of an array
+	   where each element is either empty or holds a key.  */
+	grub_printf_ (N_("Slot %d opened\n"), (int) slot);
+
+	/* Switch from the keyslot area to the data segment and set the
+	   master key.  */
+	err = luks2_configure_segment (crypt, disk, &segment);
+	if (err)
+	  goto out;
+	gcry_err = grub_cryptodisk_setkey (crypt, candidate_key,
+					   keyslot.key_size);
+	if (gcry_err)
+	  err = grub_crypto_gcry_error (gcry_err);
+	goto out;
+      }
+
+  err = GRUB_ACCESS_DENIED;
+
+ out:
+  grub_memset (candidate_key, 0, sizeof (candidate_key));
+  grub_memset (passphrase, 0, sizeof (passphrase));
+  grub_json_free (json);
+  return err;
+}
+
+static struct grub_cryptodisk_dev luks2_crypto = {
+  .scan = luks2_scan,
+  .recover_key = luks2_recover_key
+};
+
+GRUB_MOD_INIT (luks2)
+{
+  grub_cryptodisk_dev_register (&luks2_crypto);
+}
+
+GRUB_MOD_FINI (luks2)
+{
+  grub_cryptodisk_dev_unregister (&luks2_crypto);
+}
@@ -34,65 +34,949 @@
 GRUB_MOD_LICENSE ("GPLv3+");
 
 
-/* Go the string STR and return the number after STR.  *P will point
-   at the number.  In case STR is not found, *P will be NULL and the
-   return value will be 0.  */
-static grub_uint64_t
-grub_lvm_getvalue (char **p, const char *str)
+/* Metadata text is read in two steps: this much first, which is normally
+   enough to find the VG ID, and the rest only for a VG not seen yet.  */
+#define GRUB_LVM_TEXT_PREFIX 4096
+
+/* Deepest nesting of sections and arrays accepted in the metadata.  */
+#define GRUB_LVM_MAX_DEPTH 16
+
+/* The metadata is parsed in one pass into a tree of these.  Keys and
+   strings point into the metadata text.  */
+struct grub_lvm_cfg
 {
-  *p = grub_strstr (*p, str);
-  if (! *p)
-    return 0;
-  *p += grub_strlen (str);
-  return grub_strtoull (*p, p, 10);
+  enum
+    {
+      GRUB_LVM_CFG_SECTION,
+      GRUB_LVM_CFG_ARRAY,
+      GRUB_LVM_CFG_STRING,
+      GRUB_LVM_CFG_NUMBER
+    } type;
+  const char *key;
+  grub_size_t keylen;
+  const char *str;
+  grub_size_t len;
+  grub_uint64_t num;
+  /* Contents of a section or an array.  */
+  struct grub_lvm_cfg *child;
+  struct grub_lvm_cfg *next;
+};
+
+struct grub_lvm_cfg_pool
+{
+  struct grub_lvm_cfg_pool *next;
+  unsigned used;
+  struct grub_lvm_cfg nodes[128];
+};
+
+enum
+  {
+    GRUB_LVM_TOK_EOF,
+    GRUB_LVM_TOK_ERROR,
+    GRUB_LVM_TOK_WORD,
+    GRUB_LVM_TOK_STRING,
+    GRUB_LVM_TOK_PUNCT
+  };
+
+struct grub_lvm_parser
+{
+  const char *p;
+  const char *end;
+  struct grub_lvm_cfg_pool *pool;
+  unsigned depth;
+  int error;
+};
+
+static int
+grub_lvm_is_punct (char c)
+{
+  return (c == '{' || c == '}' || c == '[' || c == ']' || c == '='
+	  || c == ',' || c == '"' || c == '#');
+}
+
+/* Read the next token.  Strings are returned without the quotes.  */
+static int
+grub_lvm_next_token (struct grub_lvm_parser *ps, const char **tok,
+		     grub_size_t *len)
+{
+  const char *p = ps->p, *s;
+
+  while (p < ps->end)
+    {
+      if (*p == '#')
+	while (p < ps->end && *p != '\n')
+	  p++;
+      else if (grub_isspace (*p))
+	p++;
+      else
+	break;
+    }
+
+  if (p == ps->end)
+    {
+      ps->p = p;
+      return GRUB_LVM_TOK_EOF;
+    }
+
+  if (*p == '"')
+    {
+      s = ++p;
+      while (p < ps->end && *p != '"')
+	p += (*p == '\\' && p + 1 < ps->end) ? 2 : 1;
+      if (p >= ps->end)
+	return GRUB_LVM_TOK_ERROR;
+      *tok = s;
+      *len = p - s;
+      ps->p = p + 1;
+      return GRUB_LVM_TOK_STRING;
+    }
+
+  *tok = p;
+  if (grub_lvm_is_punct (*p))
+    {
+      *len = 1;
+      ps->p = p + 1;
+      return GRUB_LVM_TOK_PUNCT;
+    }
+
+  while (p < ps->end && !grub_isspace (*p) && !grub_lvm_is_punct (*p))
+    p++;
+  *len = p - *tok;
+  ps->p = p;
+  return GRUB_LVM_TOK_WORD;
+}
+
+static struct grub_lvm_cfg *
+grub_lvm_cfg_alloc (struct grub_lvm_parser *ps)
+{
+  if (!ps->pool || ps->pool->used == ARRAY_SIZE (ps->pool->nodes))
+    {
+      struct grub_lvm_cfg_pool *pool;
+
+      pool = grub_malloc (sizeof (*pool));
+      if (!pool)
+	{
+	  ps->error = 1;
+	  return NULL;
+	}
+      pool->next = ps->pool;
+      pool->used = 0;
+      ps->pool = pool;
+    }
+  return grub_memset (&ps->pool->nodes[ps->pool->used++], 0,
+		      sizeof (struct grub_lvm_cfg));
+}
+
+static void
+grub_lvm_cfg_free (struct grub_lvm_parser *ps)
+{
+  while (ps->pool)
+    {
+      struct grub_lvm_cfg_pool *next = ps->pool->next;
+      grub_free (ps->pool);
+      ps->pool = next;
+    }
+}
+
+/* Fill NODE from a string or number token.  */
+static int
+grub_lvm_parse_scalar (struct grub_lvm_cfg *node, int type,
+		       const char *tok, grub_size_t len)
+{
+  node->str = tok;
+  node->len = len;
+  if (type == GRUB_LVM_TOK_STRING)
+    {
+      node->type = GRUB_LVM_CFG_STRING;
+      return 0;
+    }
+  if (type != GRUB_LVM_TOK_WORD)
+    return 1;
+  node->type = GRUB_LVM_CFG_NUMBER;
+  node->num = grub_strtoull (tok, 0, 10);
+  return 0;
+}
+
+static void
+grub_lvm_parse_value (struct grub_lvm_parser *ps, struct grub_lvm_cfg *node)
+{
+  struct grub_lvm_cfg **last = &node->child;
+  const char *tok;
+  grub_size_t len;
+  int type;
+
+  type = grub_lvm_next_token (ps, &tok, &len);
+  if (type != GRUB_LVM_TOK_PUNCT || *tok != '[')
+    {
+      ps->error |= grub_lvm_parse_scalar (node, type, tok, len);
+      return;
+    }
+
+  node->type = GRUB_LVM_CFG_ARRAY;
+  while (1)
+    {
+      struct grub_lvm_cfg *elem;
+
+      type = grub_lvm_next_token (ps, &tok, &len);
+      if (type == GRUB_LVM_TOK_PUNCT && *tok == ']')
+	return;
+      if (type == GRUB_LVM_TOK_PUNCT && *tok == ',' && node->child)
+	continue;
+
+      elem = grub_lvm_cfg_alloc (ps);
+      if (!elem)
+	return;
+      if (grub_lvm_parse_scalar (elem, type, tok, len))
+	{
+	  ps->error = 1;
+	  return;
+	}
+      *last = elem;
+      last = &elem->next;
+    }
 }
 
-#if 0
+/* Parse the items of a section up to its closing brace, or up to the end
+   of the text at the top level.  */
+static struct grub_lvm_cfg *
+grub_lvm_parse_section (struct grub_lvm_parser *ps, int toplevel)
+{
+  struct grub_lvm_cfg *first = NULL, **last = &first;
+
+  if (++ps->depth > GRUB_LVM_MAX_DEPTH)
+    {
+      ps->error = 1;
+      return NULL;
+    }
+
+  while (!ps->error)
+    {
+      struct grub_lvm_cfg *node;
+      const char *tok;
+      grub_size_t len;
+      int type;
+
+      type = grub_lvm_next_token (ps, &tok, &len);
+      if (type == GRUB_LVM_TOK_EOF && toplevel)
+	break;
+      if (type == GRUB_LVM_TOK_PUNCT && *tok == '}' && !toplevel)
+	break;
+      if (type != GRUB_LVM_TOK_WORD)
+	{
+	  ps->error = 1;
+	  break;
+	}
+
+      node = grub_lvm_cfg_alloc (ps);
+      if (!node)
+	break;
+      node->key = tok;
+      node->keylen = len;
+
+      type = grub_lvm_next_token (ps, &tok, &len);
+      if (type == GRUB_LVM_TOK_PUNCT && *tok == '{')
+	{
+	  node->type = GRUB_LVM_CFG_SECTION;
+	  node->child = grub_lvm_parse_section (ps, 0);
+	}
+      else if (type == GRUB_LVM_TOK_PUNCT && *tok == '=')
+	grub_lvm_parse_value (ps, node);
+      else
+	ps->error = 1;
+
+      *last = node;
+      last = &node->next;
+    }
+
+  ps->depth--;
+  return first;
+}
+
+static int
+grub_lvm_cfg_is (const struct grub_lvm_cfg *node, const char *key)
+{
+  grub_size_t len = grub_strlen (key);
+  return node->keylen == len && grub_memcmp (node->key, key, len) == 0;
+}
+
+static struct grub_lvm_cfg *
+grub_lvm_cfg_find (const struct grub_lvm_cfg *section, const char *key,
+		   unsigned type)
+{
+  struct grub_lvm_cfg *node;
+
+  for (node = section->child; node; node = node->next)
+    if (node->type == type && grub_lvm_cfg_is (node, key))
+      return node;
+  return NULL;
+}
+
+/* Return the number KEY of SECTION in *VAL, or 0 if there is none.  */
 static int
-grub_lvm_checkvalue (char **p, char *str, char *tmpl)
+grub_lvm_cfg_number (const struct grub_lvm_cfg *section, const char *key,
+		     grub_uint64_t *val)
 {
-  int tmpllen = grub_strlen (tmpl);
-  *p = grub_strstr (*p, str);
-  if (! *p)
+  struct grub_lvm_cfg *node;
+
+  node = grub_lvm_cfg_find (section, key, GRUB_LVM_CFG_NUMBER);
+  if (!node)
     return 0;
-  *p += grub_strlen (str);
-  if (**p != '"')
+  *val = node->num;
+  return 1;
+}
+
+static int
+grub_lvm_check_flag (const struct grub_lvm_cfg *section, const char *str,
+		     const char *flag)
+{
+  grub_size_t len_flag = grub_strlen (flag);
+  struct grub_lvm_cfg *node;
+
+  node = grub_lvm_cfg_find (section, str, GRUB_LVM_CFG_ARRAY);
+  if (!node)
     return 0;
-  return (grub_memcmp (*p + 1, tmpl, tmpllen) == 0 && (*p)[tmpllen + 1] == '"');
+  for (node = node->child; node; node = node->next)
+    if (node->type == GRUB_LVM_CFG_STRING && node->len == len_flag
+	&& grub_memcmp (node->str, flag, len_flag) == 0)
+      return 1;
+  return 0;
 }
-#endif
 
+/* Find the VG name and ID at the start of the metadata text.  */
 static int
-grub_lvm_check_flag (char *p, const char *str, const char *flag)
+grub_lvm_find_vg_id (const char *text, grub_size_t size,
+		     const char **vgname, grub_size_t *vgname_len,
+		     const char **vg_id)
 {
-  grub_size_t len_str = grub_strlen (str), len_flag = grub_strlen (flag);
+  struct grub_lvm_parser ps = { .p = text, .end = text + size };
+  const char *tok;
+  grub_size_t len;
+  int type;
+
+  if (grub_lvm_next_token (&ps, vgname, vgname_len) != GRUB_LVM_TOK_WORD)
+    return 0;
+  type = grub_lvm_next_token (&ps, &tok, &len);
+  if (type != GRUB_LVM_TOK_PUNCT || *tok != '{')
+    return 0;
+
   while (1)
     {
-      char *q;
-      p = grub_strstr (p, str);
-      if (! p)
+      int is_id;
+
+      if (grub_lvm_next_token (&ps, &tok, &len) != GRUB_LVM_TOK_WORD)
 	return 0;
-      p += len_str;
-      if (grub_memcmp (p, " = [", sizeof (" = [") - 1) != 0)
-	continue;
-      q = p + sizeof (" = [") - 1;
-      while (1)
+      is_id = (len == 2 && grub_memcmp (tok, "id", 2) == 0);
+      type = grub_lvm_next_token (&ps, &tok, &len);
+      if (type != GRUB_LVM_TOK_PUNCT || *tok != '=')
+	return 0;
+
+      type = grub_lvm_next_token (&ps, &tok, &len);
+      if (is_id)
 	{
-	  while (grub_isspace (*q))
-	    q++;
-	  if (*q != '"')
-	    return 0;
-	  q++;
-	  if (grub_memcmp (q, flag, len_flag) == 0 && q[len_flag] == '"')
-	    return 1;
-	  while (*q != '"')
-	    q++;
-	  q++;
-	  if (*q == ']')
+	  if (type != GRUB_LVM_TOK_STRING || len != GRUB_LVM_ID_STRLEN)
 	    return 0;
-	  q++;
+	  *vg_id = tok;
+	  return 1;
+	}
+      if (type == GRUB_LVM_TOK_PUNCT && *tok == '[')
+	while (type == GRUB_LVM_TOK_PUNCT ? *tok != ']'
+	       : type == GRUB_LVM_TOK_WORD || type == GRUB_LVM_TOK_STRING)
+	  type = grub_lvm_next_token (&ps, &tok, &len);
+      if (type != GRUB_LVM_TOK_PUNCT
+	  && type != GRUB_LVM_TOK_WORD && type != GRUB_LVM_TOK_STRING)
+	return 0;
+    }
+}
+
+/* Read SIZE bytes of metadata text at OFFSET of the metadata area at
+   MDA_OFFSET, which is MDA_SIZE long and wraps around after its header.
+   The text is NUL-terminated.  */
+static char *
+grub_lvm_read_text (grub_disk_t disk, grub_uint64_t mda_offset,
+		    grub_uint64_t mda_size, grub_uint64_t offset,
+		    grub_size_t size)
+{
+  grub_size_t first = size;
+  char *text;
+
+  text = grub_malloc (size + 1);
+  if (!text)
+    return NULL;
+
+  if (offset + size > mda_size)
+    first = mda_size - offset;
+
+  if (grub_disk_read (disk, 0, mda_offset + offset, first, text)
+      || (first < size
+	  && grub_disk_read (disk, 0, mda_offset + GRUB_LVM_MDA_HEADER_SIZE,
+			     size - first, text + first)))
+    {
+      grub_free (text);
+      return NULL;
+    }
+
+  text[size] = '\0';
+  return text;
+}
+
+static char *
+grub_lvm_cfg_strdup (const struct grub_lvm_cfg *node)
+{
+  return grub_strndup (node->str, node->len);
+}
+
+/* Read the node names of a segment from the array KEY of SECTION, taking
+   the element at POS of every group of STEP elements.  */
+static grub_err_t
+grub_lvm_read_nodes (struct grub_diskfilter_segment *seg,
+		     const struct grub_lvm_cfg *section, const char *key,
+		     unsigned pos, unsigned step, grub_uint64_t extent_size)
+{
+  struct grub_lvm_cfg *node;
+  unsigned int i, j;
+
+  node = grub_lvm_cfg_find (section, key, GRUB_LVM_CFG_ARRAY);
+  if (!node)
+    {
+#ifdef GRUB_UTIL
+      grub_util_info ("unknown %s", key);
+#endif
+      return grub_error (GRUB_ERR_BAD_FS, "unknown %s", key);
+    }
+
+  node = node->child;
+  for (j = 0; j < seg->node_count && node; j++)
+    {
+      for (i = 0; i < pos && node; i++)
+	node = node->next;
+      if (!node || node->type != GRUB_LVM_CFG_STRING)
+	break;
+
+      seg->nodes[j].name = grub_lvm_cfg_strdup (node);
+      if (!seg->nodes[j].name)
+	return grub_errno;
+
+      /* Stripes are followed by their first extent.  */
+      node = node->next;
+      if (extent_size && node && node->type == GRUB_LVM_CFG_NUMBER)
+	seg->nodes[j].start = node->num * extent_size;
+
+      for (i = pos + 1; i < step && node; i++)
+	node = node->next;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_lvm_read_segment (struct grub_diskfilter_segment *seg,
+		       const struct grub_lvm_cfg *section, int is_pvmove,
+		       grub_uint64_t extent_size, int *skip_lv)
+{
+  struct grub_lvm_cfg *type;
+  grub_uint64_t val;
+  grub_err_t err;
+  int is_raid = 0;
+
+  if (!grub_lvm_cfg_number (section, "start_extent", &seg->start_extent))
+    {
+#ifdef GRUB_UTIL
+      grub_util_info ("unknown start_extent");
+#endif
+      return grub_error (GRUB_ERR_BAD_FS, "unknown start_extent");
+    }
+  if (!grub_lvm_cfg_number (section, "extent_count", &seg->extent_count))
+    {
+#ifdef GRUB_UTIL
+      grub_util_info ("unknown extent_count");
+#endif
+      return grub_error (GRUB_ERR_BAD_FS, "unknown extent_count");
+    }
+
+  type = grub_lvm_cfg_find (section, "type", GRUB_LVM_CFG_STRING);
+  if (!type)
+    return grub_error (GRUB_ERR_BAD_FS, "unknown segment type");
+
+  if (type->len == sizeof ("striped") - 1
+      && grub_memcmp (type->str, "striped", type->len) == 0)
+    {
+      seg->type = GRUB_DISKFILTER_STRIPED;
+      if (!grub_lvm_cfg_number (section, "stripe_count", &val))
+	{
+#ifdef GRUB_UTIL
+	  grub_util_info ("unknown stripe_count");
+#endif
+	  return grub_error (GRUB_ERR_BAD_FS, "unknown stripe_count");
+	}
+      seg->node_count = val;
+      if (seg->node_count != 1 && grub_lvm_cfg_number (section, "stripe_size",
+						       &val))
+	seg->stripe_size = val;
+    }
+  else if (type->len == sizeof ("mirror") - 1
+	   && grub_memcmp (type->str, "mirror", type->len) == 0)
+    {
+      seg->type = GRUB_DISKFILTER_MIRROR;
+      if (!grub_lvm_cfg_number (section, "mirror_count", &val))
+	{
+#ifdef GRUB_UTIL
+	  grub_util_info ("unknown mirror_count");
+#endif
+	  return grub_error (GRUB_ERR_BAD_FS, "unknown mirror_count");
+	}
+      seg->node_count = val;
+    }
+  else if (type->len == sizeof ("raidX") - 1
+	   && grub_memcmp (type->str, "raid", sizeof ("raid") - 1) == 0
+	   && ((type->str[sizeof ("raid") - 1] >= '4'
+		&& type->str[sizeof ("raid") - 1] <= '6')
+	       || type->str[sizeof ("raid") - 1] == '1'))
+    {
+      is_raid = 1;
+      switch (type->str[sizeof ("raid") - 1])
+	{
+	case '1':
+	  seg->type = GRUB_DISKFILTER_MIRROR;
+	  break;
+	case '4':
+	  seg->type = GRUB_DISKFILTER_RAID4;
+	  seg->layout = GRUB_RAID_LAYOUT_LEFT_ASYMMETRIC;
+	  break;
+	case '5':
+	  seg->type = GRUB_DISKFILTER_RAID5;
+	  seg->layout = GRUB_RAID_LAYOUT_LEFT_SYMMETRIC;
+	  break;
+	case '6':
+	  seg->type = GRUB_DISKFILTER_RAID6;
+	  seg->layout = (GRUB_RAID_LAYOUT_RIGHT_ASYMMETRIC
+			 | GRUB_RAID_LAYOUT_MUL_FROM_POS);
+	  break;
+	}
+
+      if (!grub_lvm_cfg_number (section, "device_count", &val))
+	{
+#ifdef GRUB_UTIL
+	  grub_util_info ("unknown device_count");
+#endif
+	  return grub_error (GRUB_ERR_BAD_FS, "unknown device_count");
+	}
+      seg->node_count = val;
+
+      if (seg->type != GRUB_DISKFILTER_MIRROR)
+	{
+	  if (!grub_lvm_cfg_number (section, "stripe_size", &val))
+	    {
+#ifdef GRUB_UTIL
+	      grub_util_info ("unknown stripe_size");
+#endif
+	      return grub_error (GRUB_ERR_BAD_FS, "unknown stripe_size");
+	    }
+	  seg->stripe_size = val;
 	}
     }
+  else
+    {
+#ifdef GRUB_UTIL
+      char *name = grub_lvm_cfg_strdup (type);
+      grub_util_info ("unknown LVM type %s", name ? : "");
+      grub_free (name);
+#endif
+      /* Found a non-supported type, give up and move on. */
+      *skip_lv = 1;
+      return GRUB_ERR_NONE;
+    }
+
+  if (seg->node_count == 0 || seg->node_count > 0xffff)
+    return grub_error (GRUB_ERR_BAD_FS, "invalid segment");
+  seg->nodes = grub_zalloc (seg->node_count * sizeof (seg->nodes[0]));
+  if (!seg->nodes)
+    return grub_errno;
+
+  if (seg->type == GRUB_DISKFILTER_STRIPED)
+    return grub_lvm_read_nodes (seg, section, "stripes", 0, 2, extent_size);
+
+  if (!is_raid)
+    {
+      err = grub_lvm_read_nodes (seg, section, "mirrors", 0, 1, 0);
+      /* Only first (original) is ok with in progress pvmove.  */
+      if (is_pvmove)
+	seg->node_count = 1;
+      return err;
+    }
+
+  /* Pairs of metadata and data sub-LVs.  */
+  err = grub_lvm_read_nodes (seg, section, "raids", 1, 2, 0);
+  if (!err && seg->type == GRUB_DISKFILTER_RAID4)
+    {
+      char *tmp;
+      tmp = seg->nodes[0].name;
+      grub_memmove (seg->nodes, seg->nodes + 1,
+		    sizeof (seg->nodes[0]) * (seg->node_count - 1));
+      seg->nodes[seg->node_count - 1].name = tmp;
+    }
+  return err;
+}
+
+static void
+grub_lvm_free_lv (struct grub_diskfilter_lv *lv)
+{
+  unsigned int i, j;
+
+  if (lv->segments)
+    for (i = 0; i < lv->segment_count; i++)
+      if (lv->segments[i].nodes)
+	{
+	  for (j = 0; j < lv->segments[i].node_count; j++)
+	    grub_free (lv->segments[i].nodes[j].name);
+	  grub_free (lv->segments[i].nodes);
+	}
+  grub_free (lv->segments);
+  grub_free (lv->name);
+  grub_free (lv->fullname);
+  grub_free (lv->idname);
+  grub_free (lv);
+}
+
+static void
+grub_lvm_free_vg (struct grub_diskfilter_vg *vg)
+{
+  while (vg->pvs)
+    {
+      struct grub_diskfilter_pv *pv = vg->pvs;
+      vg->pvs = pv->next;
+      grub_free (pv->name);
+      grub_free (pv->id.uuid);
+      grub_free (pv);
+    }
+  while (vg->lvs)
+    {
+      struct grub_diskfilter_lv *lv = vg->lvs;
+      vg->lvs = lv->next;
+      grub_lvm_free_lv (lv);
+    }
+  grub_free (vg->uuid);
+  grub_free (vg->name);
+  grub_free (vg);
+}
+
+static struct grub_diskfilter_lv *
+grub_lvm_read_lv (struct grub_diskfilter_vg *vg,
+		  const struct grub_lvm_cfg *section)
+{
+  struct grub_diskfilter_lv *lv;
+  struct grub_lvm_cfg *id, *node;
+  grub_uint64_t segment_count;
+  grub_size_t vgname_len = grub_strlen (vg->name);
+  const char *iptr;
+  char *optr;
+  int skip_lv = 0, is_pvmove;
+  unsigned int i;
+
+  lv = grub_zalloc (sizeof (*lv));
+  if (!lv)
+    return NULL;
+
+  lv->name = grub_strndup (section->key, section->keylen);
+  if (!lv->name)
+    goto fail;
+
+  lv->fullname = grub_malloc (sizeof ("lvm/") - 1 + 2 * vgname_len
+			      + 1 + 2 * section->keylen + 1);
+  if (!lv->fullname)
+    goto fail;
+
+  grub_memcpy (lv->fullname, "lvm/", sizeof ("lvm/") - 1);
+  optr = lv->fullname + sizeof ("lvm/") - 1;
+  for (iptr = vg->name; iptr < vg->name + vgname_len; iptr++)
+    {
+      *optr++ = *iptr;
+      if (*iptr == '-')
+	*optr++ = '-';
+    }
+  *optr++ = '-';
+  for (iptr = section->key; iptr < section->key + section->keylen; iptr++)
+    {
+      *optr++ = *iptr;
+      if (*iptr == '-')
+	*optr++ = '-';
+    }
+  *optr++ = 0;
+
+  id = grub_lvm_cfg_find (section, "id", GRUB_LVM_CFG_STRING);
+  if (!id || id->len != GRUB_LVM_ID_STRLEN)
+    {
+#ifdef GRUB_UTIL
+      grub_util_info ("couldn't find ID");
+#endif
+      grub_error (GRUB_ERR_BAD_FS, "couldn't find ID");
+      goto fail;
+    }
+  lv->idname = grub_malloc (sizeof ("lvmid/") + 2 * GRUB_LVM_ID_STRLEN + 1);
+  if (!lv->idname)
+    goto fail;
+  grub_memcpy (lv->idname, "lvmid/", sizeof ("lvmid/") - 1);
+  grub_memcpy (lv->idname + sizeof ("lvmid/") - 1,
+	       vg->uuid, GRUB_LVM_ID_STRLEN);
+  lv->idname[sizeof ("lvmid/") - 1 + GRUB_LVM_ID_STRLEN] = '/';
+  grub_memcpy (lv->idname + sizeof ("lvmid/") - 1 + GRUB_LVM_ID_STRLEN + 1,
+	       id->str, GRUB_LVM_ID_STRLEN);
+  lv->idname[sizeof ("lvmid/") - 1 + 2 * GRUB_LVM_ID_STRLEN + 1] = '\0';
+
+  lv->visible = grub_lvm_check_flag (section, "status", "VISIBLE");
+  is_pvmove = grub_lvm_check_flag (section, "status", "PVMOVE");
+
+  if (!grub_lvm_cfg_number (section, "segment_count", &segment_count))
+    {
+#ifdef GRUB_UTIL
+      grub_util_info ("unknown segment_count");
+#endif
+      grub_error (GRUB_ERR_BAD_FS, "unknown segment_count");
+      goto fail;
+    }
+  if (segment_count > GRUB_SIZE_MAX / sizeof (lv->segments[0]))
+    {
+      grub_error (GRUB_ERR_BAD_FS, "invalid segment_count");
+      goto fail;
+    }
+  lv->segments = grub_zalloc (segment_count * sizeof (lv->segments[0]));
+  if (!lv->segments)
+    goto fail;
+
+  /* The segments are the subsections, in order.  */
+  node = section->child;
+  for (i = 0; i < segment_count; i++)
+    {
+      while (node && (node->type != GRUB_LVM_CFG_SECTION
+		      || node->keylen < sizeof ("segment") - 1
+		      || grub_memcmp (node->key, "segment",
+				      sizeof ("segment") - 1) != 0))
+	node = node->next;
+      if (!node)
+	{
+#ifdef GRUB_UTIL
+	  grub_util_info ("unknown segment");
+#endif
+	  grub_error (GRUB_ERR_BAD_FS, "unknown segment");
+	  goto fail;
+	}
+
+      lv->segment_count = i + 1;
+      if (grub_lvm_read_segment (&lv->segments[i], node, is_pvmove,
+				 vg->extent_size, &skip_lv))
+	goto fail;
+      if (skip_lv)
+	break;
+      lv->size += lv->segments[i].extent_count * vg->extent_size;
+      node = node->next;
+    }
+
+  if (skip_lv)
+    {
+      grub_lvm_free_lv (lv);
+      return NULL;
+    }
+
+  lv->vg = vg;
+  return lv;
+
+ fail:
+  grub_lvm_free_lv (lv);
+  if (!grub_errno)
+    grub_error (GRUB_ERR_BAD_FS, "invalid LVM metadata");
+  return NULL;
+}
+
+/* Hash table entry used to resolve segment node names.  */
+struct grub_lvm_name
+{
+  const char *name;
+  struct grub_diskfilter_pv *pv;
+  struct grub_diskfilter_lv *lv;
+};
+
+static struct grub_lvm_name *
+grub_lvm_name_slot (struct grub_lvm_name *table, grub_size_t mask,
+		    const char *name)
+{
+  grub_uint32_t hash = 2166136261U;
+  const char *p;
+  grub_size_t i;
+
+  for (p = name; *p; p++)
+    hash = (hash ^ (grub_uint8_t) *p) * 16777619;
+
+  for (i = hash & mask; table[i].name; i = (i + 1) & mask)
+    if (grub_strcmp (table[i].name, name) == 0)
+      break;
+  return &table[i];
+}
+
+/* Point the segment nodes at the PVs and LVs they name.  */
+static grub_err_t
+grub_lvm_match_nodes (struct grub_diskfilter_vg *vg)
+{
+  struct grub_diskfilter_pv *pv;
+  struct grub_diskfilter_lv *lv;
+  struct grub_lvm_name *table, *slot;
+  grub_size_t size = 16;
+  unsigned int i, j;
+
+  for (pv = vg->pvs; pv; pv = pv->next)
+    size++;
+  for (lv = vg->lvs; lv; lv = lv->next)
+    size++;
+  while (size & (size - 1))
+    size &= size - 1;
+  size <<= 2;
+
+  table = grub_zalloc (size * sizeof (table[0]));
+  if (!table)
+    return grub_errno;
+
+  for (pv = vg->pvs; pv; pv = pv->next)
+    {
+      slot = grub_lvm_name_slot (table, size - 1, pv->name);
+      slot->name = pv->name;
+      if (!slot->pv)
+	slot->pv = pv;
+    }
+  for (lv = vg->lvs; lv; lv = lv->next)
+    {
+      slot = grub_lvm_name_slot (table, size - 1, lv->name);
+      slot->name = lv->name;
+      slot->lv = lv;
+    }
+
+  for (lv = vg->lvs; lv; lv = lv->next)
+    for (i = 0; i < lv->segment_count; i++)
+      for (j = 0; j < lv->segments[i].node_count; j++)
+	{
+	  struct grub_diskfilter_node *node = &lv->segments[i].nodes[j];
+
+	  if (!node->name)
+	    continue;
+	  slot = grub_lvm_name_slot (table, size - 1, node->name);
+	  if (slot->pv)
+	    node->pv = slot->pv;
+	  else
+	    node->lv = slot->lv;
+	}
+
+  grub_free (table);
+  return GRUB_ERR_NONE;
+}
+
+/* Build a VG from the parsed metadata ROOT.  */
+static struct grub_diskfilter_vg *
+grub_lvm_read_vg (const struct grub_lvm_cfg *root)
+{
+  struct grub_diskfilter_vg *vg;
+  struct grub_lvm_cfg *vgsec, *id, *sec, *node;
+
+  for (vgsec = root->child; vgsec; vgsec = vgsec->next)
+    if (vgsec->type == GRUB_LVM_CFG_SECTION)
+      break;
+  if (!vgsec)
+    {
+      grub_error (GRUB_ERR_BAD_FS, "error parsing metadata");
+      return NULL;
+    }
+
+  id = grub_lvm_cfg_find (vgsec, "id", GRUB_LVM_CFG_STRING);
+  if (!id || id->len != GRUB_LVM_ID_STRLEN)
+    {
+#ifdef GRUB_UTIL
+      grub_util_info ("couldn't find ID");
+#endif
+      grub_error (GRUB_ERR_BAD_FS, "couldn't find ID");
+      return NULL;
+    }
+
+  vg = grub_zalloc (sizeof (*vg));
+  if (!vg)
+    return NULL;
+  vg->name = grub_strndup (vgsec->key, vgsec->keylen);
+  vg->uuid = grub_malloc (GRUB_LVM_ID_STRLEN);
+  if (!vg->name || !vg->uuid)
+    goto fail;
+  grub_memcpy (vg->uuid, id->str, GRUB_LVM_ID_STRLEN);
+  vg->uuid_len = GRUB_LVM_ID_STRLEN;
+
+  if (!grub_lvm_cfg_number (vgsec, "extent_size", &vg->extent_size))
+    {
+#ifdef GRUB_UTIL
+      grub_util_info ("unknown extent size");
+#endif
+      grub_error (GRUB_ERR_BAD_FS, "unknown extent size");
+      goto fail;
+    }
+
+  sec = grub_lvm_cfg_find (vgsec, "physical_volumes", GRUB_LVM_CFG_SECTION);
+  for (node = sec ? sec->child : NULL; node; node = node->next)
+    {
+      struct grub_diskfilter_pv *pv;
+      struct grub_lvm_cfg *pvid;
+
+      if (node->type != GRUB_LVM_CFG_SECTION)
+	continue;
+
+      pvid = grub_lvm_cfg_find (node, "id", GRUB_LVM_CFG_STRING);
+      if (!pvid || pvid->len != GRUB_LVM_ID_STRLEN)
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "couldn't find PV ID");
+	  goto fail;
+	}
+
+      pv = grub_zalloc (sizeof (*pv));
+      if (!pv)
+	goto fail;
+      pv->next = vg->pvs;
+      vg->pvs = pv;
+
+      pv->name = grub_strndup (node->key, node->keylen);
+      pv->id.uuid = grub_malloc (GRUB_LVM_ID_STRLEN);
+      if (!pv->name || !pv->id.uuid)
+	goto fail;
+      grub_memcpy (pv->id.uuid, pvid->str, GRUB_LVM_ID_STRLEN);
+      pv->id.uuidlen = GRUB_LVM_ID_STRLEN;
+
+      if (!grub_lvm_cfg_number (node, "pe_start", &pv->start_sector))
+	{
+#ifdef GRUB_UTIL
+	  grub_util_info ("unknown pe_start");
+#endif
+	  grub_error (GRUB_ERR_BAD_FS, "unknown pe_start");
+	  goto fail;
+	}
+    }
+
+  sec = grub_lvm_cfg_find (vgsec, "logical_volumes", GRUB_LVM_CFG_SECTION);
+  for (node = sec ? sec->child : NULL; node; node = node->next)
+    {
+      struct grub_diskfilter_lv *lv;
+
+      if (node->type != GRUB_LVM_CFG_SECTION)
+	continue;
+
+      lv = grub_lvm_read_lv (vg, node);
+      if (!lv)
+	{
+	  if (grub_errno)
+	    goto fail;
+	  continue;
+	}
+      lv->next = vg->lvs;
+      vg->lvs = lv;
+    }
+
+  if (grub_lvm_match_nodes (vg))
+    goto fail;
+
+  return vg;
+
+ fail:
+  grub_lvm_free_vg (vg);
+  return NULL;
 }
 
 static struct grub_diskfilter_vg * 
@@ -101,20 +985,21 @@ grub_lvm_detect (grub_disk_t disk,
 		 grub_disk_addr_t *start_sector)
 {
   grub_err_t err;
-  grub_uint64_t mda_offset, mda_size;
+  grub_uint64_t mda_offset, mda_size, text_offset, text_size;
   char buf[GRUB_LVM_LABEL_SIZE];
+  char hdr[GRUB_LVM_MDA_HEADER_SIZE];
   char vg_id[GRUB_LVM_ID_STRLEN+1];
   char pv_id[GRUB_LVM_ID_STRLEN+1];
-  char *metadatabuf, *p, *q, *vgname;
+  char *text;
+  const char *vgname, *idp;
+  grub_size_t vgname_len, len;
   struct grub_lvm_label_header *lh = (struct grub_lvm_label_header *) buf;
   struct grub_lvm_pv_header *pvh;
   struct grub_lvm_disk_locn *dlocn;
   struct grub_lvm_mda_header *mdah;
   struct grub_lvm_raw_locn *rlocn;
   unsigned int i, j;
-  grub_size_t vgname_len;
   struct grub_diskfilter_vg *vg;
-  struct grub_diskfilter_pv *pv;
 
   /* Search for label. */
   for (i = 0; i < GRUB_LVM_LABEL_SCAN_SECTORS; i++)
@@ -170,18 +1055,13 @@ grub_lvm_detect (grub_disk_t disk,
   mda_size = grub_le_to_cpu64 (dlocn->size);
 
   /* It's possible to have multiple copies of metadata areas, we just use the
-     first one.  */
-
-  /* Allocate buffer space for the circular worst-case scenario. */
-  metadatabuf = grub_malloc (2 * mda_size);
-  if (! metadatabuf)
-    goto fail;
-
-  err = grub_disk_read (disk, 0, mda_offset, mda_size, metadatabuf);
+     first one.  Only its header and the metadata text are read, not the
+     whole area.  */
+  err = grub_disk_read (disk, 0, mda_offset, sizeof (hdr), hdr);
   if (err)
-    goto fail2;
+    goto fail;
 
-  mdah = (struct grub_lvm_mda_header *) metadatabuf;
+  mdah = (struct grub_lvm_mda_header *) hdr;
   if ((grub_strncmp ((char *)mdah->magic, GRUB_LVM_FMTT_MAGIC,
 		     sizeof (mdah->magic)))
       || (grub_le_to_cpu32 (mdah->version) != GRUB_LVM_FMTT_VERSION))
@@ -191,592 +1071,123 @@ grub_lvm_detect (grub_disk_t disk,
 #ifdef GRUB_UTIL
       grub_util_info ("unknown LVM metadata header");
 #endif
-      goto fail2;
+      goto fail;
     }
 
   rlocn = mdah->raw_locns;
-  if (grub_le_to_cpu64 (rlocn->offset) + grub_le_to_cpu64 (rlocn->size) >
-      grub_le_to_cpu64 (mdah->size))
-    {
-      /* Metadata is circular. Copy the wrap in place. */
-      grub_memcpy (metadatabuf + mda_size,
-		   metadatabuf + GRUB_LVM_MDA_HEADER_SIZE,
-		   grub_le_to_cpu64 (rlocn->offset) +
-		   grub_le_to_cpu64 (rlocn->size) -
-		   grub_le_to_cpu64 (mdah->size));
-    }
-  p = q = metadatabuf + grub_le_to_cpu64 (rlocn->offset);
-
-  while (*q != ' ' && q < metadatabuf + mda_size)
-    q++;
-
-  if (q == metadatabuf + mda_size)
+  if (grub_le_to_cpu64 (mdah->size) < mda_size)
+    mda_size = grub_le_to_cpu64 (mdah->size);
+  text_offset = grub_le_to_cpu64 (rlocn->offset);
+  text_size = grub_le_to_cpu64 (rlocn->size);
+  if (text_offset < GRUB_LVM_MDA_HEADER_SIZE || text_offset >= mda_size
+      || text_size > mda_size - GRUB_LVM_MDA_HEADER_SIZE)
     {
 #ifdef GRUB_UTIL
       grub_util_info ("error parsing metadata");
 #endif
-      goto fail2;
+      grub_error (GRUB_ERR_BAD_FS, "error parsing metadata");
+      goto fail;
     }
 
-  vgname_len = q - p;
-  vgname = grub_malloc (vgname_len + 1);
-  if (!vgname)
-    goto fail2;
-
-  grub_memcpy (vgname, p, vgname_len);
-  vgname[vgname_len] = '\0';
+  /* Usually the VG is known already and the start of the text is enough
+     to tell.  */
+  len = text_size < GRUB_LVM_TEXT_PREFIX ? text_size : GRUB_LVM_TEXT_PREFIX;
+  text = grub_lvm_read_text (disk, mda_offset, mda_size, text_offset, len);
+  if (!text)
+    goto fail;
+  if (!grub_lvm_find_vg_id (text, len, &vgname, &vgname_len, &idp)
+      && len < text_size)
+    {
+      grub_free (text);
+      len = text_size;
+      text = grub_lvm_read_text (disk, mda_offset, mda_size, text_offset, len);
+      if (!text)
+	goto fail;
+      if (!grub_lvm_find_vg_id (text, len, &vgname, &vgname_len, &idp))
+	idp = NULL;
+    }
+  else if (len == text_size
+	   && !grub_lvm_find_vg_id (text, len, &vgname, &vgname_len, &idp))
+    idp = NULL;
 
-  p = grub_strstr (q, "id = \"");
-  if (p == NULL)
+  if (!idp)
     {
 #ifdef GRUB_UTIL
       grub_util_info ("couldn't find ID");
 #endif
-      goto fail3;
+      grub_error (GRUB_ERR_BAD_FS, "couldn't find ID");
+      goto fail2;
     }
-  p += sizeof ("id = \"") - 1;
-  grub_memcpy (vg_id, p, GRUB_LVM_ID_STRLEN);
+  grub_memcpy (vg_id, idp, GRUB_LVM_ID_STRLEN);
   vg_id[GRUB_LVM_ID_STRLEN] = '\0';
 
   vg = grub_diskfilter_get_vg_by_uuid (GRUB_LVM_ID_STRLEN, vg_id);
 
   if (! vg)
     {
+      struct grub_lvm_parser ps = { 0 };
+      struct grub_lvm_cfg root = { 0 };
+
       /* First time we see this volume group. We've to create the
 	 whole volume group structure. */
-      vg = grub_malloc (sizeof (*vg));
-      if (! vg)
-	goto fail3;
-      vg->name = vgname;
-      vg->uuid = grub_malloc (GRUB_LVM_ID_STRLEN);
-      if (! vg->uuid)
-	goto fail3;
-      grub_memcpy (vg->uuid, vg_id, GRUB_LVM_ID_STRLEN);
-      vg->uuid_len = GRUB_LVM_ID_STRLEN;
-
-      vg->extent_size = grub_lvm_getvalue (&p, "extent_size = ");
-      if (p == NULL)
+      if (len < text_size)
 	{
-#ifdef GRUB_UTIL
-	  grub_util_info ("unknown extent size");
-#endif
-	  goto fail4;
+	  grub_free (text);
+	  len = text_size;
+	  text = grub_lvm_read_text (disk, mda_offset, mda_size, text_offset,
+				     len);
+	  if (!text)
+	    goto fail;
 	}
 
-      vg->lvs = NULL;
-      vg->pvs = NULL;
-
-      p = grub_strstr (p, "physical_volumes {");
-      if (p)
+      /* LVM counts the terminating NUL in the size of the text; parse
+	 only up to it.  */
+      ps.p = text;
+      ps.end = grub_memchr (text, '\0', len);
+      if (!ps.end)
+	ps.end = text + len;
+      root.type = GRUB_LVM_CFG_SECTION;
+      root.child = grub_lvm_parse_section (&ps, 1);
+      if (ps.error)
 	{
-	  p += sizeof ("physical_volumes {") - 1;
-
-	  /* Add all the pvs to the volume group. */
-	  while (1)
-	    {
-	      grub_ssize_t s;
-	      while (grub_isspace (*p))
-		p++;
-
-	      if (*p == '}')
-		break;
-
-	      pv = grub_zalloc (sizeof (*pv));
-	      q = p;
-	      while (*q != ' ')
-		q++;
-
-	      s = q - p;
-	      pv->name = grub_malloc (s + 1);
-	      grub_memcpy (pv->name, p, s);
-	      pv->name[s] = '\0';
-
-	      p = grub_strstr (p, "id = \"");
-	      if (p == NULL)
-		goto pvs_fail;
-	      p += sizeof("id = \"") - 1;
-
-	      pv->id.uuid = grub_malloc (GRUB_LVM_ID_STRLEN);
-	      if (!pv->id.uuid)
-		goto pvs_fail;
-	      grub_memcpy (pv->id.uuid, p, GRUB_LVM_ID_STRLEN);
-	      pv->id.uuidlen = GRUB_LVM_ID_STRLEN;
-
-	      pv->start_sector = grub_lvm_getvalue (&p, "pe_start = ");
-	      if (p == NULL)
-		{
+	  grub_lvm_cfg_free (&ps);
 #ifdef GRUB_UTIL
-		  grub_util_info ("unknown pe_start");
+	  grub_util_info ("error parsing metadata");
 #endif
-		  goto pvs_fail;
-		}
-
-	      p = grub_strchr (p, '}');
-	      if (p == NULL)
-		{
-#ifdef GRUB_UTIL
-		  grub_util_info ("error parsing pe_start");
-#endif
-		  goto pvs_fail;
-		}
-	      p++;
-
-	      pv->disk = NULL;
-	      pv->next = vg->pvs;
-	      vg->pvs = pv;
-
-	      continue;
-	    pvs_fail:
-	      grub_free (pv->name);
-	      grub_free (pv);
-	      goto fail4;
-	    }
+	  if (!grub_errno)
+	    grub_error (GRUB_ERR_BAD_FS, "error parsing metadata");
+	  goto fail2;
 	}
 
-      p = grub_strstr (p, "logical_volumes {");
-      if (p)
-	{
-	  p += sizeof ("logical_volumes {") - 1;
+      vg = grub_lvm_read_vg (&root);
+      grub_lvm_cfg_free (&ps);
+      if (!vg)
+	goto fail2;
 
-	  /* And add all the lvs to the volume group. */
-	  while (1)
-	    {
-	      grub_ssize_t s;
-	      int skip_lv = 0;
-	      struct grub_diskfilter_lv *lv;
-	      struct grub_diskfilter_segment *seg;
-	      int is_pvmove;
-
-	      while (grub_isspace (*p))
-		p++;
-
-	      if (*p == '}')
-		break;
-
-	      lv = grub_zalloc (sizeof (*lv));
-
-	      q = p;
-	      while (*q != ' ')
-		q++;
-
-	      s = q - p;
-	      lv->name = grub_strndup (p, s);
-	      if (!lv->name)
-		goto lvs_fail;
-
-	      {
-		const char *iptr;
-		char *optr;
-		lv->fullname = grub_malloc (sizeof ("lvm/") - 1 + 2 * vgname_len
-					    + 1 + 2 * s + 1);
-		if (!lv->fullname)
-		  goto lvs_fail;
-
-		grub_memcpy (lv->fullname, "lvm/", sizeof ("lvm/") - 1);
-		optr = lv->fullname + sizeof ("lvm/") - 1;
-		for (iptr = vgname; iptr < vgname + vgname_len; iptr++)
-		  {
-		    *optr++ = *iptr;
-		    if (*iptr == '-')
-		      *optr++ = '-';
-		  }
-		*optr++ = '-';
-		for (iptr = p; iptr < p + s; iptr++)
-		  {
-		    *optr++ = *iptr;
-		    if (*iptr == '-')
-		      *optr++ = '-';
-		  }
-		*optr++ = 0;
-		lv->idname = grub_malloc (sizeof ("lvmid/")
-					  + 2 * GRUB_LVM_ID_STRLEN + 1);
-		if (!lv->idname)
-		  goto lvs_fail;
-		grub_memcpy (lv->idname, "lvmid/",
-			     sizeof ("lvmid/") - 1);
-		grub_memcpy (lv->idname + sizeof ("lvmid/") - 1,
-			     vg_id, GRUB_LVM_ID_STRLEN);
-		lv->idname[sizeof ("lvmid/") - 1 + GRUB_LVM_ID_STRLEN] = '/';
-
-		p = grub_strstr (q, "id = \"");
-		if (p == NULL)
-		  {
-#ifdef GRUB_UTIL
-		    grub_util_info ("couldn't find ID");
-#endif
-		    goto lvs_fail;
-		  }
-		p += sizeof ("id = \"") - 1;
-		grub_memcpy (lv->idname + sizeof ("lvmid/") - 1
-			     + GRUB_LVM_ID_STRLEN + 1,
-			     p, GRUB_LVM_ID_STRLEN);
-		lv->idname[sizeof ("lvmid/") - 1 + 2 * GRUB_LVM_ID_STRLEN + 1] = '\0';
-	      }
-
-	      lv->size = 0;
-
-	      lv->visible = grub_lvm_check_flag (p, "status", "VISIBLE");
-	      is_pvmove = grub_lvm_check_flag (p, "status", "PVMOVE");
-
-	      lv->segment_count = grub_lvm_getvalue (&p, "segment_count = ");
-	      if (p == NULL)
-		{
-#ifdef GRUB_UTIL
-		  grub_util_info ("unknown segment_count");
-#endif
-		  goto lvs_fail;
-		}
-	      lv->segments = grub_zalloc (sizeof (*seg) * lv->segment_count);
-	      seg = lv->segments;
-
-	      for (i = 0; i < lv->segment_count; i++)
-		{
-
-		  p = grub_strstr (p, "segment");
-		  if (p == NULL)
-		    {
-#ifdef GRUB_UTIL
-		      grub_util_info ("unknown segment");
-#endif
-		      goto lvs_segment_fail;
-		    }
-
-		  seg->start_extent = grub_lvm_getvalue (&p, "start_extent = ");
-		  if (p == NULL)
-		    {
-#ifdef GRUB_UTIL
-		      grub_util_info ("unknown start_extent");
-#endif
-		      goto lvs_segment_fail;
-		    }
-		  seg->extent_count = grub_lvm_getvalue (&p, "extent_count = ");
-		  if (p == NULL)
-		    {
-#ifdef GRUB_UTIL
-		      grub_util_info ("unknown extent_count");
-#endif
-		      goto lvs_segment_fail;
-		    }
-
-		  p = grub_strstr (p, "type = \"");
-		  if (p == NULL)
-		    goto lvs_segment_fail;
-		  p += sizeof("type = \"") - 1;
-
-		  lv->size += seg->extent_count * vg->extent_size;
-
-		  if (grub_memcmp (p, "striped\"",
-				   sizeof ("striped\"") - 1) == 0)
-		    {
-		      struct grub_diskfilter_node *stripe;
-
-		      seg->type = GRUB_DISKFILTER_STRIPED;
-		      seg->node_count = grub_lvm_getvalue (&p, "stripe_count = ");
-		      if (p == NULL)
-			{
-#ifdef GRUB_UTIL
-			  grub_util_info ("unknown stripe_count");
-#endif
-			  goto lvs_segment_fail;
-			}
-
-		      if (seg->node_count != 1)
-			seg->stripe_size = grub_lvm_getvalue (&p, "stripe_size = ");
-
-		      seg->nodes = grub_zalloc (sizeof (*stripe)
-						* seg->node_count);
-		      stripe = seg->nodes;
-
-		      p = grub_strstr (p, "stripes = [");
-		      if (p == NULL)
-			{
-#ifdef GRUB_UTIL
-			  grub_util_info ("unknown stripes");
-#endif
-			  goto lvs_segment_fail2;
-			}
-		      p += sizeof("stripes = [") - 1;
-
-		      for (j = 0; j < seg->node_count; j++)
-			{
-			  p = grub_strchr (p, '"');
-			  if (p == NULL)
-			    continue;
-			  q = ++p;
-			  while (*q != '"')
-			    q++;
-
-			  s = q - p;
-
-			  stripe->name = grub_malloc (s + 1);
-			  if (stripe->name == NULL)
-			    goto lvs_segment_fail2;
-
-			  grub_memcpy (stripe->name, p, s);
-			  stripe->name[s] = '\0';
-
-			  p = q + 1;
-
-			  stripe->start = grub_lvm_getvalue (&p, ",")
-			    * vg->extent_size;
-			  if (p == NULL)
-			    continue;
-
-			  stripe++;
-			}
-		    }
-		  else if (grub_memcmp (p, "mirror\"", sizeof ("mirror\"") - 1)
-			   == 0)
-		    {
-		      seg->type = GRUB_DISKFILTER_MIRROR;
-		      seg->node_count = grub_lvm_getvalue (&p, "mirror_count = ");
-		      if (p == NULL)
-			{
-#ifdef GRUB_UTIL
-			  grub_util_info ("unknown mirror_count");
-#endif
-			  goto lvs_segment_fail;
-			}
-
-		      seg->nodes = grub_zalloc (sizeof (seg->nodes[0])
-						* seg->node_count);
-
-		      p = grub_strstr (p, "mirrors = [");
-		      if (p == NULL)
-			{
-#ifdef GRUB_UTIL
-			  grub_util_info ("unknown mirrors");
-#endif
-			  goto lvs_segment_fail2;
-			}
-		      p += sizeof("mirrors = [") - 1;
-
-		      for (j = 0; j < seg->node_count; j++)
-			{
-			  char *lvname;
-
-			  p = grub_strchr (p, '"');
-			  if (p == NULL)
-			    continue;
-			  q = ++p;
-			  while (*q != '"')
-			    q++;
-
-			  s = q - p;
-
-			  lvname = grub_malloc (s + 1);
-			  if (lvname == NULL)
-			    goto lvs_segment_fail2;
-
-			  grub_memcpy (lvname, p, s);
-			  lvname[s] = '\0';
-			  seg->nodes[j].name = lvname;
-			  p = q + 1;
-			}
-		      /* Only first (original) is ok with in progress pvmove.  */
-		      if (is_pvmove)
-			seg->node_count = 1;
-		    }
-		  else if (grub_memcmp (p, "raid", sizeof ("raid") - 1) == 0
-			   && ((p[sizeof ("raid") - 1] >= '4'
-				&& p[sizeof ("raid") - 1] <= '6')
-			       || p[sizeof ("raid") - 1] == '1')
-			   && p[sizeof ("raidX") - 1] == '"')
-		    {
-		      switch (p[sizeof ("raid") - 1])
-			{
-			case '1':
-			  seg->type = GRUB_DISKFILTER_MIRROR;
-			  break;
-			case '4':
-			  seg->type = GRUB_DISKFILTER_RAID4;
-			  seg->layout = GRUB_RAID_LAYOUT_LEFT_ASYMMETRIC;
-			  break;
-			case '5':
-			  seg->type = GRUB_DISKFILTER_RAID5;
-			  seg->layout = GRUB_RAID_LAYOUT_LEFT_SYMMETRIC;
-			  break;
-			case '6':
-			  seg->type = GRUB_DISKFILTER_RAID6;
-			  seg->layout = (GRUB_RAID_LAYOUT_RIGHT_ASYMMETRIC
-					 | GRUB_RAID_LAYOUT_MUL_FROM_POS);
-			  break;
-			}
-		      seg->node_count = grub_lvm_getvalue (&p, "device_count = ");
-
-		      if (p == NULL)
-			{
-#ifdef GRUB_UTIL
-			  grub_util_info ("unknown device_count");
-#endif
-			  goto lvs_segment_fail;
-			}
-
-		      if (seg->type != GRUB_DISKFILTER_MIRROR)
-			{
-			  seg->stripe_size = grub_lvm_getvalue (&p, "stripe_size = ");
-			  if (p == NULL)
-			    {
-#ifdef GRUB_UTIL
-			      grub_util_info ("unknown stripe_size");
-#endif
-			      goto lvs_segment_fail;
-			    }
-			}
-
-		      seg->nodes = grub_zalloc (sizeof (seg->nodes[0])
-						* seg->node_count);
-
-		      p = grub_strstr (p, "raids = [");
-		      if (p == NULL)
-			{
-#ifdef GRUB_UTIL
-			  grub_util_info ("unknown raids");
-#endif
-			  goto lvs_segment_fail2;
-			}
-		      p += sizeof("raids = [") - 1;
-
-		      for (j = 0; j < seg->node_count; j++)
-			{
-			  char *lvname;
-
-			  p = grub_strchr (p, '"');
-			  p = p ? grub_strchr (p + 1, '"') : 0;
-			  p = p ? grub_strchr (p + 1, '"') : 0;
-			  if (p == NULL)
-			    continue;
-			  q = ++p;
-			  while (*q != '"')
-			    q++;
-
-			  s = q - p;
-
-			  lvname = grub_malloc (s + 1);
-			  if (lvname == NULL)
-			    goto lvs_segment_fail2;
-
-			  grub_memcpy (lvname, p, s);
-			  lvname[s] = '\0';
-			  seg->nodes[j].name = lvname;
-			  p = q + 1;
-			}
-		      if (seg->type == GRUB_DISKFILTER_RAID4)
-			{
-			  char *tmp;
-			  tmp = seg->nodes[0].name;
-			  grub_memmove (seg->nodes, seg->nodes + 1,
-					sizeof (seg->nodes[0])
-					* (seg->node_count - 1));
-			  seg->nodes[seg->node_count - 1].name = tmp;
-			}
-		    }
-		  else
-		    {
-#ifdef GRUB_UTIL
-		      char *p2;
-		      p2 = grub_strchr (p, '"');
-		      if (p2)
-			*p2 = 0;
-		      grub_util_info ("unknown LVM type %s", p);
-		      if (p2)
-			*p2 ='"';
-#endif
-		      /* Found a non-supported type, give up and move on. */
-		      skip_lv = 1;
-		      break;
-		    }
-
-		  seg++;
-
-		  continue;
-		lvs_segment_fail2:
-		  grub_free (seg->nodes);
-		lvs_segment_fail:
-		  goto fail4;
-		}
-
-	      if (p != NULL)
-		p = grub_strchr (p, '}');
-	      if (p == NULL)
-		goto lvs_fail;
-	      p += 3;
-
-	      if (skip_lv)
-		{
-		  grub_free (lv->name);
-		  grub_free (lv);
-		  continue;
-		}
-
-	      lv->vg = vg;
-	      lv->next = vg->lvs;
-	      vg->lvs = lv;
-
-	      continue;
-	    lvs_fail:
-	      grub_free (lv->name);
-	      grub_free (lv);
-	      goto fail4;
-	    }
-	}
-
-      /* Match lvs.  */
-      {
-	struct grub_diskfilter_lv *lv1;
-	struct grub_diskfilter_lv *lv2;
-	for (lv1 = vg->lvs; lv1; lv1 = lv1->next)
-	  for (i = 0; i < lv1->segment_count; i++)
-	    for (j = 0; j < lv1->segments[i].node_count; j++)
-	      {
-		if (vg->pvs)
-		  for (pv = vg->pvs; pv; pv = pv->next)
-		    {
-		      if (! grub_strcmp (pv->name,
-					 lv1->segments[i].nodes[j].name))
-			{
-			  lv1->segments[i].nodes[j].pv = pv;
-			  break;
-			}
-		    }
-		if (lv1->segments[i].nodes[j].pv == NULL)
-		  for (lv2 = vg->lvs; lv2; lv2 = lv2->next)
-		    if (grub_strcmp (lv2->name,
-				     lv1->segments[i].nodes[j].name) == 0)
-		      lv1->segments[i].nodes[j].lv = lv2;
-	      }
-	
-      }
       if (grub_diskfilter_vg_register (vg))
-	goto fail4;
-    }
-  else
-    {
-      grub_free (vgname);
+	{
+	  grub_lvm_free_vg (vg);
+	  goto fail2;
+	}
     }
 
   id->uuid = grub_malloc (GRUB_LVM_ID_STRLEN);
   if (!id->uuid)
-    goto fail4;
+    goto fail2;
   grub_memcpy (id->uuid, pv_id, GRUB_LVM_ID_STRLEN);
   id->uuidlen = GRUB_LVM_ID_STRLEN;
-  grub_free (metadatabuf);
+  grub_free (text);
   *start_sector = -1;
   return vg;
 
   /* Failure path.  */
- fail4:
-  grub_free (vg);
- fail3:
-  grub_free (vgname);
-
  fail2:
-  grub_free (metadatabuf);
+  grub_free (text);
  fail:
   return NULL;
 }
 
-
+
 
 static struct grub_diskfilter grub_lvm_dev = {
   .name = "lvm",
@@ -32,15 +32,13 @@ grub_raid5_recover (struct grub_diskfilter_segment *array, int disknr,
                     char *buf, grub_disk_addr_t sector, grub_size_t size)
 {
   char *buf2;
-  int i;
+  int i, first = 1;
 
   size <<= GRUB_DISK_SECTOR_BITS;
   buf2 = grub_malloc (size);
   if (!buf2)
     return grub_errno;
 
-  grub_memset (buf, 0, size);
-
   for (i = 0; i < (int) array->node_count; i++)
     {
       grub_err_t err;
@@ -48,8 +46,11 @@ grub_raid5_recover (struct grub_diskfilter_segment *array, int disknr,
       if (i == disknr)
         continue;
 
+      /* The first surviving member goes straight to BUF, the others are
+	 xored into it.  */
       err = grub_diskfilter_read_node (&array->nodes[i], sector,
-				       size >> GRUB_DISK_SECTOR_BITS, buf2);
+				       size >> GRUB_DISK_SECTOR_BITS,
+				       first ? buf : buf2);
 
       if (err)
         {
@@ -57,9 +58,13 @@ grub_raid5_recover (struct grub_diskfilter_segment *array, int disknr,
           return err;
         }
 
-      grub_crypto_xor (buf, buf, buf2, size);
+      if (!first)
+	grub_crypto_xor (buf, buf, buf2, size);
+      first = 0;
     }
 
+  if (first)
+    grub_memset (buf, 0, size);
   grub_free (buf2);
 
   return GRUB_ERR_NONE;
@@ -24,6 +24,9 @@
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
 #include <grub/crypto.h>
+#if defined (__x86_64__)
+#include <grub/i386/cpuid.h>
+#endif
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -33,16 +36,233 @@ static grub_uint8_t powx[255 * 2];
 static unsigned powx_inv[256];
 static const grub_uint8_t poly = 0x1d;
 
+/* Multiplication by a constant is done through two 16 entry tables, the
+   products with the low and with the high nibble of each byte.  The
+   kernels below store x**mul * SRC, or xor it into DST if ACCUMULATE is
+   set.  The vector kernels handle whole multiples of their width only
+   and return the number of bytes they did.  */
+typedef grub_size_t (*raid6_kernel_t) (grub_uint8_t *dst,
+				       const grub_uint8_t *src,
+				       const grub_uint8_t *tables,
+				       grub_size_t size, int accumulate);
+
+/* Portable fallback through the full 256 entry product table, which is
+   cheap to build from the nibble tables for the sizes recovered here.
+   A single lookup per byte beats both the log/exp table pair and
+   multiplying whole words by shifting and adding.  */
 static void
-grub_raid_block_mulx (unsigned mul, char *buf, grub_size_t size)
+raid6_mul_table (grub_uint8_t *dst, const grub_uint8_t *src,
+		 const grub_uint8_t *tables, grub_size_t size, int accumulate)
 {
+  grub_uint8_t table[256];
   grub_size_t i;
-  grub_uint8_t *p;
+  unsigned j;
+
+  for (j = 0; j < 256; j++)
+    table[j] = tables[j & 0xf] ^ tables[16 + (j >> 4)];
+
+  if (accumulate)
+    for (i = 0; i < size; i++)
+      dst[i] ^= table[src[i]];
+  else
+    for (i = 0; i < size; i++)
+      dst[i] = table[src[i]];
+}
+
+/* Only SIMD registers that the firmware calling conventions treat as
+   scratch are used, as the rest of GRUB neither uses nor saves them.  */
+
+#if defined (__x86_64__)
+
+#define RAID6_SSSE3_LOOP(acc)						\
+  "1:\n\t"								\
+  "movdqu (%[src]), %%xmm0\n\t"						\
+  "movdqa %%xmm0, %%xmm1\n\t"						\
+  "psrlw $4, %%xmm1\n\t"						\
+  "pand %%xmm3, %%xmm0\n\t"						\
+  "pand %%xmm3, %%xmm1\n\t"						\
+  "movdqa %%xmm4, %%xmm2\n\t"						\
+  "pshufb %%xmm0, %%xmm2\n\t"						\
+  "movdqa %%xmm5, %%xmm0\n\t"						\
+  "pshufb %%xmm1, %%xmm0\n\t"						\
+  "pxor %%xmm2, %%xmm0\n\t"						\
+  acc									\
+  "movdqu %%xmm0, (%[dst])\n\t"						\
+  "addq $16, %[src]\n\t"						\
+  "addq $16, %[dst]\n\t"						\
+  "decq %[n]\n\t"							\
+  "jnz 1b"
+
+static grub_size_t
+raid6_mul_ssse3 (grub_uint8_t *dst, const grub_uint8_t *src,
+		 const grub_uint8_t *tables, grub_size_t size, int accumulate)
+{
+  static const grub_uint8_t mask[16] =
+    { 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf,
+      0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf };
+  grub_size_t n = size / 16;
+
+  if (!n)
+    return 0;
+
+  if (accumulate)
+    asm volatile ("movdqu (%[mask]), %%xmm3\n\t"
+		  "movdqu (%[tables]), %%xmm4\n\t"
+		  "movdqu 16(%[tables]), %%xmm5\n"
+		  RAID6_SSSE3_LOOP ("movdqu (%[dst]), %%xmm1\n\t"
+				    "pxor %%xmm1, %%xmm0\n\t")
+		  : [src] "+r" (src), [dst] "+r" (dst), [n] "+r" (n)
+		  : [mask] "r" (mask), [tables] "r" (tables)
+		  : "memory", "cc");
+  else
+    asm volatile ("movdqu (%[mask]), %%xmm3\n\t"
+		  "movdqu (%[tables]), %%xmm4\n\t"
+		  "movdqu 16(%[tables]), %%xmm5\n"
+		  RAID6_SSSE3_LOOP ("")
+		  : [src] "+r" (src), [dst] "+r" (dst), [n] "+r" (n)
+		  : [mask] "r" (mask), [tables] "r" (tables)
+		  : "memory", "cc");
 
-  p = (grub_uint8_t *) buf;
-  for (i = 0; i < size; i++, p++)
-    if (*p)
-      *p = powx[mul + powx_inv[*p]];
+  return size & ~(grub_size_t) 15;
+}
+
+#define RAID6_AVX2_LOOP(acc)						\
+  "1:\n\t"								\
+  "vmovdqu (%[src]), %%ymm0\n\t"					\
+  "vpsrlw $4, %%ymm0, %%ymm1\n\t"					\
+  "vpand %%ymm3, %%ymm0, %%ymm0\n\t"					\
+  "vpand %%ymm3, %%ymm1, %%ymm1\n\t"					\
+  "vpshufb %%ymm0, %%ymm4, %%ymm0\n\t"					\
+  "vpshufb %%ymm1, %%ymm5, %%ymm1\n\t"					\
+  "vpxor %%ymm1, %%ymm0, %%ymm0\n\t"					\
+  acc									\
+  "vmovdqu %%ymm0, (%[dst])\n\t"					\
+  "addq $32, %[src]\n\t"						\
+  "addq $32, %[dst]\n\t"						\
+  "decq %[n]\n\t"							\
+  "jnz 1b\n\t"								\
+  "vzeroupper"
+
+static grub_size_t
+raid6_mul_avx2 (grub_uint8_t *dst, const grub_uint8_t *src,
+		const grub_uint8_t *tables, grub_size_t size, int accumulate)
+{
+  static const grub_uint8_t mask = 0xf;
+  grub_size_t n = size / 32;
+
+  if (!n)
+    return 0;
+
+  if (accumulate)
+    asm volatile ("vpbroadcastb (%[mask]), %%ymm3\n\t"
+		  "vbroadcasti128 (%[tables]), %%ymm4\n\t"
+		  "vbroadcasti128 16(%[tables]), %%ymm5\n"
+		  RAID6_AVX2_LOOP ("vpxor (%[dst]), %%ymm0, %%ymm0\n\t")
+		  : [src] "+r" (src), [dst] "+r" (dst), [n] "+r" (n)
+		  : [mask] "r" (&mask), [tables] "r" (tables)
+		  : "memory", "cc");
+  else
+    asm volatile ("vpbroadcastb (%[mask]), %%ymm3\n\t"
+		  "vbroadcasti128 (%[tables]), %%ymm4\n\t"
+		  "vbroadcasti128 16(%[tables]), %%ymm5\n"
+		  RAID6_AVX2_LOOP ("")
+		  : [src] "+r" (src), [dst] "+r" (dst), [n] "+r" (n)
+		  : [mask] "r" (&mask), [tables] "r" (tables)
+		  : "memory", "cc");
+
+  return size & ~(grub_size_t) 31;
+}
+
+static void
+raid6_select_kernel (raid6_kernel_t *kernel, const char **name)
+{
+  grub_uint32_t max, a, b, c, d;
+  grub_uint32_t xcr0_lo, xcr0_hi;
+
+  if (!grub_cpu_is_cpuid_supported ())
+    return;
+  grub_cpuid (0, max, b, c, d);
+  if (max < 1)
+    return;
+  grub_cpuid (1, a, b, c, d);
+  /* SSSE3.  */
+  if (!(c & (1 << 9)))
+    return;
+  *kernel = raid6_mul_ssse3;
+  *name = "ssse3";
+
+  /* AVX2 needs the firmware to have enabled the YMM state.  */
+  if (max < 7 || !(c & (1 << 27)) || !(c & (1 << 28)))
+    return;
+  asm volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+  if ((xcr0_lo & 6) != 6)
+    return;
+  asm volatile ("cpuid"
+		: "=a" (a), "=b" (b), "=c" (c), "=d" (d)
+		: "0" (7), "2" (0));
+  if (!(b & (1 << 5)))
+    return;
+  *kernel = raid6_mul_avx2;
+  *name = "avx2";
+}
+
+#else
+
+static void
+raid6_select_kernel (raid6_kernel_t *kernel __attribute__ ((unused)),
+		     const char **name __attribute__ ((unused)))
+{
+}
+
+#endif
+
+static raid6_kernel_t raid6_kernel;
+const char *grub_raid6_kernel_name = "table";
+
+static void
+raid6_mul_real (grub_uint8_t *dst, const grub_uint8_t *src, unsigned mul,
+		grub_size_t size, int accumulate)
+{
+  grub_uint8_t tables[32];
+  grub_size_t done = 0;
+  unsigned i;
+
+  mul %= 255;
+  if (mul == 0)
+    {
+      if (accumulate)
+	grub_crypto_xor (dst, dst, src, size);
+      else if (dst != src)
+	grub_memcpy (dst, src, size);
+      return;
+    }
+
+  tables[0] = tables[16] = 0;
+  for (i = 1; i < 16; i++)
+    {
+      tables[i] = powx[mul + powx_inv[i]];
+      tables[16 + i] = powx[mul + powx_inv[i << 4]];
+    }
+
+  if (raid6_kernel)
+    done = raid6_kernel (dst, src, tables, size, accumulate);
+  if (done < size)
+    raid6_mul_table (dst + done, src + done, tables, size - done, accumulate);
+}
+
+/* DST = x**MUL * SRC, byte by byte in GF(2^8).  DST may be SRC.  */
+void
+grub_raid6_mul (void *dst, const void *src, unsigned mul, grub_size_t size)
+{
+  raid6_mul_real (dst, src, mul, size, 0);
+}
+
+/* DST ^= x**MUL * SRC.  */
+void
+grub_raid6_mul_xor (void *dst, const void *src, unsigned mul,
+		    grub_size_t size)
+{
+  raid6_mul_real (dst, src, mul, size, 1);
 }
 
 static void
@@ -113,8 +333,7 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
 					   size >> GRUB_DISK_SECTOR_BITS, buf))
             {
               grub_crypto_xor (pbuf, pbuf, buf, size);
-              grub_raid_block_mulx (c, buf, size);
-              grub_crypto_xor (qbuf, qbuf, buf, size);
+              grub_raid6_mul_xor (qbuf, buf, c, size);
             }
           else
             {
@@ -152,8 +371,7 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
         goto quit;
 
       grub_crypto_xor (buf, buf, qbuf, size);
-      grub_raid_block_mulx (255 - bad1, buf,
-                           size);
+      grub_raid6_mul (buf, buf, 255 - bad1, size);
     }
   else
     {
@@ -174,13 +392,10 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
 
       c = mod_255((255 ^ bad1)
 		  + (255 ^ powx_inv[(powx[bad2 + (bad1 ^ 255)] ^ 1)]));
-      grub_raid_block_mulx (c, qbuf, size);
+      grub_raid6_mul (buf, qbuf, c, size);
 
       c = mod_255((unsigned) bad2 + c);
-      grub_raid_block_mulx (c, pbuf, size);
-
-      grub_crypto_xor (pbuf, pbuf, qbuf, size);
-      grub_memcpy (buf, pbuf, size);
+      grub_raid6_mul_xor (buf, pbuf, c, size);
     }
 
 quit:
@@ -193,6 +408,7 @@ quit:
 GRUB_MOD_INIT(raid6rec)
 {
   grub_raid6_init_table ();
+  raid6_select_kernel (&raid6_kernel, &grub_raid6_kernel_name);
   grub_raid6_recover_func = grub_raid6_recover;
 }
 
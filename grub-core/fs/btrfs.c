@@ -29,6 +29,7 @@
 #include <minilzo.h>
 #include <grub/i18n.h>
 #include <grub/btrfs.h>
+#include <grub/time.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -215,6 +216,27 @@ struct grub_btrfs_extent_data
 
 #define GRUB_BTRFS_OBJECT_ID_CHUNK 0x100
 
+/* Mirrored chunks are read from alternating copies in units of this many
+   bytes of logical address.  */
+#define GRUB_BTRFS_MIRROR_SPREAD_SHIFT 20
+/* A read taking this long, in ms, marks the device as slow.  */
+#define GRUB_BTRFS_SLOW_MS 1000
+
+/* How reads from a device went so far.  Kept across mounts so that a
+   failing or slow mirror is only tried last for the rest of the boot.  */
+struct grub_btrfs_dev_stats
+{
+  struct grub_btrfs_dev_stats *next;
+  grub_btrfs_uuid_t fsid;
+  grub_uint64_t device_id;
+  grub_uint64_t reads;
+  grub_uint64_t read_ms;
+  grub_uint32_t read_errors;
+  int slow;
+};
+
+static struct grub_btrfs_dev_stats *dev_stats;
+
 static grub_disk_addr_t superblock_sectors[] = { 64 * 2, 64 * 1024 * 2,
   256 * 1048576 * 2, 1048576ULL * 1048576ULL * 2
 };
@@ -606,6 +628,52 @@ find_device (struct grub_btrfs_data *data, grub_uint64_t id, int do_rescan)
   return ctx.dev_found;
 }
 
+static struct grub_btrfs_dev_stats *
+find_dev_stats (struct grub_btrfs_data *data, grub_uint64_t id)
+{
+  struct grub_btrfs_dev_stats *st;
+
+  for (st = dev_stats; st; st = st->next)
+    if (st->device_id == id
+	&& grub_memcmp (st->fsid, data->sblock.uuid, sizeof (st->fsid)) == 0)
+      return st;
+
+  st = grub_zalloc (sizeof (*st));
+  if (!st)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+  grub_memcpy (st->fsid, data->sblock.uuid, sizeof (st->fsid));
+  st->device_id = id;
+  st->next = dev_stats;
+  dev_stats = st;
+  return st;
+}
+
+/* Order in which copies are tried: healthy devices first, then the slow
+   ones and those which failed last.  */
+static int
+dev_stats_rank (const struct grub_btrfs_dev_stats *st)
+{
+  if (!st)
+    return 0;
+  if (st->read_errors)
+    return 2;
+  return st->slow ? 1 : 0;
+}
+
+static void
+dev_stats_failed (struct grub_btrfs_dev_stats *st)
+{
+  if (!st)
+    return;
+  if (!st->read_errors)
+    grub_dprintf ("btrfs", "device %" PRIuGRUB_UINT64_T
+		  " failed, avoiding it\n", grub_le_to_cpu64 (st->device_id));
+  st->read_errors++;
+}
+
 static grub_err_t
 grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			 void *buf, grub_size_t size, int recursion_depth)
@@ -683,7 +751,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	grub_uint64_t chunk_stripe_length;
 	grub_uint16_t nstripes;
 	unsigned redundancy = 1;
-	unsigned i, j;
+	unsigned i, j, t, first = 0;
 
 	if (grub_le_to_cpu64 (chunk->size) <= off)
 	  {
@@ -778,17 +846,53 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	if (csize > (grub_uint64_t) size)
 	  csize = size;
 
+	/* Spread reads of mirrors on separate devices over the copies,
+	   one unit at a time.  */
+	if (redundancy > 1
+	    && (grub_le_to_cpu64 (chunk->type)
+		& ~GRUB_BTRFS_CHUNK_TYPE_BITS_DONTCARE)
+	    != GRUB_BTRFS_CHUNK_TYPE_DUPLICATED)
+	  {
+	    grub_uint64_t unit = addr >> GRUB_BTRFS_MIRROR_SPREAD_SHIFT;
+	    grub_uint64_t rem;
+
+	    grub_divmod64 (unit, redundancy, &rem);
+	    first = rem;
+	    if (((addr + csize - 1) >> GRUB_BTRFS_MIRROR_SPREAD_SHIFT) != unit)
+	      csize = ((unit + 1) << GRUB_BTRFS_MIRROR_SPREAD_SHIFT) - addr;
+	  }
+
 	for (j = 0; j < 2; j++)
 	  {
-	    for (i = 0; i < redundancy; i++)
+	    grub_uint64_t tried = 0;
+
+	    /* Try the healthy copies first, then the slow and the failed
+	       ones, without retrying one which just failed.  */
+	    for (t = 0; t < 3 * redundancy; t++)
 	      {
 		struct grub_btrfs_chunk_stripe *stripe;
+		struct grub_btrfs_dev_stats *st;
 		grub_disk_addr_t paddr;
+		grub_uint64_t start, elapsed;
+		unsigned k;
+
+		i = t % redundancy;
+		k = first + i;
+		if (k >= redundancy)
+		  k -= redundancy;
 
 		stripe = (struct grub_btrfs_chunk_stripe *) (chunk + 1);
 		/* Right now the redundancy handling is easy.
 		   With RAID5-like it will be more difficult.  */
-		stripe += stripen + i;
+		stripe += stripen + k;
+
+		st = find_dev_stats (data, stripe->device_id);
+		if ((redundancy > 1
+		     && dev_stats_rank (st) != (int) (t / redundancy))
+		    || (i < 64 && (tried & (1ULL << i))))
+		  continue;
+		if (i < 64)
+		  tried |= 1ULL << i;
 
 		paddr = grub_le_to_cpu64 (stripe->offset) + stripe_offset;
 
@@ -810,19 +914,39 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 		dev = find_device (data, stripe->device_id, j);
 		if (!dev)
 		  {
+		    /* Without a rescan the device may just not be known
+		       yet.  */
+		    if (j)
+		      dev_stats_failed (st);
 		    err = grub_errno;
 		    grub_errno = GRUB_ERR_NONE;
 		    continue;
 		  }
 
+		start = grub_get_time_ms ();
 		err = grub_disk_read (dev->disk, paddr >> GRUB_DISK_SECTOR_BITS,
 				      paddr & (GRUB_DISK_SECTOR_SIZE - 1),
 				      csize, buf);
+		elapsed = grub_get_time_ms () - start;
+		if (st)
+		  {
+		    st->reads++;
+		    st->read_ms += elapsed;
+		    if (elapsed >= GRUB_BTRFS_SLOW_MS && !st->slow)
+		      {
+			grub_dprintf ("btrfs", "device %" PRIuGRUB_UINT64_T
+				      " took %" PRIuGRUB_UINT64_T
+				      " ms, avoiding it\n",
+				      grub_le_to_cpu64 (st->device_id), elapsed);
+			st->slow = 1;
+		      }
+		  }
 		if (!err)
 		  break;
+		dev_stats_failed (st);
 		grub_errno = GRUB_ERR_NONE;
 	      }
-	    if (i != redundancy)
+	    if (t != 3 * redundancy)
 	      break;
 	  }
 	if (err)
@@ -1772,4 +1896,11 @@ GRUB_MOD_INIT (btrfs)
 GRUB_MOD_FINI (btrfs)
 {
   grub_fs_unregister (&grub_btrfs_fs);
+
+  while (dev_stats)
+    {
+      struct grub_btrfs_dev_stats *next = dev_stats->next;
+      grub_free (dev_stats);
+      dev_stats = next;
+    }
 }
@@ -137,77 +137,194 @@ grub_hfsplus_find_block (struct grub_hfsplus_extent *extent,
 
 static int grub_hfsplus_cmp_extkey (struct grub_hfsplus_key *keya,
 				    struct grub_hfsplus_key_internal *keyb);
+static int
+grub_hfsplus_btree_iterate_node (struct grub_hfsplus_btree *btree,
+				 struct grub_hfsplus_btnode *first_node,
+				 grub_disk_addr_t first_rec,
+				 int (*hook) (void *record, void *hook_arg),
+				 void *hook_arg);
+
+/* An extent of a fork, as found in the extent overflow file.  */
+struct grub_hfsplus_extmap_entry
+{
+  grub_disk_addr_t fileblock;
+  grub_disk_addr_t start;
+  grub_uint32_t count;
+};
+
+/* All extents of the fork TYPE of the file FILEID which are stored in
+   the extent overflow file, sorted by FILEBLOCK.  */
+struct grub_hfsplus_extmap
+{
+  struct grub_hfsplus_extmap *next;
+  grub_uint32_t fileid;
+  grub_uint8_t type;
+  grub_size_t count;
+  grub_size_t alloc;
+  struct grub_hfsplus_extmap_entry *ext;
+};
+
+struct grub_hfsplus_extmap_ctx
+{
+  struct grub_hfsplus_extmap *map;
+  grub_disk_addr_t fileblock;
+};
+
+static int
+grub_hfsplus_extmap_add (void *record, void *hook_arg)
+{
+  struct grub_hfsplus_extmap_ctx *ctx = hook_arg;
+  struct grub_hfsplus_extmap *map = ctx->map;
+  struct grub_hfsplus_extkey *key = record;
+  struct grub_hfsplus_extent *extents;
+  int i;
+
+  /* Stop at the first record that doesn't continue this fork.  */
+  if (grub_be_to_cpu32 (key->fileid) != map->fileid
+      || key->type != map->type
+      || grub_be_to_cpu32 (key->start) != ctx->fileblock)
+    return 1;
+
+  /* The extent overflow file has 8 extents right after the key.  */
+  extents = (struct grub_hfsplus_extent *) (key + 1);
+  for (i = 0; i < 8; i++)
+    {
+      grub_uint32_t count = grub_be_to_cpu32 (extents[i].count);
+
+      if (!count)
+	continue;
+
+      if (map->count == map->alloc)
+	{
+	  struct grub_hfsplus_extmap_entry *ext;
+	  grub_size_t alloc = map->alloc ? 2 * map->alloc : 8;
+
+	  ext = grub_realloc (map->ext, alloc * sizeof (ext[0]));
+	  if (!ext)
+	    return 1;
+	  map->ext = ext;
+	  map->alloc = alloc;
+	}
+
+      map->ext[map->count].fileblock = ctx->fileblock;
+      map->ext[map->count].start = grub_be_to_cpu32 (extents[i].start);
+      map->ext[map->count].count = count;
+      map->count++;
+      ctx->fileblock += count;
+    }
+
+  return 0;
+}
+
+/* Return the extent map of the fork of NODE which is read by
+   grub_hfsplus_read_block.  FIRST_BLOCK is the first block not covered
+   by the extents in the catalog record.  The map is built by walking
+   the extent overflow file once and then kept until the filesystem is
+   unmounted.  */
+static struct grub_hfsplus_extmap *
+grub_hfsplus_get_extmap (grub_fshelp_node_t node, grub_disk_addr_t first_block)
+{
+  struct grub_hfsplus_data *data = node->data;
+  struct grub_hfsplus_extmap *map;
+  struct grub_hfsplus_extmap_ctx ctx;
+  struct grub_hfsplus_key_internal extoverflow;
+  struct grub_hfsplus_btnode *nnode = 0;
+  grub_off_t ptr;
+  grub_uint8_t type = node->compressed ? 0xff : 0;
+
+  for (map = data->extmaps; map; map = map->next)
+    if (map->fileid == node->fileid && map->type == type)
+      return map;
+
+  map = grub_zalloc (sizeof (*map));
+  if (!map)
+    return 0;
+  map->fileid = node->fileid;
+  map->type = type;
+
+  /* Set up the key to look for in the extent overflow file.  */
+  extoverflow.extkey.fileid = node->fileid;
+  extoverflow.extkey.start = first_block;
+  extoverflow.extkey.type = type;
+  if (grub_hfsplus_btree_search (&data->extoverflow_tree, &extoverflow,
+				 grub_hfsplus_cmp_extkey, &nnode, &ptr))
+    goto fail;
+
+  if (nnode)
+    {
+      ctx.map = map;
+      ctx.fileblock = first_block;
+      grub_hfsplus_btree_iterate_node (&data->extoverflow_tree, nnode, ptr,
+				       grub_hfsplus_extmap_add, &ctx);
+      grub_free (nnode);
+      if (grub_errno)
+	goto fail;
+    }
+
+  map->next = data->extmaps;
+  data->extmaps = map;
+  return map;
+
+ fail:
+  grub_free (map->ext);
+  grub_free (map);
+  return 0;
+}
 
 /* Search for the block FILEBLOCK inside the file NODE.  Return the
    blocknumber of this block on disk.  */
 static grub_disk_addr_t
 grub_hfsplus_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 {
-  struct grub_hfsplus_btnode *nnode = 0;
+  struct grub_hfsplus_extmap *map;
   grub_disk_addr_t blksleft = fileblock;
+  grub_disk_addr_t blk;
+  grub_size_t lo, hi;
   struct grub_hfsplus_extent *extents = node->compressed 
     ? &node->resource_extents[0] : &node->extents[0];
 
-  while (1)
-    {
-      struct grub_hfsplus_extkey *key;
-      struct grub_hfsplus_key_internal extoverflow;
-      grub_disk_addr_t blk;
-      grub_off_t ptr;
-
-      /* Try to find this block in the current set of extents.  */
-      blk = grub_hfsplus_find_block (extents, &blksleft);
-
-      /* The previous iteration of this loop allocated memory.  The
-	 code above used this memory, it can be freed now.  */
-      grub_free (nnode);
-      nnode = 0;
-
-      if (blk != 0xffffffffffffffffULL)
-	return blk;
+  /* Try to find this block in the extents of the catalog record.  */
+  blk = grub_hfsplus_find_block (extents, &blksleft);
+  if (blk != 0xffffffffffffffffULL)
+    return blk;
 
-      /* For the extent overflow file, extra extents can't be found in
-	 the extent overflow file.  If this happens, you found a
-	 bug...  */
-      if (node->fileid == GRUB_HFSPLUS_FILEID_OVERFLOW)
-	{
-	  grub_error (GRUB_ERR_READ_ERROR,
-		      "extra extents found in an extend overflow file");
-	  break;
-	}
+  /* For the extent overflow file, extra extents can't be found in
+     the extent overflow file.  If this happens, you found a
+     bug...  */
+  if (node->fileid == GRUB_HFSPLUS_FILEID_OVERFLOW)
+    {
+      grub_error (GRUB_ERR_READ_ERROR,
+		  "extra extents found in an extend overflow file");
+      return -1;
+    }
 
-      /* Set up the key to look for in the extent overflow file.  */
-      extoverflow.extkey.fileid = node->fileid;
-      extoverflow.extkey.type = 0;
-      extoverflow.extkey.start = fileblock - blksleft;
-      extoverflow.extkey.type = node->compressed ? 0xff : 0;
-      if (grub_hfsplus_btree_search (&node->data->extoverflow_tree,
-				     &extoverflow,
-				     grub_hfsplus_cmp_extkey, &nnode, &ptr)
-	  || !nnode)
-	{
-	  grub_error (GRUB_ERR_READ_ERROR,
-		      "no block found for the file id 0x%x and the block offset 0x%x",
-		      node->fileid, fileblock);
-	  break;
-	}
+  map = grub_hfsplus_get_extmap (node, fileblock - blksleft);
+  if (!map)
+    return -1;
 
-      /* The extent overflow file has 8 extents right after the key.  */
-      key = (struct grub_hfsplus_extkey *)
-	grub_hfsplus_btree_recptr (&node->data->extoverflow_tree, nnode, ptr);
-      extents = (struct grub_hfsplus_extent *) (key + 1);
+  /* Find the last extent starting at or before FILEBLOCK.  */
+  lo = 0;
+  hi = map->count;
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
 
-      /* The block wasn't found.  Perhaps the next iteration will find
-	 it.  The last block we found is stored in BLKSLEFT now.  */
+      if (map->ext[mid].fileblock <= fileblock)
+	lo = mid + 1;
+      else
+	hi = mid;
     }
 
-  grub_free (nnode);
+  if (lo > 0 && fileblock - map->ext[lo - 1].fileblock < map->ext[lo - 1].count)
+    return map->ext[lo - 1].start + (fileblock - map->ext[lo - 1].fileblock);
 
   /* Too bad, you lose.  */
+  grub_error (GRUB_ERR_READ_ERROR,
+	      "no block found for the file id 0x%x and the block offset 0x%llx",
+	      node->fileid, (unsigned long long) fileblock);
   return -1;
 }
 
-
 /* Read LEN bytes from the file described by DATA starting with byte
    POS.  Return the amount of read bytes in READ.  */
 grub_ssize_t
@@ -223,6 +340,26 @@ grub_hfsplus_read_file (grub_fshelp_node_t node,
 				node->data->embedded_offset);
 }
 
+static void
+grub_hfsplus_free (struct grub_hfsplus_data *data)
+{
+  struct grub_hfsplus_extmap *map, *next;
+
+  if (!data)
+    return;
+
+  grub_free (data->catalog_tree.cache);
+  grub_free (data->extoverflow_tree.cache);
+  grub_free (data->attr_tree.cache);
+  for (map = data->extmaps; map; map = next)
+    {
+      next = map->next;
+      grub_free (map->ext);
+      grub_free (map);
+    }
+  grub_free (data);
+}
+
 static struct grub_hfsplus_data *
 grub_hfsplus_mount (grub_disk_t disk)
 {
@@ -235,7 +372,7 @@ grub_hfsplus_mount (grub_disk_t disk)
     struct grub_hfsplus_volheader hfsplus;
   } volheader;
 
-  data = grub_malloc (sizeof (*data));
+  data = grub_zalloc (sizeof (*data));
   if (!data)
     return 0;
 
@@ -380,7 +517,7 @@ grub_hfsplus_mount (grub_disk_t disk)
   if (grub_errno == GRUB_ERR_OUT_OF_RANGE)
     grub_error (GRUB_ERR_BAD_FS, "not a HFS+ filesystem");
 
-  grub_free (data);
+  grub_hfsplus_free (data);
   return 0;
 }
 
@@ -491,6 +628,63 @@ grub_hfsplus_read_symlink (grub_fshelp_node_t node)
   return symlink;
 }
 
+/* Read the node NODENUM of the B+ tree BTREE into BUF, which has room
+   for one node.  Recently read nodes are served from a small cache.  */
+static grub_err_t
+grub_hfsplus_btree_read_node (struct grub_hfsplus_btree *btree,
+			      grub_uint32_t nodenum, char *buf)
+{
+  unsigned i, victim = 0;
+
+  if (!btree->cache)
+    {
+      btree->cache = grub_malloc (GRUB_HFSPLUS_BTREE_CACHE_NODES
+				  * btree->nodesize);
+      /* The cache is only an optimization.  */
+      if (!btree->cache)
+	grub_errno = GRUB_ERR_NONE;
+      for (i = 0; i < GRUB_HFSPLUS_BTREE_CACHE_NODES; i++)
+	{
+	  btree->cache_node[i] = 0xffffffff;
+	  btree->cache_stamp[i] = 0;
+	}
+    }
+
+  if (btree->cache)
+    for (i = 0; i < GRUB_HFSPLUS_BTREE_CACHE_NODES; i++)
+      {
+	if (btree->cache_node[i] == nodenum)
+	  {
+	    grub_memcpy (buf, btree->cache + i * btree->nodesize,
+			 btree->nodesize);
+	    btree->cache_stamp[i] = ++btree->cache_clock;
+	    return GRUB_ERR_NONE;
+	  }
+	if (btree->cache_stamp[i] < btree->cache_stamp[victim])
+	  victim = i;
+      }
+
+  if (grub_hfsplus_read_file (&btree->file, 0, 0,
+			      (grub_disk_addr_t) nodenum
+			      * (grub_disk_addr_t) btree->nodesize,
+			      btree->nodesize, buf) <= 0)
+    {
+      if (!grub_errno)
+	grub_error (GRUB_ERR_BAD_FS, "couldn't read i-node");
+      return grub_errno;
+    }
+
+  if (btree->cache)
+    {
+      grub_memcpy (btree->cache + victim * btree->nodesize, buf,
+		   btree->nodesize);
+      btree->cache_node[victim] = nodenum;
+      btree->cache_stamp[victim] = ++btree->cache_clock;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
 static int
 grub_hfsplus_btree_iterate_node (struct grub_hfsplus_btree *btree,
 				 struct grub_hfsplus_btnode *first_node,
@@ -525,11 +719,9 @@ grub_hfsplus_btree_iterate_node (struct grub_hfsplus_btree *btree,
 	saved_node = first_node->next;
       node_count++;
 
-      if (grub_hfsplus_read_file (&btree->file, 0, 0,
-				  (((grub_disk_addr_t)
-				    grub_be_to_cpu32 (first_node->next))
-				   * btree->nodesize),
-				  btree->nodesize, cnode) <= 0)
+      if (grub_hfsplus_btree_read_node (btree,
+					grub_be_to_cpu32 (first_node->next),
+					cnode))
 	return 1;
 
       /* Don't skip any record in the next iteration.  */
@@ -584,10 +776,7 @@ grub_hfsplus_btree_search (struct grub_hfsplus_btree *btree,
       node_count++;
 
       /* Read a node.  */
-      if (grub_hfsplus_read_file (&btree->file, 0, 0,
-				  (grub_disk_addr_t) currnode
-				  * (grub_disk_addr_t) btree->nodesize,
-				  btree->nodesize, (char *) node) <= 0)
+      if (grub_hfsplus_btree_read_node (btree, currnode, node))
 	{
 	  grub_free (node);
 	  return grub_error (GRUB_ERR_BAD_FS, "couldn't read i-node");
@@ -864,7 +1053,7 @@ grub_hfsplus_open (struct grub_file *file, const char *name)
  fail:
   if (data && fdiro != &data->dirroot)
     grub_free (fdiro);
-  grub_free (data);
+  grub_hfsplus_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -881,7 +1070,7 @@ grub_hfsplus_close (grub_file_t file)
   grub_free (data->opened_file.cbuf);
   grub_free (data->opened_file.compress_index);
 
-  grub_free (data);
+  grub_hfsplus_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -960,7 +1149,7 @@ grub_hfsplus_dir (grub_device_t device, const char *path,
  fail:
   if (data && fdiro != &data->dirroot)
     grub_free (fdiro);
-  grub_free (data);
+  grub_hfsplus_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -995,7 +1184,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
 				 grub_hfsplus_cmp_catkey_id, &node, &ptr)
       || !node)
     {
-      grub_free (data);
+      grub_hfsplus_free (data);
       return 0;
     }
 
@@ -1020,7 +1209,7 @@ grub_hfsplus_label (grub_device_t device, char **label)
 		       label_len) = '\0';
 
   grub_free (node);
-  grub_free (data);
+  grub_hfsplus_free (data);
 
   return GRUB_ERR_NONE;
 }
@@ -1042,7 +1231,7 @@ grub_hfsplus_mtime (grub_device_t device, grub_int32_t *tm)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_hfsplus_free (data);
 
   return grub_errno;
 
@@ -1068,7 +1257,7 @@ grub_hfsplus_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_hfsplus_free (data);
 
   return grub_errno;
 }
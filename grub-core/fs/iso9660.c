@@ -28,6 +28,7 @@
 #include <grub/fshelp.h>
 #include <grub/charset.h>
 #include <grub/datetime.h>
+#include <grub/partition.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -154,8 +155,55 @@ struct grub_iso9660_data
   int susp_skip;
   int joliet;
   struct grub_fshelp_node *node;
+  struct grub_iso9660_cache *cache;
 };
 
+/* A directory parsed by grub_iso9660_iterate_dir, including the Rock Ridge
+   names, types, symlinks and extents of its entries.  */
+struct grub_iso9660_dircache_entry
+{
+  char *filename;
+  enum grub_fshelp_filetype type;
+  grub_size_t node_size;
+  struct grub_fshelp_node *node;
+};
+
+struct grub_iso9660_dircache
+{
+  struct grub_iso9660_dircache *next;
+  grub_uint32_t first_sector;
+  int busy;
+  grub_size_t size;
+  grub_size_t count, alloc;
+  struct grub_iso9660_dircache_entry *entries;
+};
+
+/* Every file open mounts the filesystem again, so the volume probing
+   results and the parsed directories are kept here, keyed by the device
+   and validated against the first volume descriptor.  */
+struct grub_iso9660_cache
+{
+  struct grub_iso9660_cache *next;
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t part_start;
+  struct grub_iso9660_primary_voldesc first_voldesc;
+  struct grub_iso9660_primary_voldesc voldesc;
+  int rockridge;
+  int susp_skip;
+  int joliet;
+  int refcnt;
+  grub_size_t size;
+  struct grub_iso9660_dircache *dirs;
+};
+
+/* Maximum number of unused volumes and maximum size of the parsed
+   directories per volume.  */
+#define GRUB_ISO9660_CACHE_VOLUMES	4
+#define GRUB_ISO9660_CACHE_SIZE		(1024 * 1024)
+
+static struct grub_iso9660_cache *grub_iso9660_cache_list;
+
 struct grub_fshelp_node
 {
   struct grub_iso9660_data *data;
@@ -429,11 +477,132 @@ set_rockridge (struct grub_iso9660_data *data)
   return GRUB_ERR_NONE;
 }
 
+static void
+dircache_free (struct grub_iso9660_dircache *dc)
+{
+  grub_size_t i;
+
+  for (i = 0; i < dc->count; i++)
+    {
+      grub_free (dc->entries[i].filename);
+      grub_free (dc->entries[i].node);
+    }
+  grub_free (dc->entries);
+  grub_free (dc);
+}
+
+static void
+cache_free (struct grub_iso9660_cache *cache)
+{
+  struct grub_iso9660_dircache *dc, *next;
+
+  for (dc = cache->dirs; dc; dc = next)
+    {
+      next = dc->next;
+      dircache_free (dc);
+    }
+  grub_free (cache);
+}
+
+static struct grub_iso9660_cache *
+cache_lookup (grub_disk_t disk,
+	      const struct grub_iso9660_primary_voldesc *first_voldesc)
+{
+  struct grub_iso9660_cache **prev, *cache;
+
+  for (prev = &grub_iso9660_cache_list; *prev; prev = &(*prev)->next)
+    {
+      cache = *prev;
+      if (cache->dev_id != disk->dev->id || cache->disk_id != disk->id
+	  || cache->part_start != grub_partition_get_start (disk->partition))
+	continue;
+      *prev = cache->next;
+      /* Stale entry for a replaced medium.  */
+      if (grub_memcmp (&cache->first_voldesc, first_voldesc,
+		       sizeof (*first_voldesc)) != 0)
+	{
+	  if (cache->refcnt)
+	    cache->refcnt = -cache->refcnt;
+	  else
+	    cache_free (cache);
+	  return NULL;
+	}
+      cache->next = grub_iso9660_cache_list;
+      grub_iso9660_cache_list = cache;
+      return cache;
+    }
+  return NULL;
+}
+
+static void
+cache_insert (struct grub_iso9660_data *data,
+	      const struct grub_iso9660_primary_voldesc *first_voldesc)
+{
+  struct grub_iso9660_cache *cache, **prev;
+  int unused = 0;
+
+  cache = grub_zalloc (sizeof (*cache));
+  if (!cache)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  cache->dev_id = data->disk->dev->id;
+  cache->disk_id = data->disk->id;
+  cache->part_start = grub_partition_get_start (data->disk->partition);
+  cache->first_voldesc = *first_voldesc;
+  cache->voldesc = data->voldesc;
+  cache->rockridge = data->rockridge;
+  cache->susp_skip = data->susp_skip;
+  cache->joliet = data->joliet;
+  cache->refcnt = 1;
+  cache->next = grub_iso9660_cache_list;
+  grub_iso9660_cache_list = cache;
+  data->cache = cache;
+
+  /* Drop the least recently used volumes nobody holds on to.  */
+  for (prev = &grub_iso9660_cache_list; *prev; )
+    {
+      cache = *prev;
+      if (cache->refcnt == 0 && ++unused > GRUB_ISO9660_CACHE_VOLUMES)
+	{
+	  *prev = cache->next;
+	  cache_free (cache);
+	  continue;
+	}
+      prev = &cache->next;
+    }
+}
+
+static void
+cache_release (struct grub_iso9660_cache *cache)
+{
+  if (!cache)
+    return;
+  /* Negative counts mark entries already unlinked from the list.  */
+  if (cache->refcnt < 0)
+    {
+      if (++cache->refcnt == 0)
+	cache_free (cache);
+    }
+  else
+    cache->refcnt--;
+}
+
+static void
+grub_iso9660_free (struct grub_iso9660_data *data)
+{
+  if (data)
+    cache_release (data->cache);
+  grub_free (data);
+}
+
 static struct grub_iso9660_data *
 grub_iso9660_mount (grub_disk_t disk)
 {
   struct grub_iso9660_data *data = 0;
-  struct grub_iso9660_primary_voldesc voldesc;
+  struct grub_iso9660_primary_voldesc voldesc, first_voldesc;
   int block;
 
   data = grub_zalloc (sizeof (struct grub_iso9660_data));
@@ -462,6 +631,24 @@ grub_iso9660_mount (grub_disk_t disk)
           goto fail;
         }
 
+      if (block == 16)
+	{
+	  struct grub_iso9660_cache *cache;
+
+	  cache = cache_lookup (disk, &voldesc);
+	  if (cache)
+	    {
+	      data->voldesc = cache->voldesc;
+	      data->rockridge = cache->rockridge;
+	      data->susp_skip = cache->susp_skip;
+	      data->joliet = cache->joliet;
+	      data->cache = cache;
+	      cache->refcnt++;
+	      return data;
+	    }
+	  first_voldesc = voldesc;
+	}
+
       if (voldesc.voldesc.type == GRUB_ISO9660_VOLDESC_PRIMARY)
 	copy_voldesc = 1;
       else if (!data->rockridge
@@ -487,6 +674,8 @@ grub_iso9660_mount (grub_disk_t disk)
       block++;
     } while (voldesc.voldesc.type != GRUB_ISO9660_VOLDESC_END);
 
+  cache_insert (data, &first_voldesc);
+
   return data;
 
  fail:
@@ -654,8 +843,8 @@ susp_iterate_dir (struct grub_iso9660_susp_entry *entry,
 }
 
 static int
-grub_iso9660_iterate_dir (grub_fshelp_node_t dir,
-			  grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
+iterate_dir_real (grub_fshelp_node_t dir,
+		  grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
 {
   struct grub_iso9660_dir dirent;
   grub_off_t offset = 0;
@@ -836,6 +1025,158 @@ grub_iso9660_iterate_dir (grub_fshelp_node_t dir,
   return 0;
 }
 
+/* Size of the allocation holding NODE, including the extra extents and the
+   symlink target stored after them.  */
+static grub_size_t
+get_node_alloc_size (grub_fshelp_node_t node)
+{
+  grub_size_t size = sizeof (*node);
+
+  if (node->have_dirents > ARRAY_SIZE (node->dirents))
+    size += ((node->have_dirents - ARRAY_SIZE (node->dirents))
+	     * sizeof (node->dirents[0]));
+  if (node->have_symlink)
+    {
+      const char *symlink = (node->symlink
+			     + node->have_dirents * sizeof (node->dirents[0])
+			     - sizeof (node->dirents));
+      grub_size_t end = (symlink - (char *) node) + grub_strlen (symlink) + 1;
+      if (end > size)
+	size = end;
+    }
+  return size;
+}
+
+/* Helper for dircache_get.  */
+static int
+dircache_add (const char *filename, enum grub_fshelp_filetype filetype,
+	      grub_fshelp_node_t node, void *data)
+{
+  struct grub_iso9660_dircache *dc = data;
+  struct grub_iso9660_dircache_entry *e;
+
+  if (dc->count == dc->alloc)
+    {
+      struct grub_iso9660_dircache_entry *n;
+
+      dc->alloc = dc->alloc ? 2 * dc->alloc : 32;
+      n = grub_realloc (dc->entries, dc->alloc * sizeof (dc->entries[0]));
+      if (!n)
+	{
+	  grub_free (node);
+	  return 1;
+	}
+      dc->entries = n;
+    }
+
+  e = &dc->entries[dc->count];
+  e->filename = grub_strdup (filename);
+  if (!e->filename)
+    {
+      grub_free (node);
+      return 1;
+    }
+  e->type = filetype;
+  e->node = node;
+  e->node_size = get_node_alloc_size (node);
+  dc->size += e->node_size + grub_strlen (filename) + 1 + sizeof (*e);
+  dc->count++;
+  return 0;
+}
+
+static struct grub_iso9660_dircache *
+dircache_get (grub_fshelp_node_t dir)
+{
+  struct grub_iso9660_cache *cache = dir->data->cache;
+  struct grub_iso9660_dircache *dc, **prev;
+  grub_uint32_t first_sector;
+
+  if (!cache)
+    return NULL;
+
+  first_sector = grub_le_to_cpu32 (dir->dirents[0].first_sector);
+  for (prev = &cache->dirs; *prev; prev = &(*prev)->next)
+    if ((*prev)->first_sector == first_sector)
+      {
+	dc = *prev;
+	*prev = dc->next;
+	dc->next = cache->dirs;
+	cache->dirs = dc;
+	return dc;
+      }
+
+  dc = grub_zalloc (sizeof (*dc));
+  if (!dc)
+    return NULL;
+  dc->first_sector = first_sector;
+
+  iterate_dir_real (dir, dircache_add, dc);
+  if (grub_errno || dc->size > GRUB_ISO9660_CACHE_SIZE)
+    {
+      dircache_free (dc);
+      return NULL;
+    }
+
+  /* Make room by dropping the least recently used directories.  */
+  while (cache->size + dc->size > GRUB_ISO9660_CACHE_SIZE)
+    {
+      struct grub_iso9660_dircache **victim = NULL, *old;
+
+      for (prev = &cache->dirs; *prev; prev = &(*prev)->next)
+	if (!(*prev)->busy)
+	  victim = prev;
+      if (!victim)
+	break;
+      old = *victim;
+      *victim = old->next;
+      cache->size -= old->size;
+      dircache_free (old);
+    }
+
+  dc->next = cache->dirs;
+  cache->dirs = dc;
+  cache->size += dc->size;
+  return dc;
+}
+
+static int
+grub_iso9660_iterate_dir (grub_fshelp_node_t dir,
+			  grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
+{
+  struct grub_iso9660_dircache *dc;
+  grub_size_t i;
+  int ret = 0;
+
+  dc = dircache_get (dir);
+  if (!dc)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return iterate_dir_real (dir, hook, hook_data);
+    }
+
+  /* The hook may open other files and thus add directories to the
+     cache; keep this one from being evicted meanwhile.  */
+  dc->busy++;
+  for (i = 0; i < dc->count; i++)
+    {
+      struct grub_fshelp_node *node;
+
+      node = grub_malloc (dc->entries[i].node_size);
+      if (!node)
+	break;
+      grub_memcpy (node, dc->entries[i].node, dc->entries[i].node_size);
+      node->data = dir->data;
+
+      if (hook (dc->entries[i].filename, dc->entries[i].type, node, hook_data))
+	{
+	  ret = 1;
+	  break;
+	}
+    }
+  dc->busy--;
+
+  return ret;
+}
 
 
 /* Context for grub_iso9660_dir.  */
@@ -898,7 +1239,7 @@ grub_iso9660_dir (grub_device_t device, const char *path,
     grub_free (foundnode);
 
  fail:
-  grub_free (data);
+  grub_iso9660_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -944,7 +1285,7 @@ grub_iso9660_open (struct grub_file *file, const char *name)
  fail:
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_iso9660_free (data);
 
   return grub_errno;
 }
@@ -976,7 +1317,7 @@ grub_iso9660_close (grub_file_t file)
   struct grub_iso9660_data *data =
     (struct grub_iso9660_data *) file->data;
   grub_free (data->node);
-  grub_free (data);
+  grub_iso9660_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -1005,7 +1346,7 @@ grub_iso9660_label (grub_device_t device, char **label)
 	    *ptr-- = 0;
 	}
 
-      grub_free (data);
+      grub_iso9660_free (data);
     }
   else
     *label = 0;
@@ -1063,7 +1404,7 @@ grub_iso9660_uuid (grub_device_t device, char **uuid)
 
 	grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_iso9660_free (data);
 
   return grub_errno;
 }
@@ -1088,7 +1429,7 @@ grub_iso9660_mtime (grub_device_t device, grub_int32_t *timebuf)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_iso9660_free (data);
 
   return err;
 }
@@ -1122,4 +1463,10 @@ GRUB_MOD_INIT(iso9660)
 GRUB_MOD_FINI(iso9660)
 {
   grub_fs_unregister (&grub_iso9660_fs);
+  while (grub_iso9660_cache_list)
+    {
+      struct grub_iso9660_cache *next = grub_iso9660_cache_list->next;
+      cache_free (grub_iso9660_cache_list);
+      grub_iso9660_cache_list = next;
+    }
 }
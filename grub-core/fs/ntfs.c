@@ -490,6 +490,146 @@ read_attr (struct grub_ntfs_attr *at, grub_uint8_t *dest, grub_disk_addr_t ofs,
   return ret;
 }
 
+/* Decode the whole run list of the $DATA attribute of MFT into an extent
+   array, merging physically adjacent runs, so that reads neither re-walk
+   the run list nor go through fshelp one cluster at a time.  Resident and
+   compressed attributes are left to read_attr.  */
+static grub_err_t
+load_runs (struct grub_ntfs_file *mft)
+{
+  struct grub_ntfs_attr *at = &mft->attr;
+  struct grub_ntfs_rlst cc, *ctx;
+  grub_uint8_t *save_cur, *pa;
+  grub_disk_addr_t end_vcn;
+  grub_size_t alloc = 0;
+  int shift;
+
+  mft->runs_read = 1;
+
+  save_cur = at->attr_cur;
+  at->attr_nxt = at->attr_cur;
+  pa = find_attr (at, *at->attr_nxt);
+  if (pa == NULL || pa[8] == 0 || (pa[0xC] & GRUB_NTFS_FLAG_COMPRESSED)
+      || u64at (pa, 0x10) != 0)
+    goto done;
+
+  grub_memset (&cc, 0, sizeof (cc));
+  ctx = &cc;
+  ctx->attr = at;
+  ctx->comp.log_spc = mft->data->log_spc;
+  ctx->comp.disk = mft->data->disk;
+  ctx->cur_run = pa + u16at (pa, 0x20);
+  ctx->next_vcn = 0;
+  ctx->curr_lcn = 0;
+
+  shift = mft->data->log_spc + GRUB_NTFS_BLK_SHR;
+  end_vcn = (u64at (pa, 0x28) + (1ULL << shift) - 1) >> shift;
+
+  while (ctx->next_vcn < end_vcn)
+    {
+      struct grub_ntfs_extent *last;
+      grub_disk_addr_t lcn;
+
+      if (grub_ntfs_read_run_list (ctx))
+	goto fail;
+
+      lcn = (ctx->flags & GRUB_NTFS_RF_BLNK) ? 0 : ctx->curr_lcn;
+      last = mft->run_count ? &mft->runs[mft->run_count - 1] : NULL;
+      if (last && ((lcn == 0 && last->lcn == 0)
+		   || (lcn && last->lcn && last->lcn + last->len == lcn)))
+	{
+	  last->len += ctx->next_vcn - ctx->curr_vcn;
+	  continue;
+	}
+
+      if (mft->run_count == alloc)
+	{
+	  struct grub_ntfs_extent *n;
+
+	  alloc = alloc ? 2 * alloc : 16;
+	  n = grub_realloc (mft->runs, alloc * sizeof (mft->runs[0]));
+	  if (!n)
+	    goto fail;
+	  mft->runs = n;
+	}
+      mft->runs[mft->run_count].vcn = ctx->curr_vcn;
+      mft->runs[mft->run_count].lcn = lcn;
+      mft->runs[mft->run_count].len = ctx->next_vcn - ctx->curr_vcn;
+      mft->run_count++;
+    }
+  goto done;
+
+ fail:
+  /* Let read_attr deal with (and report) anything unusual.  */
+  grub_free (mft->runs);
+  mft->runs = NULL;
+  mft->run_count = 0;
+  grub_errno = GRUB_ERR_NONE;
+
+ done:
+  at->attr_cur = save_cur;
+  return grub_errno;
+}
+
+static grub_err_t
+read_runs (struct grub_ntfs_file *mft, grub_uint8_t *dest, grub_off_t ofs,
+	   grub_size_t len, grub_disk_read_hook_t read_hook,
+	   void *read_hook_data)
+{
+  grub_disk_t disk = mft->data->disk;
+  int shift = mft->data->log_spc + GRUB_NTFS_BLK_SHR;
+  grub_disk_addr_t vcn = ofs >> shift;
+  grub_size_t lo = 0, hi = mft->run_count;
+
+  /* Find the last extent starting at or before VCN.  */
+  while (hi - lo > 1)
+    {
+      grub_size_t mid = (lo + hi) / 2;
+      if (mft->runs[mid].vcn <= vcn)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  while (len)
+    {
+      struct grub_ntfs_extent *e;
+      grub_off_t skip;
+      grub_size_t n;
+
+      if (lo >= mft->run_count)
+	return grub_error (GRUB_ERR_BAD_FS, "read out of range");
+      e = &mft->runs[lo];
+      if (vcn < e->vcn || vcn >= e->vcn + e->len)
+	return grub_error (GRUB_ERR_BAD_FS, "read out of range");
+
+      skip = ofs - (e->vcn << shift);
+      n = len;
+      if (n > (e->len << shift) - skip)
+	n = (e->len << shift) - skip;
+
+      if (e->lcn)
+	{
+	  disk->read_hook = read_hook;
+	  disk->read_hook_data = read_hook_data;
+	  grub_disk_read (disk, e->lcn << mft->data->log_spc, skip, n, dest);
+	  disk->read_hook = 0;
+	  if (grub_errno)
+	    return grub_errno;
+	}
+      else
+	grub_memset (dest, 0, n);
+
+      dest += n;
+      ofs += n;
+      len -= n;
+      vcn = ofs >> shift;
+      lo++;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 read_mft (struct grub_ntfs_data *data, grub_uint8_t *buf, grub_uint64_t mftno)
 {
@@ -547,6 +687,7 @@ free_file (struct grub_ntfs_file *mft)
 {
   free_attr (&mft->attr);
   grub_free (mft->buf);
+  grub_free (mft->runs);
 }
 
 static char *
@@ -1097,6 +1238,16 @@ grub_ntfs_read (grub_file_t file, char *buf, grub_size_t len)
   if (file->read_hook)
     mft->attr.save_pos = 1;
 
+  if (!mft->runs_read && load_runs (mft))
+    return -1;
+
+  if (mft->runs)
+    {
+      read_runs (mft, (grub_uint8_t *) buf, file->offset, len,
+		 file->read_hook, file->read_hook_data);
+      return (grub_errno) ? -1 : (grub_ssize_t) len;
+    }
+
   read_attr (&mft->attr, (grub_uint8_t *) buf, file->offset, len, 1,
 	     file->read_hook, file->read_hook_data);
   return (grub_errno) ? -1 : (grub_ssize_t) len;
@@ -355,10 +355,23 @@ struct grub_udf_data
   int npd, npm, lbshift;
 };
 
+/* A run of file blocks, as decoded from the allocation descriptors.  */
+struct grub_udf_extent
+{
+  grub_uint64_t fileblock;
+  /* First block on disk, 0 if the run isn't recorded.  */
+  grub_disk_addr_t start;
+  grub_uint32_t count;
+};
+
 struct grub_fshelp_node
 {
   struct grub_udf_data *data;
   int part_ref;
+  /* Decoded allocation descriptors, only set up for opened files.  */
+  int extents_read;
+  grub_size_t extent_count;
+  struct grub_udf_extent *extents;
   union
   {
     struct grub_udf_file_entry fe;
@@ -420,6 +433,9 @@ grub_udf_read_icb (struct grub_udf_data *data,
 
   node->part_ref = icb->block.part_ref;
   node->data = data;
+  node->extents_read = 0;
+  node->extent_count = 0;
+  node->extents = NULL;
   return 0;
 }
 
@@ -564,6 +580,245 @@ fail:
   return 0;
 }
 
+/* Decode all allocation descriptors of NODE into NODE->extents, merging
+   runs that are contiguous on disk.  */
+static grub_err_t
+grub_udf_load_extents (grub_fshelp_node_t node)
+{
+  struct grub_udf_data *data = node->data;
+  grub_uint32_t bsize = U32 (data->lvd.bsize);
+  grub_uint64_t size = U64 (node->block.fe.file_size);
+  grub_uint64_t filebytes = 0;
+  grub_size_t alloc = 0;
+  char *buf = NULL;
+  char *ptr;
+  grub_ssize_t len;
+  grub_size_t adsize;
+  int is_short, added = 1;
+
+  switch (U16 (node->block.fe.tag.tag_ident))
+    {
+    case GRUB_UDF_TAG_IDENT_FE:
+      ptr = (char *) &node->block.fe.ext_attr[0] + U32 (node->block.fe.ext_attr_length);
+      len = U32 (node->block.fe.alloc_descs_length);
+      break;
+
+    case GRUB_UDF_TAG_IDENT_EFE:
+      ptr = (char *) &node->block.efe.ext_attr[0] + U32 (node->block.efe.ext_attr_length);
+      len = U32 (node->block.efe.alloc_descs_length);
+      break;
+
+    default:
+      return grub_error (GRUB_ERR_BAD_FS, "invalid file entry");
+    }
+
+  is_short = ((U16 (node->block.fe.icbtag.flags) & GRUB_UDF_ICBTAG_FLAG_AD_MASK)
+	      == GRUB_UDF_ICBTAG_FLAG_AD_SHORT);
+  adsize = is_short ? sizeof (struct grub_udf_short_ad)
+    : sizeof (struct grub_udf_long_ad);
+
+  while (len >= (grub_ssize_t) adsize && filebytes < size)
+    {
+      grub_uint32_t adlen, adtype, position;
+      grub_uint16_t part_ref;
+      grub_disk_addr_t start;
+      struct grub_udf_extent *last;
+
+      if (is_short)
+	{
+	  struct grub_udf_short_ad *ad = (struct grub_udf_short_ad *) ptr;
+
+	  adlen = U32 (ad->length);
+	  position = ad->position;
+	  part_ref = node->part_ref;
+	}
+      else
+	{
+	  struct grub_udf_long_ad *ad = (struct grub_udf_long_ad *) ptr;
+
+	  adlen = U32 (ad->length);
+	  position = ad->block.block_num;
+	  part_ref = ad->block.part_ref;
+	}
+      adtype = adlen >> 30;
+      adlen &= 0x3fffffff;
+
+      if (adtype == 3)
+	{
+	  struct grub_udf_aed *extension;
+	  grub_disk_addr_t sec;
+
+	  /* An extension without any descriptor is most likely a loop.  */
+	  if (!added)
+	    {
+	      grub_error (GRUB_ERR_BAD_FS, "invalid aed chain");
+	      goto fail;
+	    }
+	  added = 0;
+
+	  sec = grub_udf_get_block (data, part_ref, position);
+	  if (grub_errno)
+	    goto fail;
+	  if (!buf)
+	    {
+	      buf = grub_malloc (bsize);
+	      if (!buf)
+		goto fail;
+	    }
+	  if (adlen > bsize)
+	    adlen = bsize;
+	  if (adlen < sizeof (struct grub_udf_aed))
+	    {
+	      grub_error (GRUB_ERR_BAD_FS, "invalid aed length");
+	      goto fail;
+	    }
+	  if (grub_disk_read (data->disk, sec << data->lbshift, 0, adlen, buf))
+	    goto fail;
+
+	  extension = (struct grub_udf_aed *) buf;
+	  if (U16 (extension->tag.tag_ident) != GRUB_UDF_TAG_IDENT_AED)
+	    {
+	      grub_error (GRUB_ERR_BAD_FS, "invalid aed tag");
+	      goto fail;
+	    }
+
+	  len = U32 (extension->ae_len);
+	  if (len > (grub_ssize_t) (adlen - sizeof (struct grub_udf_aed)))
+	    len = adlen - sizeof (struct grub_udf_aed);
+	  ptr = buf + sizeof (struct grub_udf_aed);
+	  continue;
+	}
+
+      ptr += adsize;
+      len -= adsize;
+      if (!adlen)
+	continue;
+      added = 1;
+
+      /* Only the last extent may end in the middle of a block.  */
+      if (filebytes & (bsize - 1))
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "unaligned extent");
+	  goto fail;
+	}
+
+      if (U32 (position) & GRUB_UDF_EXT_MASK)
+	start = 0;
+      else
+	{
+	  start = grub_udf_get_block (data, part_ref, position);
+	  if (grub_errno)
+	    goto fail;
+	}
+
+      last = node->extent_count ? &node->extents[node->extent_count - 1] : 0;
+      if (last
+	  && last->fileblock + last->count
+	  == (filebytes >> (GRUB_DISK_SECTOR_BITS + data->lbshift))
+	  && ((!last->start && !start)
+	      || (last->start && last->start + last->count == start))
+	  && last->count + ((adlen + bsize - 1) / bsize) > last->count)
+	{
+	  last->count += (adlen + bsize - 1) / bsize;
+	  filebytes += adlen;
+	  continue;
+	}
+
+      if (node->extent_count == alloc)
+	{
+	  struct grub_udf_extent *extents;
+
+	  alloc = alloc ? 2 * alloc : 8;
+	  extents = grub_realloc (node->extents, alloc * sizeof (extents[0]));
+	  if (!extents)
+	    goto fail;
+	  node->extents = extents;
+	}
+
+      last = &node->extents[node->extent_count++];
+      last->fileblock = filebytes >> (GRUB_DISK_SECTOR_BITS + data->lbshift);
+      last->start = start;
+      last->count = (adlen + bsize - 1) / bsize;
+      filebytes += adlen;
+    }
+
+  grub_free (buf);
+  return GRUB_ERR_NONE;
+
+ fail:
+  grub_free (buf);
+  grub_free (node->extents);
+  node->extents = NULL;
+  node->extent_count = 0;
+  return grub_errno;
+}
+
+/* Read LEN bytes at POS of NODE using its decoded extents, with one disk
+   read per extent.  Blocks not covered by any extent read as zeroes,
+   like grub_udf_read_block does.  */
+static grub_err_t
+grub_udf_read_extents (grub_fshelp_node_t node,
+		       grub_disk_read_hook_t read_hook, void *read_hook_data,
+		       grub_off_t pos, grub_size_t len, char *buf)
+{
+  grub_disk_t disk = node->data->disk;
+  int shift = GRUB_DISK_SECTOR_BITS + node->data->lbshift;
+  grub_size_t lo = 0, hi = node->extent_count;
+
+  /* Find the last extent starting at or before POS.  */
+  while (hi - lo > 1)
+    {
+      grub_size_t mid = (lo + hi) / 2;
+      if (node->extents[mid].fileblock <= (pos >> shift))
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  while (len)
+    {
+      struct grub_udf_extent *e = 0;
+      grub_uint64_t blk = pos >> shift;
+      grub_size_t n = len;
+
+      while (lo < node->extent_count
+	     && blk >= node->extents[lo].fileblock + node->extents[lo].count)
+	lo++;
+      if (lo < node->extent_count && blk >= node->extents[lo].fileblock)
+	e = &node->extents[lo];
+
+      if (e)
+	{
+	  grub_off_t skip = pos - (e->fileblock << shift);
+
+	  if (n > ((grub_uint64_t) e->count << shift) - skip)
+	    n = ((grub_uint64_t) e->count << shift) - skip;
+	}
+      else if (lo < node->extent_count
+	       && n > (node->extents[lo].fileblock << shift) - pos)
+	n = (node->extents[lo].fileblock << shift) - pos;
+
+      if (e && e->start)
+	{
+	  disk->read_hook = read_hook;
+	  disk->read_hook_data = read_hook_data;
+	  grub_disk_read (disk, e->start << node->data->lbshift,
+			  pos - (e->fileblock << shift), n, buf);
+	  disk->read_hook = 0;
+	  if (grub_errno)
+	    return grub_errno;
+	}
+      else
+	grub_memset (buf, 0, n);
+
+      buf += n;
+      pos += n;
+      len -= n;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
 static grub_ssize_t
 grub_udf_read_file (grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data,
@@ -591,6 +846,14 @@ grub_udf_read_file (grub_fshelp_node_t node,
       return 0;
     }
 
+  if (node->extents)
+    {
+      if (grub_udf_read_extents (node, read_hook, read_hook_data,
+				 pos, len, buf))
+	return -1;
+      return len;
+    }
+
   return grub_fshelp_read_file (node->data->disk, node,
 				read_hook, read_hook_data,
 				pos, len, buf, grub_udf_read_block,
@@ -874,6 +1137,9 @@ grub_udf_iterate_dir (grub_fshelp_node_t dir,
 
   /* The current directory is not stored.  */
   grub_memcpy (child, dir, get_fshelp_size (dir->data));
+  child->extents_read = 0;
+  child->extent_count = 0;
+  child->extents = NULL;
 
   if (hook (".", GRUB_FSHELP_DIR, child, hook_data))
     return 1;
@@ -1169,6 +1435,20 @@ grub_udf_read (grub_file_t file, char *buf, grub_size_t len)
 {
   struct grub_fshelp_node *node = (struct grub_fshelp_node *) file->data;
 
+  /* Decode the allocation descriptors once instead of walking them for
+     every block.  On failure, fall back to doing just that.  */
+  if (!node->extents_read)
+    {
+      grub_uint16_t ad = (U16 (node->block.fe.icbtag.flags)
+			  & GRUB_UDF_ICBTAG_FLAG_AD_MASK);
+
+      node->extents_read = 1;
+      if ((ad == GRUB_UDF_ICBTAG_FLAG_AD_SHORT
+	   || ad == GRUB_UDF_ICBTAG_FLAG_AD_LONG)
+	  && grub_udf_load_extents (node))
+	grub_errno = GRUB_ERR_NONE;
+    }
+
   return grub_udf_read_file (node, file->read_hook, file->read_hook_data,
 			     file->offset, len, buf);
 }
@@ -1180,6 +1460,7 @@ grub_udf_close (grub_file_t file)
     {
       struct grub_fshelp_node *node = (struct grub_fshelp_node *) file->data;
 
+      grub_free (node->extents);
       grub_free (node->data);
       grub_free (node);
     }
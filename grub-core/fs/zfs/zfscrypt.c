@@ -305,6 +305,22 @@ grub_zfs_decrypt_real (grub_crypto_cipher_handle_t cipher,
   return GRUB_ERR_NONE;
 }
 
+/* Prefer the AES implementation with the highest priority (e.g. hwaes)
+   and fall back to the portable one.  */
+static grub_crypto_cipher_handle_t
+grub_zfs_aes_open (void)
+{
+  const gcry_cipher_spec_t *aes;
+
+  aes = grub_crypto_lookup_cipher_by_name ("AES");
+  if (!aes)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      aes = GRUB_CIPHER_AES;
+    }
+  return grub_crypto_cipher_open (aes);
+}
+
 static grub_crypto_cipher_handle_t
 grub_zfs_load_key_real (const struct grub_zfs_key *key,
 			grub_size_t keysize,
@@ -334,7 +350,7 @@ grub_zfs_load_key_real (const struct grub_zfs_key *key,
       grub_crypto_cipher_handle_t cipher;
       grub_uint8_t decrypted[32], mac[32], wrap_key_real[32];
       gcry_err_code_t err;
-      cipher = grub_crypto_cipher_open (GRUB_CIPHER_AES);
+      cipher = grub_zfs_aes_open ();
       if (!cipher)
 	{
 	  grub_errno = GRUB_ERR_NONE;
@@ -387,7 +403,7 @@ grub_zfs_load_key_real (const struct grub_zfs_key *key,
 	  grub_crypto_cipher_close (cipher);
 	  continue;
 	}
-      ret = grub_crypto_cipher_open (GRUB_CIPHER_AES);
+      ret = grub_zfs_aes_open ();
       if (!ret)
 	{
 	  grub_errno = GRUB_ERR_NONE;
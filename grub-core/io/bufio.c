@@ -22,6 +22,7 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/fs.h>
+#include <grub/disk.h>
 #include <grub/bufio.h>
 #include <grub/dl.h>
 
@@ -30,13 +31,28 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define GRUB_BUFIO_DEF_SIZE	8192
 #define GRUB_BUFIO_MAX_SIZE	1048576
 
+/* Data of the underlying file read from AT on.  */
+struct grub_bufio_buffer
+{
+  char *data;
+  grub_size_t alloc;
+  grub_size_t len;
+  grub_off_t at;
+};
+
 struct grub_bufio
 {
   grub_file_t file;
+  /* How much the next refill reads.  It doubles while the file is read
+     sequentially and drops back to MIN_SIZE after a seek.  */
   grub_size_t block_size;
-  grub_size_t buffer_len;
-  grub_off_t buffer_at;
-  char buffer[0];
+  grub_size_t min_size;
+  /* Where the last read from FILE ended.  */
+  grub_off_t next_at;
+  /* The buffer refilled last, and the one before it, which is kept for
+     short seeks backward.  */
+  struct grub_bufio_buffer buffers[2];
+  int cur;
 };
 typedef struct grub_bufio *grub_bufio_t;
 
@@ -61,7 +77,7 @@ grub_bufio_open (grub_file_t io, int size)
     size = ((io->size > GRUB_BUFIO_MAX_SIZE) ? GRUB_BUFIO_MAX_SIZE :
             io->size);
 
-  bufio = grub_zalloc (sizeof (struct grub_bufio) + size);
+  bufio = grub_zalloc (sizeof (struct grub_bufio));
   if (! bufio)
     {
       grub_free (file);
@@ -70,6 +86,8 @@ grub_bufio_open (grub_file_t io, int size)
 
   bufio->file = io;
   bufio->block_size = size;
+  bufio->min_size = size;
+  bufio->next_at = GRUB_FILE_SIZE_UNKNOWN;
 
   file->device = io->device;
   file->size = io->size;
@@ -99,85 +117,143 @@ grub_buffile_open (const char *name, int size)
   return file;
 }
 
+/* Read from the underlying file, remembering where the read ended.  */
 static grub_ssize_t
-grub_bufio_read (grub_file_t file, char *buf, grub_size_t len)
+read_at (grub_bufio_t bufio, grub_off_t offset, char *buf, grub_size_t len)
 {
-  grub_size_t res = 0;
-  grub_off_t next_buf;
-  grub_bufio_t bufio = file->data;
   grub_ssize_t really_read;
 
-  if (file->size == GRUB_FILE_SIZE_UNKNOWN)
-    file->size = bufio->file->size;
-
-  /* First part: use whatever we already have in the buffer.  */
-  if ((file->offset >= bufio->buffer_at) &&
-      (file->offset < bufio->buffer_at + bufio->buffer_len))
+  grub_file_seek (bufio->file, offset);
+  really_read = grub_file_read (bufio->file, buf, len);
+  if (really_read < 0)
     {
-      grub_size_t n;
-      grub_uint64_t pos;
+      bufio->next_at = GRUB_FILE_SIZE_UNKNOWN;
+      return -1;
+    }
+  bufio->next_at = offset + really_read;
+  return really_read;
+}
 
-      pos = file->offset - bufio->buffer_at;
-      n = bufio->buffer_len - pos;
-      if (n > len)
-        n = len;
+/* Refill the older buffer with data from OFFSET on.  */
+static grub_err_t
+fill_buffer (grub_bufio_t bufio, grub_off_t offset)
+{
+  struct grub_bufio_buffer *b = &bufio->buffers[! bufio->cur];
+  grub_off_t at = offset;
+  grub_size_t size;
+  grub_ssize_t really_read;
 
-      grub_memcpy (buf, &bufio->buffer[pos], n);
-      len -= n;
-      res += n;
+  /* Read more at a time while the file is read sequentially.  After a
+     seek start over with the size asked for, from the beginning of the
+     sector like a disk read would.  */
+  if (offset == bufio->next_at)
+    {
+      if (bufio->block_size < GRUB_BUFIO_MAX_SIZE / 2)
+	bufio->block_size *= 2;
+      else
+	bufio->block_size = GRUB_BUFIO_MAX_SIZE;
+    }
+  else
+    {
+      bufio->block_size = bufio->min_size;
+      at &= ~((grub_off_t) GRUB_DISK_SECTOR_SIZE - 1);
+    }
 
-      buf += n;
+  size = bufio->block_size + (offset - at);
+  if (bufio->file->size != GRUB_FILE_SIZE_UNKNOWN)
+    {
+      if (at >= bufio->file->size)
+	size = 0;
+      else if (size > bufio->file->size - at)
+	size = bufio->file->size - at;
     }
-  if (len == 0)
-    return res;
 
-  /* Need to read some more.  */
-  next_buf = (file->offset + res + len - 1) & ~((grub_off_t) bufio->block_size - 1);
-  /* Now read between file->offset + res and bufio->buffer_at.  */
-  if (file->offset + res < next_buf)
+  /* Also give memory back once the buffer is more than twice the block
+     size, as after a seek, rather than keeping it at its largest for as
+     long as the file is open.  */
+  if (size > b->alloc
+      || b->alloc / 2 > bufio->block_size + GRUB_DISK_SECTOR_SIZE)
     {
-      grub_size_t read_now;
-      read_now = next_buf - (file->offset + res);
-      grub_file_seek (bufio->file, file->offset + res);
-      really_read = grub_file_read (bufio->file, buf, read_now);
-      if (really_read < 0)
-	return -1;
-      if (file->size == GRUB_FILE_SIZE_UNKNOWN)
-	file->size = bufio->file->size;
-      len -= really_read;
-      buf += really_read;
-      res += really_read;
-
-      /* Partial read. File ended unexpectedly. Save the last chunk in buffer.
-       */
-      if (really_read != (grub_ssize_t) read_now)
+      grub_free (b->data);
+      b->data = grub_malloc (size);
+      if (! b->data)
 	{
-	  bufio->buffer_len = really_read;
-	  if (bufio->buffer_len > bufio->block_size)
-	    bufio->buffer_len = bufio->block_size;
-	  bufio->buffer_at = file->offset + res - bufio->buffer_len;
-	  grub_memcpy (&bufio->buffer[0], buf - bufio->buffer_len,
-		       bufio->buffer_len);
-	  return res;
+	  b->alloc = 0;
+	  b->len = 0;
+	  return grub_errno;
 	}
+      b->alloc = size;
     }
 
-  /* Read into buffer.  */
-  grub_file_seek (bufio->file, next_buf);
-  really_read = grub_file_read (bufio->file, bufio->buffer,
-				bufio->block_size);
+  really_read = read_at (bufio, at, b->data, size);
   if (really_read < 0)
-    return -1;
-  bufio->buffer_at = next_buf;
-  bufio->buffer_len = really_read;
+    {
+      b->len = 0;
+      return grub_errno;
+    }
+  b->at = at;
+  b->len = really_read;
+  bufio->cur = ! bufio->cur;
+  return GRUB_ERR_NONE;
+}
+
+static grub_ssize_t
+grub_bufio_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  grub_size_t res = 0;
+  grub_off_t offset = file->offset;
+  grub_bufio_t bufio = file->data;
+  struct grub_bufio_buffer *b;
+  grub_ssize_t really_read;
+  grub_size_t n;
+  int i;
 
   if (file->size == GRUB_FILE_SIZE_UNKNOWN)
     file->size = bufio->file->size;
 
-  if (len > bufio->buffer_len)
-    len = bufio->buffer_len;
-  grub_memcpy (buf, &bufio->buffer[file->offset + res - next_buf], len);
-  res += len;
+  while (len > 0)
+    {
+      /* Use whatever either buffer has.  */
+      for (i = 0; i < 2; i++)
+	{
+	  b = &bufio->buffers[i == 0 ? bufio->cur : ! bufio->cur];
+	  if (offset >= b->at && offset < b->at + b->len)
+	    break;
+	}
+      if (i < 2)
+	{
+	  n = b->at + b->len - offset;
+	  if (n > len)
+	    n = len;
+	  grub_memcpy (buf, b->data + (offset - b->at), n);
+	  buf += n;
+	  len -= n;
+	  res += n;
+	  offset += n;
+	  continue;
+	}
+
+      /* A read at least as large as a block goes straight to the caller,
+	 rather than through a buffer.  */
+      if (len >= bufio->block_size)
+	{
+	  really_read = read_at (bufio, offset, buf, len);
+	  if (really_read < 0)
+	    return -1;
+	  res += really_read;
+	  break;
+	}
+
+      if (fill_buffer (bufio, offset))
+	return -1;
+      b = &bufio->buffers[bufio->cur];
+      /* The file ended.  */
+      if (offset >= b->at + b->len)
+	break;
+    }
+
+  if (file->size == GRUB_FILE_SIZE_UNKNOWN)
+    file->size = bufio->file->size;
 
   return res;
 }
@@ -188,6 +264,8 @@ grub_bufio_close (grub_file_t file)
   grub_bufio_t bufio = file->data;
 
   grub_file_close (bufio->file);
+  grub_free (bufio->buffers[0].data);
+  grub_free (bufio->buffers[1].data);
   grub_free (bufio);
 
   file->device = 0;
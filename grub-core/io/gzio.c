@@ -57,6 +57,75 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 #define INBUFSIZ  0x2000
 
+/*
+   Huffman codes are decoded with a table indexed by the next LBITS (or
+   DBITS for distances) bits of the input.  A code no longer than that is
+   found with a single lookup, as it fills in every entry it is a prefix
+   of.  Longer codes, which are necessarily the rarer ones, take a second
+   lookup in a subtable linked from the entry of their first LBITS bits
+   and sized for the longest code sharing them.
+
+   The values are the ones zlib uses, and ENOUGH_L and ENOUGH_D are the
+   most entries any valid set of codes can need with them, as computed by
+   zlib's enough.c.
+ */
+#define LBITS		9
+#define DBITS		6
+#define ENOUGH_L	852
+#define ENOUGH_D	592
+
+/* Huffman decoding table entry.  OP is HUFT_LITERAL for a literal in VAL,
+   HUFT_BASE plus the number of extra bits for a length or distance base
+   in VAL, HUFT_EOB for the end of block or HUFT_INVALID for an unused
+   code.  Any other value links to the subtable VAL entries into the
+   table, indexed by that many bits.  BITS is the number of bits of the
+   code this entry decodes.  */
+struct huft
+{
+  grub_uint8_t op;
+  grub_uint8_t bits;
+  grub_uint16_t val;
+};
+
+#define HUFT_LITERAL	0
+#define HUFT_BASE	16
+#define HUFT_INVALID	64
+#define HUFT_EOB	(HUFT_INVALID | 32)
+
+/* Uncompressed distance between two seek points, initially.  */
+#define GZIO_POINT_INTERVAL	(1 << 20)
+
+/* Most seek points kept for one file.  Each holds a copy of the window,
+   so this bounds the index to 4 MiB.  Once it is full every other point
+   is dropped and the interval doubled.  */
+#define GZIO_MAX_POINTS		128
+
+/* A point at a window boundary where decompression can be resumed, so
+   that seeking backwards doesn't need to restart from the beginning.  */
+struct grub_gzio_point
+{
+  /* The uncompressed offset, a multiple of WSIZE.  */
+  grub_off_t out;
+  /* The input offset and the bit buffer at that point.  */
+  grub_off_t in;
+  unsigned long bb;
+  unsigned bk;
+  /* The same at the start of the current block, to rebuild its Huffman
+     tables from its header.  */
+  grub_off_t block_in;
+  unsigned long block_bb;
+  unsigned block_bk;
+  /* The state of the current block.  */
+  int block_type;
+  int block_len;
+  int last_block;
+  int code_state;
+  unsigned inflate_n;
+  unsigned inflate_d;
+  /* The window preceding the point.  */
+  grub_uint8_t slide[WSIZE];
+};
+
 /* The state stored in filesystem-specific data.  */
 struct grub_gzio
 {
@@ -82,6 +151,10 @@ struct grub_gzio
   /* The input buffer.  */
   grub_uint8_t inbuf[INBUFSIZ];
   int inbuf_d;
+  /* The number of bytes read into the input buffer.  */
+  int inbuf_len;
+  /* The offset of the input buffer in the underlying file.  */
+  grub_off_t inbuf_off;
   /* The bit buffer.  */
   unsigned long bb;
   /* The bits in the bit buffer.  */
@@ -91,15 +164,23 @@ struct grub_gzio
   /* Current position in the slide.  */
   unsigned wp;
   /* The literal/length code table.  */
-  struct huft *tl;
+  struct huft lcode[ENOUGH_L];
   /* The distance code table.  */
-  struct huft *td;
+  struct huft dcode[ENOUGH_D];
   /* The lookup bits for the literal/length code table. */
   int bl;
   /* The lookup bits for the distance code table.  */
   int bd;
   /* The original offset value.  */
   grub_off_t saved_offset;
+  /* Where the current block started, see struct grub_gzio_point.  */
+  grub_off_t block_in;
+  unsigned long block_bb;
+  unsigned block_bk;
+  /* The seek points recorded so far, in increasing order.  */
+  struct grub_gzio_point **points;
+  unsigned num_points;
+  grub_off_t point_interval;
 };
 typedef struct grub_gzio *grub_gzio_t;
 
@@ -229,26 +310,6 @@ test_gzip_header (grub_file_t file)
 }
 
 
-/* Huffman code lookup table entry--this entry is four bytes for machines
-   that have 16-bit pointers (e.g. PC's in the small or medium model).
-   Valid extra bits are 0..13.  e == 15 is EOB (end of block), e == 16
-   means that v is a literal, 16 < e < 32 means that v is a pointer to
-   the next table, which codes e - 16 bits, and lastly e == 99 indicates
-   an unused code.  If a code with e == 99 is looked up, this implies an
-   error in the data. */
-struct huft
-{
-  uch e;			/* number of extra bits or operation */
-  uch b;			/* number of bits in this code or subcode */
-  union
-    {
-      ush n;			/* literal, length base, or distance base */
-      struct huft *t;		/* pointer to next level of table */
-    }
-  v;
-};
-
-
 /* The inflate algorithm uses a sliding 32K byte window on the uncompressed
    stream to find repeated byte strings.  This is implemented here as a
    circular buffer.  The index is updated simply by incrementing and then
@@ -284,46 +345,10 @@ static ush cpdext[] =
   12, 12, 13, 13};
 
 
-/*
-   Huffman code decoding is performed using a multi-level table lookup.
-   The fastest way to decode is to simply build a lookup table whose
-   size is determined by the longest code.  However, the time it takes
-   to build this table can also be a factor if the data being decoded
-   is not very long.  The most common codes are necessarily the
-   shortest codes, so those codes dominate the decoding time, and hence
-   the speed.  The idea is you can have a shorter table that decodes the
-   shorter, more probable codes, and then point to subsidiary tables for
-   the longer codes.  The time it costs to decode the longer codes is
-   then traded against the time it takes to make longer tables.
-
-   This results of this trade are in the variables lbits and dbits
-   below.  lbits is the number of bits the first level table for literal/
-   length codes can decode in one step, and dbits is the same thing for
-   the distance codes.  Subsequent tables are also less than or equal to
-   those sizes.  These values may be adjusted either when all of the
-   codes are shorter than that, in which case the longest code length in
-   bits is used, or when the shortest code is *longer* than the requested
-   table size, in which case the length of the shortest code in bits is
-   used.
-
-   There are two different values for the two tables, since they code a
-   different number of possibilities each.  The literal/length table
-   codes 286 possible values, or in a flat code, a little over eight
-   bits.  The distance table codes 30 possible values, or a little less
-   than five bits, flat.  The optimum values for speed end up being
-   about one bit more than those, so lbits is 8+1 and dbits is 5+1.
-   The optimum values may differ though from machine to machine, and
-   possibly even between compilers.  Your mileage may vary.
- */
-
-
-static int lbits = 9;		/* bits in base literal/length lookup table */
-static int dbits = 6;		/* bits in base distance lookup table */
-
-
-/* If BMAX needs to be larger than 16, then h and x[] should be ulg. */
-#define BMAX 16			/* maximum bit length of any code (16 for explode) */
-#define N_MAX 288		/* maximum number of codes in any set */
+/* maximum bit length of any code */
+#define BMAX 15
+/* maximum number of codes in any set */
+#define N_MAX 288
 
 
 /* Macros for inflate() bit peeking and grabbing.
@@ -339,21 +364,8 @@ static int dbits = 6;		/* bits in base distance lookup table */
    variables for speed, and are initialized at the beginning of a
    routine that uses these macros from a global bit buffer and count.
 
-   If we assume that EOB will be the longest code, then we will never
-   ask for bits with NEEDBITS that are beyond the end of the stream.
-   So, NEEDBITS should not read any more bytes than are needed to
-   meet the request.  Then no bytes need to be "returned" to the buffer
-   at the end of the last block.
-
-   However, this assumption is not true for fixed blocks--the EOB code
-   is 7 bits, but the other literal/length codes can be 8 or 9 bits.
-   (The EOB code is shorter than other codes because fixed blocks are
-   generally short.  So, while a block always has an EOB, many other
-   literal/length codes have a significantly lower probability of
-   showing up at all.)  However, by making the first table have a
-   lookup of seven bits, the EOB code will be found in that first
-   lookup, and so will not require that too many bits be pulled from
-   the stream.
+   These are only used to parse block headers.  The decoding of the
+   codes themselves uses the faster FILLBITS and PULLBITS below.
  */
 
 static ush mask_bits[] =
@@ -381,7 +393,10 @@ get_byte (grub_gzio_t gzio)
 		     || gzio->inbuf_d == INBUFSIZ))
     {
       gzio->inbuf_d = 0;
-      grub_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
+      gzio->inbuf_off = grub_file_tell (gzio->file);
+      gzio->inbuf_len = grub_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
+      if (gzio->inbuf_len < 0)
+	gzio->inbuf_len = 0;
     }
 
   return gzio->inbuf[gzio->inbuf_d++];
@@ -399,370 +414,424 @@ gzio_seek (grub_gzio_t gzio, grub_off_t off)
 	gzio->mem_input_off = off;
     }
   else
-    grub_file_seek (gzio->file, off);
+    {
+      grub_file_seek (gzio->file, off);
+      /* Refill the input buffer on the next get_byte.  */
+      gzio->inbuf_off = off - INBUFSIZ;
+      gzio->inbuf_d = INBUFSIZ;
+      gzio->inbuf_len = INBUFSIZ;
+    }
 }
 
-/* more function prototypes */
-static int huft_build (unsigned *, unsigned, unsigned, ush *, ush *,
-		       struct huft **, int *);
-static int huft_free (struct huft *);
-static int inflate_codes_in_window (grub_gzio_t);
+/* The offset of the next input byte get_byte returns.  */
+static grub_off_t
+gzio_tell (grub_gzio_t gzio)
+{
+  if (gzio->mem_input)
+    return gzio->mem_input_off;
+  return gzio->inbuf_off + gzio->inbuf_d;
+}
 
+/* The next unread byte of the input buffer.  */
+static const uch *
+input_next (grub_gzio_t gzio)
+{
+  if (gzio->mem_input)
+    return gzio->mem_input + gzio->mem_input_off;
+  return gzio->inbuf + gzio->inbuf_d;
+}
 
-/* Given a list of code lengths and a maximum table size, make a set of
-   tables to decode that set of codes.  Return zero on success, one if
-   the given code set is incomplete (the tables are still built in this
-   case), two if the input is invalid (all zero length codes or an
-   oversubscribed set of lengths), and three if not enough memory. */
+/* The end of the data in the input buffer.  */
+static const uch *
+input_end (grub_gzio_t gzio)
+{
+  if (gzio->mem_input)
+    return gzio->mem_input + gzio->mem_input_size;
+  /* get_byte may have run past a short read.  */
+  if (gzio->inbuf_d > gzio->inbuf_len)
+    return gzio->inbuf + gzio->inbuf_d;
+  return gzio->inbuf + gzio->inbuf_len;
+}
+
+/* Mark the input buffer as consumed up to IN.  */
+static void
+input_consume (grub_gzio_t gzio, const uch *in)
+{
+  if (gzio->mem_input)
+    gzio->mem_input_off = in - gzio->mem_input;
+  else
+    gzio->inbuf_d = in - gzio->inbuf;
+}
+
+
+/* Given a list of N code lengths, make the table to decode that set of
+   codes in TABLE, which has room for SIZE entries.  Symbols below S are
+   literals, except for 256 which is the end of block, and the others are
+   looked up in the BASE and EXTRA lists.  *BITS is the size of the first
+   level table, and is lowered to the longest code if that is shorter.
+   Return zero on success, one if the given code set is incomplete (the
+   table is still built in this case), and two if the input is invalid
+   (an oversubscribed set of lengths).  */
 
 static int
-huft_build (unsigned *b,	/* code lengths in bits (all assumed <= BMAX) */
-	    unsigned n,		/* number of codes (assumed <= N_MAX) */
-	    unsigned s,		/* number of simple-valued codes (0..s-1) */
-	    ush * d,		/* list of base values for non-simple codes */
-	    ush * e,		/* list of extra bits for non-simple codes */
-	    struct huft **t,	/* result: starting table */
-	    int *m)		/* maximum lookup bits, returns actual */
+huft_build (const unsigned *b, unsigned n, unsigned s, const ush *base,
+	    const ush *extra, struct huft *table, unsigned size, int *bits)
 {
-  unsigned a;			/* counter for codes of length k */
-  unsigned c[BMAX + 1];		/* bit length count table */
-  unsigned f;			/* i repeats in table every f entries */
-  int g;			/* maximum code length */
-  int h;			/* table level */
-  register unsigned i;		/* counter, current code */
-  register unsigned j;		/* counter */
-  register int k;		/* number of bits in current code */
-  int l;			/* bits per table (returned in m) */
-  register unsigned *p;		/* pointer into c[], b[], or v[] */
-  register struct huft *q;	/* points to current table */
-  struct huft r;		/* table entry for structure assignment */
-  struct huft *u[BMAX];		/* table stack */
-  unsigned v[N_MAX];		/* values in order of bit length */
-  register int w;		/* bits before this table == (l * h) */
-  unsigned x[BMAX + 1];		/* bit offsets, then code stack */
-  unsigned *xp;			/* pointer into x */
-  int y;			/* number of dummy codes added */
-  unsigned z;			/* number of entries in current table */
-
-  /* Generate counts for each bit length */
-  grub_memset ((char *) c, 0, sizeof (c));
-  p = b;
-  i = n;
-  do
+  unsigned count[BMAX + 1];	/* number of codes of each length */
+  unsigned next[BMAX + 1];	/* next code of each length */
+  unsigned code[N_MAX];		/* the codes, bit-reversed */
+  uch sub[1 << LBITS];		/* bits of the subtable for each prefix */
+  unsigned root;		/* bits of the first level table */
+  unsigned max;			/* longest code */
+  unsigned used;		/* table entries used so far */
+  unsigned i, j, len, rev;
+  int left;			/* number of prefix codes available */
+  struct huft entry, invalid;
+
+  for (len = 0; len <= BMAX; len++)
+    count[len] = 0;
+  for (i = 0; i < n; i++)
+    count[b[i]]++;
+
+  for (max = BMAX; max > 0 && ! count[max]; max--);
+
+  /* Check for an oversubscribed or incomplete set of lengths.  */
+  left = 1;
+  for (len = 1; len <= BMAX; len++)
     {
-      c[*p]++;			/* assume all entries <= BMAX */
-      p++;			/* Can't combine with above line (Solaris bug) */
-    }
-  while (--i);
-  if (c[0] == n)		/* null input--all zero length codes */
-    {
-      *t = (struct huft *) NULL;
-      *m = 0;
-      return 0;
+      left <<= 1;
+      left -= count[len];
+      if (left < 0)
+	return 2;
     }
 
-  /* Find minimum and maximum length, bound *m by those */
-  l = *m;
-  for (j = 1; j <= BMAX; j++)
-    if (c[j])
-      break;
-  k = j;			/* minimum code length */
-  if ((unsigned) l < j)
-    l = j;
-  for (i = BMAX; i; i--)
-    if (c[i])
-      break;
-  g = i;			/* maximum code length */
-  if ((unsigned) l > i)
-    l = i;
-  *m = l;
-
-  /* Adjust last length count to fill out codes, if needed */
-  for (y = 1 << j; j < i; j++, y <<= 1)
-    if ((y -= c[j]) < 0)
-      return 2;			/* bad input: more codes than bits */
-  if ((y -= c[i]) < 0)
-    return 2;
-  c[i] += y;
-
-  /* Generate starting offsets into the value table for each length */
-  x[1] = j = 0;
-  p = c + 1;
-  xp = x + 2;
-  while (--i)
-    {				/* note that i == g from above */
-      *xp++ = (j += *p++);
-    }
-
-  /* Make a table of values in order of bit lengths */
-  p = b;
-  i = 0;
-  do
+  /* Generate the codes, in canonical order, and reverse them since the
+     first bit sent is the most significant one.  */
+  next[1] = 0;
+  for (len = 1; len < BMAX; len++)
+    next[len + 1] = (next[len] + count[len]) << 1;
+  for (i = 0; i < n; i++)
     {
-      if ((j = *p++) != 0)
-	v[x[j]++] = i;
+      len = b[i];
+      if (! len)
+	continue;
+      j = next[len]++;
+      for (rev = 0; len; len--, j >>= 1)
+	rev = (rev << 1) | (j & 1);
+      code[i] = rev;
     }
-  while (++i < n);
-
-  /* Generate the Huffman codes and for each, make the table entries */
-  x[0] = i = 0;			/* first Huffman code is zero */
-  p = v;			/* grab values in bit order */
-  h = -1;			/* no tables yet--level -1 */
-  w = -l;			/* bits decoded == (l * h) */
-  u[0] = (struct huft *) NULL;	/* just to keep compilers happy */
-  q = (struct huft *) NULL;	/* ditto */
-  z = 0;			/* ditto */
-
-  /* go through the bit lengths (k already is bits in shortest code) */
-  for (; k <= g; k++)
-    {
-      a = c[k];
-      while (a--)
-	{
-	  /* here i is the Huffman code of length k bits for value *p */
-	  /* make tables up to required level */
-	  while (k > w + l)
-	    {
-	      h++;
-	      w += l;		/* previous table always l bits */
-
-	      /* compute minimum size table less than or equal to l bits */
-	      z = (z = (unsigned) (g - w)) > (unsigned) l ? (unsigned) l : z;	/* upper limit on table size */
-	      if ((f = 1 << (j = k - w)) > a + 1)	/* try a k-w bit table */
-		{		/* too few codes for k-w bit table */
-		  f -= a + 1;	/* deduct codes from patterns left */
-		  xp = c + k;
-		  while (++j < z)	/* try smaller tables up to z bits */
-		    {
-		      if ((f <<= 1) <= *++xp)
-			break;	/* enough codes to use up j bits */
-		      f -= *xp;	/* else deduct codes from patterns */
-		    }
-		}
-	      z = 1 << j;	/* table entries for j-bit table */
 
-	      /* allocate and link in new table */
-	      q = (struct huft *) grub_zalloc ((z + 1) * sizeof (struct huft));
-	      if (! q)
-		{
-		  if (h)
-		    huft_free (u[0]);
-		  return 3;
-		}
-
-	      *t = q + 1;	/* link to list for huft_free() */
-	      *(t = &(q->v.t)) = (struct huft *) NULL;
-	      u[h] = ++q;	/* table starts after link */
+  root = *bits;
+  if (root > max)
+    root = max;
+  *bits = root;
 
-	      /* connect to last table, if there is one */
-	      if (h)
-		{
-		  x[h] = i;	/* save pattern for backing up */
-		  r.b = (uch) l;	/* bits to dump before this table */
-		  r.e = (uch) (16 + j);		/* bits in this table */
-		  r.v.t = q;	/* pointer to this table */
-		  j = i >> (w - l);	/* (get around Turbo C bug) */
-		  u[h - 1][j] = r;	/* connect to last table */
-		}
-	    }
-
-	  /* set up table entry in r */
-	  r.b = (uch) (k - w);
-	  if (p >= v + n)
-	    r.e = 99;		/* out of values--invalid code */
-	  else if (*p < s)
-	    {
-	      r.e = (uch) (*p < 256 ? 16 : 15);		/* 256 is end-of-block code */
-	      r.v.n = (ush) (*p);	/* simple code is just the value */
-	      p++;		/* one compiler does not like *p++ */
-	    }
-	  else
-	    {
-	      r.e = (uch) e[*p - s];	/* non-simple--look up in lists */
-	      r.v.n = d[*p++ - s];
-	    }
+  invalid.op = HUFT_INVALID;
+  invalid.bits = 0;
+  invalid.val = 0;
+  used = 1 << root;
+  if (used > size)
+    return 2;
+  for (i = 0; i < used; i++)
+    table[i] = invalid;
+
+  /* Size a subtable for the longest code sharing each first level index,
+     and link it from that entry.  */
+  for (i = 0; i < (1U << root); i++)
+    sub[i] = 0;
+  for (i = 0; i < n; i++)
+    if (b[i] > root && b[i] - root > sub[code[i] & ((1 << root) - 1)])
+      sub[code[i] & ((1 << root) - 1)] = b[i] - root;
+  for (i = 0; i < (1U << root); i++)
+    if (sub[i])
+      {
+	if (used + (1U << sub[i]) > size)
+	  return 2;
+	table[i].op = sub[i];
+	table[i].bits = root;
+	table[i].val = used;
+	for (j = 0; j < (1U << sub[i]); j++)
+	  table[used + j] = invalid;
+	used += 1 << sub[i];
+      }
+
+  /* Fill in every entry whose index starts with a code.  */
+  for (i = 0; i < n; i++)
+    {
+      len = b[i];
+      if (! len)
+	continue;
 
-	  /* fill code-like entries with r */
-	  f = 1 << (k - w);
-	  for (j = i >> w; j < z; j += f)
-	    q[j] = r;
+      if (i < s)
+	{
+	  entry.op = (i == 256) ? HUFT_EOB : HUFT_LITERAL;
+	  entry.val = i;
+	}
+      else if (extra[i - s] == 99)
+	{
+	  entry.op = HUFT_INVALID;
+	  entry.val = 0;
+	}
+      else
+	{
+	  entry.op = HUFT_BASE + extra[i - s];
+	  entry.val = base[i - s];
+	}
 
-	  /* backwards increment the k-bit code i */
-	  for (j = 1 << (k - 1); i & j; j >>= 1)
-	    i ^= j;
-	  i ^= j;
+      if (len <= root)
+	{
+	  entry.bits = len;
+	  for (j = code[i]; j < (1U << root); j += 1 << len)
+	    table[j] = entry;
+	}
+      else
+	{
+	  struct huft *t = table + table[code[i] & ((1 << root) - 1)].val;
+	  unsigned sb = sub[code[i] & ((1 << root) - 1)];
 
-	  /* backup over finished tables */
-	  while ((i & ((1 << w) - 1)) != x[h])
-	    {
-	      h--;		/* don't need to update q */
-	      w -= l;
-	    }
+	  entry.bits = len - root;
+	  for (j = code[i] >> root; j < (1U << sb); j += 1 << (len - root))
+	    t[j] = entry;
 	}
     }
 
   /* Return true (1) if we were given an incomplete table */
-  return y != 0 && g != 1;
+  return left != 0 && max > 1;
 }
 
 
-/* Free the malloc'ed tables built by huft_build(), which makes a linked
-   list of the tables it made, with the links in a dummy first entry of
-   each table.  */
-static int
-huft_free (struct huft *t)
-{
-  register struct huft *p, *q;
-
-
-  /* Go through linked list, freeing from the malloced (t[-1]) address. */
-  p = t;
-  while (p != (struct huft *) NULL)
-    {
-      q = (--p)->v.t;
-      grub_free ((char *) p);
-      p = q;
-    }
-  return 0;
-}
-
+/* Macros for the decoding loop, which reads the input through pointers
+   into the input buffer, IN to IN_END, rather than through get_byte.
+   FILLBITS tops up the bit buffer from there, with a single unaligned
+   load when the bit buffer is 64 bits wide, so that most codes can be
+   decoded without looking at the input at all.  PULLBITS makes sure there
+   are N bits, falling back to get_byte once the input buffer runs out.
+   Unlike NEEDBITS this reads ahead in the stream, which is harmless as
+   nothing but the gzip trailer follows the last block.  */
+
+#define BB_BITS		(sizeof (ulg) * 8)
+
+#define FILLBITS() \
+  do \
+    { \
+      if (BB_BITS == 64 && in_end - in >= 8) \
+	{ \
+	  b |= (ulg) grub_le_to_cpu64 (grub_get_unaligned64 (in)) << k; \
+	  in += (63 - k) >> 3; \
+	  k |= 56; \
+	  b &= ((ulg) 1 << k) - 1; \
+	} \
+      else \
+	while (k <= BB_BITS - 8 && in < in_end) \
+	  { \
+	    b |= (ulg) *in++ << k; \
+	    k += 8; \
+	  } \
+    } \
+  while (0)
+
+#define PULLBITS(n) \
+  do \
+    { \
+      while (k < (n)) \
+	{ \
+	  if (in == in_end) \
+	    { \
+	      input_consume (gzio, in); \
+	      b |= (ulg) get_byte (gzio) << k; \
+	      in = input_next (gzio); \
+	      in_end = input_end (gzio); \
+	    } \
+	  else \
+	    b |= (ulg) *in++ << k; \
+	  k += 8; \
+	} \
+    } \
+  while (0)
 
 /*
- *  inflate (decompress) the codes in a deflated (compressed) block.
- *  Return an error code or zero if it all goes ok.
+ *  inflate (decompress) the codes in a deflated (compressed) block into
+ *  WIN, until the end of the block or WIN is full.  PREV is the window
+ *  before WIN, which is WIN itself when the slide is used circularly.
  */
 
-static int
-inflate_codes_in_window (grub_gzio_t gzio)
+static void
+inflate_codes_in_window (grub_gzio_t gzio, uch *win, const uch *prev)
 {
-  register unsigned e;		/* table entry flag/number of extra bits */
-  unsigned n, d;		/* length and index for copy */
+  const struct huft *t;		/* pointer to table entry */
+  const struct huft *lcode, *dcode;	/* the tables */
+  unsigned bl, bd;		/* lookup bits of the tables */
+  unsigned op;			/* table entry operation */
+  int copying;			/* in the middle of a copy */
+  unsigned n, d;		/* length and distance for copy */
   unsigned w;			/* current window position */
-  struct huft *t;		/* pointer to table entry */
+  unsigned e;			/* number of bytes to copy at once */
   unsigned ml, md;		/* masks for bl and bd bits */
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
+  ulg b;			/* bit buffer */
+  unsigned k;			/* number of bits in bit buffer */
+  const uch *in, *in_end;	/* unread input */
 
-  /* make local copies of globals */
+  /* make local copies of globals, which the compiler can't keep in
+     registers itself as writes to the window may alias them */
+  copying = gzio->code_state;
   d = gzio->inflate_d;
   n = gzio->inflate_n;
   b = gzio->bb;			/* initialize bit buffer */
   k = gzio->bk;
   w = gzio->wp;			/* initialize window position */
+  lcode = gzio->lcode;
+  dcode = gzio->dcode;
+  bl = gzio->bl;
+  bd = gzio->bd;
+  in = input_next (gzio);
+  in_end = input_end (gzio);
 
   /* inflate the coded data */
-  ml = mask_bits[gzio->bl];		/* precompute masks for speed */
-  md = mask_bits[gzio->bd];
+  ml = (1U << bl) - 1;		/* precompute masks for speed */
+  md = (1U << bd) - 1;
   for (;;)			/* do until end of block */
     {
-      if (! gzio->code_state)
+      if (copying)
 	{
-	  NEEDBITS ((unsigned) gzio->bl);
-	  if ((e = (t = gzio->tl + ((unsigned) b & ml))->e) > 16)
-	    do
-	      {
-		if (e == 99)
-		  {
-		    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-				"an unused code found");
-		    return 1;
-		  }
-		DUMPBITS (t->b);
-		e -= 16;
-		NEEDBITS (e);
-	      }
-	    while ((e = (t = t->v.t + ((unsigned) b & mask_bits[e]))->e) > 16);
-	  DUMPBITS (t->b);
-
-	  if (e == 16)		/* then it's a literal */
-	    {
-	      gzio->slide[w++] = (uch) t->v.n;
-	      if (w == WSIZE)
-		break;
-	    }
-	  else
-	    /* it's an EOB or a length */
+	  /* do the copy */
+	  while (n && w < WSIZE)
 	    {
-	      /* exit if end of block */
-	      if (e == 15)
+	      e = WSIZE - w;
+	      if (e > n)
+		e = n;
+
+	      if (d > w)
+		{
+		  /* The start is in the previous window.  */
+		  if (e > d - w)
+		    e = d - w;
+		  grub_memmove (win + w, prev + WSIZE - (d - w), e);
+		}
+	      else
 		{
-		  gzio->block_len = 0;
-		  break;
+		  /* Copies are mostly short, so do them inline, a word at a
+		     time unless the overlap is closer than that.  */
+		  uch *p = win + w;
+		  uch *end = p + e;
+		  const uch *q = p - d;
+
+		  if (d >= 8)
+		    for (; end - p >= 8; p += 8, q += 8)
+		      grub_set_unaligned64 (p, grub_get_unaligned64 (q));
+		  /* purposefully use the overlap for extra copies here!! */
+		  while (p < end)
+		    *p++ = *q++;
 		}
 
-	      /* get length of block to copy */
-	      NEEDBITS (e);
-	      n = t->v.n + ((unsigned) b & mask_bits[e]);
-	      DUMPBITS (e);
-
-	      /* decode distance of block to copy */
-	      NEEDBITS ((unsigned) gzio->bd);
-	      if ((e = (t = gzio->td + ((unsigned) b & md))->e) > 16)
-		do
-		  {
-		    if (e == 99)
-		      {
-			grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-				    "an unused code found");
-			return 1;
-		      }
-		    DUMPBITS (t->b);
-		    e -= 16;
-		    NEEDBITS (e);
-		  }
-		while ((e = (t = t->v.t + ((unsigned) b & mask_bits[e]))->e)
-		       > 16);
-	      DUMPBITS (t->b);
-	      NEEDBITS (e);
-	      d = w - t->v.n - ((unsigned) b & mask_bits[e]);
-	      DUMPBITS (e);
-	      gzio->code_state++;
+	      w += e;
+	      n -= e;
 	    }
+
+	  /* did we break from the loop too soon? */
+	  if (n)
+	    break;
+	  copying = 0;
 	}
 
-      if (gzio->code_state)
+      if (w == WSIZE)
+	break;
+
+      /* With room in the window and a word of input, a fill leaves at
+	 least 56 bits, enough for three literals from the first level
+	 table, so decode these without any checks.  */
+      if (BB_BITS == 64 && w < WSIZE - 3 && in_end - in >= 8)
 	{
-	  /* do the copy */
-	  do
+	  FILLBITS ();
+	  t = lcode + ((unsigned) b & ml);
+	  if (t->op == HUFT_LITERAL)
 	    {
-	      n -= (e = (e = WSIZE - ((d &= WSIZE - 1) > w ? d : w)) > n ? n
-		    : e);
-
-	      if (w - d >= e)
+	      DUMPBITS (t->bits);
+	      win[w++] = (uch) t->val;
+	      t = lcode + ((unsigned) b & ml);
+	      if (t->op == HUFT_LITERAL)
 		{
-		  grub_memmove (gzio->slide + w, gzio->slide + d, e);
-		  w += e;
-		  d += e;
-		}
-	      else
-		/* purposefully use the overlap for extra copies here!! */
-		{
-		  while (e--)
-		    gzio->slide[w++] = gzio->slide[d++];
+		  DUMPBITS (t->bits);
+		  win[w++] = (uch) t->val;
+		  t = lcode + ((unsigned) b & ml);
+		  if (t->op == HUFT_LITERAL)
+		    {
+		      DUMPBITS (t->bits);
+		      win[w++] = (uch) t->val;
+		    }
 		}
-
-	      if (w == WSIZE)
-		break;
+	      continue;
 	    }
-	  while (n);
+	}
+      else if (k < 32)
+	FILLBITS ();
+      PULLBITS (bl);
+      t = lcode + ((unsigned) b & ml);
+      op = t->op;
+      if (op && op < HUFT_BASE)
+	{
+	  DUMPBITS (t->bits);
+	  PULLBITS (op);
+	  t = lcode + t->val + ((unsigned) b & ((1U << op) - 1));
+	  op = t->op;
+	}
+      DUMPBITS (t->bits);
 
-	  if (! n)
-	    gzio->code_state--;
+      if (op == HUFT_LITERAL)
+	{
+	  win[w++] = (uch) t->val;
+	  continue;
+	}
 
-	  /* did we break from the loop too soon? */
-	  if (w == WSIZE)
-	    break;
+      if (op & HUFT_INVALID)
+	{
+	  /* exit if end of block */
+	  if (op == HUFT_EOB)
+	    {
+	      gzio->block_len = 0;
+	      break;
+	    }
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "an unused code found");
+	  break;
+	}
+
+      /* get length of block to copy */
+      op -= HUFT_BASE;
+      PULLBITS (op);
+      n = t->val + ((unsigned) b & ((1U << op) - 1));
+      DUMPBITS (op);
+
+      /* decode distance of block to copy */
+      PULLBITS (bd);
+      t = dcode + ((unsigned) b & md);
+      op = t->op;
+      if (op && op < HUFT_BASE)
+	{
+	  DUMPBITS (t->bits);
+	  PULLBITS (op);
+	  t = dcode + t->val + ((unsigned) b & ((1U << op) - 1));
+	  op = t->op;
 	}
+      DUMPBITS (t->bits);
+      if (op & HUFT_INVALID)
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "an unused code found");
+	  break;
+	}
+      op -= HUFT_BASE;
+      PULLBITS (op);
+      d = t->val + ((unsigned) b & ((1U << op) - 1));
+      DUMPBITS (op);
+      copying = 1;
     }
 
   /* restore the globals from the locals */
+  input_consume (gzio, in);
+  gzio->code_state = copying;
   gzio->inflate_d = d;
   gzio->inflate_n = n;
   gzio->wp = w;			/* restore global window pointer */
   gzio->bb = b;			/* restore global bit buffer */
   gzio->bk = k;
-
-  return ! gzio->block_len;
 }
 
 
@@ -797,9 +866,8 @@ init_stored_block (grub_gzio_t gzio)
 }
 
 
-/* get header for an inflated type 1 (fixed Huffman codes) block.  We should
-   either replace this with a custom decoder, or at least precompute the
-   Huffman tables. */
+/* get header for an inflated type 1 (fixed Huffman codes) block.  Building
+   the tables takes little compared with decoding even a short block.  */
 
 static void
 init_fixed_block (grub_gzio_t gzio)
@@ -816,8 +884,9 @@ init_fixed_block (grub_gzio_t gzio)
     l[i] = 7;
   for (; i < 288; i++)		/* make a complete, but wrong code set */
     l[i] = 8;
-  gzio->bl = 7;
-  if (huft_build (l, 288, 257, cplens, cplext, &gzio->tl, &gzio->bl) != 0)
+  gzio->bl = LBITS;
+  if (huft_build (l, 288, 257, cplens, cplext, gzio->lcode, ENOUGH_L,
+		  &gzio->bl) != 0)
     {
       if (grub_errno == GRUB_ERR_NONE)
 	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
@@ -828,14 +897,13 @@ init_fixed_block (grub_gzio_t gzio)
   /* set up distance table */
   for (i = 0; i < 30; i++)	/* make an incomplete code set */
     l[i] = 5;
-  gzio->bd = 5;
-  if (huft_build (l, 30, 0, cpdist, cpdext, &gzio->td, &gzio->bd) > 1)
+  gzio->bd = DBITS;
+  if (huft_build (l, 30, 0, cpdist, cpdext, gzio->dcode, ENOUGH_D,
+		  &gzio->bd) > 1)
     {
       if (grub_errno == GRUB_ERR_NONE)
 	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
 		    "failed in building a Huffman code table");
-      huft_free (gzio->tl);
-      gzio->tl = 0;
       return;
     }
 
@@ -859,6 +927,7 @@ init_dynamic_block (grub_gzio_t gzio)
   unsigned nl;			/* number of literal/length codes */
   unsigned nd;			/* number of distance codes */
   unsigned ll[286 + 30];	/* literal/length and distance code lengths */
+  const struct huft *t;		/* pointer to table entry */
   register ulg b;		/* bit buffer */
   register unsigned k;		/* number of bits in bit buffer */
 
@@ -894,7 +963,8 @@ init_dynamic_block (grub_gzio_t gzio)
 
   /* build decoding table for trees--single level, 7 bit lookup */
   gzio->bl = 7;
-  if (huft_build (ll, 19, 19, NULL, NULL, &gzio->tl, &gzio->bl) != 0)
+  if (huft_build (ll, 19, 19, NULL, NULL, gzio->lcode, ENOUGH_L,
+		  &gzio->bl) != 0)
     {
       grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
 		  "failed in building a Huffman code table");
@@ -908,9 +978,14 @@ init_dynamic_block (grub_gzio_t gzio)
   while ((unsigned) i < n)
     {
       NEEDBITS ((unsigned) gzio->bl);
-      j = (gzio->td = gzio->tl + ((unsigned) b & m))->b;
-      DUMPBITS (j);
-      j = gzio->td->v.n;
+      t = gzio->lcode + ((unsigned) b & m);
+      if (t->op != HUFT_LITERAL)
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "an unused code found");
+	  return;
+	}
+      DUMPBITS (t->bits);
+      j = t->val;
       if (j < 16)		/* length of code in bits (0..15) */
 	ll[i++] = l = j;	/* save last length in l */
       else if (j == 16)		/* repeat last length 3 to 6 times */
@@ -957,28 +1032,23 @@ init_dynamic_block (grub_gzio_t gzio)
 	}
     }
 
-  /* free decoding table for trees */
-  huft_free (gzio->tl);
-  gzio->td = 0;
-  gzio->tl = 0;
-
   /* restore the global bit buffer */
   gzio->bb = b;
   gzio->bk = k;
 
   /* build the decoding tables for literal/length and distance codes */
-  gzio->bl = lbits;
-  if (huft_build (ll, nl, 257, cplens, cplext, &gzio->tl, &gzio->bl) != 0)
+  gzio->bl = LBITS;
+  if (huft_build (ll, nl, 257, cplens, cplext, gzio->lcode, ENOUGH_L,
+		  &gzio->bl) != 0)
     {
       grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
 		  "failed in building a Huffman code table");
       return;
     }
-  gzio->bd = dbits;
-  if (huft_build (ll + nl, nd, 0, cpdist, cpdext, &gzio->td, &gzio->bd) != 0)
+  gzio->bd = DBITS;
+  if (huft_build (ll + nl, nd, 0, cpdist, cpdext, gzio->dcode, ENOUGH_D,
+		  &gzio->bd) != 0)
     {
-      huft_free (gzio->tl);
-      gzio->tl = 0;
       grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
 		  "failed in building a Huffman code table");
       return;
@@ -1031,9 +1101,177 @@ get_new_block (grub_gzio_t gzio)
 }
 
 
+/* Record a seek point at the current window boundary if the last one is
+   far enough behind.  PREV is the window just completed.  Failing to do
+   so is not an error.  */
+static void
+add_point (grub_gzio_t gzio, const uch *prev)
+{
+  struct grub_gzio_point *point;
+  unsigned i;
+
+  if (! gzio->file || gzio->saved_offset == 0
+      || (! gzio->block_len && gzio->last_block))
+    return;
+
+  if (! gzio->points)
+    {
+      gzio->points = grub_malloc (GZIO_MAX_POINTS * sizeof (gzio->points[0]));
+      if (! gzio->points)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+      gzio->point_interval = GZIO_POINT_INTERVAL;
+    }
+
+  if (gzio->saved_offset < (gzio->num_points
+			    ? gzio->points[gzio->num_points - 1]->out : 0)
+      + gzio->point_interval)
+    return;
+
+  if (gzio->num_points == GZIO_MAX_POINTS)
+    {
+      for (i = 0; i < GZIO_MAX_POINTS / 2; i++)
+	{
+	  grub_free (gzio->points[2 * i + 1]);
+	  gzio->points[i] = gzio->points[2 * i];
+	}
+      gzio->num_points = GZIO_MAX_POINTS / 2;
+      gzio->point_interval *= 2;
+      if (gzio->saved_offset < gzio->points[gzio->num_points - 1]->out
+	  + gzio->point_interval)
+	return;
+    }
+
+  point = grub_malloc (sizeof (*point));
+  if (! point)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  point->out = gzio->saved_offset;
+  point->in = gzio_tell (gzio);
+  point->bb = gzio->bb;
+  point->bk = gzio->bk;
+  point->block_in = gzio->block_in;
+  point->block_bb = gzio->block_bb;
+  point->block_bk = gzio->block_bk;
+  point->block_type = gzio->block_type;
+  point->block_len = gzio->block_len;
+  point->last_block = gzio->last_block;
+  point->code_state = gzio->code_state;
+  point->inflate_n = gzio->inflate_n;
+  point->inflate_d = gzio->inflate_d;
+  grub_memcpy (point->slide, prev, WSIZE);
+
+  gzio->points[gzio->num_points++] = point;
+}
+
+/* Find the last seek point at or before OFFSET.  */
+static struct grub_gzio_point *
+find_point (grub_gzio_t gzio, grub_off_t offset)
+{
+  unsigned lo = 0, hi = gzio->num_points, mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (gzio->points[mid]->out <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo ? gzio->points[lo - 1] : NULL;
+}
+
+/* Resume decompression at POINT.  */
+static void
+restore_point (grub_gzio_t gzio, struct grub_gzio_point *point)
+{
+  /* Parse the header of the current block again for its tables.  */
+  if (point->block_len && point->block_type != INFLATE_STORED)
+    {
+      gzio_seek (gzio, point->block_in);
+      gzio->bb = point->block_bb;
+      gzio->bk = point->block_bk;
+      get_new_block (gzio);
+      if (grub_errno != GRUB_ERR_NONE)
+	return;
+    }
+
+  gzio_seek (gzio, point->in);
+  gzio->bb = point->bb;
+  gzio->bk = point->bk;
+  gzio->block_in = point->block_in;
+  gzio->block_bb = point->block_bb;
+  gzio->block_bk = point->block_bk;
+  gzio->block_type = point->block_type;
+  gzio->block_len = point->block_len;
+  gzio->last_block = point->last_block;
+  gzio->code_state = point->code_state;
+  gzio->inflate_n = point->inflate_n;
+  gzio->inflate_d = point->inflate_d;
+  grub_memcpy (gzio->slide, point->slide, WSIZE);
+  gzio->saved_offset = point->out;
+  gzio->wp = 0;
+}
+
+/* Copy the data of a stored block into WIN.  The bit buffer may still
+   hold whole bytes read ahead by the decoding loop, which come first.  */
 static void
-inflate_window (grub_gzio_t gzio)
+inflate_stored_in_window (grub_gzio_t gzio, uch *win)
 {
+  const uch *in, *in_end;
+  unsigned w = gzio->wp;
+  unsigned e;
+
+  while (gzio->block_len && w < WSIZE && gzio->bk >= 8)
+    {
+      win[w++] = (uch) gzio->bb;
+      gzio->bb >>= 8;
+      gzio->bk -= 8;
+      gzio->block_len--;
+    }
+
+  in = input_next (gzio);
+  in_end = input_end (gzio);
+  while (gzio->block_len && w < WSIZE && grub_errno == GRUB_ERR_NONE)
+    {
+      if (in == in_end)
+	{
+	  input_consume (gzio, in);
+	  win[w++] = get_byte (gzio);
+	  gzio->block_len--;
+	  in = input_next (gzio);
+	  in_end = input_end (gzio);
+	  continue;
+	}
+
+      e = WSIZE - w;
+      if (e > (unsigned) gzio->block_len)
+	e = gzio->block_len;
+      if (e > (unsigned) (in_end - in))
+	e = in_end - in;
+      grub_memcpy (win + w, in, e);
+      in += e;
+      w += e;
+      gzio->block_len -= e;
+    }
+  input_consume (gzio, in);
+
+  gzio->wp = w;
+}
+
+/* Decompress the next window into WIN.  PREV is the previous window,
+   which back-references reach into.  */
+static void
+inflate_window (grub_gzio_t gzio, uch *win, const uch *prev)
+{
+  add_point (gzio, prev);
+
   /* initialize window */
   gzio->wp = 0;
 
@@ -1048,6 +1286,9 @@ inflate_window (grub_gzio_t gzio)
 	  if (gzio->last_block)
 	    break;
 
+	  gzio->block_in = gzio_tell (gzio);
+	  gzio->block_bb = gzio->bb;
+	  gzio->block_bk = gzio->bk;
 	  get_new_block (gzio);
 	}
 
@@ -1063,20 +1304,7 @@ inflate_window (grub_gzio_t gzio)
        */
       if (gzio->block_type == INFLATE_STORED)
 	{
-	  int w = gzio->wp;
-
-	  /*
-	   *  This is basically a glorified pass-through
-	   */
-
-	  while (gzio->block_len && w < WSIZE && grub_errno == GRUB_ERR_NONE)
-	    {
-	      gzio->slide[w++] = get_byte (gzio);
-	      gzio->block_len--;
-	    }
-
-	  gzio->wp = w;
-
+	  inflate_stored_in_window (gzio, win);
 	  continue;
 	}
 
@@ -1084,13 +1312,7 @@ inflate_window (grub_gzio_t gzio)
        *  Expand other kind of block.
        */
 
-      if (inflate_codes_in_window (gzio))
-	{
-	  huft_free (gzio->tl);
-	  huft_free (gzio->td);
-	  gzio->tl = 0;
-	  gzio->td = 0;
-	}
+      inflate_codes_in_window (gzio, win, prev);
     }
 
   gzio->saved_offset += gzio->wp;
@@ -1098,6 +1320,38 @@ inflate_window (grub_gzio_t gzio)
   /* XXX do CRC calculation here! */
 }
 
+/* Decompress as many whole windows as fit into BUF, of LEN bytes,
+   directly there rather than into the slide and copying them out.  Each
+   window refers back into the previous one in BUF, and the last one is
+   copied to the slide at the end to keep the state inflate_window would
+   leave.  Return the number of bytes decompressed.  */
+static grub_size_t
+inflate_direct (grub_gzio_t gzio, uch *buf, grub_size_t len)
+{
+  const uch *prev = gzio->slide;
+  unsigned prev_len = gzio->wp;
+  uch *win = buf;
+
+  while ((grub_size_t) (win - buf) + WSIZE <= len)
+    {
+      inflate_window (gzio, win, prev);
+      if (! gzio->wp || grub_errno != GRUB_ERR_NONE)
+	break;
+
+      prev = win;
+      prev_len = gzio->wp;
+      win += gzio->wp;
+      if (prev_len < WSIZE)
+	break;
+    }
+
+  if (prev != gzio->slide)
+    grub_memcpy (gzio->slide, prev, prev_len);
+  gzio->wp = prev_len;
+
+  return win - buf;
+}
+
 
 static void
 initialize_tables (grub_gzio_t gzio)
@@ -1112,12 +1366,6 @@ initialize_tables (grub_gzio_t gzio)
   /* Reset partial decompression code.  */
   gzio->last_block = 0;
   gzio->block_len = 0;
-
-  /* Reset memory allocation stuff.  */
-  huft_free (gzio->tl);
-  huft_free (gzio->td);
-  gzio->tl = NULL;
-  gzio->td = NULL;
 }
 
 
@@ -1218,9 +1466,19 @@ grub_gzio_read_real (grub_gzio_t gzio, grub_off_t offset,
 		     char *buf, grub_size_t len)
 {
   grub_ssize_t ret = 0;
-
-  /* Do we reset decompression to the beginning of the file?  */
-  if (gzio->saved_offset > offset + WSIZE)
+  struct grub_gzio_point *point;
+  int behind;
+
+  /* Is OFFSET before the window in the slide?  The last window may be
+     shorter than WSIZE.  */
+  behind = gzio->saved_offset > offset + gzio->wp;
+
+  /* Resume from the closest seek point when it saves decompressing
+     from the current position or the beginning of the file.  */
+  point = find_point (gzio, offset);
+  if (point && (behind || point->out > gzio->saved_offset))
+    restore_point (gzio, point);
+  else if (behind)
     initialize_tables (gzio);
 
   /*
@@ -1234,9 +1492,22 @@ grub_gzio_read_real (grub_gzio_t gzio, grub_off_t offset,
       register grub_size_t size;
       register char *srcaddr;
 
+      if (offset == gzio->saved_offset && len >= WSIZE)
+	{
+	  size = inflate_direct (gzio, (uch *) buf, len);
+	  if (size == 0)
+	    goto out;
+
+	  buf += size;
+	  len -= size;
+	  ret += size;
+	  offset += size;
+	  continue;
+	}
+
       while (offset >= gzio->saved_offset)
 	{
-	  inflate_window (gzio);
+	  inflate_window (gzio, gzio->slide, gzio->slide);
 	  if (gzio->wp == 0)
 	    goto out;
 	}
@@ -1283,10 +1554,12 @@ static grub_err_t
 grub_gzio_close (grub_file_t file)
 {
   grub_gzio_t gzio = file->data;
+  unsigned i;
 
   grub_file_close (gzio->file);
-  huft_free (gzio->tl);
-  huft_free (gzio->td);
+  for (i = 0; i < gzio->num_points; i++)
+    grub_free (gzio->points[i]);
+  grub_free (gzio->points);
   grub_free (gzio);
 
   /* No need to close the same device twice.  */
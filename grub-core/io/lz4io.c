@@ -0,0 +1,777 @@
+/* lz4io.c - decompression support for lz4 */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/err.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/file.h>
+#include <grub/fs.h>
+#include <grub/dl.h>
+#include <grub/i18n.h>
+#include <grub/lib/lz4.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define LZ4_MAGIC		0x184D2204
+#define LZ4_SKIPPABLE_MAGIC	0x184D2A50
+#define LZ4_SKIPPABLE_MASK	0xFFFFFFF0
+#define LZ4_SKIPPABLE_HEADER_SIZE	8
+
+/* Magic number, FLG, BD, content size and header checksum.  Frames with
+   a dictionary ID are not supported.  */
+#define LZ4_FRAME_HEADER_MIN	7
+#define LZ4_FRAME_HEADER_MAX	15
+
+#define LZ4_FLG_VERSION_MASK	0xc0
+#define LZ4_FLG_VERSION		0x40
+#define LZ4_FLG_INDEPENDENT	0x20
+#define LZ4_FLG_BLOCK_CHECKSUM	0x10
+#define LZ4_FLG_CONTENT_SIZE	0x08
+#define LZ4_FLG_CONTENT_CHECKSUM	0x04
+#define LZ4_FLG_RESERVED	0x02
+#define LZ4_FLG_DICT_ID		0x01
+#define LZ4_BD_RESERVED_MASK	0x8f
+
+#define LZ4_BLOCK_UNCOMPRESSED	0x80000000
+#define LZ4_CHECKSUM_SIZE	4
+
+/* The legacy format written by lz4 -l, which the Linux kernel build uses.
+   Every block but the last decompresses to exactly 8 MiB.  */
+#define LZ4_LEGACY_MAGIC	0x184C2102
+#define LZ4_LEGACY_BLOCK_SIZE	(8 << 20)
+
+/* Smallest buffer used for frames of linked blocks, so that the history
+   is not slid down after every small block.  */
+#define LZ4IO_WINDOW_MIN	(1 << 20)
+
+/* Where a frame, or a block which does not depend on the ones before it,
+   starts in the compressed and uncompressed data.  */
+struct grub_lz4io_point
+{
+  grub_off_t in;
+  grub_off_t out;
+};
+
+struct grub_lz4io
+{
+  grub_file_t file;
+  /* The frames of the file, followed by one more entry for where the
+     last one ends.  */
+  struct grub_lz4io_point *frames;
+  grub_size_t num_frames;
+  /* The independent blocks found so far, in increasing order.  */
+  struct grub_lz4io_point *points;
+  grub_size_t num_points;
+  grub_size_t alloc_points;
+
+  /* The frame being decompressed.  */
+  grub_size_t frame;
+  grub_off_t frame_end;
+  grub_off_t in_pos;
+  int frame_done;
+  int legacy;
+  int linked;
+  int block_checksum;
+  int content_checksum;
+  grub_uint64_t content_size;
+  grub_size_t block_max;
+  grub_size_t window_size;
+
+  /* OUT_LEN bytes of the frame, decompressed from OUT_OFF on.  For
+     linked blocks the last LZ4_HISTORY_SIZE are kept when sliding down
+     for more room.  */
+  grub_uint8_t *outbuf;
+  grub_size_t out_alloc;
+  grub_size_t out_len;
+  grub_off_t out_off;
+
+  grub_uint8_t *inbuf;
+  grub_size_t in_alloc;
+};
+
+typedef struct grub_lz4io *grub_lz4io_t;
+static struct grub_fs grub_lz4io_fs;
+
+static grub_err_t
+read_at (grub_lz4io_t lz4io, grub_off_t off, void *buf, grub_size_t size)
+{
+  if (grub_file_tell (lz4io->file) != off
+      && grub_file_seek (lz4io->file, off) == (grub_off_t) -1)
+    return grub_errno;
+  if (grub_file_read (lz4io->file, buf, size) != (grub_ssize_t) size)
+    {
+      if (!grub_errno)
+	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		    N_("premature end of compressed file"));
+      return grub_errno;
+    }
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+corrupted (void)
+{
+  return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		     N_("lz4 file corrupted or unsupported frame options"));
+}
+
+/* Restart decoding at the beginning of frame IDX.  */
+static grub_err_t
+start_frame (grub_lz4io_t lz4io, grub_size_t idx)
+{
+  grub_uint8_t buf[LZ4_FRAME_HEADER_MAX];
+  grub_off_t in = lz4io->frames[idx].in;
+  grub_size_t size = LZ4_FRAME_HEADER_MAX, in_max;
+  grub_uint8_t flg, bd;
+
+  if (size > lz4io->file->size - in)
+    size = lz4io->file->size - in;
+  if (size < 4)
+    return corrupted ();
+  if (read_at (lz4io, in, buf, size))
+    return grub_errno;
+
+  lz4io->content_size = GRUB_FILE_SIZE_UNKNOWN;
+  if (grub_le_to_cpu32 (grub_get_unaligned32 (buf)) == LZ4_LEGACY_MAGIC)
+    {
+      lz4io->legacy = 1;
+      lz4io->linked = 0;
+      lz4io->block_checksum = 0;
+      lz4io->content_checksum = 0;
+      lz4io->block_max = LZ4_LEGACY_BLOCK_SIZE;
+      lz4io->in_pos = in + 4;
+      in_max = LZ4_COMPRESS_BOUND (LZ4_LEGACY_BLOCK_SIZE);
+    }
+  else
+    {
+      if (size < LZ4_FRAME_HEADER_MIN)
+	return corrupted ();
+      flg = buf[4];
+      bd = buf[5];
+      if ((flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION
+	  || (flg & (LZ4_FLG_RESERVED | LZ4_FLG_DICT_ID))
+	  || (bd & LZ4_BD_RESERVED_MASK) || (bd >> 4) < 4)
+	return corrupted ();
+
+      /* The header checksum is skipped like the CRC of gzio.  */
+      lz4io->in_pos = in + LZ4_FRAME_HEADER_MIN;
+      if (flg & LZ4_FLG_CONTENT_SIZE)
+	{
+	  if (size < LZ4_FRAME_HEADER_MAX)
+	    return corrupted ();
+	  lz4io->content_size
+	    = grub_le_to_cpu64 (grub_get_unaligned64 (buf + 6));
+	  lz4io->in_pos += 8;
+	}
+
+      lz4io->legacy = 0;
+      lz4io->linked = !(flg & LZ4_FLG_INDEPENDENT);
+      lz4io->block_checksum = !!(flg & LZ4_FLG_BLOCK_CHECKSUM);
+      lz4io->content_checksum = !!(flg & LZ4_FLG_CONTENT_CHECKSUM);
+      /* 64 KiB, 256 KiB, 1 MiB or 4 MiB.  */
+      lz4io->block_max = (grub_size_t) 1 << (2 * (bd >> 4) + 8);
+      /* Blocks which do not get smaller are stored uncompressed.  */
+      in_max = lz4io->block_max;
+    }
+
+  if (in_max > lz4io->in_alloc)
+    {
+      grub_free (lz4io->inbuf);
+      lz4io->inbuf = grub_malloc (in_max);
+      if (!lz4io->inbuf)
+	{
+	  lz4io->in_alloc = 0;
+	  return grub_errno;
+	}
+      lz4io->in_alloc = in_max;
+    }
+
+  /* The output buffer is only allocated once a block does not fit where
+     the data is being read to.  */
+  lz4io->window_size = lz4io->block_max;
+  if (lz4io->linked)
+    lz4io->window_size = LZ4_HISTORY_SIZE
+			 + (lz4io->block_max > LZ4IO_WINDOW_MIN
+			    ? lz4io->block_max : LZ4IO_WINDOW_MIN);
+  if (lz4io->content_size < lz4io->window_size)
+    lz4io->window_size = lz4io->content_size ? : 1;
+
+  lz4io->frame = idx;
+  lz4io->frame_end = idx < lz4io->num_frames ? lz4io->frames[idx + 1].out
+		     : GRUB_FILE_SIZE_UNKNOWN;
+  lz4io->frame_done = 0;
+  lz4io->out_off = lz4io->frames[idx].out;
+  lz4io->out_len = 0;
+
+  return GRUB_ERR_NONE;
+}
+
+/* Read the size of the next block, or notice the end of the frame.  */
+static grub_err_t
+next_block (grub_lz4io_t lz4io, grub_size_t *size, int *raw)
+{
+  grub_uint8_t buf[4];
+  grub_uint32_t v;
+
+  if (read_at (lz4io, lz4io->in_pos, buf, sizeof (buf)))
+    return grub_errno;
+  lz4io->in_pos += sizeof (buf);
+  v = grub_le_to_cpu32 (grub_get_unaligned32 (buf));
+
+  if (lz4io->legacy)
+    {
+      *raw = 0;
+      *size = v;
+      if (*size > lz4io->in_alloc)
+	return corrupted ();
+      return GRUB_ERR_NONE;
+    }
+
+  if (!v)
+    {
+      /* The content checksum is skipped like the CRC of gzio.  */
+      lz4io->frame_done = 1;
+      if (lz4io->content_checksum)
+	lz4io->in_pos += LZ4_CHECKSUM_SIZE;
+      *raw = 0;
+      *size = 0;
+      return GRUB_ERR_NONE;
+    }
+
+  *raw = !!(v & LZ4_BLOCK_UNCOMPRESSED);
+  *size = v & ~LZ4_BLOCK_UNCOMPRESSED;
+  if (*size > lz4io->block_max)
+    return corrupted ();
+  return GRUB_ERR_NONE;
+}
+
+/* Decompress the block of SIZE bytes whose header was just read to DEST,
+   which has room for ROOM bytes and is preceded by HIST bytes of the
+   frame.  */
+static grub_ssize_t
+block_data (grub_lz4io_t lz4io, grub_size_t size, int raw,
+	    grub_uint8_t *dest, grub_size_t room, grub_size_t hist)
+{
+  grub_ssize_t n;
+
+  if (raw)
+    {
+      if (size > room)
+	{
+	  corrupted ();
+	  return -1;
+	}
+      if (read_at (lz4io, lz4io->in_pos, dest, size))
+	return -1;
+      n = size;
+    }
+  else
+    {
+      if (read_at (lz4io, lz4io->in_pos, lz4io->inbuf, size))
+	return -1;
+      n = lz4_decompress_block (lz4io->inbuf, size, dest, room, hist);
+      if (n < 0)
+	{
+	  corrupted ();
+	  return -1;
+	}
+    }
+
+  /* So are block checksums.  */
+  lz4io->in_pos += size;
+  if (lz4io->block_checksum)
+    lz4io->in_pos += LZ4_CHECKSUM_SIZE;
+
+  /* The frame size was worked out from the number of blocks.  */
+  if (lz4io->legacy && lz4io->frame_end != GRUB_FILE_SIZE_UNKNOWN
+      && lz4io->out_off + lz4io->out_len + n < lz4io->frame_end
+      && n != LZ4_LEGACY_BLOCK_SIZE)
+    {
+      corrupted ();
+      return -1;
+    }
+
+  return n;
+}
+
+static grub_err_t
+alloc_window (grub_lz4io_t lz4io)
+{
+  if (lz4io->out_alloc >= lz4io->window_size)
+    return GRUB_ERR_NONE;
+
+  /* Only called while nothing is kept in the buffer.  */
+  grub_free (lz4io->outbuf);
+  lz4io->outbuf = grub_malloc (lz4io->window_size);
+  if (!lz4io->outbuf)
+    {
+      lz4io->out_alloc = 0;
+      return grub_errno;
+    }
+  lz4io->out_alloc = lz4io->window_size;
+  return GRUB_ERR_NONE;
+}
+
+/* Decompress the block whose header was just read after the data in
+   OUTBUF.  */
+static grub_err_t
+window_block (grub_lz4io_t lz4io, grub_size_t size, int raw)
+{
+  grub_off_t pos = lz4io->out_off + lz4io->out_len;
+  grub_size_t need = lz4io->block_max, keep;
+  grub_ssize_t n;
+
+  if (need > lz4io->frame_end - pos)
+    need = lz4io->frame_end - pos;
+
+  if (!lz4io->out_len && alloc_window (lz4io))
+    return grub_errno;
+  if (lz4io->out_alloc - lz4io->out_len < need)
+    {
+      keep = 0;
+      if (lz4io->linked)
+	keep = lz4io->out_len < LZ4_HISTORY_SIZE ? lz4io->out_len
+		: LZ4_HISTORY_SIZE;
+      grub_memmove (lz4io->outbuf,
+		    lz4io->outbuf + lz4io->out_len - keep, keep);
+      lz4io->out_off += lz4io->out_len - keep;
+      lz4io->out_len = keep;
+    }
+  if (need > lz4io->out_alloc - lz4io->out_len)
+    need = lz4io->out_alloc - lz4io->out_len;
+
+  n = block_data (lz4io, size, raw, lz4io->outbuf + lz4io->out_len, need,
+		  lz4io->linked ? lz4io->out_len : 0);
+  if (n < 0)
+    return grub_errno;
+  lz4io->out_len += n;
+  return GRUB_ERR_NONE;
+}
+
+/* Copy the history for the next linked block, which was decompressed
+   straight to the caller's buffer ending at BUF, into OUTBUF.  */
+static grub_err_t
+keep_history (grub_lz4io_t lz4io, const char *buf)
+{
+  grub_off_t pos = lz4io->out_off;
+  grub_size_t keep = LZ4_HISTORY_SIZE;
+
+  if (keep > pos - lz4io->frames[lz4io->frame].out)
+    keep = pos - lz4io->frames[lz4io->frame].out;
+  if (alloc_window (lz4io))
+    return grub_errno;
+  grub_memcpy (lz4io->outbuf, buf - keep, keep);
+  lz4io->out_off = pos - keep;
+  lz4io->out_len = keep;
+  return GRUB_ERR_NONE;
+}
+
+/* Remember that decompression can start over at the block header at IN,
+   which is OUT in the data.  */
+static void
+add_point (grub_lz4io_t lz4io, grub_off_t in, grub_off_t out)
+{
+  struct grub_lz4io_point *points;
+  grub_size_t lo = 0, hi = lz4io->num_points, mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (lz4io->points[mid].out < out)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo < lz4io->num_points && lz4io->points[lo].out == out)
+    return;
+
+  if (lz4io->num_points == lz4io->alloc_points)
+    {
+      points = grub_realloc (lz4io->points,
+			     (lz4io->alloc_points ? 2 * lz4io->alloc_points
+			      : 64) * sizeof (lz4io->points[0]));
+      /* The points only save work, so carry on without a new one.  */
+      if (!points)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+      lz4io->points = points;
+      lz4io->alloc_points = lz4io->alloc_points ? 2 * lz4io->alloc_points
+			    : 64;
+    }
+
+  grub_memmove (lz4io->points + lo + 1, lz4io->points + lo,
+		(lz4io->num_points - lo) * sizeof (lz4io->points[0]));
+  lz4io->points[lo].in = in;
+  lz4io->points[lo].out = out;
+  lz4io->num_points++;
+}
+
+/* Find the last entry of POINTS starting at or before OFFSET.  */
+static grub_size_t
+find_point (const struct grub_lz4io_point *points, grub_size_t num,
+	    grub_off_t offset)
+{
+  grub_size_t lo = 0, hi = num, mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (points[mid].out <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo - 1;
+}
+
+/* Walk the legacy frame just started, whose blocks end at the first word
+   which is too large to be a block size, or would run past the end of the
+   file.  Only the last block needs to be decompressed to find the size.  */
+static grub_err_t
+walk_legacy_frame (grub_lz4io_t lz4io)
+{
+  grub_off_t out = lz4io->out_off, last = 0;
+  grub_uint8_t buf[4];
+  grub_size_t size;
+  int raw;
+
+  while (lz4io->file->size - lz4io->in_pos >= 4)
+    {
+      if (read_at (lz4io, lz4io->in_pos, buf, sizeof (buf)))
+	return grub_errno;
+      size = grub_le_to_cpu32 (grub_get_unaligned32 (buf));
+      if (size > lz4io->in_alloc
+	  || size > lz4io->file->size - lz4io->in_pos - 4)
+	break;
+      if (last)
+	out += LZ4_LEGACY_BLOCK_SIZE;
+      add_point (lz4io, lz4io->in_pos, out);
+      last = lz4io->in_pos;
+      lz4io->in_pos += 4 + size;
+    }
+  if (!last)
+    return GRUB_ERR_NONE;
+
+  lz4io->in_pos = last;
+  lz4io->out_off = out;
+  if (next_block (lz4io, &size, &raw) || window_block (lz4io, size, raw))
+    return grub_errno;
+  return GRUB_ERR_NONE;
+}
+
+/* Find the frames by going through the file, skipping over blocks in
+   frames which give their size, and decompressing those which do not.  */
+static int
+find_frames (grub_lz4io_t lz4io)
+{
+  grub_off_t in = 0, out = 0, block;
+  grub_size_t alloc = 0, size;
+  grub_uint8_t buf[LZ4_SKIPPABLE_HEADER_SIZE];
+  grub_uint32_t magic;
+  struct grub_lz4io_point *frames;
+  int raw;
+
+  for (;;)
+    {
+      if (lz4io->num_frames + 1 >= alloc)
+	{
+	  alloc = alloc ? 2 * alloc : 16;
+	  frames = grub_realloc (lz4io->frames,
+				 alloc * sizeof (lz4io->frames[0]));
+	  if (!frames)
+	    return 0;
+	  lz4io->frames = frames;
+	}
+
+      /* Stop at anything that is not a frame, like the size which the
+	 kernel build appends to legacy frames.  */
+      if (in >= lz4io->file->size || lz4io->file->size - in < 4
+	  || read_at (lz4io, in, buf, 4))
+	break;
+      magic = grub_le_to_cpu32 (grub_get_unaligned32 (buf));
+      if ((magic & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC)
+	{
+	  if (read_at (lz4io, in, buf, LZ4_SKIPPABLE_HEADER_SIZE))
+	    return 0;
+	  in += LZ4_SKIPPABLE_HEADER_SIZE
+		+ grub_le_to_cpu32 (grub_get_unaligned32 (buf + 4));
+	  continue;
+	}
+      if (magic != LZ4_MAGIC && magic != LZ4_LEGACY_MAGIC)
+	break;
+
+      lz4io->frames[lz4io->num_frames].in = in;
+      lz4io->frames[lz4io->num_frames].out = out;
+      if (start_frame (lz4io, lz4io->num_frames))
+	return 0;
+
+      if (lz4io->legacy)
+	{
+	  if (walk_legacy_frame (lz4io))
+	    return 0;
+	  out = lz4io->out_off + lz4io->out_len;
+	}
+      else if (lz4io->content_size != GRUB_FILE_SIZE_UNKNOWN)
+	{
+	  for (;;)
+	    {
+	      if (next_block (lz4io, &size, &raw))
+		return 0;
+	      if (lz4io->frame_done)
+		break;
+	      lz4io->in_pos += size;
+	      if (lz4io->block_checksum)
+		lz4io->in_pos += LZ4_CHECKSUM_SIZE;
+	    }
+	  if (out + lz4io->content_size < out)
+	    return 0;
+	  out += lz4io->content_size;
+	}
+      else
+	{
+	  for (;;)
+	    {
+	      block = lz4io->in_pos;
+	      if (next_block (lz4io, &size, &raw))
+		return 0;
+	      if (lz4io->frame_done)
+		break;
+	      if (!lz4io->linked)
+		add_point (lz4io, block, lz4io->out_off + lz4io->out_len);
+	      if (window_block (lz4io, size, raw))
+		return 0;
+	    }
+	  out = lz4io->out_off + lz4io->out_len;
+	}
+      in = lz4io->in_pos;
+      lz4io->num_frames++;
+    }
+
+  if (!lz4io->num_frames || in > lz4io->file->size)
+    return 0;
+
+  lz4io->frames[lz4io->num_frames].in = in;
+  lz4io->frames[lz4io->num_frames].out = out;
+  return 1;
+}
+
+static grub_file_t
+grub_lz4io_open (grub_file_t io,
+		 const char *name __attribute__ ((unused)))
+{
+  grub_file_t file;
+  grub_lz4io_t lz4io;
+  grub_uint8_t magic[4];
+  grub_uint32_t m;
+
+  if (grub_file_tell (io) != 0)
+    grub_file_seek (io, 0);
+  if (grub_file_read (io, magic, sizeof (magic)) != sizeof (magic)
+      || ((m = grub_le_to_cpu32 (grub_get_unaligned32 (magic))) != LZ4_MAGIC
+	  && m != LZ4_LEGACY_MAGIC))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (io, 0);
+      return io;
+    }
+
+  file = (grub_file_t) grub_zalloc (sizeof (*file));
+  if (!file)
+    return 0;
+
+  lz4io = grub_zalloc (sizeof (*lz4io));
+  if (!lz4io)
+    {
+      grub_free (file);
+      return 0;
+    }
+
+  lz4io->file = io;
+
+  file->device = io->device;
+  file->data = lz4io;
+  file->fs = &grub_lz4io_fs;
+  file->size = GRUB_FILE_SIZE_UNKNOWN;
+  file->not_easily_seekable = 1;
+
+  if (!find_frames (lz4io))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (io, 0);
+      grub_free (lz4io->frames);
+      grub_free (lz4io->points);
+      grub_free (lz4io->outbuf);
+      grub_free (lz4io->inbuf);
+      grub_free (lz4io);
+      grub_free (file);
+
+      return io;
+    }
+
+  file->size = lz4io->frames[lz4io->num_frames].out;
+  /* Nothing decompressed yet.  */
+  lz4io->frame = lz4io->num_frames;
+  lz4io->out_off = 0;
+  lz4io->out_len = 0;
+
+  return file;
+}
+
+static grub_ssize_t
+grub_lz4io_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  grub_lz4io_t lz4io = file->data;
+  grub_off_t offset = file->offset, pos;
+  grub_ssize_t ret = 0, n;
+  grub_size_t frame, idx, size, room, hist;
+  int raw, stale = 0;
+
+  while (len > 0 && offset < file->size)
+    {
+      if (offset >= lz4io->out_off
+	  && offset < lz4io->out_off + lz4io->out_len)
+	{
+	  n = lz4io->out_off + lz4io->out_len - offset;
+	  if ((grub_size_t) n > len)
+	    n = len;
+	  grub_memcpy (buf, lz4io->outbuf + (offset - lz4io->out_off), n);
+	  buf += n;
+	  len -= n;
+	  ret += n;
+	  offset += n;
+	  continue;
+	}
+
+      /* A seek to another frame or back within this one restarts at the
+	 frame containing the offset, or at the last independent block
+	 before it.  */
+      frame = find_point (lz4io->frames, lz4io->num_frames, offset);
+      if (frame != lz4io->frame || offset < lz4io->out_off)
+	{
+	  stale = 0;
+	  if (start_frame (lz4io, frame))
+	    return -1;
+	}
+      pos = lz4io->out_off + lz4io->out_len;
+      idx = find_point (lz4io->points, lz4io->num_points, offset);
+      if (idx != (grub_size_t) -1 && lz4io->points[idx].out > pos)
+	{
+	  stale = 0;
+	  lz4io->in_pos = lz4io->points[idx].in;
+	  lz4io->out_off = pos = lz4io->points[idx].out;
+	  lz4io->out_len = 0;
+	}
+
+      if (!lz4io->linked)
+	add_point (lz4io, lz4io->in_pos, pos);
+      if (lz4io->frame_done || next_block (lz4io, &size, &raw)
+	  || lz4io->frame_done)
+	goto corrupted;
+
+      /* Decompress a block which is wanted whole straight to BUF, if the
+	 history it may refer to is there as well.  */
+      room = lz4io->block_max;
+      if (room > lz4io->frame_end - pos)
+	room = lz4io->frame_end - pos;
+      hist = pos - lz4io->frames[frame].out;
+      if (hist > LZ4_HISTORY_SIZE)
+	hist = LZ4_HISTORY_SIZE;
+      if (offset == pos && len >= (raw ? size : room)
+	  && (!lz4io->linked || (grub_size_t) ret >= hist))
+	{
+	  if (room > len)
+	    room = len;
+	  n = block_data (lz4io, size, raw, (grub_uint8_t *) buf, room,
+			  lz4io->linked ? hist : 0);
+	  if (n < 0)
+	    goto corrupted;
+	  lz4io->out_off = pos + n;
+	  lz4io->out_len = 0;
+	  stale = lz4io->linked;
+	  buf += n;
+	  len -= n;
+	  ret += n;
+	  offset += n;
+	  continue;
+	}
+
+      if ((stale && keep_history (lz4io, buf))
+	  || window_block (lz4io, size, raw))
+	goto corrupted;
+      stale = 0;
+    }
+
+  /* Without the history the next read has to start over, which is
+     better than failing this one.  */
+  if (stale && keep_history (lz4io, buf))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      lz4io->frame = lz4io->num_frames;
+      lz4io->out_len = 0;
+    }
+
+  return ret;
+
+ corrupted:
+  if (!grub_errno)
+    corrupted ();
+  return -1;
+}
+
+/* Release everything, including the underlying file object.  */
+static grub_err_t
+grub_lz4io_close (grub_file_t file)
+{
+  grub_lz4io_t lz4io = file->data;
+
+  grub_file_close (lz4io->file);
+  grub_free (lz4io->frames);
+  grub_free (lz4io->points);
+  grub_free (lz4io->outbuf);
+  grub_free (lz4io->inbuf);
+  grub_free (lz4io);
+
+  /* Device must not be closed twice.  */
+  file->device = 0;
+  file->name = 0;
+  return grub_errno;
+}
+
+static struct grub_fs grub_lz4io_fs = {
+  .name = "lz4io",
+  .dir = 0,
+  .open = 0,
+  .read = grub_lz4io_read,
+  .close = grub_lz4io_close,
+  .label = 0,
+  .next = 0
+};
+
+GRUB_MOD_INIT (lz4io)
+{
+  grub_file_filter_register (GRUB_FILE_FILTER_LZ4IO, grub_lz4io_open);
+}
+
+GRUB_MOD_FINI (lz4io)
+{
+  grub_file_filter_unregister (GRUB_FILE_FILTER_LZ4IO);
+}
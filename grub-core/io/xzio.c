@@ -32,6 +32,15 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define XZBUFSIZ 0x2000
 #define VLI_MAX_DIGITS 9
 #define XZ_STREAM_FOOTER_SIZE 12
+/* Largest stream index read into memory.  */
+#define XZ_INDEX_MAX (1 << 24)
+
+/* Where a block starts in the compressed and uncompressed data.  */
+struct grub_xzio_block
+{
+  grub_off_t in;
+  grub_off_t out;
+};
 
 struct grub_xzio
 {
@@ -41,6 +50,13 @@ struct grub_xzio
   grub_uint8_t inbuf[XZBUFSIZ];
   grub_uint8_t outbuf[XZBUFSIZ];
   grub_off_t saved_offset;
+  /* The stream header, to restart the decoder at a block.  */
+  grub_uint8_t header[STREAM_HEADER_SIZE];
+  /* The blocks listed in the stream index.  */
+  struct grub_xzio_block *blocks;
+  grub_size_t num_blocks;
+  /* Where the stream index starts in the compressed data.  */
+  grub_off_t index_start;
 };
 
 typedef struct grub_xzio *grub_xzio_t;
@@ -70,22 +86,6 @@ decode_vli (const grub_uint8_t buf[], grub_size_t size_max,
   return i;
 }
 
-static grub_ssize_t
-read_vli (grub_file_t file, grub_uint64_t *num)
-{
-  grub_uint8_t buf[VLI_MAX_DIGITS];
-  grub_ssize_t read_bytes;
-  grub_size_t dec;
-
-  read_bytes = grub_file_read (file, buf, VLI_MAX_DIGITS);
-  if (read_bytes < 0)
-    return -1;
-
-  dec = decode_vli (buf, read_bytes, num);
-  grub_file_seek (file, file->offset - (read_bytes - dec));
-  return dec;
-}
-
 /* Function xz_dec_run() should consume header and ask for more (XZ_OK)
  * else file is corrupted (or options not supported) or not xz.  */
 static int
@@ -100,6 +100,8 @@ test_header (grub_file_t file)
   if (xzio->buf.in_size != STREAM_HEADER_SIZE)
     return 0;
 
+  grub_memcpy (xzio->header, xzio->inbuf, STREAM_HEADER_SIZE);
+
   ret = xz_dec_run (xzio->dec, &xzio->buf);
 
   if (ret == XZ_FORMAT_ERROR)
@@ -111,7 +113,7 @@ test_header (grub_file_t file)
   return 1;
 }
 
-/* Try to find out size of uncompressed data,
+/* Try to find out size of uncompressed data and where each block starts,
  * also do some footer sanity checks.  */
 static int
 test_footer (grub_file_t file)
@@ -119,10 +121,14 @@ test_footer (grub_file_t file)
   grub_xzio_t xzio = file->data;
   grub_uint8_t footer[FOOTER_MAGIC_SIZE];
   grub_uint32_t backsize;
-  grub_uint8_t imarker;
+  grub_uint8_t *index = NULL;
+  grub_size_t pos, dec;
   grub_uint64_t uncompressed_size_total = 0;
+  grub_uint64_t compressed_offset = STREAM_HEADER_SIZE;
+  grub_uint64_t unpadded_size;
   grub_uint64_t uncompressed_size;
-  grub_uint64_t records;
+  grub_uint64_t records, i;
+  grub_off_t index_start;
 
   grub_file_seek (xzio->file, xzio->file->size - FOOTER_MAGIC_SIZE);
   if (grub_file_read (xzio->file, footer, FOOTER_MAGIC_SIZE)
@@ -137,37 +143,117 @@ test_footer (grub_file_t file)
 
   /* Calculate real backward size.  */
   backsize = (grub_le_to_cpu32 (backsize) + 1) * 4;
+  if (backsize > XZ_INDEX_MAX
+      || backsize > xzio->file->size - XZ_STREAM_FOOTER_SIZE
+		    - STREAM_HEADER_SIZE)
+    goto ERROR;
 
-  /* Set file to the beginning of stream index.  */
-  grub_file_seek (xzio->file,
-		  xzio->file->size - XZ_STREAM_FOOTER_SIZE - backsize);
+  /* Read the whole stream index.  */
+  index = grub_malloc (backsize);
+  if (!index)
+    goto ERROR;
+  index_start = xzio->file->size - XZ_STREAM_FOOTER_SIZE - backsize;
+  grub_file_seek (xzio->file, index_start);
+  if (grub_file_read (xzio->file, index, backsize) != (grub_ssize_t) backsize)
+    goto ERROR;
 
   /* Test index marker.  */
-  if (grub_file_read (xzio->file, &imarker, sizeof (imarker))
-      != sizeof (imarker) && imarker != 0x00)
+  if (index[0] != 0x00)
+    goto ERROR;
+  pos = 1;
+
+  dec = decode_vli (index + pos, backsize - pos, &records);
+  if (dec == 0)
+    goto ERROR;
+  pos += dec;
+
+  /* Each record takes at least two bytes.  */
+  if (records > (backsize - pos) / 2)
     goto ERROR;
 
-  if (read_vli (xzio->file, &records) <= 0)
+  xzio->blocks = grub_malloc (records * sizeof (xzio->blocks[0]));
+  if (!xzio->blocks && records)
     goto ERROR;
+  xzio->num_blocks = records;
 
-  for (; records != 0; records--)
+  for (i = 0; i < records; i++)
     {
-      if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Ignore unpadded.  */
+      dec = decode_vli (index + pos, backsize - pos, &unpadded_size);
+      if (dec == 0)
 	goto ERROR;
-      if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Uncompressed.  */
+      pos += dec;
+      dec = decode_vli (index + pos, backsize - pos, &uncompressed_size);
+      if (dec == 0)
 	goto ERROR;
+      pos += dec;
 
+      xzio->blocks[i].in = compressed_offset;
+      xzio->blocks[i].out = uncompressed_size_total;
+      compressed_offset += ALIGN_UP (unpadded_size, 4);
       uncompressed_size_total += uncompressed_size;
     }
 
+  /* The blocks must end where the index starts.  */
+  if (compressed_offset != index_start)
+    goto ERROR;
+
+  grub_free (index);
+  xzio->index_start = index_start;
   file->size = uncompressed_size_total;
   grub_file_seek (xzio->file, STREAM_HEADER_SIZE);
   return 1;
 
 ERROR:
+  grub_free (index);
+  grub_free (xzio->blocks);
+  xzio->blocks = NULL;
+  xzio->num_blocks = 0;
   return 0;
 }
 
+/* Find the block containing OFFSET.  */
+static struct grub_xzio_block *
+find_block (grub_xzio_t xzio, grub_off_t offset)
+{
+  grub_size_t lo = 0, hi = xzio->num_blocks, mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (xzio->blocks[mid].out <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo ? &xzio->blocks[lo - 1] : NULL;
+}
+
+/* Restart decoding at the beginning of BLOCK.  */
+static grub_err_t
+seek_block (grub_xzio_t xzio, struct grub_xzio_block *block)
+{
+  xz_dec_reset (xzio->dec);
+
+  /* Let the decoder parse the stream header again, after which it
+     expects a block.  */
+  grub_memcpy (xzio->inbuf, xzio->header, STREAM_HEADER_SIZE);
+  xzio->buf.in_pos = 0;
+  xzio->buf.in_size = STREAM_HEADER_SIZE;
+  xzio->buf.out_pos = 0;
+  if (xz_dec_run (xzio->dec, &xzio->buf) != XZ_OK)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       N_("xz file corrupted or unsupported block options"));
+
+  xzio->buf.in_pos = 0;
+  xzio->buf.in_size = 0;
+  xzio->buf.out_pos = 0;
+  grub_file_seek (xzio->file, block->in);
+  xzio->saved_offset = block->out;
+
+  return GRUB_ERR_NONE;
+}
+
 static grub_file_t
 grub_xzio_open (grub_file_t io,
 		const char *name __attribute__ ((unused)))
@@ -217,6 +303,7 @@ grub_xzio_open (grub_file_t io,
       grub_errno = GRUB_ERR_NONE;
       grub_file_seek (io, 0);
       xz_dec_end (xzio->dec);
+      grub_free (xzio->blocks);
       grub_free (xzio);
       grub_free (file);
 
@@ -234,10 +321,21 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
   enum xz_ret xzret;
   grub_xzio_t xzio = file->data;
   grub_off_t current_offset;
-
-  /* If seek backward need to reset decoder and start from beginning of file.
-     TODO Possible improvement by jumping blocks.  */
-  if (file->offset < xzio->saved_offset)
+  struct grub_xzio_block *block;
+
+  /* Blocks are decoded independently, so seeking backward, or forward
+     past the end of the current block, can restart at the block
+     containing the offset.  The decoder must not reach the stream index
+     afterwards, as it would count fewer blocks than listed there, so it
+     is never fed past the end of the last block.  */
+  block = find_block (xzio, file->offset);
+  if (block && (file->offset < xzio->saved_offset
+		|| block->out > xzio->saved_offset))
+    {
+      if (seek_block (xzio, block))
+	return -1;
+    }
+  else if (file->offset < xzio->saved_offset)
     {
       xz_dec_reset (xzio->dec);
       xzio->saved_offset = 0;
@@ -257,7 +355,12 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
       /* Feed input.  */
       if (xzio->buf.in_pos == xzio->buf.in_size)
 	{
-	  readret = grub_file_read (xzio->file, xzio->inbuf, XZBUFSIZ);
+	  grub_size_t size = XZBUFSIZ;
+	  grub_off_t pos = grub_file_tell (xzio->file);
+
+	  if (xzio->index_start - pos < size)
+	    size = xzio->index_start - pos;
+	  readret = grub_file_read (xzio->file, xzio->inbuf, size);
 	  if (readret < 0)
 	    return -1;
 	  xzio->buf.in_size = readret;
@@ -315,6 +418,7 @@ grub_xzio_close (grub_file_t file)
   xz_dec_end (xzio->dec);
 
   grub_file_close (xzio->file);
+  grub_free (xzio->blocks);
   grub_free (xzio);
 
   /* Device must not be closed twice.  */
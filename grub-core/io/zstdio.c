@@ -0,0 +1,593 @@
+/* zstdio.c - decompression support for zstd */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/err.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/file.h>
+#include <grub/fs.h>
+#include <grub/dl.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#include "zstd.h"
+
+/* The seek table of the seekable format, a skippable frame at the end
+   of the file listing the sizes of the frames before it.  */
+#define ZSTD_SEEKABLE_MAGIC		0x8F92EAB1
+#define ZSTD_SEEKABLE_SKIPPABLE_MAGIC	0x184D2A5E
+#define ZSTD_SEEKABLE_FOOTER_SIZE	9
+#define ZSTD_SEEKABLE_CHECKSUM_FLAG	0x80
+#define ZSTD_SEEKABLE_RESERVED_MASK	0x7c
+/* Largest seek table read into memory.  */
+#define ZSTD_SEEKABLE_TABLE_MAX		(1 << 24)
+
+/* Largest window accepted.  */
+#define ZSTDIO_WINDOW_MAX		(1 << 27)
+
+/* Where a frame starts in the compressed and uncompressed data.  */
+struct grub_zstdio_frame
+{
+  grub_off_t in;
+  grub_off_t out;
+};
+
+struct grub_zstdio
+{
+  grub_file_t file;
+  struct zstd_dec *dec;
+  /* The frames of the file, followed by one more entry for where the
+     last one ends.  */
+  struct grub_zstdio_frame *frames;
+  grub_size_t num_frames;
+
+  /* The frame being decompressed.  */
+  grub_size_t frame;
+  grub_off_t in_pos;
+  int frame_done;
+  int checksum;
+  grub_uint64_t content_size;
+  grub_uint64_t window_size;
+  grub_size_t block_max;
+
+  /* The window, kept in a circular buffer with room for two blocks more.
+     The first OUT_LEN bytes are the frame decompressed from OUT_OFF on.
+     When there is no room for another block, decompression starts over
+     at the beginning, and the data before OUT_OFF is left in the
+     buffer up to PREV_END, where it gets overwritten.  */
+  grub_uint8_t *outbuf;
+  grub_size_t out_alloc;
+  grub_size_t out_len;
+  grub_off_t out_off;
+  grub_size_t prev_end;
+
+  grub_uint8_t inbuf[ZSTD_BLOCK_MAX];
+};
+
+typedef struct grub_zstdio *grub_zstdio_t;
+static struct grub_fs grub_zstdio_fs;
+
+static grub_err_t
+read_at (grub_zstdio_t zstdio, grub_off_t off, void *buf, grub_size_t size)
+{
+  if (grub_file_tell (zstdio->file) != off
+      && grub_file_seek (zstdio->file, off) == (grub_off_t) -1)
+    return grub_errno;
+  if (grub_file_read (zstdio->file, buf, size) != (grub_ssize_t) size)
+    {
+      if (!grub_errno)
+	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		    N_("premature end of compressed file"));
+      return grub_errno;
+    }
+  return GRUB_ERR_NONE;
+}
+
+/* Restart decoding at the beginning of frame IDX.  */
+static grub_err_t
+start_frame (grub_zstdio_t zstdio, grub_size_t idx)
+{
+  grub_uint8_t buf[ZSTD_FRAME_HEADER_MAX];
+  struct zstd_frame_header hdr;
+  grub_off_t in = zstdio->frames[idx].in;
+  grub_size_t size = ZSTD_FRAME_HEADER_MAX;
+  grub_uint64_t alloc;
+
+  if (size > zstdio->file->size - in)
+    size = zstdio->file->size - in;
+  if (read_at (zstdio, in, buf, size)
+      || zstd_frame_header (buf, size, &hdr))
+    return grub_errno;
+  if (hdr.window_size > ZSTDIO_WINDOW_MAX)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       N_("zstd window too large"));
+
+  /* Room for the window and two blocks, or for the whole frame if that
+     is less.  */
+  alloc = hdr.window_size + 2 * (hdr.window_size < ZSTD_BLOCK_MAX
+				 ? hdr.window_size : ZSTD_BLOCK_MAX);
+  if (hdr.content_size < alloc)
+    alloc = hdr.content_size;
+  if (!alloc)
+    alloc = 1;
+  if (alloc > zstdio->out_alloc)
+    {
+      grub_free (zstdio->outbuf);
+      zstdio->outbuf = grub_malloc (alloc);
+      if (!zstdio->outbuf)
+	{
+	  zstdio->out_alloc = 0;
+	  return grub_errno;
+	}
+      zstdio->out_alloc = alloc;
+    }
+
+  zstd_dec_reset (zstdio->dec);
+  zstdio->frame = idx;
+  zstdio->in_pos = in + hdr.header_size;
+  zstdio->frame_done = 0;
+  zstdio->checksum = hdr.checksum;
+  zstdio->content_size = hdr.content_size;
+  zstdio->window_size = hdr.window_size;
+  zstdio->block_max = hdr.window_size < ZSTD_BLOCK_MAX
+		      ? hdr.window_size : ZSTD_BLOCK_MAX;
+  zstdio->out_off = zstdio->frames[idx].out;
+  zstdio->out_len = 0;
+  zstdio->prev_end = 0;
+
+  return GRUB_ERR_NONE;
+}
+
+/* Read the header of the next block, returning its type and size.  */
+static grub_err_t
+next_block (grub_zstdio_t zstdio, unsigned *type, grub_size_t *size,
+	    int *last)
+{
+  grub_uint8_t header[ZSTD_BLOCK_HEADER_SIZE];
+  grub_uint32_t h;
+
+  if (read_at (zstdio, zstdio->in_pos, header, sizeof (header)))
+    return grub_errno;
+  zstdio->in_pos += sizeof (header);
+
+  h = header[0] | (header[1] << 8) | ((grub_uint32_t) header[2] << 16);
+  *last = h & 1;
+  *type = (h >> 1) & 3;
+  *size = h >> 3;
+  if (*type == ZSTD_BLOCK_RESERVED || *size > zstdio->block_max)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       N_("zstd file corrupted or unsupported frame options"));
+  return GRUB_ERR_NONE;
+}
+
+static void
+end_block (grub_zstdio_t zstdio, int last)
+{
+  if (!last)
+    return;
+
+  /* The content checksum is skipped like the CRC of gzio.  */
+  zstdio->frame_done = 1;
+  if (zstdio->checksum)
+    zstdio->in_pos += ZSTD_CHECKSUM_SIZE;
+}
+
+/* Decompress the next block of the frame after the data in OUTBUF.  */
+static grub_err_t
+decode_block (grub_zstdio_t zstdio)
+{
+  grub_size_t size, room, ext_size = 0;
+  grub_ssize_t n;
+  unsigned type;
+  int last;
+
+  /* Wrap around once a whole window and a block are behind us.  The
+     window then reaches no further back than the data just after the
+     block written next.  */
+  if (zstdio->out_alloc - zstdio->out_len < zstdio->block_max
+      && zstdio->out_len > zstdio->window_size + zstdio->block_max)
+    {
+      zstdio->prev_end = zstdio->out_len;
+      zstdio->out_off += zstdio->out_len;
+      zstdio->out_len = 0;
+    }
+  room = zstdio->out_alloc - zstdio->out_len;
+  if (room > zstdio->block_max)
+    room = zstdio->block_max;
+  if (zstdio->prev_end > zstdio->out_len + room)
+    ext_size = zstdio->prev_end - zstdio->out_len - room;
+
+  if (next_block (zstdio, &type, &size, &last))
+    return grub_errno;
+
+  switch (type)
+    {
+    case ZSTD_BLOCK_RAW:
+      if (size > room
+	  || read_at (zstdio, zstdio->in_pos,
+		      zstdio->outbuf + zstdio->out_len, size))
+	break;
+      zstdio->in_pos += size;
+      zstdio->out_len += size;
+      end_block (zstdio, last);
+      return GRUB_ERR_NONE;
+
+    case ZSTD_BLOCK_RLE:
+      if (size > room || read_at (zstdio, zstdio->in_pos, zstdio->inbuf, 1))
+	break;
+      grub_memset (zstdio->outbuf + zstdio->out_len, zstdio->inbuf[0], size);
+      zstdio->in_pos++;
+      zstdio->out_len += size;
+      end_block (zstdio, last);
+      return GRUB_ERR_NONE;
+
+    default:
+      if (read_at (zstdio, zstdio->in_pos, zstdio->inbuf, size))
+	return grub_errno;
+      n = zstd_dec_block (zstdio->dec, zstdio->inbuf, size,
+			  zstdio->outbuf + zstdio->out_len, room,
+			  zstdio->out_len, zstdio->outbuf + zstdio->prev_end,
+			  ext_size);
+      if (n < 0)
+	return grub_errno;
+      zstdio->in_pos += size;
+      zstdio->out_len += n;
+      end_block (zstdio, last);
+      return GRUB_ERR_NONE;
+    }
+
+  if (!grub_errno)
+    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		N_("zstd file corrupted or unsupported frame options"));
+  return grub_errno;
+}
+
+/* Read the frame sizes from the seek table of the seekable format.  */
+static int
+read_seek_table (grub_zstdio_t zstdio)
+{
+  grub_uint8_t footer[ZSTD_SEEKABLE_FOOTER_SIZE];
+  grub_uint8_t *table = NULL, *p;
+  grub_uint64_t size = zstdio->file->size, table_size;
+  grub_uint32_t n, i, entry_size;
+  grub_off_t in = 0, out = 0;
+
+  if (size < ZSTD_SKIPPABLE_HEADER_SIZE + ZSTD_SEEKABLE_FOOTER_SIZE
+      || read_at (zstdio, size - ZSTD_SEEKABLE_FOOTER_SIZE, footer,
+		  sizeof (footer))
+      || grub_le_to_cpu32 (grub_get_unaligned32 (footer + 5))
+	 != ZSTD_SEEKABLE_MAGIC
+      || (footer[4] & ZSTD_SEEKABLE_RESERVED_MASK))
+    goto fail;
+
+  n = grub_le_to_cpu32 (grub_get_unaligned32 (footer));
+  entry_size = (footer[4] & ZSTD_SEEKABLE_CHECKSUM_FLAG) ? 12 : 8;
+  if (!n || n > ZSTD_SEEKABLE_TABLE_MAX / entry_size)
+    goto fail;
+  table_size = ZSTD_SKIPPABLE_HEADER_SIZE + (grub_uint64_t) n * entry_size
+	       + ZSTD_SEEKABLE_FOOTER_SIZE;
+  if (table_size > size)
+    goto fail;
+
+  table = grub_malloc (table_size - ZSTD_SEEKABLE_FOOTER_SIZE);
+  zstdio->frames = grub_malloc ((n + 1) * sizeof (zstdio->frames[0]));
+  if (!table || !zstdio->frames
+      || read_at (zstdio, size - table_size, table,
+		  table_size - ZSTD_SEEKABLE_FOOTER_SIZE)
+      || grub_le_to_cpu32 (grub_get_unaligned32 (table))
+	 != ZSTD_SEEKABLE_SKIPPABLE_MAGIC
+      || grub_le_to_cpu32 (grub_get_unaligned32 (table + 4))
+	 != table_size - ZSTD_SKIPPABLE_HEADER_SIZE)
+    goto fail;
+
+  for (i = 0, p = table + ZSTD_SKIPPABLE_HEADER_SIZE; i <= n;
+       i++, p += entry_size)
+    {
+      zstdio->frames[i].in = in;
+      zstdio->frames[i].out = out;
+      if (i == n)
+	break;
+      in += grub_le_to_cpu32 (grub_get_unaligned32 (p));
+      out += grub_le_to_cpu32 (grub_get_unaligned32 (p + 4));
+    }
+  if (in != size - table_size)
+    goto fail;
+
+  zstdio->num_frames = n;
+  grub_free (table);
+  return 1;
+
+ fail:
+  grub_errno = GRUB_ERR_NONE;
+  grub_free (table);
+  grub_free (zstdio->frames);
+  zstdio->frames = NULL;
+  return 0;
+}
+
+/* Find the frames by going through the file, skipping over blocks in
+   frames which give their size, and decompressing those which do not.  */
+static int
+find_frames (grub_zstdio_t zstdio)
+{
+  grub_off_t in = 0, out = 0;
+  grub_size_t alloc = 0, size;
+  grub_uint8_t buf[ZSTD_SKIPPABLE_HEADER_SIZE];
+  grub_uint32_t magic;
+  struct grub_zstdio_frame *frames;
+  unsigned type;
+  int last;
+
+  for (;;)
+    {
+      if (zstdio->num_frames + 1 >= alloc)
+	{
+	  alloc = alloc ? 2 * alloc : 16;
+	  frames = grub_realloc (zstdio->frames,
+				 alloc * sizeof (zstdio->frames[0]));
+	  if (!frames)
+	    return 0;
+	  zstdio->frames = frames;
+	}
+
+      /* Stop at anything that is not a frame, like xzio does at padding
+	 after the stream.  */
+      if (in >= zstdio->file->size || zstdio->file->size - in < 4
+	  || read_at (zstdio, in, buf, 4))
+	break;
+      magic = grub_le_to_cpu32 (grub_get_unaligned32 (buf));
+      if ((magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC)
+	{
+	  if (read_at (zstdio, in, buf, ZSTD_SKIPPABLE_HEADER_SIZE))
+	    return 0;
+	  in += ZSTD_SKIPPABLE_HEADER_SIZE
+		+ grub_le_to_cpu32 (grub_get_unaligned32 (buf + 4));
+	  continue;
+	}
+      if (magic != ZSTD_MAGIC)
+	break;
+
+      zstdio->frames[zstdio->num_frames].in = in;
+      zstdio->frames[zstdio->num_frames].out = out;
+      if (start_frame (zstdio, zstdio->num_frames))
+	return 0;
+
+      if (zstdio->content_size != ZSTD_CONTENT_SIZE_UNKNOWN)
+	{
+	  while (!zstdio->frame_done)
+	    {
+	      if (next_block (zstdio, &type, &size, &last))
+		return 0;
+	      zstdio->in_pos += type == ZSTD_BLOCK_RLE ? 1 : size;
+	      end_block (zstdio, last);
+	    }
+	  out += zstdio->content_size;
+	}
+      else
+	{
+	  while (!zstdio->frame_done)
+	    if (decode_block (zstdio))
+	      return 0;
+	  out = zstdio->out_off + zstdio->out_len;
+	}
+      in = zstdio->in_pos;
+      zstdio->num_frames++;
+    }
+
+  if (!zstdio->num_frames || in > zstdio->file->size)
+    return 0;
+
+  zstdio->frames[zstdio->num_frames].in = in;
+  zstdio->frames[zstdio->num_frames].out = out;
+  return 1;
+}
+
+/* Find the frame containing OFFSET.  */
+static grub_size_t
+find_frame (grub_zstdio_t zstdio, grub_off_t offset)
+{
+  grub_size_t lo = 0, hi = zstdio->num_frames, mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (zstdio->frames[mid].out <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo - 1;
+}
+
+static grub_file_t
+grub_zstdio_open (grub_file_t io,
+		  const char *name __attribute__ ((unused)))
+{
+  grub_file_t file;
+  grub_zstdio_t zstdio;
+  grub_uint8_t magic[4];
+
+  if (grub_file_tell (io) != 0)
+    grub_file_seek (io, 0);
+  if (grub_file_read (io, magic, sizeof (magic)) != sizeof (magic)
+      || grub_le_to_cpu32 (grub_get_unaligned32 (magic)) != ZSTD_MAGIC)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (io, 0);
+      return io;
+    }
+
+  file = (grub_file_t) grub_zalloc (sizeof (*file));
+  if (!file)
+    return 0;
+
+  zstdio = grub_zalloc (sizeof (*zstdio));
+  if (!zstdio)
+    {
+      grub_free (file);
+      return 0;
+    }
+
+  zstdio->file = io;
+
+  file->device = io->device;
+  file->data = zstdio;
+  file->fs = &grub_zstdio_fs;
+  file->size = GRUB_FILE_SIZE_UNKNOWN;
+  file->not_easily_seekable = 1;
+
+  zstdio->dec = zstd_dec_init ();
+  if (!zstdio->dec)
+    {
+      grub_free (zstdio);
+      grub_free (file);
+      return 0;
+    }
+
+  /* Prefer the seek table, which also gives every frame size, over
+     going through all the block headers.  */
+  if (!read_seek_table (zstdio) && !find_frames (zstdio))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (io, 0);
+      zstd_dec_end (zstdio->dec);
+      grub_free (zstdio->frames);
+      grub_free (zstdio->outbuf);
+      grub_free (zstdio);
+      grub_free (file);
+
+      return io;
+    }
+
+  file->size = zstdio->frames[zstdio->num_frames].out;
+  /* Nothing decompressed yet.  */
+  zstdio->frame = zstdio->num_frames;
+  zstdio->out_off = 0;
+  zstdio->out_len = 0;
+
+  return file;
+}
+
+static grub_ssize_t
+grub_zstdio_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  grub_zstdio_t zstdio = file->data;
+  grub_off_t offset = file->offset;
+  grub_ssize_t ret = 0;
+  grub_size_t n, frame;
+
+  while (len > 0 && offset < file->size)
+    {
+      if (offset >= zstdio->out_off
+	  && offset < zstdio->out_off + zstdio->out_len)
+	{
+	  n = zstdio->out_off + zstdio->out_len - offset;
+	  if (n > len)
+	    n = len;
+	  grub_memcpy (buf, zstdio->outbuf + (offset - zstdio->out_off), n);
+	  buf += n;
+	  len -= n;
+	  ret += n;
+	  offset += n;
+	  continue;
+	}
+
+      /* What is left of the data from before the wrap around.  */
+      if (offset < zstdio->out_off && zstdio->prev_end > zstdio->out_len
+	  && zstdio->out_off - offset <= zstdio->prev_end - zstdio->out_len)
+	{
+	  n = zstdio->out_off - offset;
+	  if (n > len)
+	    n = len;
+	  grub_memcpy (buf, zstdio->outbuf + zstdio->prev_end
+		       - (zstdio->out_off - offset), n);
+	  buf += n;
+	  len -= n;
+	  ret += n;
+	  offset += n;
+	  continue;
+	}
+
+      /* Frames are decompressed independently, so a seek to another frame
+	 or back within this one restarts at the frame containing the
+	 offset.  */
+      frame = find_frame (zstdio, offset);
+      if (frame != zstdio->frame || offset < zstdio->out_off)
+	{
+	  if (start_frame (zstdio, frame))
+	    return -1;
+	  continue;
+	}
+
+      if (zstdio->frame_done || decode_block (zstdio))
+	goto corrupted;
+      if (zstdio->out_off + zstdio->out_len
+	  > zstdio->frames[zstdio->frame + 1].out)
+	goto corrupted;
+    }
+
+  return ret;
+
+ corrupted:
+  if (!grub_errno)
+    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		N_("zstd file corrupted or unsupported frame options"));
+  return -1;
+}
+
+/* Release everything, including the underlying file object.  */
+static grub_err_t
+grub_zstdio_close (grub_file_t file)
+{
+  grub_zstdio_t zstdio = file->data;
+
+  zstd_dec_end (zstdio->dec);
+
+  grub_file_close (zstdio->file);
+  grub_free (zstdio->frames);
+  grub_free (zstdio->outbuf);
+  grub_free (zstdio);
+
+  /* Device must not be closed twice.  */
+  file->device = 0;
+  file->name = 0;
+  return grub_errno;
+}
+
+static struct grub_fs grub_zstdio_fs = {
+  .name = "zstdio",
+  .dir = 0,
+  .open = 0,
+  .read = grub_zstdio_read,
+  .close = grub_zstdio_close,
+  .label = 0,
+  .next = 0
+};
+
+GRUB_MOD_INIT (zstdio)
+{
+  grub_file_filter_register (GRUB_FILE_FILTER_ZSTDIO, grub_zstdio_open);
+}
+
+GRUB_MOD_FINI (zstdio)
+{
+  grub_file_filter_unregister (GRUB_FILE_FILTER_ZSTDIO);
+}
@@ -408,6 +408,75 @@ grub_disk_read_small (grub_disk_t disk, grub_disk_addr_t sector,
   return GRUB_ERR_NONE;
 }
 
+/* Read data from a disk which isn't cached.  SECTOR and OFFSET are already
+   adjusted.  Whole device sectors are read straight into BUF, only partial
+   ones at the ends go through a bounce buffer.  */
+static grub_err_t
+grub_disk_read_nocache (grub_disk_t disk, grub_disk_addr_t sector,
+			grub_off_t offset, grub_size_t size, void *buf)
+{
+  unsigned log_ratio = disk->log_sector_size - GRUB_DISK_SECTOR_BITS;
+  grub_size_t sector_size = 1 << disk->log_sector_size;
+  grub_size_t max_size = (grub_size_t) disk->max_agglomerate
+    << (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS);
+  grub_disk_addr_t hw_sector;
+  char *tmp_buf = NULL;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  if (max_size < sector_size)
+    max_size = sector_size;
+
+  hw_sector = sector >> log_ratio;
+  offset += (sector - (hw_sector << log_ratio)) << GRUB_DISK_SECTOR_BITS;
+
+  while (size)
+    {
+      grub_size_t len;
+
+      if (offset || size < sector_size)
+	{
+	  /* Partial device sector.  */
+	  if (!tmp_buf)
+	    {
+	      tmp_buf = grub_malloc (sector_size);
+	      if (!tmp_buf)
+		return grub_errno;
+	    }
+	  len = sector_size - offset;
+	  if (len > size)
+	    len = size;
+	  err = (disk->dev->read) (disk, hw_sector, 1, tmp_buf);
+	  if (err)
+	    break;
+	  grub_memcpy (buf, tmp_buf + offset, len);
+	}
+      else
+	{
+	  len = size & ~(sector_size - 1);
+	  if (len > max_size)
+	    len = max_size & ~(sector_size - 1);
+	  err = (disk->dev->read) (disk, hw_sector,
+				   len >> disk->log_sector_size, buf);
+	  if (err)
+	    break;
+	}
+
+      if (disk->read_hook)
+	(disk->read_hook) ((hw_sector << log_ratio)
+			   + (offset >> GRUB_DISK_SECTOR_BITS),
+			   offset & (GRUB_DISK_SECTOR_SIZE - 1),
+			   len, disk->read_hook_data);
+
+      hw_sector += (offset + len) >> disk->log_sector_size;
+      offset = 0;
+      buf = (char *) buf + len;
+      size -= len;
+    }
+
+  grub_free (tmp_buf);
+  return err;
+}
+
 /* Read data from the disk.  */
 grub_err_t
 grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
@@ -423,6 +492,9 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
       return grub_errno;
     }
 
+  if (disk->nocache)
+    return grub_disk_read_nocache (disk, sector, offset, size, buf);
+
   /* First read until first cache boundary.   */
   if (offset || (sector & (GRUB_DISK_CACHE_SIZE - 1)))
     {
@@ -10,6 +10,33 @@
 static grub_efi_guid_t tpm_guid = EFI_TPM_GUID;
 static grub_efi_guid_t tpm2_guid = EFI_TPM2_GUID;
 
+/* The TPM doesn't come and go during boot services, so the handle,
+   protocol and presence lookups are done once instead of for every
+   measured command.  -1 means not looked up yet.  */
+static int tpm_handle_found = -1;
+static grub_efi_handle_t tpm_cached_handle;
+static grub_efi_uint8_t tpm_cached_version;
+static int tpm_is_present = -1;
+static void *tpm_protocol;
+
+/* Event buffer reused across measurements.  */
+static grub_uint8_t *tpm_event_buf;
+static grub_size_t tpm_event_buf_size;
+
+static void *grub_tpm_event_buffer(grub_size_t size)
+{
+  if (size > tpm_event_buf_size) {
+    grub_free(tpm_event_buf);
+    tpm_event_buf_size = 0;
+    tpm_event_buf = grub_malloc(size);
+    if (!tpm_event_buf)
+      return NULL;
+    tpm_event_buf_size = size;
+  }
+  grub_memset(tpm_event_buf, 0, size);
+  return tpm_event_buf;
+}
+
 static grub_efi_boolean_t grub_tpm_present(grub_efi_tpm_protocol_t *tpm)
 {
   grub_efi_status_t status;
@@ -50,23 +77,81 @@ static grub_efi_boolean_t grub_tpm_handle_find(grub_efi_handle_t *tpm_handle,
   grub_efi_handle_t *handles;
   grub_efi_uintn_t num_handles;
 
+  if (tpm_handle_found != -1) {
+    *tpm_handle = tpm_cached_handle;
+    *protocol_version = tpm_cached_version;
+    return tpm_handle_found;
+  }
+
+  tpm_handle_found = 0;
+
   handles = grub_efi_locate_handle (GRUB_EFI_BY_PROTOCOL, &tpm_guid, NULL,
 				    &num_handles);
   if (handles && num_handles > 0) {
-    *tpm_handle = handles[0];
-    *protocol_version = 1;
-    return 1;
+    tpm_cached_handle = handles[0];
+    tpm_cached_version = 1;
+    tpm_handle_found = 1;
+  }
+  grub_free (handles);
+
+  if (!tpm_handle_found) {
+    handles = grub_efi_locate_handle (GRUB_EFI_BY_PROTOCOL, &tpm2_guid, NULL,
+				      &num_handles);
+    if (handles && num_handles > 0) {
+      tpm_cached_handle = handles[0];
+      tpm_cached_version = 2;
+      tpm_handle_found = 1;
+    }
+    grub_free (handles);
   }
 
-  handles = grub_efi_locate_handle (GRUB_EFI_BY_PROTOCOL, &tpm2_guid, NULL,
-				    &num_handles);
-  if (handles && num_handles > 0) {
-    *tpm_handle = handles[0];
-    *protocol_version = 2;
-    return 1;
+  *tpm_handle = tpm_cached_handle;
+  *protocol_version = tpm_cached_version;
+  return tpm_handle_found;
+}
+
+/* Open the TPM protocol on TPM_HANDLE and check that the TPM is usable,
+   remembering the outcome.  Returns NULL if there is no usable TPM.  */
+static void *grub_tpm_protocol(grub_efi_handle_t tpm_handle,
+			       grub_efi_uint8_t protocol_version)
+{
+  if (tpm_is_present != -1)
+    return tpm_is_present ? tpm_protocol : NULL;
+
+  tpm_is_present = 0;
+  if (protocol_version == 1) {
+    grub_efi_tpm_protocol_t *tpm;
+
+    tpm = grub_efi_open_protocol (tpm_handle, &tpm_guid,
+				  GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+    if (tpm && grub_tpm_present(tpm)) {
+      tpm_protocol = tpm;
+      tpm_is_present = 1;
+    }
+  } else {
+    grub_efi_tpm2_protocol_t *tpm;
+
+    tpm = grub_efi_open_protocol (tpm_handle, &tpm2_guid,
+				  GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+    if (tpm && grub_tpm2_present(tpm)) {
+      tpm_protocol = tpm;
+      tpm_is_present = 1;
+    }
   }
 
-  return 0;
+  return tpm_is_present ? tpm_protocol : NULL;
+}
+
+int
+grub_tpm_available(void)
+{
+  grub_efi_handle_t tpm_handle;
+  grub_efi_uint8_t protocol_version;
+
+  if (!grub_tpm_handle_find(&tpm_handle, &protocol_version))
+    return 0;
+
+  return grub_tpm_protocol(tpm_handle, protocol_version) != NULL;
 }
 
 static grub_err_t
@@ -79,10 +164,8 @@ grub_tpm1_execute(grub_efi_handle_t tpm_handle,
   grub_uint32_t inhdrsize = sizeof(*inbuf) - sizeof(inbuf->TPMOperandIn);
   grub_uint32_t outhdrsize = sizeof(*outbuf) - sizeof(outbuf->TPMOperandOut);
 
-  tpm = grub_efi_open_protocol (tpm_handle, &tpm_guid,
-				GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
-
-  if (!grub_tpm_present(tpm))
+  tpm = grub_tpm_protocol(tpm_handle, 1);
+  if (!tpm)
     return 0;
 
   /* UEFI TPM protocol takes the raw operand block, no param block header */
@@ -116,10 +199,8 @@ grub_tpm2_execute(grub_efi_handle_t tpm_handle,
   grub_uint32_t inhdrsize = sizeof(*inbuf) - sizeof(inbuf->TPMOperandIn);
   grub_uint32_t outhdrsize = sizeof(*outbuf) - sizeof(outbuf->TPMOperandOut);
 
-  tpm = grub_efi_open_protocol (tpm_handle, &tpm2_guid,
-				GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
-
-  if (!grub_tpm2_present(tpm))
+  tpm = grub_tpm_protocol(tpm_handle, 2);
+  if (!tpm)
     return 0;
 
   /* UEFI TPM protocol takes the raw operand block, no param block header */
@@ -173,13 +254,11 @@ grub_tpm1_log_event(grub_efi_handle_t tpm_handle, unsigned char *buf,
   grub_uint32_t algorithm;
   grub_uint32_t eventnum = 0;
 
-  tpm = grub_efi_open_protocol (tpm_handle, &tpm_guid,
-				GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
-
-  if (!grub_tpm_present(tpm))
+  tpm = grub_tpm_protocol(tpm_handle, 1);
+  if (!tpm)
     return 0;
 
-  event = grub_zalloc(sizeof (TCG_PCR_EVENT) + grub_strlen(description) + 1);
+  event = grub_tpm_event_buffer(sizeof (TCG_PCR_EVENT) + grub_strlen(description) + 1);
   if (!event)
     return grub_error (GRUB_ERR_OUT_OF_MEMORY,
 		       N_("cannot allocate TPM event buffer"));
@@ -218,13 +297,11 @@ grub_tpm2_log_event(grub_efi_handle_t tpm_handle, unsigned char *buf,
   grub_efi_status_t status;
   grub_efi_tpm2_protocol_t *tpm;
 
-  tpm = grub_efi_open_protocol (tpm_handle, &tpm2_guid,
-				GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
-
-  if (!grub_tpm2_present(tpm))
+  tpm = grub_tpm_protocol(tpm_handle, 2);
+  if (!tpm)
     return 0;
 
-  event = grub_zalloc(sizeof (EFI_TCG2_EVENT) + grub_strlen(description) + 1);
+  event = grub_tpm_event_buffer(sizeof (EFI_TCG2_EVENT) + grub_strlen(description) + 1);
   if (!event)
     return grub_error (GRUB_ERR_OUT_OF_MEMORY,
 		       N_("cannot allocate TPM event buffer"));
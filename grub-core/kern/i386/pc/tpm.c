@@ -9,9 +9,7 @@
 
 static int tpm_presence = -1;
 
-int tpm_present(void);
-
-int tpm_present(void)
+int grub_tpm_available(void)
 {
   struct grub_bios_int_registers regs;
 
@@ -38,7 +36,7 @@ grub_tpm_execute(PassThroughToTPM_InputParamBlock *inbuf,
   struct grub_bios_int_registers regs;
   grub_addr_t inaddr, outaddr;
 
-  if (!tpm_present())
+  if (!grub_tpm_available())
     return 0;
 
   inaddr = (grub_addr_t) inbuf;
@@ -100,7 +98,7 @@ grub_tpm_log_event(unsigned char *buf, grub_size_t size, grub_uint8_t pcr,
 	Event *event;
 	grub_uint32_t datalength;
 
-	if (!tpm_present())
+	if (!grub_tpm_available())
 		return 0;
 
 	datalength = grub_strlen(description);
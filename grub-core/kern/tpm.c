@@ -4,16 +4,43 @@
 #include <grub/mm.h>
 #include <grub/tpm.h>
 #include <grub/term.h>
+#include <grub/time.h>
+
+static grub_uint64_t tpm_events;
+static grub_uint64_t tpm_bytes;
+static grub_uint64_t tpm_time_ms;
 
 grub_err_t
 grub_tpm_measure (unsigned char *buf, grub_size_t size, grub_uint8_t pcr,
 		  const char *kind, const char *description)
 {
   grub_err_t ret;
-  char *desc = grub_xasprintf("%s %s", kind, description);
+  grub_uint64_t start;
+  char *desc;
+
+  /* Every script command ends up here, don't even format the description
+     when there is no TPM to log it to.  */
+  if (!grub_tpm_available())
+    return GRUB_ERR_NONE;
+
+  start = grub_get_time_ms();
+  desc = grub_xasprintf("%s %s", kind, description);
   if (!desc)
     return GRUB_ERR_OUT_OF_MEMORY;
   ret = grub_tpm_log_event(buf, size, pcr, desc);
   grub_free(desc);
+
+  tpm_events++;
+  tpm_bytes += size;
+  tpm_time_ms += grub_get_time_ms() - start;
   return ret;
 }
+
+void
+grub_tpm_get_stats (grub_uint64_t *events, grub_uint64_t *bytes,
+		    grub_uint64_t *time_ms)
+{
+  *events = tpm_events;
+  *bytes = tpm_bytes;
+  *time_ms = tpm_time_ms;
+}
@@ -0,0 +1,632 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Argon2 memory-hard key derivation as per RFC 9106, version 0x13.  */
+
+#include <grub/crypto.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/dl.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define ARGON2_VERSION 0x13
+#define ARGON2_BLOCK_SIZE 1024
+#define ARGON2_QWORDS_IN_BLOCK (ARGON2_BLOCK_SIZE / 8)
+#define ARGON2_ADDRESSES_IN_BLOCK ARGON2_QWORDS_IN_BLOCK
+#define ARGON2_SYNC_POINTS 4
+#define ARGON2_PREHASH_LEN 64
+#define ARGON2_MAX_LANES 0xffffff
+
+#define BLAKE2B_BLOCK_SIZE 128
+#define BLAKE2B_OUT_SIZE 64
+
+struct blake2b_ctx
+{
+  grub_uint64_t h[8];
+  grub_uint64_t t[2];
+  grub_uint8_t buf[BLAKE2B_BLOCK_SIZE];
+  grub_size_t buflen;
+  grub_size_t outlen;
+};
+
+struct argon2_block
+{
+  grub_uint64_t v[ARGON2_QWORDS_IN_BLOCK];
+};
+
+struct argon2_ctx
+{
+  grub_crypto_argon2_type_t type;
+  grub_uint32_t passes;
+  grub_uint32_t lanes;
+  grub_uint32_t memory_blocks;
+  grub_uint32_t lane_length;
+  grub_uint32_t segment_length;
+  /* The memory is allocated one segment at a time so that large
+     parameters do not need a single contiguous region of GRUB's heap.
+     Segment S of lane L is segments[L * ARGON2_SYNC_POINTS + S].  */
+  struct argon2_block **segments;
+};
+
+static const grub_uint64_t blake2b_iv[8] =
+  {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+  };
+
+static const grub_uint8_t blake2b_sigma[12][16] =
+  {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+  };
+
+static inline grub_uint64_t
+rotr64 (grub_uint64_t x, unsigned n)
+{
+  return (x >> n) | (x << (64 - n));
+}
+
+static inline grub_uint64_t
+load64 (const grub_uint8_t *p)
+{
+  return grub_le_to_cpu64 (grub_get_unaligned64 (p));
+}
+
+static inline void
+store32 (grub_uint8_t *p, grub_uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static inline void
+store64 (grub_uint8_t *p, grub_uint64_t v)
+{
+  store32 (p, v);
+  store32 (p + 4, v >> 32);
+}
+
+#define B2B_G(a, b, c, d, x, y)			\
+  do {						\
+    a = a + b + (x);				\
+    d = rotr64 (d ^ a, 32);			\
+    c = c + d;					\
+    b = rotr64 (b ^ c, 24);			\
+    a = a + b + (y);				\
+    d = rotr64 (d ^ a, 16);			\
+    c = c + d;					\
+    b = rotr64 (b ^ c, 63);			\
+  } while (0)
+
+static void
+blake2b_compress (struct blake2b_ctx *ctx, const grub_uint8_t *block,
+		  int last)
+{
+  grub_uint64_t m[16], v[16];
+  unsigned i;
+
+  for (i = 0; i < 16; i++)
+    m[i] = load64 (block + 8 * i);
+  for (i = 0; i < 8; i++)
+    {
+      v[i] = ctx->h[i];
+      v[i + 8] = blake2b_iv[i];
+    }
+  v[12] ^= ctx->t[0];
+  v[13] ^= ctx->t[1];
+  if (last)
+    v[14] = ~v[14];
+
+  for (i = 0; i < 12; i++)
+    {
+      const grub_uint8_t *s = blake2b_sigma[i];
+      B2B_G (v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+      B2B_G (v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+      B2B_G (v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+      B2B_G (v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+      B2B_G (v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+      B2B_G (v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+      B2B_G (v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+      B2B_G (v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+  for (i = 0; i < 8; i++)
+    ctx->h[i] ^= v[i] ^ v[i + 8];
+}
+
+static void
+blake2b_init (struct blake2b_ctx *ctx, grub_size_t outlen)
+{
+  unsigned i;
+
+  for (i = 0; i < 8; i++)
+    ctx->h[i] = blake2b_iv[i];
+  /* Parameter block: digest length, no key, fanout 1, depth 1.  */
+  ctx->h[0] ^= 0x01010000 ^ outlen;
+  ctx->t[0] = ctx->t[1] = 0;
+  ctx->buflen = 0;
+  ctx->outlen = outlen;
+}
+
+static void
+blake2b_increment (struct blake2b_ctx *ctx, grub_uint64_t inc)
+{
+  ctx->t[0] += inc;
+  if (ctx->t[0] < inc)
+    ctx->t[1]++;
+}
+
+static void
+blake2b_write (struct blake2b_ctx *ctx, const void *data, grub_size_t len)
+{
+  const grub_uint8_t *in = data;
+
+  while (len)
+    {
+      grub_size_t n;
+
+      /* The final block has to go through blake2b_final, so a full
+	 buffer is only compressed once more input is known to follow.  */
+      if (ctx->buflen == BLAKE2B_BLOCK_SIZE)
+	{
+	  blake2b_increment (ctx, BLAKE2B_BLOCK_SIZE);
+	  blake2b_compress (ctx, ctx->buf, 0);
+	  ctx->buflen = 0;
+	}
+      n = BLAKE2B_BLOCK_SIZE - ctx->buflen;
+      if (n > len)
+	n = len;
+      grub_memcpy (ctx->buf + ctx->buflen, in, n);
+      ctx->buflen += n;
+      in += n;
+      len -= n;
+    }
+}
+
+static void
+blake2b_final (struct blake2b_ctx *ctx, grub_uint8_t *out)
+{
+  grub_uint8_t digest[BLAKE2B_OUT_SIZE];
+  unsigned i;
+
+  blake2b_increment (ctx, ctx->buflen);
+  grub_memset (ctx->buf + ctx->buflen, 0, BLAKE2B_BLOCK_SIZE - ctx->buflen);
+  blake2b_compress (ctx, ctx->buf, 1);
+
+  for (i = 0; i < 8; i++)
+    store64 (digest + 8 * i, ctx->h[i]);
+  grub_memcpy (out, digest, ctx->outlen);
+  grub_memset (digest, 0, sizeof (digest));
+  grub_memset (ctx, 0, sizeof (*ctx));
+}
+
+/* The variable-length hash H' of RFC 9106 section 3.3, over the
+   concatenation of IN1 and IN2.  */
+static void
+argon2_hash (grub_uint8_t *out, grub_size_t outlen,
+	     const void *in1, grub_size_t in1len,
+	     const void *in2, grub_size_t in2len)
+{
+  struct blake2b_ctx ctx;
+  grub_uint8_t outlen_le[4];
+  grub_uint8_t v[BLAKE2B_OUT_SIZE];
+
+  store32 (outlen_le, outlen);
+  blake2b_init (&ctx, outlen <= BLAKE2B_OUT_SIZE ? outlen : BLAKE2B_OUT_SIZE);
+  blake2b_write (&ctx, outlen_le, sizeof (outlen_le));
+  blake2b_write (&ctx, in1, in1len);
+  blake2b_write (&ctx, in2, in2len);
+
+  if (outlen <= BLAKE2B_OUT_SIZE)
+    {
+      blake2b_final (&ctx, out);
+      return;
+    }
+
+  /* Emit the first half of each intermediate digest, chaining until the
+     remainder fits into one final digest.  */
+  blake2b_final (&ctx, v);
+  grub_memcpy (out, v, BLAKE2B_OUT_SIZE / 2);
+  out += BLAKE2B_OUT_SIZE / 2;
+  outlen -= BLAKE2B_OUT_SIZE / 2;
+  while (outlen > BLAKE2B_OUT_SIZE)
+    {
+      blake2b_init (&ctx, BLAKE2B_OUT_SIZE);
+      blake2b_write (&ctx, v, BLAKE2B_OUT_SIZE);
+      blake2b_final (&ctx, v);
+      grub_memcpy (out, v, BLAKE2B_OUT_SIZE / 2);
+      out += BLAKE2B_OUT_SIZE / 2;
+      outlen -= BLAKE2B_OUT_SIZE / 2;
+    }
+  blake2b_init (&ctx, outlen);
+  blake2b_write (&ctx, v, BLAKE2B_OUT_SIZE);
+  blake2b_final (&ctx, out);
+  grub_memset (v, 0, sizeof (v));
+}
+
+static inline grub_uint64_t
+fBlaMka (grub_uint64_t x, grub_uint64_t y)
+{
+  return x + y + 2 * (x & 0xffffffff) * (y & 0xffffffff);
+}
+
+#define ARGON2_G(a, b, c, d)			\
+  do {						\
+    a = fBlaMka (a, b);				\
+    d = rotr64 (d ^ a, 32);			\
+    c = fBlaMka (c, d);				\
+    b = rotr64 (b ^ c, 24);			\
+    a = fBlaMka (a, b);				\
+    d = rotr64 (d ^ a, 16);			\
+    c = fBlaMka (c, d);				\
+    b = rotr64 (b ^ c, 63);			\
+  } while (0)
+
+#define ARGON2_ROUND(v0, v1, v2, v3, v4, v5, v6, v7,		\
+		     v8, v9, v10, v11, v12, v13, v14, v15)	\
+  do {								\
+    ARGON2_G (v0, v4, v8, v12);					\
+    ARGON2_G (v1, v5, v9, v13);					\
+    ARGON2_G (v2, v6, v10, v14);				\
+    ARGON2_G (v3, v7, v11, v15);				\
+    ARGON2_G (v0, v5, v10, v15);				\
+    ARGON2_G (v1, v6, v11, v12);				\
+    ARGON2_G (v2, v7, v8, v13);					\
+    ARGON2_G (v3, v4, v9, v14);					\
+  } while (0)
+
+/* The compression function G.  NEXT = G (PREV, REF), XORed into the old
+   contents of NEXT when WITH_XOR is set (passes after the first).  */
+static void
+argon2_fill_block (const struct argon2_block *prev,
+		   const struct argon2_block *ref,
+		   struct argon2_block *next, int with_xor)
+{
+  struct argon2_block r, tmp;
+  unsigned i;
+
+  for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+    r.v[i] = prev->v[i] ^ ref->v[i];
+  if (with_xor)
+    for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+      tmp.v[i] = r.v[i] ^ next->v[i];
+  else
+    tmp = r;
+
+  for (i = 0; i < 8; i++)
+    {
+      grub_uint64_t *v = r.v + 16 * i;
+      ARGON2_ROUND (v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7],
+		    v[8], v[9], v[10], v[11], v[12], v[13], v[14], v[15]);
+    }
+  for (i = 0; i < 8; i++)
+    {
+      grub_uint64_t *v = r.v + 2 * i;
+      ARGON2_ROUND (v[0], v[1], v[16], v[17], v[32], v[33], v[48], v[49],
+		    v[64], v[65], v[80], v[81], v[96], v[97], v[112], v[113]);
+    }
+
+  for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+    next->v[i] = tmp.v[i] ^ r.v[i];
+}
+
+static inline struct argon2_block *
+argon2_block_at (const struct argon2_ctx *ctx, grub_uint32_t lane,
+		 grub_uint32_t index)
+{
+  return ctx->segments[lane * ARGON2_SYNC_POINTS
+		       + index / ctx->segment_length]
+    + index % ctx->segment_length;
+}
+
+/* Map the pseudo-random value J1 to a block index within the reference
+   area of the current position, as per RFC 9106 section 3.4.1.2.  */
+static grub_uint32_t
+argon2_index_alpha (const struct argon2_ctx *ctx, grub_uint32_t pass,
+		    grub_uint32_t slice, grub_uint32_t index,
+		    grub_uint32_t j1, int same_lane)
+{
+  grub_uint32_t area_size, start = 0;
+  grub_uint64_t rel;
+
+  if (pass == 0)
+    {
+      if (slice == 0)
+	area_size = index - 1;
+      else if (same_lane)
+	area_size = slice * ctx->segment_length + index - 1;
+      else
+	area_size = slice * ctx->segment_length + (index == 0 ? -1 : 0);
+    }
+  else
+    {
+      if (same_lane)
+	area_size = ctx->lane_length - ctx->segment_length + index - 1;
+      else
+	area_size = ctx->lane_length - ctx->segment_length
+	  + (index == 0 ? -1 : 0);
+      if (slice != ARGON2_SYNC_POINTS - 1)
+	start = (slice + 1) * ctx->segment_length;
+    }
+
+  rel = j1;
+  rel = (rel * rel) >> 32;
+  rel = area_size - 1 - ((area_size * rel) >> 32);
+
+  return (start + rel) % ctx->lane_length;
+}
+
+static void
+argon2_next_addresses (struct argon2_block *address,
+		       struct argon2_block *input)
+{
+  static const struct argon2_block zero;
+
+  input->v[6]++;
+  argon2_fill_block (&zero, input, address, 0);
+  argon2_fill_block (&zero, address, address, 0);
+}
+
+static void
+argon2_fill_segment (const struct argon2_ctx *ctx, grub_uint32_t pass,
+		     grub_uint32_t lane, grub_uint32_t slice)
+{
+  struct argon2_block address, input;
+  struct argon2_block *seg = ctx->segments[lane * ARGON2_SYNC_POINTS + slice];
+  const struct argon2_block *prev;
+  grub_uint32_t i, start = 0;
+  int data_independent;
+
+  data_independent = (ctx->type == GRUB_CRYPTO_ARGON2I
+		      || (ctx->type == GRUB_CRYPTO_ARGON2ID && pass == 0
+			  && slice < ARGON2_SYNC_POINTS / 2));
+
+  if (data_independent)
+    {
+      grub_memset (&input, 0, sizeof (input));
+      input.v[0] = pass;
+      input.v[1] = lane;
+      input.v[2] = slice;
+      input.v[3] = ctx->memory_blocks;
+      input.v[4] = ctx->passes;
+      input.v[5] = ctx->type;
+    }
+
+  /* The first two blocks of each lane are seeded from H0.  */
+  if (pass == 0 && slice == 0)
+    {
+      start = 2;
+      if (data_independent)
+	argon2_next_addresses (&address, &input);
+    }
+
+  if (slice == 0 && start == 0)
+    prev = argon2_block_at (ctx, lane, ctx->lane_length - 1);
+  else if (start == 0)
+    prev = ctx->segments[lane * ARGON2_SYNC_POINTS + slice - 1]
+      + ctx->segment_length - 1;
+  else
+    prev = seg + start - 1;
+
+  for (i = start; i < ctx->segment_length; i++)
+    {
+      grub_uint64_t rand;
+      grub_uint32_t ref_lane, ref_index;
+
+      if (data_independent)
+	{
+	  if (i % ARGON2_ADDRESSES_IN_BLOCK == 0)
+	    argon2_next_addresses (&address, &input);
+	  rand = address.v[i % ARGON2_ADDRESSES_IN_BLOCK];
+	}
+      else
+	rand = prev->v[0];
+
+      ref_lane = (rand >> 32) % ctx->lanes;
+      if (pass == 0 && slice == 0)
+	ref_lane = lane;
+
+      ref_index = argon2_index_alpha (ctx, pass, slice, i, rand & 0xffffffff,
+				      ref_lane == lane);
+
+      argon2_fill_block (prev, argon2_block_at (ctx, ref_lane, ref_index),
+			 seg + i, pass != 0);
+      prev = seg + i;
+    }
+}
+
+static void
+argon2_free_memory (struct argon2_ctx *ctx)
+{
+  grub_uint32_t i;
+
+  if (!ctx->segments)
+    return;
+  for (i = 0; i < ctx->lanes * ARGON2_SYNC_POINTS; i++)
+    if (ctx->segments[i])
+      {
+	grub_memset (ctx->segments[i], 0,
+		     (grub_size_t) ctx->segment_length * ARGON2_BLOCK_SIZE);
+	grub_free (ctx->segments[i]);
+      }
+  grub_free (ctx->segments);
+  ctx->segments = NULL;
+}
+
+static gcry_err_code_t
+argon2_alloc_memory (struct argon2_ctx *ctx)
+{
+  grub_uint32_t i, nsegs = ctx->lanes * ARGON2_SYNC_POINTS;
+
+  ctx->segments = grub_zalloc (nsegs * sizeof (ctx->segments[0]));
+  if (!ctx->segments)
+    return GPG_ERR_OUT_OF_MEMORY;
+  for (i = 0; i < nsegs; i++)
+    {
+      ctx->segments[i] = grub_malloc ((grub_size_t) ctx->segment_length
+				      * ARGON2_BLOCK_SIZE);
+      if (!ctx->segments[i])
+	{
+	  argon2_free_memory (ctx);
+	  return GPG_ERR_OUT_OF_MEMORY;
+	}
+    }
+  return GPG_ERR_NO_ERROR;
+}
+
+static void
+argon2_load_block (struct argon2_block *block, const grub_uint8_t *buf)
+{
+  unsigned i;
+
+  for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+    block->v[i] = load64 (buf + 8 * i);
+}
+
+static void
+argon2_prehash_write (struct blake2b_ctx *b2, const void *data,
+		      grub_size_t len)
+{
+  grub_uint8_t len_le[4];
+
+  store32 (len_le, len);
+  blake2b_write (b2, len_le, sizeof (len_le));
+  blake2b_write (b2, data, len);
+}
+
+/* Derive TLEN bytes into T from password P and salt S with the Argon2
+   variant TYPE.  K is the optional secret and X the optional associated
+   data.  T_COST is the number of passes, M_COST the memory size in KiB
+   and PARALLELISM the number of lanes.  GRUB runs single-threaded, so
+   the lanes are filled one after another within each slice.  */
+gcry_err_code_t
+grub_crypto_argon2 (grub_crypto_argon2_type_t type,
+		    const grub_uint8_t *P, grub_size_t Plen,
+		    const grub_uint8_t *S, grub_size_t Slen,
+		    const grub_uint8_t *K, grub_size_t Klen,
+		    const grub_uint8_t *X, grub_size_t Xlen,
+		    unsigned int t_cost, unsigned int m_cost,
+		    unsigned int parallelism,
+		    grub_uint8_t *T, grub_size_t Tlen)
+{
+  struct argon2_ctx ctx;
+  struct blake2b_ctx b2;
+  grub_uint8_t h0[ARGON2_PREHASH_LEN + 8];
+  grub_uint8_t params[6 * 4];
+  grub_uint8_t *buf;
+  struct argon2_block *last;
+  grub_uint32_t pass, slice, lane, i;
+  gcry_err_code_t err;
+
+  if (type != GRUB_CRYPTO_ARGON2D && type != GRUB_CRYPTO_ARGON2I
+      && type != GRUB_CRYPTO_ARGON2ID)
+    return GPG_ERR_INV_ARG;
+  if (t_cost < 1 || parallelism < 1 || parallelism > ARGON2_MAX_LANES
+      || m_cost < 8 * parallelism || Tlen < 4 || Tlen > 0xffffffff)
+    return GPG_ERR_INV_ARG;
+
+  ctx.type = type;
+  ctx.passes = t_cost;
+  ctx.lanes = parallelism;
+  ctx.segment_length = m_cost / (parallelism * ARGON2_SYNC_POINTS);
+  ctx.lane_length = ctx.segment_length * ARGON2_SYNC_POINTS;
+  ctx.memory_blocks = ctx.lane_length * parallelism;
+  ctx.segments = NULL;
+
+  /* H0 over the parameters and inputs.  */
+  store32 (params, parallelism);
+  store32 (params + 4, Tlen);
+  store32 (params + 8, m_cost);
+  store32 (params + 12, t_cost);
+  store32 (params + 16, ARGON2_VERSION);
+  store32 (params + 20, type);
+  blake2b_init (&b2, ARGON2_PREHASH_LEN);
+  blake2b_write (&b2, params, sizeof (params));
+  argon2_prehash_write (&b2, P, Plen);
+  argon2_prehash_write (&b2, S, Slen);
+  argon2_prehash_write (&b2, K, Klen);
+  argon2_prehash_write (&b2, X, Xlen);
+  blake2b_final (&b2, h0);
+
+  err = argon2_alloc_memory (&ctx);
+  if (err)
+    {
+      grub_memset (h0, 0, sizeof (h0));
+      return err;
+    }
+
+  buf = grub_malloc (ARGON2_BLOCK_SIZE);
+  if (!buf)
+    {
+      argon2_free_memory (&ctx);
+      grub_memset (h0, 0, sizeof (h0));
+      return GPG_ERR_OUT_OF_MEMORY;
+    }
+
+  for (lane = 0; lane < ctx.lanes; lane++)
+    {
+      store32 (h0 + ARGON2_PREHASH_LEN + 4, lane);
+      for (i = 0; i < 2; i++)
+	{
+	  store32 (h0 + ARGON2_PREHASH_LEN, i);
+	  argon2_hash (buf, ARGON2_BLOCK_SIZE, h0, sizeof (h0), NULL, 0);
+	  argon2_load_block (argon2_block_at (&ctx, lane, i), buf);
+	}
+    }
+  grub_memset (h0, 0, sizeof (h0));
+
+  for (pass = 0; pass < ctx.passes; pass++)
+    for (slice = 0; slice < ARGON2_SYNC_POINTS; slice++)
+      for (lane = 0; lane < ctx.lanes; lane++)
+	argon2_fill_segment (&ctx, pass, lane, slice);
+
+  /* XOR the last column together and hash it into the tag.  */
+  last = argon2_block_at (&ctx, 0, ctx.lane_length - 1);
+  for (lane = 1; lane < ctx.lanes; lane++)
+    {
+      const struct argon2_block *b;
+
+      b = argon2_block_at (&ctx, lane, ctx.lane_length - 1);
+      for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+	last->v[i] ^= b->v[i];
+    }
+  for (i = 0; i < ARGON2_QWORDS_IN_BLOCK; i++)
+    store64 (buf + 8 * i, last->v[i]);
+  argon2_hash (T, Tlen, buf, ARGON2_BLOCK_SIZE, NULL, 0);
+
+  grub_memset (buf, 0, ARGON2_BLOCK_SIZE);
+  grub_free (buf);
+  argon2_free_memory (&ctx);
+
+  return GPG_ERR_NO_ERROR;
+}
@@ -43,7 +43,7 @@ void (*grub_crypto_autoload_hook) (const char *name) = NULL;
 void
 grub_burn_stack (grub_size_t size)
 {
-  char buf[64];
+  char buf[256];
 
   grub_memset (buf, 0, sizeof (buf));
   if (size > sizeof (buf))
@@ -138,17 +138,23 @@ grub_crypto_hash (const gcry_md_spec_t *hash, void *out, const void *in,
 const gcry_md_spec_t *
 grub_crypto_lookup_md_by_name (const char *name)
 {
-  const gcry_md_spec_t *md;
+  const gcry_md_spec_t *md, *best;
   int first = 1;
   while (1)
     {
+      best = NULL;
       for (md = grub_digests; md; md = md->next)
-	if (grub_strcasecmp (name, md->name) == 0)
-	  return md;
+	if (grub_strcasecmp (name, md->name) == 0
+	    && (!best || md->priority > best->priority))
+	  best = md;
+      /* An accelerated implementation may be available but not loaded
+	 yet, so the portable one only wins after trying to autoload.  */
+      if (best && (best->priority > 0 || !first))
+	return best;
       if (grub_crypto_autoload_hook && first)
 	grub_crypto_autoload_hook (name);
       else
-	return NULL;
+	return best;
       first = 0;
     }
 }
@@ -156,25 +162,33 @@ grub_crypto_lookup_md_by_name (const char *name)
 const gcry_cipher_spec_t *
 grub_crypto_lookup_cipher_by_name (const char *name)
 {
-  const gcry_cipher_spec_t *ciph;
+  const gcry_cipher_spec_t *ciph, *best;
   int first = 1;
   while (1)
     {
+      best = NULL;
       for (ciph = grub_ciphers; ciph; ciph = ciph->next)
 	{
 	  const char **alias;
-	  if (grub_strcasecmp (name, ciph->name) == 0)
-	    return ciph;
-	  if (!ciph->aliases)
-	    continue;
-	  for (alias = ciph->aliases; *alias; alias++)
-	    if (grub_strcasecmp (name, *alias) == 0)
-	      return ciph;
+	  int match = (grub_strcasecmp (name, ciph->name) == 0);
+	  if (!match && ciph->aliases)
+	    for (alias = ciph->aliases; *alias; alias++)
+	      if (grub_strcasecmp (name, *alias) == 0)
+		{
+		  match = 1;
+		  break;
+		}
+	  if (match && (!best || ciph->priority > best->priority))
+	    best = ciph;
 	}
+      /* Same as for digests: prefer an accelerated implementation that
+	 autoloading may still bring in.  */
+      if (best && (best->priority > 0 || !first))
+	return best;
       if (grub_crypto_autoload_hook && first)
 	grub_crypto_autoload_hook (name);
       else
-	return NULL;
+	return best;
       first = 0;
     }
 }
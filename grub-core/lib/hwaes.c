@@ -0,0 +1,393 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2020  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* AES using the x86_64 AES-NI instructions.  When the CPU supports them,
+   the ciphers registered here are preferred by
+   grub_crypto_lookup_cipher_by_name over the table based implementation
+   in gcry_rijndael, which is also what this module falls back to.  */
+
+#include <grub/types.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/dl.h>
+#include <grub/crypto.h>
+#include <grub/command.h>
+#include <grub/time.h>
+#include <grub/normal.h>
+#include <grub/i18n.h>
+#if defined (__x86_64__)
+#include <grub/i386/cpuid.h>
+#endif
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define AES_MAXROUNDS 14
+
+struct hwaes_context
+{
+  /* Round keys for encryption and for the equivalent inverse cipher,
+     in memory byte order.  */
+  grub_uint32_t ekey[4 * (AES_MAXROUNDS + 1)];
+  grub_uint32_t dkey[4 * (AES_MAXROUNDS + 1)];
+  int rounds;
+};
+
+/* The SIMD registers used below are never touched by the rest of GRUB,
+   which is built without floating point and vector support, and can't
+   even be named as clobbers for that reason.  Only registers that the
+   firmware calling conventions treat as scratch are used.  */
+
+#if defined (__x86_64__)
+
+static int
+hwaes_supported (void)
+{
+  grub_uint32_t a, b, c, d;
+
+  if (!grub_cpu_is_cpuid_supported ())
+    return 0;
+  grub_cpuid (0, a, b, c, d);
+  if (a < 1)
+    return 0;
+  grub_cpuid (1, a, b, c, d);
+  /* AES-NI.  SSE is always enabled by x86_64 firmware.  */
+  return !!(c & (1 << 25));
+}
+
+/* Apply the AES S-box to each byte of W.  */
+static grub_uint32_t
+hwaes_subword (grub_uint32_t w)
+{
+  grub_uint32_t r;
+
+  asm volatile ("movd %1, %%xmm0\n\t"
+		"pshufd $0, %%xmm0, %%xmm0\n\t"
+		"aeskeygenassist $0, %%xmm0, %%xmm1\n\t"
+		"movd %%xmm1, %0"
+		: "=r" (r) : "r" (w));
+  return r;
+}
+
+static void
+hwaes_invmixcolumns (grub_uint32_t *out, const grub_uint32_t *in)
+{
+  asm volatile ("movdqu (%1), %%xmm0\n\t"
+		"aesimc %%xmm0, %%xmm0\n\t"
+		"movdqu %%xmm0, (%0)"
+		: : "r" (out), "r" (in) : "memory");
+}
+
+static void
+hwaes_encrypt (void *context, unsigned char *out, const unsigned char *in)
+{
+  struct hwaes_context *ctx = context;
+  const grub_uint32_t *key = ctx->ekey;
+  unsigned long rounds = ctx->rounds - 1;
+
+  asm volatile ("movdqu (%[in]), %%xmm0\n\t"
+		"movdqu (%[key]), %%xmm1\n\t"
+		"pxor %%xmm1, %%xmm0\n"
+		"1:\n\t"
+		"addq $16, %[key]\n\t"
+		"movdqu (%[key]), %%xmm1\n\t"
+		"aesenc %%xmm1, %%xmm0\n\t"
+		"decq %[rounds]\n\t"
+		"jnz 1b\n\t"
+		"movdqu 16(%[key]), %%xmm1\n\t"
+		"aesenclast %%xmm1, %%xmm0\n\t"
+		"movdqu %%xmm0, (%[out])"
+		: [key] "+r" (key), [rounds] "+r" (rounds)
+		: [in] "r" (in), [out] "r" (out)
+		: "memory", "cc");
+}
+
+static void
+hwaes_decrypt (void *context, unsigned char *out, const unsigned char *in)
+{
+  struct hwaes_context *ctx = context;
+  const grub_uint32_t *key = ctx->dkey;
+  unsigned long rounds = ctx->rounds - 1;
+
+  asm volatile ("movdqu (%[in]), %%xmm0\n\t"
+		"movdqu (%[key]), %%xmm1\n\t"
+		"pxor %%xmm1, %%xmm0\n"
+		"1:\n\t"
+		"addq $16, %[key]\n\t"
+		"movdqu (%[key]), %%xmm1\n\t"
+		"aesdec %%xmm1, %%xmm0\n\t"
+		"decq %[rounds]\n\t"
+		"jnz 1b\n\t"
+		"movdqu 16(%[key]), %%xmm1\n\t"
+		"aesdeclast %%xmm1, %%xmm0\n\t"
+		"movdqu %%xmm0, (%[out])"
+		: [key] "+r" (key), [rounds] "+r" (rounds)
+		: [in] "r" (in), [out] "r" (out)
+		: "memory", "cc");
+}
+
+#else
+#error "hwaes is only supported on x86_64"
+#endif
+
+/* Standard AES key expansion.  The S-box comes from the hardware so that
+   no lookup table is involved.  Words are kept in little endian order, so
+   that byte 0 of a word is its lowest byte.  */
+static gcry_err_code_t
+hwaes_setkey (void *context, const unsigned char *key, unsigned keylen)
+{
+  struct hwaes_context *ctx = context;
+  unsigned nk = keylen / 4, total, i;
+  grub_uint32_t rcon = 1;
+
+  if (keylen != 16 && keylen != 24 && keylen != 32)
+    return GPG_ERR_INV_KEYLEN;
+
+  ctx->rounds = nk + 6;
+  total = 4 * (ctx->rounds + 1);
+
+  for (i = 0; i < nk; i++)
+    ctx->ekey[i] = grub_le_to_cpu32 (grub_get_unaligned32 (key + 4 * i));
+
+  for (i = nk; i < total; i++)
+    {
+      grub_uint32_t t = ctx->ekey[i - 1];
+
+      if (i % nk == 0)
+	{
+	  t = hwaes_subword ((t >> 8) | (t << 24)) ^ rcon;
+	  rcon = ((rcon << 1) ^ ((rcon & 0x80) ? 0x1b : 0)) & 0xff;
+	}
+      else if (nk > 6 && i % nk == 4)
+	t = hwaes_subword (t);
+      ctx->ekey[i] = ctx->ekey[i - nk] ^ t;
+    }
+
+  for (i = 0; i < total; i++)
+    ctx->ekey[i] = grub_cpu_to_le32 (ctx->ekey[i]);
+
+  /* Decryption keys run backwards and, except for the first and the last
+     one, have InvMixColumns applied.  */
+  grub_memcpy (ctx->dkey, ctx->ekey + 4 * ctx->rounds, 16);
+  for (i = 1; i < (unsigned) ctx->rounds; i++)
+    hwaes_invmixcolumns (ctx->dkey + 4 * i,
+			 ctx->ekey + 4 * (ctx->rounds - i));
+  grub_memcpy (ctx->dkey + 4 * ctx->rounds, ctx->ekey, 16);
+
+  return GPG_ERR_NO_ERROR;
+}
+
+static const char *hwaes_names[] =
+  {
+    "RIJNDAEL",
+    "AES128",
+    "AES-128",
+    NULL
+  };
+
+static const char *hwaes192_names[] =
+  {
+    "RIJNDAEL192",
+    "AES-192",
+    NULL
+  };
+
+static const char *hwaes256_names[] =
+  {
+    "RIJNDAEL256",
+    "AES-256",
+    NULL
+  };
+
+static gcry_cipher_spec_t hwaes_spec =
+  {
+    .name = "AES",
+    .aliases = hwaes_names,
+    .blocksize = 16,
+    .keylen = 128,
+    .contextsize = sizeof (struct hwaes_context),
+    .setkey = hwaes_setkey,
+    .encrypt = hwaes_encrypt,
+    .decrypt = hwaes_decrypt,
+    .priority = 1,
+#ifdef GRUB_UTIL
+    .modname = "hwaes",
+#endif
+  };
+
+static gcry_cipher_spec_t hwaes192_spec =
+  {
+    .name = "AES192",
+    .aliases = hwaes192_names,
+    .blocksize = 16,
+    .keylen = 192,
+    .contextsize = sizeof (struct hwaes_context),
+    .setkey = hwaes_setkey,
+    .encrypt = hwaes_encrypt,
+    .decrypt = hwaes_decrypt,
+    .priority = 1,
+#ifdef GRUB_UTIL
+    .modname = "hwaes",
+#endif
+  };
+
+static gcry_cipher_spec_t hwaes256_spec =
+  {
+    .name = "AES256",
+    .aliases = hwaes256_names,
+    .blocksize = 16,
+    .keylen = 256,
+    .contextsize = sizeof (struct hwaes_context),
+    .setkey = hwaes_setkey,
+    .encrypt = hwaes_encrypt,
+    .decrypt = hwaes_decrypt,
+    .priority = 1,
+#ifdef GRUB_UTIL
+    .modname = "hwaes",
+#endif
+  };
+
+#define BENCH_DEFAULT_SIZE (1024 * 1024)
+
+/* Encrypt and decrypt BUF with CIPHER keyed with KEY and report the
+   speed.  Leave the ciphertext in OUT.  */
+static grub_err_t
+hwaes_bench_one (const char *label, const gcry_cipher_spec_t *cipher,
+		 const grub_uint8_t *key, grub_uint8_t *buf, grub_uint8_t *out,
+		 grub_size_t size)
+{
+  grub_crypto_cipher_handle_t handle;
+  grub_uint64_t start, enc, dec;
+  gcry_err_code_t err;
+
+  handle = grub_crypto_cipher_open (cipher);
+  if (!handle)
+    return grub_errno;
+  err = grub_crypto_cipher_set_key (handle, key, 32);
+  if (err)
+    {
+      grub_crypto_cipher_close (handle);
+      return grub_crypto_gcry_error (err);
+    }
+
+  start = grub_get_time_ms ();
+  grub_crypto_ecb_encrypt (handle, out, buf, size);
+  enc = grub_get_time_ms () - start;
+  start = grub_get_time_ms ();
+  grub_crypto_ecb_decrypt (handle, buf, out, size);
+  dec = grub_get_time_ms () - start;
+  grub_crypto_cipher_close (handle);
+
+  grub_printf ("%s: ", label);
+  if (enc)
+    grub_printf_ (N_("encrypt %s, "),
+		  grub_get_human_size (grub_divmod64 (size * 100ULL * 1000ULL,
+						      enc, 0),
+				       GRUB_HUMAN_SIZE_SPEED));
+  else
+    grub_printf_ (N_("encrypt too fast to measure, "));
+  if (dec)
+    grub_printf_ (N_("decrypt %s\n"),
+		  grub_get_human_size (grub_divmod64 (size * 100ULL * 1000ULL,
+						      dec, 0),
+				       GRUB_HUMAN_SIZE_SPEED));
+  else
+    grub_printf_ (N_("decrypt too fast to measure\n"));
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_cmd_aes_bench (grub_command_t cmd __attribute__ ((unused)),
+		    int argc, char **args)
+{
+  grub_size_t size = BENCH_DEFAULT_SIZE, i;
+  grub_uint8_t key[32];
+  grub_uint8_t *buf, *hw_out = 0, *sw_out = 0;
+  grub_err_t err;
+
+  if (argc > 0)
+    size = grub_strtoul (args[0], 0, 0) & ~(grub_size_t) 15;
+  if (!size)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid block size"));
+
+  buf = grub_malloc (size);
+  hw_out = grub_malloc (size);
+  sw_out = grub_malloc (size);
+  if (!buf || !hw_out || !sw_out)
+    {
+      err = grub_errno;
+      goto out;
+    }
+
+  for (i = 0; i < sizeof (key); i++)
+    key[i] = i * 7 + 1;
+  for (i = 0; i < size; i++)
+    buf[i] = i ^ (i >> 8);
+
+  err = hwaes_bench_one ("portable", GRUB_CIPHER_AES, key,
+			 buf, sw_out, size);
+  if (err)
+    goto out;
+
+  if (!hwaes_supported ())
+    {
+      grub_printf_ (N_("No hardware AES support.\n"));
+      goto out;
+    }
+
+  err = hwaes_bench_one ("hardware", &hwaes_spec, key,
+			 buf, hw_out, size);
+  if (err)
+    goto out;
+
+  if (grub_memcmp (hw_out, sw_out, size) != 0)
+    err = grub_error (GRUB_ERR_BUG, "hardware and portable AES disagree");
+
+ out:
+  grub_free (buf);
+  grub_free (hw_out);
+  grub_free (sw_out);
+  return err;
+}
+
+static grub_command_t cmd;
+static int registered;
+
+GRUB_MOD_INIT(hwaes)
+{
+  cmd = grub_register_command ("aes_bench", grub_cmd_aes_bench,
+			       N_("[SIZE]"),
+			       N_("Compare hardware and portable AES speed."));
+  if (!hwaes_supported ())
+    return;
+  grub_cipher_register (&hwaes_spec);
+  grub_cipher_register (&hwaes192_spec);
+  grub_cipher_register (&hwaes256_spec);
+  registered = 1;
+}
+
+GRUB_MOD_FINI(hwaes)
+{
+  if (registered)
+    {
+      grub_cipher_unregister (&hwaes_spec);
+      grub_cipher_unregister (&hwaes192_spec);
+      grub_cipher_unregister (&hwaes256_spec);
+    }
+  grub_unregister_command (cmd);
+}
@@ -0,0 +1,678 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* SHA-1 and SHA-256 using the x86_64 SHA extensions.  When the CPU
+   supports them, the digests registered here are preferred by
+   grub_crypto_lookup_md_by_name over the portable ones from gcry_sha1
+   and gcry_sha256.  */
+
+#include <grub/types.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/dl.h>
+#include <grub/crypto.h>
+#include <grub/command.h>
+#include <grub/time.h>
+#include <grub/normal.h>
+#include <grub/i18n.h>
+#if defined (__x86_64__)
+#include <grub/i386/cpuid.h>
+#endif
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define HWSHA_BLOCKSIZE 64
+
+struct hwsha_context
+{
+  /* Chaining state, in CPU byte order.  */
+  grub_uint32_t h[8];
+  grub_uint64_t nblocks;
+  /* Pending partial block, and the digest once finalised.  */
+  grub_uint8_t buf[HWSHA_BLOCKSIZE];
+  unsigned count;
+};
+
+typedef void (*hwsha_blocks_t) (grub_uint32_t *h, const grub_uint8_t *data,
+				grub_size_t nblocks);
+
+static const grub_uint32_t sha256_k[64] =
+  {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+/* The SIMD registers used below are never touched by the rest of GRUB,
+   which is built without floating point and vector support, and can't
+   even be named as clobbers for that reason.  Registers that the
+   firmware calling conventions don't treat as scratch are saved and
+   restored around each call.  */
+
+#if defined (__x86_64__)
+
+static int
+hwsha_supported (void)
+{
+  grub_uint32_t a, b, c, d;
+  grub_uint32_t max;
+
+  if (!grub_cpu_is_cpuid_supported ())
+    return 0;
+  grub_cpuid (0, max, b, c, d);
+  if (max < 7)
+    return 0;
+  grub_cpuid (1, a, b, c, d);
+  /* SSSE3 and SSE4.1 for the byte shuffles and blends.  */
+  if (!(c & (1 << 9)) || !(c & (1 << 19)))
+    return 0;
+  asm volatile ("cpuid"
+		: "=a" (a), "=b" (b), "=c" (c), "=d" (d)
+		: "0" (7), "2" (0));
+  /* SHA extensions.  */
+  return !!(b & (1 << 29));
+}
+
+static const grub_uint8_t hwsha_bswap_mask[16] =
+  { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+
+static const grub_uint8_t hwsha1_bswap_mask[16] =
+  { 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+
+/* SHA-1: ABCD in xmm0, E alternating between xmm1 and xmm2, the message
+   schedule in xmm3-xmm6, the byte swap mask in xmm7 and the state at the
+   start of the block in xmm8 and xmm9.  */
+
+#define SHA1_LOAD(i, m)						\
+  "movdqu " #i "*16(%[data]), %%" m "\n\t"				\
+  "pshufb %%xmm7, %%" m "\n\t"
+
+/* Four rounds with message words M, using E and leaving the next E in
+   ENEXT.  */
+#define SHA1_ROUNDS(f, m, e, enext)					\
+  "sha1nexte %%" m ", %%" e "\n\t"					\
+  "movdqa %%xmm0, %%" enext "\n\t"					\
+  "sha1rnds4 $" #f ", %%" e ", %%xmm0\n\t"
+
+#define SHA1_MSG1(m, mprev) "sha1msg1 %%" m ", %%" mprev "\n\t"
+#define SHA1_MSG2(m, mnext) "sha1msg2 %%" m ", %%" mnext "\n\t"
+#define SHA1_XOR(m, mprev2) "pxor %%" m ", %%" mprev2 "\n\t"
+
+static void
+hwsha1_blocks (grub_uint32_t *h, const grub_uint8_t *data,
+	       grub_size_t nblocks)
+{
+  grub_uint8_t save[4][16];
+
+  if (!nblocks)
+    return;
+
+  asm volatile ("movdqu %%xmm6, 0(%[save])\n\t"
+		"movdqu %%xmm7, 16(%[save])\n\t"
+		"movdqu %%xmm8, 32(%[save])\n\t"
+		"movdqu %%xmm9, 48(%[save])\n\t"
+		"movdqu (%[h]), %%xmm0\n\t"
+		"pshufd $0x1b, %%xmm0, %%xmm0\n\t"
+		"movd 16(%[h]), %%xmm1\n\t"
+		"pslldq $12, %%xmm1\n\t"
+		"movdqu (%[mask]), %%xmm7\n"
+		"1:\n\t"
+		"movdqa %%xmm1, %%xmm8\n\t"
+		"movdqa %%xmm0, %%xmm9\n\t"
+
+		SHA1_LOAD (0, "xmm3")
+		"paddd %%xmm3, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1rnds4 $0, %%xmm1, %%xmm0\n\t"
+
+		SHA1_LOAD (1, "xmm4")
+		SHA1_ROUNDS (0, "xmm4", "xmm2", "xmm1")
+		SHA1_MSG1 ("xmm4", "xmm3")
+
+		SHA1_LOAD (2, "xmm5")
+		SHA1_ROUNDS (0, "xmm5", "xmm1", "xmm2")
+		SHA1_MSG1 ("xmm5", "xmm4")
+		SHA1_XOR ("xmm5", "xmm3")
+
+		SHA1_LOAD (3, "xmm6")
+		SHA1_ROUNDS (0, "xmm6", "xmm2", "xmm1")
+		SHA1_MSG2 ("xmm6", "xmm3")
+		SHA1_MSG1 ("xmm6", "xmm5")
+		SHA1_XOR ("xmm6", "xmm4")
+
+		SHA1_ROUNDS (0, "xmm3", "xmm1", "xmm2")
+		SHA1_MSG2 ("xmm3", "xmm4")
+		SHA1_MSG1 ("xmm3", "xmm6")
+		SHA1_XOR ("xmm3", "xmm5")
+
+		SHA1_ROUNDS (1, "xmm4", "xmm2", "xmm1")
+		SHA1_MSG2 ("xmm4", "xmm5")
+		SHA1_MSG1 ("xmm4", "xmm3")
+		SHA1_XOR ("xmm4", "xmm6")
+
+		SHA1_ROUNDS (1, "xmm5", "xmm1", "xmm2")
+		SHA1_MSG2 ("xmm5", "xmm6")
+		SHA1_MSG1 ("xmm5", "xmm4")
+		SHA1_XOR ("xmm5", "xmm3")
+
+		SHA1_ROUNDS (1, "xmm6", "xmm2", "xmm1")
+		SHA1_MSG2 ("xmm6", "xmm3")
+		SHA1_MSG1 ("xmm6", "xmm5")
+		SHA1_XOR ("xmm6", "xmm4")
+
+		SHA1_ROUNDS (1, "xmm3", "xmm1", "xmm2")
+		SHA1_MSG2 ("xmm3", "xmm4")
+		SHA1_MSG1 ("xmm3", "xmm6")
+		SHA1_XOR ("xmm3", "xmm5")
+
+		SHA1_ROUNDS (1, "xmm4", "xmm2", "xmm1")
+		SHA1_MSG2 ("xmm4", "xmm5")
+		SHA1_MSG1 ("xmm4", "xmm3")
+		SHA1_XOR ("xmm4", "xmm6")
+
+		SHA1_ROUNDS (2, "xmm5", "xmm1", "xmm2")
+		SHA1_MSG2 ("xmm5", "xmm6")
+		SHA1_MSG1 ("xmm5", "xmm4")
+		SHA1_XOR ("xmm5", "xmm3")
+
+		SHA1_ROUNDS (2, "xmm6", "xmm2", "xmm1")
+		SHA1_MSG2 ("xmm6", "xmm3")
+		SHA1_MSG1 ("xmm6", "xmm5")
+		SHA1_XOR ("xmm6", "xmm4")
+
+		SHA1_ROUNDS (2, "xmm3", "xmm1", "xmm2")
+		SHA1_MSG2 ("xmm3", "xmm4")
+		SHA1_MSG1 ("xmm3", "xmm6")
+		SHA1_XOR ("xmm3", "xmm5")
+
+		SHA1_ROUNDS (2, "xmm4", "xmm2", "xmm1")
+		SHA1_MSG2 ("xmm4", "xmm5")
+		SHA1_MSG1 ("xmm4", "xmm3")
+		SHA1_XOR ("xmm4", "xmm6")
+
+		SHA1_ROUNDS (2, "xmm5", "xmm1", "xmm2")
+		SHA1_MSG2 ("xmm5", "xmm6")
+		SHA1_MSG1 ("xmm5", "xmm4")
+		SHA1_XOR ("xmm5", "xmm3")
+
+		SHA1_ROUNDS (3, "xmm6", "xmm2", "xmm1")
+		SHA1_MSG2 ("xmm6", "xmm3")
+		SHA1_MSG1 ("xmm6", "xmm5")
+		SHA1_XOR ("xmm6", "xmm4")
+
+		SHA1_ROUNDS (3, "xmm3", "xmm1", "xmm2")
+		SHA1_MSG2 ("xmm3", "xmm4")
+		SHA1_MSG1 ("xmm3", "xmm6")
+		SHA1_XOR ("xmm3", "xmm5")
+
+		SHA1_ROUNDS (3, "xmm4", "xmm2", "xmm1")
+		SHA1_MSG2 ("xmm4", "xmm5")
+		SHA1_XOR ("xmm4", "xmm6")
+
+		SHA1_ROUNDS (3, "xmm5", "xmm1", "xmm2")
+		SHA1_MSG2 ("xmm5", "xmm6")
+
+		SHA1_ROUNDS (3, "xmm6", "xmm2", "xmm1")
+
+		"sha1nexte %%xmm8, %%xmm1\n\t"
+		"paddd %%xmm9, %%xmm0\n\t"
+		"addq $64, %[data]\n\t"
+		"decq %[n]\n\t"
+		"jnz 1b\n\t"
+
+		"pshufd $0x1b, %%xmm0, %%xmm0\n\t"
+		"movdqu %%xmm0, (%[h])\n\t"
+		"psrldq $12, %%xmm1\n\t"
+		"movd %%xmm1, 16(%[h])\n\t"
+		"movdqu 0(%[save]), %%xmm6\n\t"
+		"movdqu 16(%[save]), %%xmm7\n\t"
+		"movdqu 32(%[save]), %%xmm8\n\t"
+		"movdqu 48(%[save]), %%xmm9"
+		: [data] "+r" (data), [n] "+r" (nblocks)
+		: [h] "r" (h), [mask] "r" (hwsha1_bswap_mask),
+		  [save] "r" (save)
+		: "memory", "cc");
+}
+
+/* SHA-256: the message words plus constants in xmm0 as sha256rnds2
+   requires, ABEF in xmm1, CDGH in xmm2, the message schedule in
+   xmm3-xmm6, a temporary in xmm7, the byte swap mask in xmm8 and the
+   state at the start of the block in xmm9 and xmm10.  */
+
+#define SHA256_LOAD(i, m)						\
+  "movdqu " #i "*16(%[data]), %%" m "\n\t"				\
+  "pshufb %%xmm8, %%" m "\n\t"
+
+#define SHA256_ROUNDS(i, m)						\
+  "movdqa %%" m ", %%xmm0\n\t"					\
+  "movdqu " #i "*16(%[k]), %%xmm7\n\t"				\
+  "paddd %%xmm7, %%xmm0\n\t"						\
+  "sha256rnds2 %%xmm1, %%xmm2\n\t"					\
+  "pshufd $0x0e, %%xmm0, %%xmm0\n\t"					\
+  "sha256rnds2 %%xmm2, %%xmm1\n\t"
+
+#define SHA256_MSG1(m, mprev) "sha256msg1 %%" m ", %%" mprev "\n\t"
+
+#define SHA256_MSG2(m, mprev, mnext)					\
+  "movdqa %%" m ", %%xmm7\n\t"						\
+  "palignr $4, %%" mprev ", %%xmm7\n\t"				\
+  "paddd %%xmm7, %%" mnext "\n\t"					\
+  "sha256msg2 %%" m ", %%" mnext "\n\t"
+
+static void
+hwsha256_blocks (grub_uint32_t *h, const grub_uint8_t *data,
+		 grub_size_t nblocks)
+{
+  grub_uint8_t save[5][16];
+
+  if (!nblocks)
+    return;
+
+  asm volatile ("movdqu %%xmm6, 0(%[save])\n\t"
+		"movdqu %%xmm7, 16(%[save])\n\t"
+		"movdqu %%xmm8, 32(%[save])\n\t"
+		"movdqu %%xmm9, 48(%[save])\n\t"
+		"movdqu %%xmm10, 64(%[save])\n\t"
+		/* DCBA, HGFE -> ABEF, CDGH.  */
+		"movdqu 0(%[h]), %%xmm1\n\t"
+		"movdqu 16(%[h]), %%xmm2\n\t"
+		"pshufd $0xb1, %%xmm1, %%xmm1\n\t"
+		"pshufd $0x1b, %%xmm2, %%xmm2\n\t"
+		"movdqa %%xmm1, %%xmm7\n\t"
+		"palignr $8, %%xmm2, %%xmm1\n\t"
+		"pblendw $0xf0, %%xmm7, %%xmm2\n\t"
+		"movdqu (%[mask]), %%xmm8\n"
+		"1:\n\t"
+		"movdqa %%xmm1, %%xmm9\n\t"
+		"movdqa %%xmm2, %%xmm10\n\t"
+
+		SHA256_LOAD (0, "xmm3")
+		SHA256_ROUNDS (0, "xmm3")
+
+		SHA256_LOAD (1, "xmm4")
+		SHA256_ROUNDS (1, "xmm4")
+		SHA256_MSG1 ("xmm4", "xmm3")
+
+		SHA256_LOAD (2, "xmm5")
+		SHA256_ROUNDS (2, "xmm5")
+		SHA256_MSG1 ("xmm5", "xmm4")
+
+		SHA256_LOAD (3, "xmm6")
+		SHA256_ROUNDS (3, "xmm6")
+		SHA256_MSG2 ("xmm6", "xmm5", "xmm3")
+		SHA256_MSG1 ("xmm6", "xmm5")
+
+		SHA256_ROUNDS (4, "xmm3")
+		SHA256_MSG2 ("xmm3", "xmm6", "xmm4")
+		SHA256_MSG1 ("xmm3", "xmm6")
+
+		SHA256_ROUNDS (5, "xmm4")
+		SHA256_MSG2 ("xmm4", "xmm3", "xmm5")
+		SHA256_MSG1 ("xmm4", "xmm3")
+
+		SHA256_ROUNDS (6, "xmm5")
+		SHA256_MSG2 ("xmm5", "xmm4", "xmm6")
+		SHA256_MSG1 ("xmm5", "xmm4")
+
+		SHA256_ROUNDS (7, "xmm6")
+		SHA256_MSG2 ("xmm6", "xmm5", "xmm3")
+		SHA256_MSG1 ("xmm6", "xmm5")
+
+		SHA256_ROUNDS (8, "xmm3")
+		SHA256_MSG2 ("xmm3", "xmm6", "xmm4")
+		SHA256_MSG1 ("xmm3", "xmm6")
+
+		SHA256_ROUNDS (9, "xmm4")
+		SHA256_MSG2 ("xmm4", "xmm3", "xmm5")
+		SHA256_MSG1 ("xmm4", "xmm3")
+
+		SHA256_ROUNDS (10, "xmm5")
+		SHA256_MSG2 ("xmm5", "xmm4", "xmm6")
+		SHA256_MSG1 ("xmm5", "xmm4")
+
+		SHA256_ROUNDS (11, "xmm6")
+		SHA256_MSG2 ("xmm6", "xmm5", "xmm3")
+		SHA256_MSG1 ("xmm6", "xmm5")
+
+		SHA256_ROUNDS (12, "xmm3")
+		SHA256_MSG2 ("xmm3", "xmm6", "xmm4")
+		SHA256_MSG1 ("xmm3", "xmm6")
+
+		SHA256_ROUNDS (13, "xmm4")
+		SHA256_MSG2 ("xmm4", "xmm3", "xmm5")
+
+		SHA256_ROUNDS (14, "xmm5")
+		SHA256_MSG2 ("xmm5", "xmm4", "xmm6")
+
+		SHA256_ROUNDS (15, "xmm6")
+
+		"paddd %%xmm9, %%xmm1\n\t"
+		"paddd %%xmm10, %%xmm2\n\t"
+		"addq $64, %[data]\n\t"
+		"decq %[n]\n\t"
+		"jnz 1b\n\t"
+
+		/* ABEF, CDGH -> DCBA, HGFE.  */
+		"pshufd $0x1b, %%xmm1, %%xmm1\n\t"
+		"pshufd $0xb1, %%xmm2, %%xmm2\n\t"
+		"movdqa %%xmm1, %%xmm7\n\t"
+		"pblendw $0xf0, %%xmm2, %%xmm1\n\t"
+		"palignr $8, %%xmm7, %%xmm2\n\t"
+		"movdqu %%xmm1, 0(%[h])\n\t"
+		"movdqu %%xmm2, 16(%[h])\n\t"
+		"movdqu 0(%[save]), %%xmm6\n\t"
+		"movdqu 16(%[save]), %%xmm7\n\t"
+		"movdqu 32(%[save]), %%xmm8\n\t"
+		"movdqu 48(%[save]), %%xmm9\n\t"
+		"movdqu 64(%[save]), %%xmm10"
+		: [data] "+r" (data), [n] "+r" (nblocks)
+		: [h] "r" (h), [mask] "r" (hwsha_bswap_mask),
+		  [k] "r" (sha256_k), [save] "r" (save)
+		: "memory", "cc");
+}
+
+#else
+#error "hwsha is only supported on x86_64"
+#endif
+
+static void
+hwsha_write (struct hwsha_context *ctx, hwsha_blocks_t blocks,
+	     const grub_uint8_t *in, grub_size_t len)
+{
+  if (ctx->count)
+    {
+      grub_size_t n = HWSHA_BLOCKSIZE - ctx->count;
+
+      if (n > len)
+	n = len;
+      grub_memcpy (ctx->buf + ctx->count, in, n);
+      ctx->count += n;
+      in += n;
+      len -= n;
+      if (ctx->count < HWSHA_BLOCKSIZE)
+	return;
+      blocks (ctx->h, ctx->buf, 1);
+      ctx->nblocks++;
+      ctx->count = 0;
+    }
+
+  if (len >= HWSHA_BLOCKSIZE)
+    {
+      grub_size_t n = len / HWSHA_BLOCKSIZE;
+
+      blocks (ctx->h, in, n);
+      ctx->nblocks += n;
+      in += n * HWSHA_BLOCKSIZE;
+      len -= n * HWSHA_BLOCKSIZE;
+    }
+
+  grub_memcpy (ctx->buf, in, len);
+  ctx->count = len;
+}
+
+/* Pad the message, process the last block(s) and store the first NWORDS
+   words of the state as the big endian digest in BUF.  */
+static void
+hwsha_final (struct hwsha_context *ctx, hwsha_blocks_t blocks,
+	     unsigned nwords)
+{
+  grub_uint64_t bits = (ctx->nblocks * HWSHA_BLOCKSIZE + ctx->count) << 3;
+  unsigned i;
+
+  ctx->buf[ctx->count++] = 0x80;
+  if (ctx->count > HWSHA_BLOCKSIZE - 8)
+    {
+      grub_memset (ctx->buf + ctx->count, 0, HWSHA_BLOCKSIZE - ctx->count);
+      blocks (ctx->h, ctx->buf, 1);
+      ctx->count = 0;
+    }
+  grub_memset (ctx->buf + ctx->count, 0, HWSHA_BLOCKSIZE - 8 - ctx->count);
+  grub_set_unaligned64 (ctx->buf + HWSHA_BLOCKSIZE - 8,
+			grub_cpu_to_be64 (bits));
+  blocks (ctx->h, ctx->buf, 1);
+
+  for (i = 0; i < nwords; i++)
+    grub_set_unaligned32 (ctx->buf + 4 * i, grub_cpu_to_be32 (ctx->h[i]));
+}
+
+static unsigned char *
+hwsha_read (void *context)
+{
+  struct hwsha_context *ctx = context;
+
+  return ctx->buf;
+}
+
+static void
+hwsha1_init (void *context)
+{
+  struct hwsha_context *ctx = context;
+
+  ctx->h[0] = 0x67452301;
+  ctx->h[1] = 0xefcdab89;
+  ctx->h[2] = 0x98badcfe;
+  ctx->h[3] = 0x10325476;
+  ctx->h[4] = 0xc3d2e1f0;
+  ctx->nblocks = 0;
+  ctx->count = 0;
+}
+
+static void
+hwsha1_write (void *context, const void *in, grub_size_t len)
+{
+  hwsha_write (context, hwsha1_blocks, in, len);
+}
+
+static void
+hwsha1_final (void *context)
+{
+  hwsha_final (context, hwsha1_blocks, 5);
+}
+
+static void
+hwsha256_init (void *context)
+{
+  struct hwsha_context *ctx = context;
+
+  ctx->h[0] = 0x6a09e667;
+  ctx->h[1] = 0xbb67ae85;
+  ctx->h[2] = 0x3c6ef372;
+  ctx->h[3] = 0xa54ff53a;
+  ctx->h[4] = 0x510e527f;
+  ctx->h[5] = 0x9b05688c;
+  ctx->h[6] = 0x1f83d9ab;
+  ctx->h[7] = 0x5be0cd19;
+  ctx->nblocks = 0;
+  ctx->count = 0;
+}
+
+static void
+hwsha256_write (void *context, const void *in, grub_size_t len)
+{
+  hwsha_write (context, hwsha256_blocks, in, len);
+}
+
+static void
+hwsha256_final (void *context)
+{
+  hwsha_final (context, hwsha256_blocks, 8);
+}
+
+/* The ASN.1 prefixes and OIDs are shared with the portable
+   implementations, so that signatures verify the same way with either.  */
+
+static gcry_md_spec_t hwsha1_spec =
+  {
+    .name = "SHA1",
+    .mdlen = 20,
+    .init = hwsha1_init,
+    .write = hwsha1_write,
+    .final = hwsha1_final,
+    .read = hwsha_read,
+    .contextsize = sizeof (struct hwsha_context),
+    .blocksize = HWSHA_BLOCKSIZE,
+    .priority = 1,
+#ifdef GRUB_UTIL
+    .modname = "hwsha",
+#endif
+  };
+
+static gcry_md_spec_t hwsha256_spec =
+  {
+    .name = "SHA256",
+    .mdlen = 32,
+    .init = hwsha256_init,
+    .write = hwsha256_write,
+    .final = hwsha256_final,
+    .read = hwsha_read,
+    .contextsize = sizeof (struct hwsha_context),
+    .blocksize = HWSHA_BLOCKSIZE,
+    .priority = 1,
+#ifdef GRUB_UTIL
+    .modname = "hwsha",
+#endif
+  };
+
+#define BENCH_DEFAULT_SIZE (1024 * 1024)
+
+/* Hash BUF with MD and report the speed.  Leave the digest in OUT.  */
+static grub_err_t
+hwsha_bench_one (const char *label, const gcry_md_spec_t *md,
+		 const grub_uint8_t *buf, grub_size_t size, grub_uint8_t *out)
+{
+  grub_uint64_t start, elapsed;
+  void *ctx;
+
+  ctx = grub_malloc (md->contextsize);
+  if (!ctx)
+    return grub_errno;
+
+  start = grub_get_time_ms ();
+  md->init (ctx);
+  md->write (ctx, buf, size);
+  md->final (ctx);
+  elapsed = grub_get_time_ms () - start;
+  grub_memcpy (out, md->read (ctx), md->mdlen);
+  grub_free (ctx);
+
+  grub_printf ("%s %s: ", label, md->name);
+  if (elapsed)
+    grub_printf ("%s\n",
+		 grub_get_human_size (grub_divmod64 (size * 100ULL * 1000ULL,
+						     elapsed, 0),
+				      GRUB_HUMAN_SIZE_SPEED));
+  else
+    grub_printf_ (N_("too fast to measure\n"));
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_cmd_sha_bench (grub_command_t cmd __attribute__ ((unused)),
+		    int argc, char **args)
+{
+  const gcry_md_spec_t *portable[] = { GRUB_MD_SHA1, GRUB_MD_SHA256 };
+  const gcry_md_spec_t *hardware[] = { &hwsha1_spec, &hwsha256_spec };
+  grub_uint8_t hw_out[GRUB_CRYPTO_MAX_MDLEN], sw_out[GRUB_CRYPTO_MAX_MDLEN];
+  grub_size_t size = BENCH_DEFAULT_SIZE, i;
+  grub_uint8_t *buf;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  if (argc > 0)
+    size = grub_strtoul (args[0], 0, 0);
+  if (!size)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid block size"));
+
+  buf = grub_malloc (size);
+  if (!buf)
+    return grub_errno;
+  for (i = 0; i < size; i++)
+    buf[i] = i ^ (i >> 8);
+
+  for (i = 0; i < ARRAY_SIZE (portable); i++)
+    {
+      err = hwsha_bench_one ("portable", portable[i], buf, size, sw_out);
+      if (err)
+	break;
+
+      if (!hwsha_supported ())
+	{
+	  grub_printf_ (N_("No hardware SHA support.\n"));
+	  continue;
+	}
+
+      err = hwsha_bench_one ("hardware", hardware[i], buf, size, hw_out);
+      if (err)
+	break;
+
+      if (grub_memcmp (hw_out, sw_out, portable[i]->mdlen) != 0)
+	{
+	  err = grub_error (GRUB_ERR_BUG,
+			    "hardware and portable %s disagree",
+			    portable[i]->name);
+	  break;
+	}
+    }
+
+  grub_free (buf);
+  return err;
+}
+
+static grub_command_t cmd;
+static int registered;
+
+GRUB_MOD_INIT(hwsha)
+{
+  cmd = grub_register_command ("sha_bench", grub_cmd_sha_bench,
+			       N_("[SIZE]"),
+			       N_("Compare hardware and portable SHA speed."));
+  if (!hwsha_supported ())
+    return;
+  hwsha1_spec.asnoid = GRUB_MD_SHA1->asnoid;
+  hwsha1_spec.asnlen = GRUB_MD_SHA1->asnlen;
+  hwsha1_spec.oids = GRUB_MD_SHA1->oids;
+  hwsha256_spec.asnoid = GRUB_MD_SHA256->asnoid;
+  hwsha256_spec.asnlen = GRUB_MD_SHA256->asnlen;
+  hwsha256_spec.oids = GRUB_MD_SHA256->oids;
+  grub_md_register (&hwsha1_spec);
+  grub_md_register (&hwsha256_spec);
+  registered = 1;
+}
+
+GRUB_MOD_FINI(hwsha)
+{
+  if (registered)
+    {
+      grub_md_unregister (&hwsha1_spec);
+      grub_md_unregister (&hwsha256_spec);
+    }
+  grub_unregister_command (cmd);
+}
@@ -0,0 +1,496 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/json.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/dl.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Nesting limit, to keep the recursive parser off the end of the stack.  */
+#define JSON_MAX_DEPTH 64
+
+/* The document is parsed once into a flat array of tokens in document
+   order.  Each token records where its subtree ends, so walking the
+   children of a value skips over nested values without looking at the
+   text again.  */
+struct grub_json_token
+{
+  grub_json_type_t type;
+  /* Offsets of the value in the text.  For strings START is just after
+     the opening quote and END at the closing quote.  */
+  grub_size_t start;
+  grub_size_t end;
+  grub_size_t size;
+  /* Index of the first token after this subtree.  */
+  grub_size_t next;
+};
+
+struct json_parser
+{
+  const char *s;
+  grub_size_t len;
+  grub_size_t pos;
+  struct grub_json_token *tokens;
+  grub_size_t ntokens;
+  grub_size_t alloced;
+};
+
+static grub_err_t
+json_new_token (struct json_parser *p, grub_json_type_t type,
+		grub_size_t *idx)
+{
+  struct grub_json_token *tok;
+
+  if (p->ntokens == p->alloced)
+    {
+      grub_size_t n = p->alloced ? 2 * p->alloced : 64;
+      struct grub_json_token *t;
+
+      t = grub_realloc (p->tokens, n * sizeof (*t));
+      if (!t)
+	return grub_errno;
+      p->tokens = t;
+      p->alloced = n;
+    }
+
+  *idx = p->ntokens++;
+  tok = &p->tokens[*idx];
+  tok->type = type;
+  tok->start = p->pos;
+  tok->end = p->pos;
+  tok->size = 0;
+  tok->next = p->ntokens;
+  return GRUB_ERR_NONE;
+}
+
+static void
+json_skip_space (struct json_parser *p)
+{
+  while (p->pos < p->len
+	 && (p->s[p->pos] == ' ' || p->s[p->pos] == '\t'
+	     || p->s[p->pos] == '\n' || p->s[p->pos] == '\r'))
+    p->pos++;
+}
+
+static grub_err_t
+json_syntax_error (struct json_parser *p)
+{
+  return grub_error (GRUB_ERR_BAD_ARGUMENT,
+		     "invalid JSON at offset %" PRIuGRUB_SIZE, p->pos);
+}
+
+static grub_err_t
+json_parse_string (struct json_parser *p, grub_size_t *idx)
+{
+  grub_err_t err;
+
+  if (p->pos >= p->len || p->s[p->pos] != '"')
+    return json_syntax_error (p);
+  p->pos++;
+
+  err = json_new_token (p, GRUB_JSON_STRING, idx);
+  if (err)
+    return err;
+
+  for (; p->pos < p->len; p->pos++)
+    {
+      char c = p->s[p->pos];
+
+      if (c == '"')
+	{
+	  p->tokens[*idx].end = p->pos++;
+	  return GRUB_ERR_NONE;
+	}
+      if ((grub_uint8_t) c < 0x20)
+	return json_syntax_error (p);
+      if (c != '\\')
+	continue;
+
+      /* Escapes are validated but left as they are.  */
+      if (++p->pos >= p->len)
+	break;
+      switch (p->s[p->pos])
+	{
+	case '"': case '\\': case '/': case 'b':
+	case 'f': case 'n': case 'r': case 't':
+	  break;
+	case 'u':
+	  {
+	    int i;
+
+	    for (i = 0; i < 4; i++)
+	      if (++p->pos >= p->len || !grub_isxdigit (p->s[p->pos]))
+		return json_syntax_error (p);
+	  }
+	  break;
+	default:
+	  return json_syntax_error (p);
+	}
+    }
+
+  return json_syntax_error (p);
+}
+
+static grub_err_t
+json_parse_primitive (struct json_parser *p, grub_size_t *idx)
+{
+  static const char *const keywords[] = { "true", "false", "null" };
+  const char *start = p->s + p->pos;
+  grub_size_t len, i;
+  grub_err_t err;
+
+  err = json_new_token (p, GRUB_JSON_PRIMITIVE, idx);
+  if (err)
+    return err;
+
+  while (p->pos < p->len
+	 && (grub_isalnum (p->s[p->pos]) || p->s[p->pos] == '-'
+	     || p->s[p->pos] == '+' || p->s[p->pos] == '.'))
+    p->pos++;
+  len = p->pos - p->tokens[*idx].start;
+  p->tokens[*idx].end = p->pos;
+
+  if (len == 0)
+    return json_syntax_error (p);
+  for (i = 0; i < ARRAY_SIZE (keywords); i++)
+    if (grub_strlen (keywords[i]) == len
+	&& grub_memcmp (start, keywords[i], len) == 0)
+      return GRUB_ERR_NONE;
+  if (*start == '-')
+    start++;
+  if (!grub_isdigit (*start))
+    return json_syntax_error (p);
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+json_parse_value (struct json_parser *p, unsigned depth, grub_size_t *idx)
+{
+  grub_err_t err;
+  char close;
+  int is_object;
+
+  json_skip_space (p);
+  if (p->pos >= p->len)
+    return json_syntax_error (p);
+
+  if (p->s[p->pos] == '"')
+    return json_parse_string (p, idx);
+  if (p->s[p->pos] != '{' && p->s[p->pos] != '[')
+    return json_parse_primitive (p, idx);
+
+  if (depth >= JSON_MAX_DEPTH)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "JSON nested too deeply");
+
+  is_object = (p->s[p->pos] == '{');
+  close = is_object ? '}' : ']';
+  err = json_new_token (p, is_object ? GRUB_JSON_OBJECT : GRUB_JSON_ARRAY,
+			idx);
+  if (err)
+    return err;
+  p->pos++;
+
+  json_skip_space (p);
+  if (p->pos < p->len && p->s[p->pos] == close)
+    goto done;
+
+  while (1)
+    {
+      grub_size_t key, child;
+
+      if (is_object)
+	{
+	  json_skip_space (p);
+	  err = json_parse_string (p, &key);
+	  if (err)
+	    return err;
+	  json_skip_space (p);
+	  if (p->pos >= p->len || p->s[p->pos] != ':')
+	    return json_syntax_error (p);
+	  p->pos++;
+	  err = json_parse_value (p, depth + 1, &child);
+	  if (err)
+	    return err;
+	  /* The key's subtree is its value.  */
+	  p->tokens[key].size = 1;
+	  p->tokens[key].next = p->ntokens;
+	}
+      else
+	{
+	  err = json_parse_value (p, depth + 1, &child);
+	  if (err)
+	    return err;
+	}
+      p->tokens[*idx].size++;
+
+      json_skip_space (p);
+      if (p->pos >= p->len)
+	return json_syntax_error (p);
+      if (p->s[p->pos] == close)
+	break;
+      if (p->s[p->pos] != ',')
+	return json_syntax_error (p);
+      p->pos++;
+    }
+
+ done:
+  p->pos++;
+  p->tokens[*idx].end = p->pos;
+  p->tokens[*idx].next = p->ntokens;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_json_parse (grub_json_t **out, const char *string,
+		 grub_size_t string_len)
+{
+  struct json_parser p;
+  grub_json_t *json;
+  grub_size_t root;
+  grub_err_t err;
+
+  /* Fixed-size metadata areas are padded with NULs after the text.  */
+  for (p.len = 0; p.len < string_len && string[p.len]; p.len++);
+
+  json = grub_zalloc (sizeof (*json));
+  if (!json)
+    return grub_errno;
+  json->string = grub_malloc (p.len + 1);
+  if (!json->string)
+    {
+      grub_free (json);
+      return grub_errno;
+    }
+  grub_memcpy (json->string, string, p.len);
+  json->string[p.len] = '\0';
+
+  p.s = json->string;
+  p.pos = 0;
+  p.tokens = NULL;
+  p.ntokens = 0;
+  p.alloced = 0;
+
+  err = json_parse_value (&p, 0, &root);
+  if (!err)
+    {
+      json_skip_space (&p);
+      if (p.pos != p.len)
+	err = json_syntax_error (&p);
+    }
+  if (err)
+    {
+      grub_free (p.tokens);
+      grub_json_free (json);
+      return err;
+    }
+
+  json->tokens = p.tokens;
+  json->idx = root;
+  *out = json;
+  return GRUB_ERR_NONE;
+}
+
+void
+grub_json_free (grub_json_t *json)
+{
+  if (!json)
+    return;
+  grub_free (json->tokens);
+  grub_free (json->string);
+  grub_free (json);
+}
+
+grub_err_t
+grub_json_getsize (grub_size_t *out, const grub_json_t *json)
+{
+  *out = json->tokens[json->idx].size;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_json_gettype (grub_json_type_t *out, const grub_json_t *json)
+{
+  *out = json->tokens[json->idx].type;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_json_getchild (grub_json_t *out, const grub_json_t *parent,
+		    grub_size_t n)
+{
+  grub_size_t idx;
+
+  if (n >= parent->tokens[parent->idx].size)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "JSON child %" PRIuGRUB_SIZE
+		       " out of range", n);
+
+  for (idx = parent->idx + 1; n; n--)
+    idx = parent->tokens[idx].next;
+
+  out->tokens = parent->tokens;
+  out->string = parent->string;
+  out->idx = idx;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_json_getvalue (grub_json_t *out, const grub_json_t *parent,
+		    const char *key)
+{
+  const struct grub_json_token *tokens = parent->tokens;
+  grub_size_t keylen = grub_strlen (key);
+  grub_size_t idx, n;
+
+  if (tokens[parent->idx].type != GRUB_JSON_OBJECT)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "JSON value is not an object");
+
+  for (idx = parent->idx + 1, n = 0; n < tokens[parent->idx].size;
+       idx = tokens[idx].next, n++)
+    if (tokens[idx].end - tokens[idx].start == keylen
+	&& grub_memcmp (parent->string + tokens[idx].start, key, keylen) == 0)
+      {
+	out->tokens = parent->tokens;
+	out->string = parent->string;
+	out->idx = idx + 1;
+	return GRUB_ERR_NONE;
+      }
+
+  return grub_error (GRUB_ERR_FILE_NOT_FOUND, "JSON key `%s' not found", key);
+}
+
+static grub_err_t
+json_get (grub_json_t *out, const grub_json_t *parent, const char *key)
+{
+  if (key)
+    return grub_json_getvalue (out, parent, key);
+  *out = *parent;
+  return GRUB_ERR_NONE;
+}
+
+/* Terminate the text of VALUE in place and return it.  Parsing is done
+   by now, so overwriting the closing quote or delimiter is harmless.  */
+static const char *
+json_terminate (const grub_json_t *value)
+{
+  const struct grub_json_token *tok = &value->tokens[value->idx];
+
+  value->string[tok->end] = '\0';
+  return value->string + tok->start;
+}
+
+grub_err_t
+grub_json_getstring (const char **out, const grub_json_t *parent,
+		     const char *key)
+{
+  grub_json_t value;
+  grub_err_t err;
+
+  err = json_get (&value, parent, key);
+  if (err)
+    return err;
+  if (value.tokens[value.idx].type != GRUB_JSON_STRING)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "JSON value is not a string");
+
+  *out = json_terminate (&value);
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+json_getdigits (const char **out, int *negative, const grub_json_t *parent,
+		const char *key)
+{
+  grub_json_t value;
+  grub_json_type_t type;
+  const char *s;
+  grub_err_t err;
+
+  err = json_get (&value, parent, key);
+  if (err)
+    return err;
+  type = value.tokens[value.idx].type;
+  if (type != GRUB_JSON_STRING && type != GRUB_JSON_PRIMITIVE)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "JSON value is not a number");
+
+  s = json_terminate (&value);
+  *negative = (*s == '-');
+  if (*negative)
+    s++;
+  if (!grub_isdigit (*s))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "JSON value is not an integer");
+  *out = s;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+json_parse_uint64 (grub_uint64_t *out, const char *s)
+{
+  grub_uint64_t v = 0;
+
+  for (; *s; s++)
+    {
+      if (!grub_isdigit (*s))
+	return grub_error (GRUB_ERR_BAD_ARGUMENT,
+			   "JSON value is not an integer");
+      if (v > (~(grub_uint64_t) 0 - (*s - '0')) / 10)
+	return grub_error (GRUB_ERR_OUT_OF_RANGE, N_("overflow is detected"));
+      v = v * 10 + (*s - '0');
+    }
+  *out = v;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_json_getuint64 (grub_uint64_t *out, const grub_json_t *parent,
+		     const char *key)
+{
+  const char *s;
+  int negative;
+  grub_err_t err;
+
+  err = json_getdigits (&s, &negative, parent, key);
+  if (err)
+    return err;
+  if (negative)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "JSON value is negative");
+  return json_parse_uint64 (out, s);
+}
+
+grub_err_t
+grub_json_getint64 (grub_int64_t *out, const grub_json_t *parent,
+		    const char *key)
+{
+  const char *s;
+  grub_uint64_t v;
+  int negative;
+  grub_err_t err;
+
+  err = json_getdigits (&s, &negative, parent, key);
+  if (err)
+    return err;
+  err = json_parse_uint64 (&v, s);
+  if (err)
+    return err;
+
+  if (v > (grub_uint64_t) GRUB_INT64_MAX + negative)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, N_("overflow is detected"));
+  *out = negative ? -(grub_int64_t) (v - 1) - 1 : (grub_int64_t) v;
+  return GRUB_ERR_NONE;
+}
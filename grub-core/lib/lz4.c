@@ -1,6 +1,5 @@
 /*
  * LZ4 - Fast LZ compression algorithm
- * Header File
  * Copyright (C) 2011-2013, Yann Collet.
  * BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
  *
@@ -36,9 +35,14 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/types.h>
+#include <grub/dl.h>
+#include <grub/lib/lz4.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
 
 static int LZ4_uncompress_unknownOutputSize(const char *source, char *dest,
-					    int isize, int maxOutputSize);
+					    int isize, int maxOutputSize,
+					    const char *lowest);
 
 /*
  * CPU Feature Detection
@@ -132,9 +136,6 @@ typedef struct _U64_S {
 #define	LZ4_WILDCOPY(s, d, e) do { LZ4_COPYPACKET(s, d) } while (d < e);
 
 /* Decompression functions */
-grub_err_t
-lz4_decompress(void *s_start, void *d_start, size_t s_len, size_t d_len);
-
 grub_err_t
 lz4_decompress(void *s_start, void *d_start, size_t s_len, size_t d_len)
 {
@@ -151,12 +152,30 @@ lz4_decompress(void *s_start, void *d_start, size_t s_len, size_t d_len)
 	 * and appropriate error on failure (decompression function returned negative).
 	 */
 	return (LZ4_uncompress_unknownOutputSize((char*)s_start + 4, d_start, bufsiz,
-	    d_len) < 0)?grub_error(GRUB_ERR_BAD_FS,"lz4 decompression failed."):0;
+	    d_len, d_start) < 0)?grub_error(GRUB_ERR_BAD_FS,"lz4 decompression failed."):0;
 }
 
+grub_ssize_t
+lz4_decompress_block(const void *src, grub_size_t src_size, void *dest,
+    grub_size_t dest_size, grub_size_t hist)
+{
+	int ret;
+
+	if (src_size > GRUB_INT_MAX || dest_size > GRUB_INT_MAX)
+		return -1;
+
+	ret = LZ4_uncompress_unknownOutputSize(src, dest, src_size, dest_size,
+	    (const char *) dest - hist);
+	return ret < 0 ? -1 : ret;
+}
+
+/*
+ * Matches may refer back as far as LOWEST, which is DEST unless the block
+ * depends on the output of the previous ones.
+ */
 static int
 LZ4_uncompress_unknownOutputSize(const char *source,
-    char *dest, int isize, int maxOutputSize)
+    char *dest, int isize, int maxOutputSize, const char *lowest)
 {
 	/* Local Variables */
 	const BYTE * ip = (const BYTE *) source;
@@ -172,7 +191,7 @@ LZ4_uncompress_unknownOutputSize(const char *source,
 	/* Main Loop */
 	while (ip < iend) {
 		BYTE token;
-		int length;
+		size_t length;
 
 		/* get runlength */
 		token = *ip++;
@@ -217,7 +236,7 @@ LZ4_uncompress_unknownOutputSize(const char *source,
 		/* get offset */
 		LZ4_READ_LITTLEENDIAN_16(ref, cpy, ip);
 		ip += 2;
-		if (ref < (BYTE * const) dest)
+		if (ref < (const BYTE *) lowest)
 			/*
 			 * Error: offset creates reference outside of
 			 * destination buffer.
@@ -234,6 +253,9 @@ LZ4_uncompress_unknownOutputSize(const char *source,
 				break;
 			}
 		}
+		if (length > (size_t) (oend - op))
+			/* Error: match longer than the space left. */
+			goto _output_error;
 		/* copy repeated sequence */
 		if unlikely(op - ref < STEPSIZE) {
 #if LZ4_ARCH64
@@ -25,12 +25,31 @@
 
 GRUB_MOD_LICENSE ("GPLv2+");
 
+/* Finish the HMAC whose inner hash has been fed into WORK and store the
+   result in OUT.  OUTER is the hash state after absorbing the outer pad.  */
+static void
+pbkdf2_hmac_finish (const struct gcry_md_spec *md, const void *outer,
+		    void *work, grub_uint8_t *out)
+{
+  md->final (work);
+  grub_memcpy (out, md->read (work), md->mdlen);
+
+  grub_memcpy (work, outer, md->contextsize);
+  md->write (work, out, md->mdlen);
+  md->final (work);
+  grub_memcpy (out, md->read (work), md->mdlen);
+}
+
 /* Implement PKCS#5 PBKDF2 as per RFC 2898.  The PRF to use is HMAC variant
    of digest supplied by MD.  Inputs are the password P of length PLEN,
    the salt S of length SLEN, the iteration counter C (> 0), and the
    desired derived output length DKLEN.  Output buffer is DK which
    must have room for at least DKLEN octets.  The output buffer will
-   be filled with the derived data.  */
+   be filled with the derived data.
+
+   The hash states after absorbing the inner and outer HMAC pads depend
+   only on P, so they are computed once and copied for every iteration
+   instead of redoing the key setup each time.  */
 
 gcry_err_code_t
 grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
@@ -42,18 +61,22 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   unsigned int hLen = md->mdlen;
   grub_uint8_t U[GRUB_CRYPTO_MAX_MDLEN];
   grub_uint8_t T[GRUB_CRYPTO_MAX_MDLEN];
+  grub_uint8_t counter[4];
   unsigned int u;
   unsigned int l;
   unsigned int r;
   unsigned int i;
   unsigned int k;
-  gcry_err_code_t rc;
-  grub_uint8_t *tmp;
-  grub_size_t tmplen = Slen + 4;
+  grub_uint8_t *state, *pad;
+  void *inner, *outer, *work;
+  grub_size_t statelen;
 
   if (md->mdlen > GRUB_CRYPTO_MAX_MDLEN || md->mdlen == 0)
     return GPG_ERR_INV_ARG;
 
+  if (md->mdlen > md->blocksize)
+    return GPG_ERR_INV_ARG;
+
   if (c == 0)
     return GPG_ERR_INV_ARG;
 
@@ -66,35 +89,51 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   l = ((dkLen - 1) / hLen) + 1;
   r = dkLen - (l - 1) * hLen;
 
-  tmp = grub_malloc (tmplen);
-  if (tmp == NULL)
+  statelen = 3 * md->contextsize + md->blocksize;
+  state = grub_malloc (statelen);
+  if (state == NULL)
     return GPG_ERR_OUT_OF_MEMORY;
 
-  grub_memcpy (tmp, S, Slen);
+  inner = state;
+  outer = state + md->contextsize;
+  work = state + 2 * md->contextsize;
+  pad = state + 3 * md->contextsize;
+
+  /* Keys longer than a block are replaced by their digest.  */
+  grub_memset (pad, 0, md->blocksize);
+  if (Plen > md->blocksize)
+    grub_crypto_hash (md, pad, P, Plen);
+  else
+    grub_memcpy (pad, P, Plen);
+
+  for (k = 0; k < md->blocksize; k++)
+    pad[k] ^= 0x36;
+  md->init (inner);
+  md->write (inner, pad, md->blocksize);
+
+  for (k = 0; k < md->blocksize; k++)
+    pad[k] ^= 0x36 ^ 0x5c;
+  md->init (outer);
+  md->write (outer, pad, md->blocksize);
 
   for (i = 1; i - 1 < l; i++)
     {
-      grub_memset (T, 0, hLen);
-
-      for (u = 0; u < c; u++)
+      counter[0] = (i & 0xff000000) >> 24;
+      counter[1] = (i & 0x00ff0000) >> 16;
+      counter[2] = (i & 0x0000ff00) >> 8;
+      counter[3] = (i & 0x000000ff) >> 0;
+
+      grub_memcpy (work, inner, md->contextsize);
+      md->write (work, S, Slen);
+      md->write (work, counter, sizeof (counter));
+      pbkdf2_hmac_finish (md, outer, work, U);
+      grub_memcpy (T, U, hLen);
+
+      for (u = 1; u < c; u++)
 	{
-	  if (u == 0)
-	    {
-	      tmp[Slen + 0] = (i & 0xff000000) >> 24;
-	      tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
-	      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
-	      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
-
-	      rc = grub_crypto_hmac_buffer (md, P, Plen, tmp, tmplen, U);
-	    }
-	  else
-	    rc = grub_crypto_hmac_buffer (md, P, Plen, U, hLen, U);
-
-	  if (rc != GPG_ERR_NO_ERROR)
-	    {
-	      grub_free (tmp);
-	      return rc;
-	    }
+	  grub_memcpy (work, inner, md->contextsize);
+	  md->write (work, U, hLen);
+	  pbkdf2_hmac_finish (md, outer, work, U);
 
 	  for (k = 0; k < hLen; k++)
 	    T[k] ^= U[k];
@@ -103,7 +142,10 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
       grub_memcpy (DK + (i - 1) * hLen, T, i == l ? r : hLen);
     }
 
-  grub_free (tmp);
+  grub_memset (U, 0, sizeof (U));
+  grub_memset (T, 0, sizeof (T));
+  grub_memset (state, 0, statelen);
+  grub_free (state);
 
   return GPG_ERR_NO_ERROR;
 }
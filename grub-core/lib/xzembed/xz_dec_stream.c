@@ -452,6 +452,16 @@ static enum xz_ret dec_stream_header(struct xz_dec *s)
 		return XZ_FORMAT_ERROR;
 
 #ifndef GRUB_EMBED_DECOMPRESSOR
+	/* Contexts left from the previous stream after xz_dec_reset().  */
+	kfree(s->crc32_context);
+	kfree(s->hash_context);
+	kfree(s->index.hash.hash_context);
+	kfree(s->block.hash.hash_context);
+	s->crc32_context = NULL;
+	s->hash_context = NULL;
+	s->index.hash.hash_context = NULL;
+	s->block.hash.hash_context = NULL;
+
 	s->crc32 = grub_crypto_lookup_md_by_name ("CRC32");
 
 	if (s->crc32)
@@ -506,30 +516,19 @@ static enum xz_ret dec_stream_header(struct xz_dec *s)
 		{
 			if (s->hash->mdlen != s->hash_size)
 				return XZ_OPTIONS_ERROR;
+			/* On failure the contexts are freed by xz_dec_end().  */
 			s->hash_context = kmalloc(s->hash->contextsize, GFP_KERNEL);
 			if (s->hash_context == NULL)
-			{
-				kfree(s->crc32_context);
 				return XZ_MEMLIMIT_ERROR;
-			}
 			
 			s->index.hash.hash_context = kmalloc(s->hash->contextsize,
 							     GFP_KERNEL);
 			if (s->index.hash.hash_context == NULL)
-			{
-				kfree(s->hash_context);
-				kfree(s->crc32_context);
 				return XZ_MEMLIMIT_ERROR;
-			}
 			
 			s->block.hash.hash_context = kmalloc(s->hash->contextsize, GFP_KERNEL);
 			if (s->block.hash.hash_context == NULL)
-			{
-				kfree(s->index.hash.hash_context);
-				kfree(s->hash_context);
-				kfree(s->crc32_context);
 				return XZ_MEMLIMIT_ERROR;
-			}
 
 			s->hash->init(s->hash_context);
 			s->hash->init(s->index.hash.hash_context);
@@ -1012,7 +1011,8 @@ void xz_dec_reset(struct xz_dec *s)
 	s->temp.size = STREAM_HEADER_SIZE;
 
 #ifndef GRUB_EMBED_DECOMPRESSOR
-	if (s->hash)
+	/* The block context is allocated last.  */
+	if (s->hash && s->block.hash.hash_context)
 	{
 		s->hash->init(s->hash_context);
 		s->hash->init(s->index.hash.hash_context);
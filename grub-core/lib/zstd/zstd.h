@@ -0,0 +1,86 @@
+/* zstd.h - Zstandard (RFC 8878) block decoder */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_ZSTD_HEADER
+#define GRUB_ZSTD_HEADER	1
+
+#include <grub/types.h>
+#include <grub/err.h>
+
+#define ZSTD_MAGIC		0xFD2FB528
+#define ZSTD_SKIPPABLE_MAGIC	0x184D2A50
+#define ZSTD_SKIPPABLE_MASK	0xFFFFFFF0
+#define ZSTD_SKIPPABLE_HEADER_SIZE	8
+
+/* Magic number, descriptor, window descriptor, dictionary ID and frame
+   content size.  */
+#define ZSTD_FRAME_HEADER_MAX	18
+#define ZSTD_BLOCK_HEADER_SIZE	3
+#define ZSTD_CHECKSUM_SIZE	4
+#define ZSTD_BLOCK_MAX		(1 << 17)
+
+#define ZSTD_CONTENT_SIZE_UNKNOWN	((grub_uint64_t) -1)
+
+enum zstd_block_type
+  {
+    ZSTD_BLOCK_RAW,
+    ZSTD_BLOCK_RLE,
+    ZSTD_BLOCK_COMPRESSED,
+    ZSTD_BLOCK_RESERVED
+  };
+
+struct zstd_frame_header
+{
+  /* ZSTD_CONTENT_SIZE_UNKNOWN if the frame does not say.  */
+  grub_uint64_t content_size;
+  /* How far back matches may reach.  */
+  grub_uint64_t window_size;
+  grub_size_t header_size;
+  /* Whether the last block is followed by a checksum.  */
+  int checksum;
+};
+
+struct zstd_dec;
+
+/* Parse the frame header at the start of BUF, which holds LEN bytes of
+   the frame or ZSTD_FRAME_HEADER_MAX, whichever is less.  */
+grub_err_t zstd_frame_header (const grub_uint8_t *buf, grub_size_t len,
+			      struct zstd_frame_header *hdr);
+
+struct zstd_dec *zstd_dec_init (void);
+
+/* Forget the tables and offsets carried over between blocks, before the
+   first block of a frame.  */
+void zstd_dec_reset (struct zstd_dec *dec);
+
+void zstd_dec_end (struct zstd_dec *dec);
+
+/* Decompress the compressed block SRC, of SRC_SIZE bytes, to OUT, which
+   has room for OUT_SIZE bytes and is preceded by HIST bytes of the frame
+   decompressed so far.  The EXT_SIZE bytes ending at EXT_END, which must
+   not overlap OUT, come before those in the frame, for a window kept in a
+   circular buffer.  Return the size of the decompressed block, or -1
+   with grub_errno set if it is corrupted.  */
+grub_ssize_t zstd_dec_block (struct zstd_dec *dec, const grub_uint8_t *src,
+			     grub_size_t src_size, grub_uint8_t *out,
+			     grub_size_t out_size, grub_size_t hist,
+			     const grub_uint8_t *ext_end,
+			     grub_size_t ext_size);
+
+#endif
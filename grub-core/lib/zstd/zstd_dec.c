@@ -0,0 +1,968 @@
+/* zstd_dec.c - Zstandard (RFC 8878) block decoder */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Only what a frame needs from one block to the next is kept here: the
+   caller reads the frame and block headers, handles raw and RLE blocks
+   itself and keeps the decompressed data that matches refer back to.
+   Dictionaries are not supported.  */
+
+#include <grub/err.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+
+#include "zstd.h"
+
+#define LL_MAX_SYMBOL		35
+#define ML_MAX_SYMBOL		52
+#define OF_MAX_SYMBOL		31
+#define LL_MAX_LOG		9
+#define ML_MAX_LOG		9
+#define OF_MAX_LOG		8
+#define FSE_MAX_LOG		9
+#define FSE_MAX_SYMBOLS		(ML_MAX_SYMBOL + 1)
+
+#define HUF_MAX_LOG		11
+#define HUF_MAX_SYMBOLS		256
+#define HUF_WEIGHT_MAX_LOG	6
+
+enum literals_type
+  {
+    LITERALS_RAW,
+    LITERALS_RLE,
+    LITERALS_COMPRESSED,
+    LITERALS_TREELESS
+  };
+
+enum table_mode
+  {
+    MODE_PREDEFINED,
+    MODE_RLE,
+    MODE_FSE,
+    MODE_REPEAT
+  };
+
+struct fse_entry
+{
+  grub_uint8_t symbol;
+  grub_uint8_t bits;
+  grub_uint16_t base;
+};
+
+struct fse_table
+{
+  /* Zero for RLE mode, where the only state decodes to the symbol.  */
+  unsigned log;
+  int valid;
+  struct fse_entry entries[1 << FSE_MAX_LOG];
+};
+
+struct huf_entry
+{
+  grub_uint8_t symbol;
+  grub_uint8_t bits;
+};
+
+struct zstd_dec
+{
+  /* Kept for blocks which repeat the tables of the previous one.  */
+  struct fse_table ll, of, ml;
+  struct huf_entry huf[1 << HUF_MAX_LOG];
+  /* Zero if there is no Huffman table yet.  */
+  unsigned huf_log;
+
+  grub_uint32_t rep[3];
+
+  /* The literals of the current block, either in LITBUF or straight in
+     the block if they are stored raw.  */
+  const grub_uint8_t *lit;
+  grub_size_t lit_size;
+  grub_uint8_t litbuf[ZSTD_BLOCK_MAX];
+};
+
+/* Default distributions for the sequence codes.  */
+static const grub_int16_t ll_default[LL_MAX_SYMBOL + 1] =
+  {
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1
+  };
+#define LL_DEFAULT_LOG		6
+
+static const grub_int16_t ml_default[ML_MAX_SYMBOL + 1] =
+  {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+    -1, -1, -1, -1, -1
+  };
+#define ML_DEFAULT_LOG		6
+
+static const grub_int16_t of_default[28 + 1] =
+  {
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+  };
+#define OF_DEFAULT_LOG		5
+
+/* Literal and match lengths for each code, and how many extra bits
+   follow it.  */
+static const grub_uint32_t ll_base[LL_MAX_SYMBOL + 1] =
+  {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+    8192, 16384, 32768, 65536
+  };
+
+static const grub_uint8_t ll_bits[LL_MAX_SYMBOL + 1] =
+  {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+    13, 14, 15, 16
+  };
+
+static const grub_uint32_t ml_base[ML_MAX_SYMBOL + 1] =
+  {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+    4099, 8195, 16387, 32771, 65539
+  };
+
+static const grub_uint8_t ml_bits[ML_MAX_SYMBOL + 1] =
+  {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16
+  };
+
+static grub_ssize_t
+corrupted (void)
+{
+  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "zstd data corrupted");
+  return -1;
+}
+
+static unsigned
+highbit (grub_uint32_t n)
+{
+  unsigned r = 0;
+
+  while (n >>= 1)
+    r++;
+  return r;
+}
+
+/* N bits of SRC, of LEN bytes, from bit POS on, reading the bytes least
+   significant bit first as the FSE table descriptions are.  Bits past the
+   end read as zero.  */
+static grub_uint32_t
+get_bits (const grub_uint8_t *src, grub_size_t len, grub_size_t pos,
+	  unsigned n)
+{
+  grub_uint32_t v = 0;
+  unsigned i;
+
+  for (i = 0; i < 3 && (pos >> 3) + i < len; i++)
+    v |= (grub_uint32_t) src[(pos >> 3) + i] << (8 * i);
+  return (v >> (pos & 7)) & ((1U << n) - 1);
+}
+
+/* The backward bitstreams of the Huffman coded literals and of the
+   sequences are written from the end, the first bit read being the one
+   after the highest set bit of the last byte.  BITS holds the next AVAIL
+   bits, the next one read being the most significant of them.  Reading
+   past the start yields zeros and sets OVERFLOW.  */
+struct bwd_bits
+{
+  const grub_uint8_t *start;
+  const grub_uint8_t *ptr;
+  grub_uint64_t bits;
+  unsigned avail;
+  int overflow;
+};
+
+static inline void
+bwd_refill (struct bwd_bits *br)
+{
+  while (br->avail <= 56 && br->ptr > br->start)
+    {
+      br->bits = (br->bits << 8) | *--br->ptr;
+      br->avail += 8;
+    }
+}
+
+static int
+bwd_init (struct bwd_bits *br, const grub_uint8_t *src, grub_size_t len)
+{
+  if (!len || !src[len - 1])
+    return 0;
+
+  br->start = src;
+  br->ptr = src + len - 1;
+  br->avail = highbit (src[len - 1]);
+  br->bits = src[len - 1] & ((1U << br->avail) - 1);
+  br->overflow = 0;
+  bwd_refill (br);
+  return 1;
+}
+
+static inline grub_uint32_t
+bwd_peek (struct bwd_bits *br, unsigned n)
+{
+  if (br->avail < n)
+    {
+      bwd_refill (br);
+      if (br->avail < n)
+	return br->bits << (n - br->avail);
+    }
+  return br->bits >> (br->avail - n);
+}
+
+static inline void
+bwd_skip (struct bwd_bits *br, unsigned n)
+{
+  if (n > br->avail)
+    {
+      br->overflow = 1;
+      br->avail = 0;
+    }
+  else
+    br->avail -= n;
+  br->bits &= ((grub_uint64_t) 1 << br->avail) - 1;
+}
+
+static inline grub_uint32_t
+bwd_read (struct bwd_bits *br, unsigned n)
+{
+  grub_uint32_t v;
+
+  if (!n)
+    return 0;
+  v = bwd_peek (br, n);
+  bwd_skip (br, n);
+  return v;
+}
+
+/* Whether the stream was read exactly to its start.  */
+static inline int
+bwd_finished (struct bwd_bits *br)
+{
+  return !br->overflow && !br->avail && br->ptr == br->start;
+}
+
+/* Read the normalized counts of an FSE table description at SRC, of at
+   most LEN bytes, into COUNTS.  *MAX_SYMBOL is the largest symbol allowed
+   and is lowered to the last one described.  Return the size of the
+   description, or zero if it is invalid.  */
+static grub_size_t
+read_counts (const grub_uint8_t *src, grub_size_t len, grub_int16_t *counts,
+	     unsigned *max_symbol, unsigned *log, unsigned max_log)
+{
+  grub_size_t pos = 4;
+  unsigned symbol = 0, nbits, repeat, i;
+  int remaining, threshold, max, count;
+  int previous0 = 0;
+  grub_uint32_t v;
+
+  if (!len)
+    return 0;
+  *log = (src[0] & 0xf) + 5;
+  if (*log > max_log)
+    return 0;
+
+  remaining = (1 << *log) + 1;
+  threshold = 1 << *log;
+  nbits = *log + 1;
+
+  while (remaining > 1 && symbol <= *max_symbol)
+    {
+      /* A zero probability is followed by how many more symbols have
+	 none, two bits at a time.  */
+      if (previous0)
+	for (;;)
+	  {
+	    repeat = get_bits (src, len, pos, 2);
+	    pos += 2;
+	    if (symbol + repeat > *max_symbol)
+	      return 0;
+	    for (i = 0; i < repeat; i++)
+	      counts[symbol++] = 0;
+	    if (repeat != 3 || pos > len * 8)
+	      break;
+	  }
+
+      max = 2 * threshold - 1 - remaining;
+      v = get_bits (src, len, pos, nbits - 1);
+      if ((int) v < max)
+	pos += nbits - 1;
+      else
+	{
+	  v = get_bits (src, len, pos, nbits);
+	  if ((int) v >= threshold)
+	    v -= max;
+	  pos += nbits;
+	}
+      count = (int) v - 1;
+      remaining -= count < 0 ? -count : count;
+      counts[symbol++] = count;
+      previous0 = !count;
+      while (remaining < threshold)
+	{
+	  nbits--;
+	  threshold >>= 1;
+	}
+      if (pos > len * 8)
+	return 0;
+    }
+
+  if (remaining != 1)
+    return 0;
+  *max_symbol = symbol - 1;
+  return (pos + 7) / 8;
+}
+
+/* Build the decoding table for the normalized COUNTS of the symbols up to
+   MAX_SYMBOL.  Return zero if they do not add up to the table size.  */
+static int
+build_fse (struct fse_table *table, const grub_int16_t *counts,
+	   unsigned max_symbol, unsigned log)
+{
+  grub_uint16_t next[FSE_MAX_SYMBOLS];
+  unsigned size = 1 << log, high = size - 1, mask = size - 1;
+  unsigned step = (size >> 1) + (size >> 3) + 3;
+  unsigned pos = 0, s, u, n;
+  int i;
+
+  table->valid = 0;
+  if (max_symbol >= FSE_MAX_SYMBOLS)
+    return 0;
+
+  /* Symbols with a "less than one" probability get a state each at the
+     end of the table.  */
+  for (s = 0; s <= max_symbol; s++)
+    if (counts[s] == -1)
+      {
+	if (high == 0)
+	  return 0;
+	table->entries[high--].symbol = s;
+	next[s] = 1;
+      }
+    else
+      next[s] = counts[s];
+
+  for (s = 0; s <= max_symbol; s++)
+    for (i = 0; i < counts[s]; i++)
+      {
+	if (pos > high)
+	  return 0;
+	table->entries[pos].symbol = s;
+	do
+	  pos = (pos + step) & mask;
+	while (pos > high);
+      }
+  if (pos != 0)
+    return 0;
+
+  for (u = 0; u < size; u++)
+    {
+      s = table->entries[u].symbol;
+      n = next[s]++;
+      if (!n)
+	return 0;
+      table->entries[u].bits = log - highbit (n);
+      table->entries[u].base = (n << table->entries[u].bits) - size;
+    }
+
+  table->log = log;
+  table->valid = 1;
+  return 1;
+}
+
+/* Read the Huffman table description at SRC, of at most LEN bytes.
+   Return its size, or zero if it is invalid.  */
+static grub_size_t
+read_huffman (struct zstd_dec *dec, const grub_uint8_t *src, grub_size_t len)
+{
+  grub_uint8_t weights[HUF_MAX_SYMBOLS];
+  unsigned rank[HUF_MAX_LOG + 2];
+  unsigned num = 0, i, j, w, log, size, total, rest;
+  grub_size_t used;
+
+  if (!len)
+    return 0;
+
+  if (src[0] < 128)
+    {
+      /* The weights are FSE compressed, with two states taking turns on
+	 one bitstream.  */
+      struct fse_table table;
+      grub_int16_t counts[HUF_MAX_LOG + 2];
+      unsigned max_symbol = HUF_MAX_LOG + 1, flog, s1, s2;
+      struct bwd_bits br;
+      grub_size_t n;
+
+      used = 1 + src[0];
+      if (used > len)
+	return 0;
+      n = read_counts (src + 1, src[0], counts, &max_symbol, &flog,
+		       HUF_WEIGHT_MAX_LOG);
+      if (!n || !build_fse (&table, counts, max_symbol, flog)
+	  || !bwd_init (&br, src + 1 + n, src[0] - n))
+	return 0;
+
+      s1 = bwd_read (&br, flog);
+      s2 = bwd_read (&br, flog);
+      for (;;)
+	{
+	  if (num > HUF_MAX_SYMBOLS - 3)
+	    return 0;
+	  weights[num++] = table.entries[s1].symbol;
+	  s1 = table.entries[s1].base + bwd_read (&br, table.entries[s1].bits);
+	  if (br.overflow)
+	    {
+	      weights[num++] = table.entries[s2].symbol;
+	      break;
+	    }
+	  if (num > HUF_MAX_SYMBOLS - 3)
+	    return 0;
+	  weights[num++] = table.entries[s2].symbol;
+	  s2 = table.entries[s2].base + bwd_read (&br, table.entries[s2].bits);
+	  if (br.overflow)
+	    {
+	      weights[num++] = table.entries[s1].symbol;
+	      break;
+	    }
+	}
+    }
+  else
+    {
+      num = src[0] - 127;
+      used = 1 + (num + 1) / 2;
+      if (used > len)
+	return 0;
+      for (i = 0; i < num; i++)
+	weights[i] = (i & 1) ? src[1 + i / 2] & 0xf : src[1 + i / 2] >> 4;
+    }
+
+  /* The weight of the last symbol is implied by the others, which leave
+     a power of two to fill.  */
+  grub_memset (rank, 0, sizeof (rank));
+  total = 0;
+  for (i = 0; i < num; i++)
+    {
+      if (weights[i] > HUF_MAX_LOG)
+	return 0;
+      rank[weights[i]]++;
+      total += (1U << weights[i]) >> 1;
+    }
+  if (!total)
+    return 0;
+  log = highbit (total) + 1;
+  if (log > HUF_MAX_LOG)
+    return 0;
+  rest = (1U << log) - total;
+  if (rest & (rest - 1))
+    return 0;
+  w = highbit (rest) + 1;
+  weights[num++] = w;
+  rank[w]++;
+  if (rank[1] < 2 || (rank[1] & 1))
+    return 0;
+
+  /* Codes of the same length are in the order of their symbols, and the
+     longest come first.  */
+  for (w = 1, size = 0; w <= log; w++)
+    {
+      j = rank[w] << (w - 1);
+      rank[w] = size;
+      size += j;
+    }
+  for (i = 0; i < num; i++)
+    {
+      w = weights[i];
+      if (!w)
+	continue;
+      for (j = 0; j < (1U << (w - 1)); j++)
+	{
+	  dec->huf[rank[w] + j].symbol = i;
+	  dec->huf[rank[w] + j].bits = log + 1 - w;
+	}
+      rank[w] += 1U << (w - 1);
+    }
+
+  dec->huf_log = log;
+  return used;
+}
+
+/* Decode COUNT literals from the Huffman coded stream SRC, of LEN bytes,
+   to OUT.  */
+static int
+decode_huffman_stream (struct zstd_dec *dec, const grub_uint8_t *src,
+		       grub_size_t len, grub_uint8_t *out, grub_size_t count)
+{
+  const struct huf_entry *e;
+  unsigned log = dec->huf_log;
+  struct bwd_bits br;
+  grub_size_t i;
+
+  if (!bwd_init (&br, src, len))
+    return 0;
+
+  for (i = 0; i < count; i++)
+    {
+      e = &dec->huf[bwd_peek (&br, log)];
+      bwd_skip (&br, e->bits);
+      out[i] = e->symbol;
+    }
+
+  return bwd_finished (&br);
+}
+
+/* Decode the literals section at SRC, of at most LEN bytes, and return
+   its size, or -1 if it is corrupted.  */
+static grub_ssize_t
+decode_literals (struct zstd_dec *dec, const grub_uint8_t *src,
+		 grub_size_t len)
+{
+  unsigned type, format, hsize, bits, i;
+  grub_uint64_t h = 0;
+  grub_size_t regen, comp, n, sizes[4], segment;
+  const grub_uint8_t *p;
+  grub_uint8_t *out;
+
+  if (!len)
+    return corrupted ();
+  type = src[0] & 3;
+  format = (src[0] >> 2) & 3;
+
+  if (type == LITERALS_RAW || type == LITERALS_RLE)
+    {
+      switch (format)
+	{
+	case 1:
+	  hsize = 2;
+	  break;
+	case 3:
+	  hsize = 3;
+	  break;
+	default:
+	  hsize = 1;
+	  break;
+	}
+      if (len < hsize)
+	return corrupted ();
+      if (hsize == 1)
+	regen = src[0] >> 3;
+      else
+	{
+	  regen = (src[0] >> 4) | (src[1] << 4);
+	  if (hsize == 3)
+	    regen |= src[2] << 12;
+	}
+      if (regen > ZSTD_BLOCK_MAX)
+	return corrupted ();
+
+      dec->lit_size = regen;
+      if (type == LITERALS_RAW)
+	{
+	  if (len - hsize < regen)
+	    return corrupted ();
+	  dec->lit = src + hsize;
+	  return hsize + regen;
+	}
+      if (len - hsize < 1)
+	return corrupted ();
+      grub_memset (dec->litbuf, src[hsize], regen);
+      dec->lit = dec->litbuf;
+      return hsize + 1;
+    }
+
+  /* Huffman coded, in one stream or four.  */
+  hsize = format < 2 ? 3 : format + 2;
+  bits = format < 2 ? 10 : format == 2 ? 14 : 18;
+  if (len < hsize)
+    return corrupted ();
+  for (i = 0; i < hsize; i++)
+    h |= (grub_uint64_t) src[i] << (8 * i);
+  regen = (h >> 4) & ((1 << bits) - 1);
+  comp = (h >> (4 + bits)) & ((1 << bits) - 1);
+  if (regen > ZSTD_BLOCK_MAX || comp > len - hsize)
+    return corrupted ();
+
+  p = src + hsize;
+  n = comp;
+  if (type == LITERALS_COMPRESSED)
+    {
+      grub_size_t used = read_huffman (dec, p, n);
+
+      if (!used)
+	return corrupted ();
+      p += used;
+      n -= used;
+    }
+  else if (!dec->huf_log)
+    return corrupted ();
+
+  dec->lit = out = dec->litbuf;
+  dec->lit_size = regen;
+
+  if (format == 0)
+    {
+      if (!decode_huffman_stream (dec, p, n, out, regen))
+	return corrupted ();
+      return hsize + comp;
+    }
+
+  /* A jump table gives the sizes of the first three streams, and each
+     but the last decodes a quarter of the literals, rounded up.  */
+  if (n < 6)
+    return corrupted ();
+  sizes[0] = p[0] | (p[1] << 8);
+  sizes[1] = p[2] | (p[3] << 8);
+  sizes[2] = p[4] | (p[5] << 8);
+  p += 6;
+  n -= 6;
+  if (sizes[0] + sizes[1] + sizes[2] > n)
+    return corrupted ();
+  sizes[3] = n - sizes[0] - sizes[1] - sizes[2];
+  segment = (regen + 3) / 4;
+  if (3 * segment > regen)
+    return corrupted ();
+
+  for (i = 0; i < 4; i++)
+    {
+      grub_size_t count = i < 3 ? segment : regen - 3 * segment;
+
+      if (!decode_huffman_stream (dec, p, sizes[i], out, count))
+	return corrupted ();
+      p += sizes[i];
+      out += count;
+    }
+
+  return hsize + comp;
+}
+
+/* Set up TABLE for the sequence code with the given compression MODE,
+   from the description at SRC, of at most LEN bytes, if there is one.
+   Return the size of the description, or -1 if it is invalid.  */
+static grub_ssize_t
+read_table (struct fse_table *table, unsigned mode, const grub_uint8_t *src,
+	    grub_size_t len, const grub_int16_t *def, unsigned def_max,
+	    unsigned def_log, unsigned max_symbol, unsigned max_log)
+{
+  grub_int16_t counts[FSE_MAX_SYMBOLS];
+  grub_size_t n;
+  unsigned log;
+
+  switch (mode)
+    {
+    case MODE_PREDEFINED:
+      if (!build_fse (table, def, def_max, def_log))
+	return corrupted ();
+      return 0;
+
+    case MODE_RLE:
+      if (!len || src[0] > max_symbol)
+	return corrupted ();
+      table->entries[0].symbol = src[0];
+      table->entries[0].bits = 0;
+      table->entries[0].base = 0;
+      table->log = 0;
+      table->valid = 1;
+      return 1;
+
+    case MODE_FSE:
+      n = read_counts (src, len, counts, &max_symbol, &log, max_log);
+      if (!n || !build_fse (table, counts, max_symbol, log))
+	return corrupted ();
+      return n;
+
+    default:
+      if (!table->valid)
+	return corrupted ();
+      return 0;
+    }
+}
+
+/* Copy a match of LEN bytes from OFFSET bytes back to OUT.  */
+static inline void
+copy_match (grub_uint8_t *out, grub_size_t offset, grub_size_t len)
+{
+  const grub_uint8_t *from = out - offset;
+  grub_size_t n;
+
+  if (offset >= len)
+    {
+      grub_memcpy (out, from, len);
+      return;
+    }
+
+  /* The match overlaps itself and repeats the last OFFSET bytes.  */
+  if (offset < 8)
+    {
+      while (len--)
+	*out++ = *from++;
+      return;
+    }
+  while (len)
+    {
+      n = len < offset ? len : offset;
+      grub_memcpy (out, from, n);
+      out += n;
+      from += n;
+      len -= n;
+    }
+}
+
+grub_err_t
+zstd_frame_header (const grub_uint8_t *buf, grub_size_t len,
+		   struct zstd_frame_header *hdr)
+{
+  static const grub_uint8_t dict_sizes[4] = { 0, 1, 2, 4 };
+  static const grub_uint8_t fcs_sizes[4] = { 0, 2, 4, 8 };
+  unsigned desc, pos = 5, dict_size, fcs_size, i;
+  grub_uint64_t v;
+  int single;
+
+  if (len < 5 || grub_le_to_cpu32 (grub_get_unaligned32 (buf)) != ZSTD_MAGIC)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "not a zstd frame");
+
+  desc = buf[4];
+  if (desc & 0x08)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       "reserved zstd frame header bit set");
+  single = (desc >> 5) & 1;
+  dict_size = dict_sizes[desc & 3];
+  fcs_size = fcs_sizes[desc >> 6];
+  if (single && !fcs_size)
+    fcs_size = 1;
+
+  hdr->header_size = 5 + !single + dict_size + fcs_size;
+  hdr->checksum = (desc >> 2) & 1;
+  if (len < hdr->header_size)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       "zstd frame header truncated");
+
+  if (!single)
+    {
+      grub_uint64_t base = 1ULL << (10 + (buf[pos] >> 3));
+
+      hdr->window_size = base + (base / 8) * (buf[pos] & 7);
+      pos++;
+    }
+
+  for (i = 0, v = 0; i < dict_size; i++)
+    v |= (grub_uint64_t) buf[pos++] << (8 * i);
+  if (v)
+    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		       "zstd dictionaries are not supported");
+
+  for (i = 0, v = 0; i < fcs_size; i++)
+    v |= (grub_uint64_t) buf[pos++] << (8 * i);
+  if (fcs_size == 2)
+    v += 256;
+  hdr->content_size = fcs_size ? v : ZSTD_CONTENT_SIZE_UNKNOWN;
+
+  if (single)
+    hdr->window_size = hdr->content_size;
+
+  return GRUB_ERR_NONE;
+}
+
+struct zstd_dec *
+zstd_dec_init (void)
+{
+  struct zstd_dec *dec;
+
+  dec = grub_malloc (sizeof (*dec));
+  if (dec)
+    zstd_dec_reset (dec);
+  return dec;
+}
+
+void
+zstd_dec_reset (struct zstd_dec *dec)
+{
+  dec->ll.valid = 0;
+  dec->of.valid = 0;
+  dec->ml.valid = 0;
+  dec->huf_log = 0;
+  dec->rep[0] = 1;
+  dec->rep[1] = 4;
+  dec->rep[2] = 8;
+}
+
+void
+zstd_dec_end (struct zstd_dec *dec)
+{
+  grub_free (dec);
+}
+
+grub_ssize_t
+zstd_dec_block (struct zstd_dec *dec, const grub_uint8_t *src,
+		grub_size_t src_size, grub_uint8_t *out, grub_size_t out_size,
+		grub_size_t hist, const grub_uint8_t *ext_end,
+		grub_size_t ext_size)
+{
+  const grub_uint8_t *end = src + src_size, *lit;
+  grub_size_t lit_left, pos = 0, nseq, i, back;
+  grub_uint32_t of_code, ll_code, ml_code, offset, ll, ml;
+  unsigned ll_state, of_state, ml_state, modes;
+  const struct fse_entry *e;
+  struct bwd_bits br;
+  grub_ssize_t n;
+
+  n = decode_literals (dec, src, src_size);
+  if (n < 0)
+    return -1;
+  src += n;
+
+  if (src == end)
+    return corrupted ();
+  if (src[0] < 128)
+    nseq = *src++;
+  else if (src[0] < 255)
+    {
+      if (end - src < 2)
+	return corrupted ();
+      nseq = ((src[0] - 128) << 8) + src[1];
+      src += 2;
+    }
+  else
+    {
+      if (end - src < 3)
+	return corrupted ();
+      nseq = src[1] + (src[2] << 8) + 0x7f00;
+      src += 3;
+    }
+
+  lit = dec->lit;
+  lit_left = dec->lit_size;
+
+  if (nseq)
+    {
+      if (src == end)
+	return corrupted ();
+      modes = *src++;
+      if (modes & 3)
+	return corrupted ();
+
+      n = read_table (&dec->ll, (modes >> 6) & 3, src, end - src, ll_default,
+		      LL_MAX_SYMBOL, LL_DEFAULT_LOG, LL_MAX_SYMBOL, LL_MAX_LOG);
+      if (n < 0)
+	return -1;
+      src += n;
+      n = read_table (&dec->of, (modes >> 4) & 3, src, end - src, of_default,
+		      ARRAY_SIZE (of_default) - 1, OF_DEFAULT_LOG,
+		      OF_MAX_SYMBOL, OF_MAX_LOG);
+      if (n < 0)
+	return -1;
+      src += n;
+      n = read_table (&dec->ml, (modes >> 2) & 3, src, end - src, ml_default,
+		      ML_MAX_SYMBOL, ML_DEFAULT_LOG, ML_MAX_SYMBOL, ML_MAX_LOG);
+      if (n < 0)
+	return -1;
+      src += n;
+
+      if (!bwd_init (&br, src, end - src))
+	return corrupted ();
+      ll_state = bwd_read (&br, dec->ll.log);
+      of_state = bwd_read (&br, dec->of.log);
+      ml_state = bwd_read (&br, dec->ml.log);
+
+      for (i = 0; i < nseq; i++)
+	{
+	  of_code = dec->of.entries[of_state].symbol;
+	  ll_code = dec->ll.entries[ll_state].symbol;
+	  ml_code = dec->ml.entries[ml_state].symbol;
+
+	  offset = (1U << of_code) + bwd_read (&br, of_code);
+	  ml = ml_base[ml_code] + bwd_read (&br, ml_bits[ml_code]);
+	  ll = ll_base[ll_code] + bwd_read (&br, ll_bits[ll_code]);
+
+	  /* Offsets up to three refer to the last ones used, shifted by
+	     one if there are no literals.  */
+	  if (offset > 3)
+	    {
+	      dec->rep[2] = dec->rep[1];
+	      dec->rep[1] = dec->rep[0];
+	      dec->rep[0] = offset - 3;
+	    }
+	  else
+	    {
+	      unsigned idx = offset - 1 + (ll == 0);
+
+	      if (idx)
+		{
+		  offset = idx == 3 ? dec->rep[0] - 1 : dec->rep[idx];
+		  if (idx != 1)
+		    dec->rep[2] = dec->rep[1];
+		  dec->rep[1] = dec->rep[0];
+		  dec->rep[0] = offset;
+		}
+	    }
+	  offset = dec->rep[0];
+
+	  if (i + 1 < nseq)
+	    {
+	      e = &dec->ll.entries[ll_state];
+	      ll_state = e->base + bwd_read (&br, e->bits);
+	      e = &dec->ml.entries[ml_state];
+	      ml_state = e->base + bwd_read (&br, e->bits);
+	      e = &dec->of.entries[of_state];
+	      of_state = e->base + bwd_read (&br, e->bits);
+	    }
+
+	  if (ll > lit_left || ll + ml > out_size - pos
+	      || !offset || offset > hist + ext_size + pos + ll)
+	    return corrupted ();
+	  grub_memcpy (out + pos, lit, ll);
+	  lit += ll;
+	  lit_left -= ll;
+	  pos += ll;
+	  /* A match starting in the older data continues at the start of
+	     the history.  */
+	  if (offset > hist + pos)
+	    {
+	      back = offset - hist - pos;
+	      if (back > ml)
+		back = ml;
+	      grub_memcpy (out + pos, ext_end - (offset - hist - pos), back);
+	      pos += back;
+	      ml -= back;
+	    }
+	  if (ml)
+	    copy_match (out + pos, offset, ml);
+	  pos += ml;
+	}
+
+      if (!bwd_finished (&br))
+	return corrupted ();
+    }
+  else if (src != end)
+    return corrupted ();
+
+  if (lit_left > out_size - pos)
+    return corrupted ();
+  grub_memcpy (out + pos, lit, lit_left);
+  pos += lit_left;
+
+  return pos;
+}
@@ -29,6 +29,8 @@ struct load_spec
   struct load_spec *next;
   char *name;
   char *modname;
+  /* Loading the module failed, so don't try it again.  */
+  int failed;
 };
 
 static struct load_spec *crypto_specs = NULL;
@@ -46,12 +48,18 @@ grub_crypto_autoload (const char *name)
     return;
   depth++;
 
+  /* Digest lookups come back here for names that are already provided,
+     looking for faster variants, so skip modules that are loaded, and
+     those that failed to load before.  Unloaded ones are tried again.  */
   for (cur = crypto_specs; cur; cur = cur->next)
-    if (grub_strcasecmp (name, cur->name) == 0)
+    if (grub_strcasecmp (name, cur->name) == 0 && !cur->failed
+	&& !grub_dl_get (cur->modname))
       {
 	mod = grub_dl_load (cur->modname);
 	if (mod)
 	  grub_dl_ref (mod);
+	else
+	  cur->failed = 1;
 	grub_errno = GRUB_ERR_NONE;
       }
   depth--;
@@ -151,6 +159,7 @@ read_crypto_list (const char *prefix)
 	  grub_free (cur);
 	  continue;
 	}
+      cur->failed = 0;
       cur->next = crypto_specs;
       crypto_specs = cur;
     }
@@ -19,3 +19,15 @@ grub_install_compress_lzop (const char *src, const char *dest)
 {
   grub_util_error (_("no compression is available for your platform"));
 }
+
+int 
+grub_install_compress_zstd (const char *src, const char *dest)
+{
+  grub_util_error (_("no compression is available for your platform"));
+}
+
+int 
+grub_install_compress_lz4 (const char *src, const char *dest)
+{
+  grub_util_error (_("no compression is available for your platform"));
+}
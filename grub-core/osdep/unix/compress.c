@@ -30,7 +30,8 @@ int
 grub_install_compress_xz (const char *src, const char *dest)
 {
   return grub_util_exec_redirect ((const char * []) { "xz",
-	"--lzma2=dict=128KiB", "--check=none", "--stdout", NULL }, src, dest);
+	"--lzma2=dict=128KiB", "--check=none", "--block-size=1MiB",
+	"--stdout", NULL }, src, dest);
 }
 
 int 
@@ -39,3 +40,20 @@ grub_install_compress_lzop (const char *src, const char *dest)
   return grub_util_exec_redirect ((const char * []) { "lzop", "-9",  "-c",
 	NULL }, src, dest);
 }
+
+int 
+grub_install_compress_zstd (const char *src, const char *dest)
+{
+  /* Name the file rather than piping it in, for its size to be recorded
+     in the frame header.  */
+  return grub_util_exec_redirect ((const char * []) { "zstd", "-19",
+	"--no-check", "--quiet", "--stdout", src, NULL }, src, dest);
+}
+
+int 
+grub_install_compress_lz4 (const char *src, const char *dest)
+{
+  return grub_util_exec_redirect ((const char * []) { "lz4", "-9",
+	"--content-size", "--no-frame-crc", "--quiet", "--stdout", src,
+	NULL }, src, dest);
+}
@@ -0,0 +1,120 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/crypto.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define RFC9106_P "\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01" \
+  "\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01"
+#define RFC9106_S "\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02\x02"
+#define RFC9106_K "\x03\x03\x03\x03\x03\x03\x03\x03"
+#define RFC9106_X "\x04\x04\x04\x04\x04\x04\x04\x04\x04\x04\x04\x04"
+
+static struct
+{
+  grub_crypto_argon2_type_t type;
+  const char *P;
+  grub_size_t Plen;
+  const char *S;
+  grub_size_t Slen;
+  const char *K;
+  grub_size_t Klen;
+  const char *X;
+  grub_size_t Xlen;
+  unsigned int t, m, p;
+  grub_size_t Tlen;
+  const char *T;
+} vectors[] = {
+  /* RFC9106.  */
+  {
+    GRUB_CRYPTO_ARGON2D,
+    RFC9106_P, 32, RFC9106_S, 16, RFC9106_K, 8, RFC9106_X, 12,
+    3, 32, 4, 32,
+    "\x51\x2b\x39\x1b\x6f\x11\x62\x97\x53\x71\xd3\x09\x19\x73\x42\x94"
+    "\xf8\x68\xe3\xbe\x39\x84\xf3\xc1\xa1\x3a\x4d\xb9\xfa\xbe\x4a\xcb"
+  },
+  {
+    GRUB_CRYPTO_ARGON2I,
+    RFC9106_P, 32, RFC9106_S, 16, RFC9106_K, 8, RFC9106_X, 12,
+    3, 32, 4, 32,
+    "\xc8\x14\xd9\xd1\xdc\x7f\x37\xaa\x13\xf0\xd7\x7f\x24\x94\xbd\xa1"
+    "\xc8\xde\x6b\x01\x6d\xd3\x88\xd2\x99\x52\xa4\xc4\x67\x2b\x6c\xe8"
+  },
+  {
+    GRUB_CRYPTO_ARGON2ID,
+    RFC9106_P, 32, RFC9106_S, 16, RFC9106_K, 8, RFC9106_X, 12,
+    3, 32, 4, 32,
+    "\x0d\x64\x0d\xf5\x8d\x78\x76\x6c\x08\xc0\x37\xa3\x4a\x8b\x53\xc9"
+    "\xd0\x1e\xf0\x45\x2d\x75\xb6\x5e\xb5\x25\x20\xe9\x6b\x01\xe6\x59"
+  },
+  /* Reference implementation test suite, version 0x13.  */
+  {
+    GRUB_CRYPTO_ARGON2I,
+    "password", 8, "somesalt", 8, NULL, 0, NULL, 0,
+    2, 65536, 1, 32,
+    "\xc1\x62\x88\x32\x14\x7d\x97\x20\xc5\xbd\x1c\xfd\x61\x36\x70\x78"
+    "\x72\x9f\x6d\xfb\x6f\x8f\xea\x9f\xf9\x81\x58\xe0\xd7\x81\x6e\xd0"
+  },
+  {
+    GRUB_CRYPTO_ARGON2ID,
+    "password", 8, "somesalt", 8, NULL, 0, NULL, 0,
+    2, 65536, 1, 32,
+    "\x09\x31\x61\x15\xd5\xcf\x24\xed\x5a\x15\xa3\x1a\x3b\xa3\x26\xe5"
+    "\xcf\x32\xed\xc2\x47\x02\x98\x7c\x02\xb6\x56\x6f\x61\x91\x3c\xf7"
+  },
+  {
+    GRUB_CRYPTO_ARGON2ID,
+    "password", 8, "somesalt", 8, NULL, 0, NULL, 0,
+    2, 256, 2, 32,
+    "\x6d\x09\x3c\x50\x1f\xd5\x99\x96\x45\xe0\xea\x3b\xf6\x20\xd7\xb8"
+    "\xbe\x7f\xd2\xdb\x59\xc2\x0d\x9f\xff\x95\x39\xda\x2b\xf5\x70\x37"
+  }
+};
+
+static void
+argon2_test (void)
+{
+  grub_size_t i;
+
+  for (i = 0; i < ARRAY_SIZE (vectors); i++)
+    {
+      gcry_err_code_t err;
+      grub_uint8_t T[32];
+      err = grub_crypto_argon2 (vectors[i].type,
+				(const grub_uint8_t *) vectors[i].P,
+				vectors[i].Plen,
+				(const grub_uint8_t *) vectors[i].S,
+				vectors[i].Slen,
+				(const grub_uint8_t *) vectors[i].K,
+				vectors[i].Klen,
+				(const grub_uint8_t *) vectors[i].X,
+				vectors[i].Xlen,
+				vectors[i].t, vectors[i].m, vectors[i].p,
+				T, vectors[i].Tlen);
+      grub_test_assert (err == 0, "gcry error %d", err);
+      grub_test_assert (grub_memcmp (T, vectors[i].T, vectors[i].Tlen) == 0,
+			"Argon2 mismatch in vector %" PRIuGRUB_SIZE, i);
+    }
+}
+
+/* Register argon2_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (argon2_test, argon2_test);
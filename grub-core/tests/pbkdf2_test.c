@@ -25,6 +25,7 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 static struct
 {
+  const gcry_md_spec_t *md;
   const char *P;
   grub_size_t Plen;
   const char *S;
@@ -35,6 +36,7 @@ static struct
 } vectors[] = {
   /* RFC6070. */
   {
+    GRUB_MD_SHA1,
     "password", 8,
     "salt", 4,
     1, 20,
@@ -42,6 +44,7 @@ static struct
     "\x06\x2f\xe0\x37\xa6"
   },
   {
+    GRUB_MD_SHA1,
     "password", 8,
     "salt", 4,
     2, 20,
@@ -50,6 +53,7 @@ static struct
     "\xd8\xde\x89\x57"
   },
   {
+    GRUB_MD_SHA1,
     "password", 8,
     "salt", 4,
     4096, 20,
@@ -57,6 +61,7 @@ static struct
     "\x21\xd0\x65\xa4\x29\xc1"
   },
   {
+    GRUB_MD_SHA1,
     "passwordPASSWORDpassword", 24,
     "saltSALTsaltSALTsaltSALTsaltSALTsalt", 36,
     4096, 25,
@@ -64,13 +69,72 @@ static struct
     "\xe4\x4a\x8b\x29\x1a\x96\x4c\xf2\xf0\x70\x38"
   },
   {
+    GRUB_MD_SHA1,
     "pass\0word", 9,
     "sa\0lt", 5,
     4096, 16,
     "\x56\xfa\x6a\xa7\x55\x48\x09\x9d\xcc\x37\xd7\xf0\x34\x25\xe0\xc3"
+  },
+  /* RFC7914. */
+  {
+    GRUB_MD_SHA256,
+    "passwd", 6,
+    "salt", 4,
+    1, 64,
+    "\x55\xac\x04\x6e\x56\xe3\x08\x9f\xec\x16\x91\xc2\x25\x44"
+    "\xb6\x05\xf9\x41\x85\x21\x6d\xde\x04\x65\xe6\x8b\x9d\x57"
+    "\xc2\x0d\xac\xbc\x49\xca\x9c\xcc\xf1\x79\xb6\x45\x99\x16"
+    "\x64\xb3\x9d\x77\xef\x31\x7c\x71\xb8\x45\xb1\xe3\x0b\xd5"
+    "\x09\x11\x20\x41\xd3\xa1\x97\x83"
+  },
+  {
+    GRUB_MD_SHA512,
+    "password", 8,
+    "salt", 4,
+    4096, 64,
+    "\xd1\x97\xb1\xb3\x3d\xb0\x14\x3e\x01\x8b\x12\xf3\xd1\xd1"
+    "\x47\x9e\x6c\xde\xbd\xcc\x97\xc5\xc0\xf8\x7f\x69\x02\xe0"
+    "\x72\xf4\x57\xb5\x14\x3f\x30\x60\x26\x41\xb3\xd5\x5c\xd3"
+    "\x35\x98\x8c\xb3\x6b\x84\x37\x60\x60\xec\xd5\x32\xe0\x39"
+    "\xb7\x42\xa2\x39\x43\x4a\xf2\xd5"
   }
 };
 
+/* Compute PBKDF2 the slow way, one full HMAC per iteration, to check
+   the precomputed-state implementation against.  Only the first block
+   is derived.  */
+static gcry_err_code_t
+pbkdf2_reference (const gcry_md_spec_t *md,
+		  const grub_uint8_t *P, grub_size_t Plen,
+		  const grub_uint8_t *S, grub_size_t Slen,
+		  unsigned int c, grub_uint8_t *DK)
+{
+  grub_uint8_t U[GRUB_CRYPTO_MAX_MDLEN];
+  grub_uint8_t tmp[64 + 4];
+  gcry_err_code_t err;
+  unsigned int u, k;
+
+  grub_memcpy (tmp, S, Slen);
+  grub_memcpy (tmp + Slen, "\0\0\0\1", 4);
+  err = grub_crypto_hmac_buffer (md, P, Plen, tmp, Slen + 4, U);
+  if (err)
+    return err;
+  grub_memcpy (DK, U, md->mdlen);
+  for (u = 1; u < c; u++)
+    {
+      err = grub_crypto_hmac_buffer (md, P, Plen, U, md->mdlen, U);
+      if (err)
+	return err;
+      for (k = 0; k < md->mdlen; k++)
+	DK[k] ^= U[k];
+    }
+  return GPG_ERR_NO_ERROR;
+}
+
+static const gcry_md_spec_t *reference_hashes[] = {
+  GRUB_MD_SHA1, GRUB_MD_SHA256, GRUB_MD_SHA512
+};
+
 static void
 pbkdf2_test (void)
 {
@@ -79,8 +143,8 @@ pbkdf2_test (void)
   for (i = 0; i < ARRAY_SIZE (vectors); i++)
     {
       gcry_err_code_t err;
-      grub_uint8_t DK[32];
-      err = grub_crypto_pbkdf2 (GRUB_MD_SHA1,
+      grub_uint8_t DK[64];
+      err = grub_crypto_pbkdf2 (vectors[i].md,
 				(const grub_uint8_t *) vectors[i].P,
 				vectors[i].Plen,
 				(const grub_uint8_t *) vectors[i].S,
@@ -91,6 +155,29 @@ pbkdf2_test (void)
       grub_test_assert (grub_memcmp (DK, vectors[i].DK, vectors[i].dkLen) == 0,
 			"PBKDF2 mismatch");
     }
+
+  /* Check against the plain HMAC construction with a key longer than
+     the block size.  */
+  for (i = 0; i < ARRAY_SIZE (reference_hashes); i++)
+    {
+      const gcry_md_spec_t *md = reference_hashes[i];
+      grub_uint8_t key[200], DK[GRUB_CRYPTO_MAX_MDLEN];
+      grub_uint8_t ref[GRUB_CRYPTO_MAX_MDLEN];
+      gcry_err_code_t err;
+      grub_size_t j;
+
+      for (j = 0; j < sizeof (key); j++)
+	key[j] = j;
+      err = grub_crypto_pbkdf2 (md, key, sizeof (key),
+				(const grub_uint8_t *) "salt", 4, 100,
+				DK, md->mdlen);
+      grub_test_assert (err == 0, "gcry error %d", err);
+      err = pbkdf2_reference (md, key, sizeof (key),
+			      (const grub_uint8_t *) "salt", 4, 100, ref);
+      grub_test_assert (err == 0, "gcry error %d", err);
+      grub_test_assert (grub_memcmp (DK, ref, md->mdlen) == 0,
+			"PBKDF2-%s differs from HMAC reference", md->name);
+    }
 }
 
 /* Register example_test method as a functional test.  */
@@ -0,0 +1,158 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/time.h>
+#include <grub/disk.h>
+#include <grub/diskfilter.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Data members of the simulated array and the size of each chunk.  */
+#define RAID6_BENCH_DISKS 6
+#define RAID6_BENCH_CHUNK (64 * 1024)
+#define RAID6_BENCH_ROUNDS 64
+
+/* Bitwise multiplication in GF(2^8) with the RAID6 polynomial.  */
+static grub_uint8_t
+gf_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  grub_uint8_t r = 0;
+
+  while (b)
+    {
+      if (b & 1)
+	r ^= a;
+      a = (a << 1) ^ ((a & 0x80) ? 0x1d : 0);
+      b >>= 1;
+    }
+  return r;
+}
+
+static grub_uint8_t
+gf_pow2 (unsigned n)
+{
+  grub_uint8_t r = 1;
+
+  while (n--)
+    r = gf_mul (r, 2);
+  return r;
+}
+
+static void
+raid6_test (void)
+{
+  grub_uint8_t *src, *dst, *ref, *data[RAID6_BENCH_DISKS], *q, *out;
+  grub_size_t len = 1031, i;
+  grub_uint64_t start, elapsed;
+  unsigned mul, d, round;
+
+  src = grub_malloc (len + 1);
+  dst = grub_malloc (len + 1);
+  ref = grub_malloc (len + 1);
+  grub_test_assert (src && dst && ref, "out of memory");
+  if (!src || !dst || !ref)
+    goto fail;
+
+  for (i = 0; i <= len; i++)
+    src[i] = i * 31 + (i >> 3);
+
+  /* Every multiplier, on a misaligned buffer of odd length so that both
+     the vector kernels and the table fallback for the tail are covered.  */
+  for (mul = 0; mul < 255; mul++)
+    {
+      grub_uint8_t m = gf_pow2 (mul);
+
+      for (i = 0; i < len; i++)
+	ref[i] = gf_mul (src[i + 1], m);
+      grub_raid6_mul (dst + 1, src + 1, mul, len);
+      grub_test_assert (grub_memcmp (dst + 1, ref, len) == 0,
+			"x**%u * data mismatch (%s)", mul,
+			grub_raid6_kernel_name);
+
+      for (i = 0; i < len; i++)
+	ref[i] ^= src[i];
+      grub_memcpy (dst + 1, src, len);
+      grub_raid6_mul_xor (dst + 1, src + 1, mul, len);
+      grub_test_assert (grub_memcmp (dst + 1, ref, len) == 0,
+			"x**%u * data xor mismatch (%s)", mul,
+			grub_raid6_kernel_name);
+    }
+
+  /* Recover a missing data chunk from Q, the slowest degraded case, and
+     report the throughput.  */
+  q = grub_zalloc (RAID6_BENCH_CHUNK);
+  out = grub_malloc (RAID6_BENCH_CHUNK);
+  for (d = 0; d < RAID6_BENCH_DISKS; d++)
+    data[d] = grub_malloc (RAID6_BENCH_CHUNK);
+  for (d = 0; d < RAID6_BENCH_DISKS; d++)
+    if (!data[d])
+      break;
+  grub_test_assert (q && out && d == RAID6_BENCH_DISKS, "out of memory");
+  if (q && out && d == RAID6_BENCH_DISKS)
+    {
+      for (d = 0; d < RAID6_BENCH_DISKS; d++)
+	{
+	  for (i = 0; i < RAID6_BENCH_CHUNK; i++)
+	    data[d][i] = (i * (d + 3)) ^ (i >> 9);
+	  grub_raid6_mul_xor (q, data[d], d, RAID6_BENCH_CHUNK);
+	}
+
+      start = grub_get_time_ms ();
+      for (round = 0; round < RAID6_BENCH_ROUNDS; round++)
+	{
+	  unsigned bad = round % RAID6_BENCH_DISKS;
+
+	  grub_memcpy (out, q, RAID6_BENCH_CHUNK);
+	  for (d = 0; d < RAID6_BENCH_DISKS; d++)
+	    if (d != bad)
+	      grub_raid6_mul_xor (out, data[d], d, RAID6_BENCH_CHUNK);
+	  grub_raid6_mul (out, out, 255 - bad, RAID6_BENCH_CHUNK);
+	  grub_test_assert (grub_memcmp (out, data[bad],
+					 RAID6_BENCH_CHUNK) == 0,
+			    "chunk %u not recovered", bad);
+	}
+      elapsed = grub_get_time_ms () - start;
+
+      if (elapsed)
+	grub_printf ("RAID6 degraded read (%s): %llu MB/s\n",
+		     grub_raid6_kernel_name,
+		     (unsigned long long) ((grub_uint64_t) RAID6_BENCH_ROUNDS
+					   * RAID6_BENCH_CHUNK * 1000
+					   / elapsed / (1024 * 1024)));
+      else
+	grub_printf ("RAID6 degraded read (%s): %u chunks in <1 ms\n",
+		     grub_raid6_kernel_name, RAID6_BENCH_ROUNDS);
+    }
+
+  for (d = 0; d < RAID6_BENCH_DISKS; d++)
+    grub_free (data[d]);
+  grub_free (q);
+  grub_free (out);
+
+ fail:
+  grub_free (src);
+  grub_free (dst);
+  grub_free (ref);
+}
+
+/* Register raid6_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (raid6_test, raid6_test);
@@ -137,6 +137,9 @@ typedef struct gcry_cipher_spec
   gcry_cipher_decrypt_t decrypt;
   gcry_cipher_stencrypt_t stencrypt;
   gcry_cipher_stdecrypt_t stdecrypt;
+  /* Among ciphers of the same name the one with the highest priority is
+     used, e.g. an accelerated implementation over the portable one.  */
+  int priority;
 #ifdef GRUB_UTIL
   const char *modname;
 #endif
@@ -175,6 +178,9 @@ typedef struct gcry_md_spec
   grub_size_t contextsize; /* allocate this amount of context */
   /* Block size, needed for HMAC.  */
   grub_size_t blocksize;
+  /* Among digests of the same name the one with the highest priority is
+     used, e.g. an accelerated implementation over the portable one.  */
+  int priority;
 #ifdef GRUB_UTIL
   const char *modname;
 #endif
@@ -393,6 +399,28 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
 		    unsigned int c,
 		    grub_uint8_t *DK, grub_size_t dkLen);
 
+typedef enum
+  {
+    GRUB_CRYPTO_ARGON2D = 0,
+    GRUB_CRYPTO_ARGON2I = 1,
+    GRUB_CRYPTO_ARGON2ID = 2
+  } grub_crypto_argon2_type_t;
+
+/* Implement the Argon2 memory-hard function as per RFC 9106.  Inputs are
+   the password P of length PLEN, the salt S of length SLEN, the optional
+   secret K and associated data X, the number of passes T_COST (> 0), the
+   memory size M_COST in KiB (>= 8 * PARALLELISM) and the number of lanes
+   PARALLELISM.  The TLEN (>= 4) byte tag is stored in T.  */
+gcry_err_code_t
+grub_crypto_argon2 (grub_crypto_argon2_type_t type,
+		    const grub_uint8_t *P, grub_size_t Plen,
+		    const grub_uint8_t *S, grub_size_t Slen,
+		    const grub_uint8_t *K, grub_size_t Klen,
+		    const grub_uint8_t *X, grub_size_t Xlen,
+		    unsigned int t_cost, unsigned int m_cost,
+		    unsigned int parallelism,
+		    grub_uint8_t *T, grub_size_t Tlen);
+
 int
 grub_crypto_memcmp (const void *a, const void *b, grub_size_t n);
 
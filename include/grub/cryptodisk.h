@@ -97,7 +97,14 @@ struct grub_cryptodisk
   grub_uint8_t rekey_key[64];
   grub_uint64_t last_rekey;
   int rekey_derived_size;
+  /* Private state of the rekey function, wiped and freed with DEV.  */
+  void *rekey_ctx;
+  grub_size_t rekey_ctx_size;
   grub_disk_addr_t partition_start;
+
+  /* Scratch space for grub_cryptodisk_endecrypt, allocated on first use.  */
+  void *iv_hash_ctx;
+  grub_uint8_t *tweak;
 };
 typedef struct grub_cryptodisk *grub_cryptodisk_t;
 
@@ -133,6 +140,9 @@ grub_cryptodisk_dev_unregister (grub_cryptodisk_dev_t cr)
 gcry_err_code_t
 grub_cryptodisk_setkey (grub_cryptodisk_t dev,
 			grub_uint8_t *key, grub_size_t keysize);
+grub_err_t
+grub_cryptodisk_setcipher (grub_cryptodisk_t dev, const char *ciphername,
+			   const char *ciphermode);
 gcry_err_code_t
 grub_cryptodisk_decrypt (struct grub_cryptodisk *dev,
 			 grub_uint8_t * data, grub_size_t len,
@@ -132,6 +132,10 @@ struct grub_disk
   /* The id used by the disk cache manager.  */
   unsigned long id;
 
+  /* Bypass the disk cache, set by devices whose reads already go through
+     a cached disk.  */
+  int nocache;
+
   /* The partition information. This is machine-specific.  */
   struct grub_partition *partition;
 
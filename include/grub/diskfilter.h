@@ -129,6 +129,13 @@ struct grub_diskfilter_node {
   char *name;
   struct grub_diskfilter_pv *pv;
   struct grub_diskfilter_lv *lv;
+
+  /* Read statistics of mirror members, kept for the whole boot.  */
+  grub_uint64_t reads;
+  grub_uint64_t read_sectors;
+  grub_uint64_t read_ms;
+  grub_uint32_t read_errors;
+  int slow;
 };
 
 struct grub_diskfilter_vg *
@@ -148,9 +155,12 @@ struct grub_diskfilter
 typedef struct grub_diskfilter *grub_diskfilter_t;
 
 extern grub_diskfilter_t grub_diskfilter_list;
+/* Bumped whenever grub_diskfilter_list changes.  */
+extern unsigned int grub_diskfilter_generation;
 static inline void
 grub_diskfilter_register_front (grub_diskfilter_t diskfilter)
 {
+  grub_diskfilter_generation++;
   grub_list_push (GRUB_AS_LIST_P (&grub_diskfilter_list),
 		  GRUB_AS_LIST (diskfilter));
 }
@@ -159,6 +169,7 @@ static inline void
 grub_diskfilter_register_back (grub_diskfilter_t diskfilter)
 {
   grub_diskfilter_t p, *q;
+  grub_diskfilter_generation++;
   for (q = &grub_diskfilter_list, p = *q; p; q = &p->next, p = *q);
   diskfilter->next = NULL;
   diskfilter->prev = q;
@@ -167,6 +178,7 @@ grub_diskfilter_register_back (grub_diskfilter_t diskfilter)
 static inline void
 grub_diskfilter_unregister (grub_diskfilter_t diskfilter)
 {
+  grub_diskfilter_generation++;
   grub_list_remove (GRUB_AS_LIST (diskfilter));
 }
 
@@ -189,6 +201,15 @@ typedef grub_err_t (*grub_raid6_recover_func_t) (struct grub_diskfilter_segment
 extern grub_raid5_recover_func_t grub_raid5_recover_func;
 extern grub_raid6_recover_func_t grub_raid6_recover_func;
 
+/* GF(2^8) helpers from raid6rec: DST = x**MUL * SRC and
+   DST ^= x**MUL * SRC for every byte.  */
+void grub_raid6_mul (void *dst, const void *src, unsigned mul,
+		     grub_size_t size);
+void grub_raid6_mul_xor (void *dst, const void *src, unsigned mul,
+			 grub_size_t size);
+/* Name of the implementation in use.  */
+extern const char *grub_raid6_kernel_name;
+
 grub_err_t grub_diskfilter_vg_register (struct grub_diskfilter_vg *vg);
 
 grub_err_t
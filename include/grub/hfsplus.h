@@ -92,6 +92,9 @@ struct grub_hfsplus_file
   grub_uint32_t compress_index_size;
 };
 
+/* Number of B+ tree nodes kept in memory per tree.  */
+#define GRUB_HFSPLUS_BTREE_CACHE_NODES 16
+
 struct grub_hfsplus_btree
 {
   grub_uint32_t root;
@@ -99,8 +102,16 @@ struct grub_hfsplus_btree
 
   /* Catalog file node.  */
   struct grub_hfsplus_file file;
+
+  /* Recently read nodes, allocated on first use.  */
+  char *cache;
+  grub_uint32_t cache_node[GRUB_HFSPLUS_BTREE_CACHE_NODES];
+  grub_uint32_t cache_stamp[GRUB_HFSPLUS_BTREE_CACHE_NODES];
+  grub_uint32_t cache_clock;
 };
 
+struct grub_hfsplus_extmap;
+
 /* Information about a "mounted" HFS+ filesystem.  */
 struct grub_hfsplus_data
 {
@@ -120,6 +131,9 @@ struct grub_hfsplus_data
      filesystem (one inside a plain HFS wrapper).  */
   grub_disk_addr_t embedded_offset;
   int case_sensitive;
+
+  /* Extents of forks which continue in the extent overflow file.  */
+  struct grub_hfsplus_extmap *extmaps;
 };
 
 /* Internal representation of a catalog key.  */
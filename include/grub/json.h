@@ -0,0 +1,90 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_JSON_HEADER
+#define GRUB_JSON_HEADER	1
+
+#include <grub/types.h>
+#include <grub/err.h>
+
+typedef enum
+  {
+    GRUB_JSON_OBJECT,
+    GRUB_JSON_ARRAY,
+    GRUB_JSON_STRING,
+    /* Numbers, true, false and null.  */
+    GRUB_JSON_PRIMITIVE,
+    GRUB_JSON_UNDEFINED
+  } grub_json_type_t;
+
+struct grub_json_token;
+
+/* A value inside a parsed document.  Children of an object are its keys,
+   each of which has the associated value as its only child.  */
+struct grub_json
+{
+  struct grub_json_token *tokens;
+  grub_size_t idx;
+  char *string;
+};
+typedef struct grub_json grub_json_t;
+
+/* Parse STRING_LEN bytes of STRING into a token tree.  The input is
+   copied, so STRING may be freed afterwards.  */
+grub_err_t
+grub_json_parse (grub_json_t **out, const char *string,
+		 grub_size_t string_len);
+
+void
+grub_json_free (grub_json_t *json);
+
+/* Number of children of JSON: keys of an object, elements of an array,
+   1 for an object key and 0 otherwise.  */
+grub_err_t
+grub_json_getsize (grub_size_t *out, const grub_json_t *json);
+
+grub_err_t
+grub_json_gettype (grub_json_type_t *out, const grub_json_t *json);
+
+/* Store the Nth child of PARENT into OUT.  */
+grub_err_t
+grub_json_getchild (grub_json_t *out, const grub_json_t *parent,
+		    grub_size_t n);
+
+/* Store the value of KEY in object PARENT into OUT.  */
+grub_err_t
+grub_json_getvalue (grub_json_t *out, const grub_json_t *parent,
+		    const char *key);
+
+/* The accessors below read PARENT itself if KEY is NULL and the value of
+   KEY in object PARENT otherwise.  Integers may be given either as
+   numbers or as strings.  Returned strings stay valid until the
+   document is freed.  */
+grub_err_t
+grub_json_getstring (const char **out, const grub_json_t *parent,
+		     const char *key);
+
+grub_err_t
+grub_json_getuint64 (grub_uint64_t *out, const grub_json_t *parent,
+		     const char *key);
+
+grub_err_t
+grub_json_getint64 (grub_int64_t *out, const grub_json_t *parent,
+		    const char *key);
+
+#endif
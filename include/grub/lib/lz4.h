@@ -0,0 +1,45 @@
+/* lz4.h - prototypes for the LZ4 block decoder */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_LZ4_H
+#define GRUB_LZ4_H	1
+
+#include <grub/types.h>
+#include <grub/err.h>
+
+/* Largest match offset, and so the most history a block may refer to.  */
+#define LZ4_HISTORY_SIZE	65536
+
+/* Worst case size of ISIZE bytes compressed.  */
+#define LZ4_COMPRESS_BOUND(isize)	((isize) + (isize) / 255 + 16)
+
+/* Decompress the ZFS form of a block, which is preceded by its size as
+   a big endian 32-bit number.  */
+grub_err_t lz4_decompress (void *s_start, void *d_start, grub_size_t s_len,
+			   grub_size_t d_len);
+
+/* Decompress the LZ4 block SRC, of SRC_SIZE bytes, to DEST, which has
+   room for DEST_SIZE bytes and is preceded by HIST bytes of earlier
+   output that matches may refer to.  Return the size of the decompressed
+   block, or -1 if it is corrupted.  */
+grub_ssize_t lz4_decompress_block (const void *src, grub_size_t src_size,
+				   void *dest, grub_size_t dest_size,
+				   grub_size_t hist);
+
+#endif /* ! GRUB_LZ4_H */
@@ -137,6 +137,15 @@ struct grub_ntfs_attr
   struct grub_ntfs_file *mft;
 };
 
+/* One decoded run of a non-resident attribute.  LCN 0 marks a sparse
+   run, the same convention grub_ntfs_read_block uses.  */
+struct grub_ntfs_extent
+{
+  grub_disk_addr_t vcn;
+  grub_disk_addr_t lcn;
+  grub_uint64_t len;
+};
+
 struct grub_ntfs_file
 {
   struct grub_ntfs_data *data;
@@ -146,6 +155,10 @@ struct grub_ntfs_file
   grub_uint64_t ino;
   int inode_read;
   struct grub_ntfs_attr attr;
+  /* Cached run list of the $DATA attribute, built on first read.  */
+  int runs_read;
+  grub_size_t run_count;
+  struct grub_ntfs_extent *runs;
 };
 
 struct grub_ntfs_data
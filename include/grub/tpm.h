@@ -69,12 +69,22 @@ typedef struct {
 grub_err_t EXPORT_FUNC(grub_tpm_measure) (unsigned char *buf, grub_size_t size,
 					  grub_uint8_t pcr, const char *kind,
 					  const char *description);
+/* Number of events measured so far, the amount of data they covered and
+   the time spent in the firmware doing so.  */
+void EXPORT_FUNC(grub_tpm_get_stats) (grub_uint64_t *events,
+				      grub_uint64_t *bytes,
+				      grub_uint64_t *time_ms);
 #if defined (GRUB_MACHINE_EFI) || defined (GRUB_MACHINE_PCBIOS)
+int grub_tpm_available(void);
 grub_err_t grub_tpm_execute(PassThroughToTPM_InputParamBlock *inbuf,
 			    PassThroughToTPM_OutputParamBlock *outbuf);
 grub_err_t grub_tpm_log_event(unsigned char *buf, grub_size_t size,
 			      grub_uint8_t pcr, const char *description);
 #else
+static inline int grub_tpm_available(void)
+{
+	return 0;
+};
 static inline grub_err_t grub_tpm_execute(
 	PassThroughToTPM_InputParamBlock *inbuf __attribute__ ((unused)),
 	PassThroughToTPM_OutputParamBlock *outbuf __attribute__ ((unused)))
@@ -137,6 +137,8 @@ typedef grub_int32_t	grub_ssize_t;
 #define GRUB_INT_MAX 0x7fffffff
 #define GRUB_INT32_MIN (-2147483647 - 1)
 #define GRUB_INT32_MAX 2147483647
+#define GRUB_INT64_MIN (-9223372036854775807LL - 1)
+#define GRUB_INT64_MAX 9223372036854775807LL
 
 #if GRUB_CPU_SIZEOF_LONG == 8
 # define GRUB_ULONG_MAX 18446744073709551615UL
@@ -39,7 +39,7 @@
   { "locales", GRUB_INSTALL_OPTIONS_INSTALL_LOCALES, N_("LOCALES"),\
     0, N_("install only LOCALES [default=all]"), 1 },			  \
   { "compress", GRUB_INSTALL_OPTIONS_INSTALL_COMPRESS,		  \
-    "no|xz|gz|lzo", 0,				  \
+    "no|xz|gz|lzo|zstd|lz4", 0,				  \
     N_("compress GRUB files [optional]"), 1 },			          \
   {"core-compress", GRUB_INSTALL_OPTIONS_INSTALL_CORE_COMPRESS,		\
       "xz|none|auto",						\
@@ -225,6 +225,10 @@ int
 grub_install_compress_lzop (const char *src, const char *dest);
 int 
 grub_install_compress_xz (const char *src, const char *dest);
+int 
+grub_install_compress_zstd (const char *src, const char *dest);
+int 
+grub_install_compress_lz4 (const char *src, const char *dest);
 
 void
 grub_install_get_blocklist (grub_device_t root_dev,
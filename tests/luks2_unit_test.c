@@ -0,0 +1,360 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/command.h>
+#include <grub/crypto.h>
+#include <grub/cryptodisk.h>
+#include <grub/disk.h>
+#include <grub/emu/hostdisk.h>
+#include <grub/emu/misc.h>
+#include <grub/err.h>
+#include <grub/test.h>
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Two 16KiB header copies followed by a small segment.  */
+#define HDR_SIZE	0x4000
+#define BINARY_SIZE	4096
+#define DISK_SIZE	0x10000
+
+#define PRIMARY_UUID	"11111111-2222-3333-4444-555555555555"
+#define SECONDARY_UUID	"66666666-7777-8888-9999-aaaaaaaaaaaa"
+
+/* On disk LUKS2 binary header.  */
+struct luks2_header
+{
+  char magic[6];
+  grub_uint16_t version;
+  grub_uint64_t hdr_size;
+  grub_uint64_t seqid;
+  char label[48];
+  char csum_alg[32];
+  grub_uint8_t salt[64];
+  char uuid[40];
+  char subsystem[48];
+  grub_uint64_t hdr_offset;
+  char _padding[184];
+  grub_uint8_t csum[64];
+  char _padding4096[7 * 512];
+} GRUB_PACKED;
+
+static const char metadata[] =
+  "{\"keyslots\":{},\"tokens\":{},"
+  "\"segments\":{\"0\":{\"type\":\"crypt\",\"offset\":\"32768\","
+  "\"size\":\"dynamic\",\"iv_tweak\":\"0\","
+  "\"encryption\":\"aes-xts-plain64\",\"sector_size\":512}},"
+  "\"digests\":{},"
+  "\"config\":{\"json_size\":\"12288\",\"keyslots_size\":\"0\"}}";
+
+struct test_data
+{
+  int fd;
+  grub_uint8_t *raw;
+};
+
+static grub_err_t
+execute_command2 (const char *name, const char *arg1, const char *arg2)
+{
+  grub_command_t cmd;
+  grub_err_t err;
+  char *argv[2];
+
+  cmd = grub_command_find (name);
+  if (!cmd)
+    grub_fatal ("can't find command %s", name);
+
+  argv[0] = strdup (arg1);
+  argv[1] = strdup (arg2);
+  err = (cmd->func) (cmd, 2, argv);
+  free (argv[0]);
+  free (argv[1]);
+
+  return err;
+}
+
+/* Compute the checksum of the header copy at OFFSET.  */
+static void
+checksum_header (struct test_data *data, grub_size_t offset)
+{
+  struct luks2_header *hdr = (struct luks2_header *) (data->raw + offset);
+  const gcry_md_spec_t *hash;
+
+  hash = grub_crypto_lookup_md_by_name ("sha256");
+  if (!hash)
+    grub_fatal ("sha256 not found");
+
+  memset (hdr->csum, 0, sizeof (hdr->csum));
+  grub_crypto_hash (hash, hdr->csum, hdr, HDR_SIZE);
+}
+
+/* Write the header copy at OFFSET.  */
+static void
+write_header (struct test_data *data, grub_size_t offset, const char *magic,
+	      grub_uint64_t seqid, const char *uuid, const char *json)
+{
+  struct luks2_header *hdr = (struct luks2_header *) (data->raw + offset);
+
+  memset (hdr, 0, HDR_SIZE);
+  memcpy (hdr->magic, magic, sizeof (hdr->magic));
+  hdr->version = grub_cpu_to_be16_compile_time (2);
+  hdr->hdr_size = grub_cpu_to_be64_compile_time (HDR_SIZE);
+  hdr->seqid = grub_cpu_to_be64 (seqid);
+  strcpy (hdr->csum_alg, "sha256");
+  strcpy (hdr->uuid, uuid);
+  hdr->hdr_offset = grub_cpu_to_be64 (offset);
+  strcpy ((char *) hdr + BINARY_SIZE, json);
+
+  checksum_header (data, offset);
+}
+
+static void
+sync_disk (struct test_data *data)
+{
+  if (msync (data->raw, DISK_SIZE, MS_SYNC | MS_INVALIDATE) < 0)
+    grub_fatal ("Syncing disk failed: %s", strerror (errno));
+}
+
+/* Write both header copies, the secondary one with a higher sequence ID
+   if SECONDARY_NEWER.  */
+static void
+reset_disk (struct test_data *data, int secondary_newer)
+{
+  memset (data->raw, 0, DISK_SIZE);
+  write_header (data, 0, "LUKS\xBA\xBE", secondary_newer ? 1 : 2,
+		PRIMARY_UUID, metadata);
+  write_header (data, HDR_SIZE, "SKUL\xBA\xBE", secondary_newer ? 2 : 1,
+		SECONDARY_UUID, metadata);
+  sync_disk (data);
+}
+
+static void
+open_disk (struct test_data *data)
+{
+  const char *loop = "loop0";
+  char template[] = "/tmp/grub_luks2_test.XXXXXX";
+  char host[sizeof ("(host)") + sizeof (template)];
+
+  data->fd = mkstemp (template);
+  if (data->fd < 0)
+    grub_fatal ("Creating %s failed: %s", template, strerror (errno));
+
+  if (ftruncate (data->fd, DISK_SIZE) < 0)
+    {
+      int err = errno;
+      unlink (template);
+      grub_fatal ("Resizing %s failed: %s", template, strerror (err));
+    }
+
+  data->raw = mmap (NULL, DISK_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, data->fd, 0);
+  if (data->raw == MAP_FAILED)
+    {
+      int err = errno;
+      unlink (template);
+      grub_fatal ("Maping %s failed: %s", template, strerror (err));
+    }
+
+  snprintf (host, sizeof (host), "(host)%s", template);
+  if (execute_command2 ("loopback", loop, host) != GRUB_ERR_NONE)
+    {
+      unlink (template);
+      grub_fatal ("loopback %s %s failed: %s", loop, host, grub_errmsg);
+    }
+
+  if (unlink (template) < 0)
+    grub_fatal ("Unlinking %s failed: %s", template, strerror (errno));
+}
+
+static void
+close_disk (struct test_data *data)
+{
+  if (munmap (data->raw, DISK_SIZE) || close (data->fd))
+    grub_fatal ("Closing disk image failed: %s", strerror (errno));
+
+  grub_test_assert (execute_command2 ("loopback", "-d", "loop0") ==
+		    GRUB_ERR_NONE, "loopback -d loop0 failed: %s",
+		    grub_errmsg);
+}
+
+/* Scan the disk and return the UUID of the LUKS2 header found, without
+   dashes, or NULL.  */
+static char *
+scan_disk (void)
+{
+  grub_cryptodisk_dev_t cr;
+  grub_cryptodisk_t dev = NULL;
+  grub_disk_t disk;
+  char *uuid;
+
+  disk = grub_disk_open ("loop0");
+  if (!disk)
+    grub_fatal ("Opening loop0 failed: %s", grub_errmsg);
+
+  FOR_CRYPTODISK_DEVS (cr)
+    {
+      dev = cr->scan (disk, NULL, 0);
+      if (dev || grub_errno)
+	break;
+    }
+  grub_disk_close (disk);
+  if (!dev)
+    return NULL;
+
+  grub_test_assert (strcmp (dev->modname, "luks2") == 0,
+		    "unexpected module %s", dev->modname);
+  uuid = strdup (dev->uuid);
+  grub_crypto_cipher_close (dev->cipher);
+  grub_crypto_cipher_close (dev->secondary_cipher);
+  grub_crypto_cipher_close (dev->essiv_cipher);
+  grub_free (dev);
+  return uuid;
+}
+
+static void
+check_uuid (const char *expected)
+{
+  char *uuid;
+
+  uuid = scan_disk ();
+  grub_test_assert (uuid != NULL, "no LUKS2 header found: %s", grub_errmsg);
+  if (uuid)
+    grub_test_assert (strcmp (uuid, expected) == 0,
+		      "unexpected header %s", uuid);
+  free (uuid);
+  grub_errno = GRUB_ERR_NONE;
+}
+
+static void
+newer_header_test (void)
+{
+  struct test_data data;
+
+  open_disk (&data);
+
+  reset_disk (&data, 0);
+  check_uuid ("11111111222233334444555555555555");
+
+  reset_disk (&data, 1);
+  check_uuid ("66666666777788889999aaaaaaaaaaaa");
+
+  close_disk (&data);
+}
+
+static void
+corrupted_primary_test (void)
+{
+  struct test_data data;
+
+  open_disk (&data);
+
+  /* A bad magic hides where the secondary header is.  */
+  reset_disk (&data, 0);
+  data.raw[0] = 0;
+  sync_disk (&data);
+  check_uuid ("66666666777788889999aaaaaaaaaaaa");
+
+  /* So does a bad header size.  */
+  reset_disk (&data, 0);
+  data.raw[offsetof (struct luks2_header, hdr_size) + 6] = 0;
+  sync_disk (&data);
+  check_uuid ("66666666777788889999aaaaaaaaaaaa");
+
+  /* A damaged JSON area fails the checksum.  */
+  reset_disk (&data, 0);
+  data.raw[BINARY_SIZE + 2] = 'x';
+  sync_disk (&data);
+  check_uuid ("66666666777788889999aaaaaaaaaaaa");
+
+  /* JSON that does not parse, but with a valid checksum.  */
+  reset_disk (&data, 0);
+  data.raw[BINARY_SIZE] = '[';
+  checksum_header (&data, 0);
+  sync_disk (&data);
+  check_uuid ("66666666777788889999aaaaaaaaaaaa");
+
+  close_disk (&data);
+}
+
+static void
+corrupted_secondary_test (void)
+{
+  struct test_data data;
+
+  open_disk (&data);
+
+  reset_disk (&data, 1);
+  data.raw[HDR_SIZE + BINARY_SIZE + 2] = 'x';
+  sync_disk (&data);
+  check_uuid ("11111111222233334444555555555555");
+
+  close_disk (&data);
+}
+
+static void
+corrupted_both_test (void)
+{
+  struct test_data data;
+  char *uuid;
+
+  open_disk (&data);
+
+  reset_disk (&data, 0);
+  data.raw[BINARY_SIZE + 2] = 'x';
+  data.raw[HDR_SIZE + BINARY_SIZE + 2] = 'x';
+  sync_disk (&data);
+  uuid = scan_disk ();
+  grub_test_assert (uuid == NULL, "unexpected header %s", uuid);
+  grub_test_assert (grub_errno == GRUB_ERR_BAD_FS,
+		    "unexpected error: %s", grub_errmsg);
+  free (uuid);
+  grub_errno = GRUB_ERR_NONE;
+
+  close_disk (&data);
+}
+
+void
+grub_unit_test_init (void)
+{
+  grub_init_all ();
+  grub_gcry_init_all ();
+  grub_hostfs_init ();
+  grub_host_init ();
+  grub_test_register ("luks2_newer_header_test", newer_header_test);
+  grub_test_register ("luks2_corrupted_primary_test", corrupted_primary_test);
+  grub_test_register ("luks2_corrupted_secondary_test",
+		      corrupted_secondary_test);
+  grub_test_register ("luks2_corrupted_both_test", corrupted_both_test);
+}
+
+void
+grub_unit_test_fini (void)
+{
+  grub_test_unregister ("luks2_newer_header_test");
+  grub_test_unregister ("luks2_corrupted_primary_test");
+  grub_test_unregister ("luks2_corrupted_secondary_test");
+  grub_test_unregister ("luks2_corrupted_both_test");
+  grub_gcry_fini_all ();
+  grub_fini_all ();
+}
@@ -0,0 +1,279 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/command.h>
+#include <grub/disk.h>
+#include <grub/emu/hostdisk.h>
+#include <grub/emu/misc.h>
+#include <grub/err.h>
+#include <grub/lvm.h>
+#include <grub/test.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Layout of the 8MiB test PV: the label in sector 1, the metadata area
+   from 4KiB to 1MiB and the physical extents of 1MiB from there on.  */
+#define DISK_SIZE	(8 * 1048576)
+#define LABEL_SECTOR	1
+#define MDA_OFFSET	4096
+#define MDA_SIZE	(1048576 - MDA_OFFSET)
+#define PE_START	1048576
+#define EXTENT_SECTORS	2048
+#define LV_EXTENTS	4
+
+#define PV_UUID		"0123456789abcdefghijklmnopqrstuv"
+#define PV_ID		"012345-6789-abcd-efgh-ijkl-mnop-qrstuv"
+
+/* Metadata as vgcreate and lvcreate write it.  */
+static const char metadata[] =
+  "testvg {\n"
+  "id = \"ABCDEF-GHIJ-KLMN-OPQR-STUV-WXYZ-abcdef\"\n"
+  "seqno = 2\n"
+  "format = \"lvm2\"\n"
+  "status = [\"RESIZEABLE\", \"READ\", \"WRITE\"]\n"
+  "flags = []\n"
+  "extent_size = 2048\n"
+  "max_lv = 0\n"
+  "max_pv = 0\n"
+  "metadata_copies = 0\n"
+  "\n"
+  "physical_volumes {\n"
+  "\n"
+  "pv0 {\n"
+  "id = \"" PV_ID "\"\n"
+  "device = \"/dev/loop0\"\t# Hint only\n"
+  "\n"
+  "status = [\"ALLOCATABLE\"]\n"
+  "flags = []\n"
+  "dev_size = 16384\n"
+  "pe_start = 2048\n"
+  "pe_count = 7\n"
+  "}\n"
+  "}\n"
+  "\n"
+  "logical_volumes {\n"
+  "\n"
+  "testlv {\n"
+  "id = \"abcdef-GHIJ-KLMN-OPQR-STUV-WXYZ-ABCDEF\"\n"
+  "status = [\"READ\", \"WRITE\", \"VISIBLE\"]\n"
+  "flags = []\n"
+  "creation_time = 1700000000\t# 2023-11-14 22:13:20 +0000\n"
+  "creation_host = \"test\"\n"
+  "segment_count = 1\n"
+  "\n"
+  "segment1 {\n"
+  "start_extent = 0\n"
+  "extent_count = 4\n"
+  "\n"
+  "type = \"striped\"\n"
+  "stripe_count = 1\t# linear\n"
+  "\n"
+  "stripes = [\n"
+  "\"pv0\", 0\n"
+  "]\n"
+  "}\n"
+  "}\n"
+  "}\n"
+  "\n"
+  "}\n"
+  "# Generated by LVM2 version 2.03.16(2) (2022-05-18): Tue Nov 14 22:13:20 2023\n"
+  "\n"
+  "contents = \"Text Format Volume\"\n"
+  "version = 1\n"
+  "\n"
+  "description = \"\"\n"
+  "\n"
+  "creation_host = \"test\"\n"
+  "creation_time = 1700000000\t# Tue Nov 14 22:13:20 2023\n"
+  "\n";
+
+struct test_data
+{
+  int fd;
+  grub_uint8_t *raw;
+};
+
+static grub_err_t
+execute_command2 (const char *name, const char *arg1, const char *arg2)
+{
+  grub_command_t cmd;
+  grub_err_t err;
+  char *argv[2];
+
+  cmd = grub_command_find (name);
+  if (!cmd)
+    grub_fatal ("can't find command %s", name);
+
+  argv[0] = strdup (arg1);
+  argv[1] = strdup (arg2);
+  err = (cmd->func) (cmd, 2, argv);
+  free (argv[0]);
+  free (argv[1]);
+
+  return err;
+}
+
+/* Write a PV whose metadata text is TEXT_SIZE bytes of TEXT, and fill the
+   extents with a pattern.  */
+static void
+write_pv (struct test_data *data, const char *text, grub_size_t text_size)
+{
+  struct grub_lvm_label_header *lh;
+  struct grub_lvm_pv_header *pvh;
+  struct grub_lvm_mda_header *mdah;
+  grub_size_t i;
+
+  memset (data->raw, 0, DISK_SIZE);
+
+  lh = (struct grub_lvm_label_header *) (data->raw
+					 + LABEL_SECTOR
+					 * GRUB_DISK_SECTOR_SIZE);
+  memcpy (lh->id, GRUB_LVM_LABEL_ID, sizeof (lh->id));
+  lh->sector_xl = grub_cpu_to_le64_compile_time (LABEL_SECTOR);
+  lh->offset_xl = grub_cpu_to_le32_compile_time (sizeof (*lh));
+  memcpy (lh->type, GRUB_LVM_LVM2_LABEL, sizeof (lh->type));
+
+  pvh = (struct grub_lvm_pv_header *) (lh + 1);
+  memcpy (pvh->pv_uuid, PV_UUID, sizeof (pvh->pv_uuid));
+  pvh->device_size_xl = grub_cpu_to_le64_compile_time (DISK_SIZE);
+  pvh->disk_areas_xl[0].offset = grub_cpu_to_le64_compile_time (PE_START);
+  pvh->disk_areas_xl[2].offset = grub_cpu_to_le64_compile_time (MDA_OFFSET);
+  pvh->disk_areas_xl[2].size = grub_cpu_to_le64_compile_time (MDA_SIZE);
+
+  mdah = (struct grub_lvm_mda_header *) (data->raw + MDA_OFFSET);
+  memcpy (mdah->magic, GRUB_LVM_FMTT_MAGIC, sizeof (mdah->magic));
+  mdah->version = grub_cpu_to_le32_compile_time (GRUB_LVM_FMTT_VERSION);
+  mdah->start = grub_cpu_to_le64_compile_time (MDA_OFFSET);
+  mdah->size = grub_cpu_to_le64_compile_time (MDA_SIZE);
+  mdah->raw_locns[0].offset
+    = grub_cpu_to_le64_compile_time (GRUB_LVM_MDA_HEADER_SIZE);
+  mdah->raw_locns[0].size = grub_cpu_to_le64 (text_size);
+  memcpy (data->raw + MDA_OFFSET + GRUB_LVM_MDA_HEADER_SIZE, text,
+	  text_size);
+
+  for (i = PE_START; i < DISK_SIZE; i++)
+    data->raw[i] = i / GRUB_DISK_SECTOR_SIZE;
+
+  if (msync (data->raw, DISK_SIZE, MS_SYNC | MS_INVALIDATE) < 0)
+    grub_fatal ("Syncing disk failed: %s", strerror (errno));
+}
+
+static void
+open_disk (struct test_data *data)
+{
+  const char *loop = "loop0";
+  char template[] = "/tmp/grub_lvm_test.XXXXXX";
+  char host[sizeof ("(host)") + sizeof (template)];
+
+  data->fd = mkstemp (template);
+  if (data->fd < 0)
+    grub_fatal ("Creating %s failed: %s", template, strerror (errno));
+
+  if (ftruncate (data->fd, DISK_SIZE) < 0)
+    {
+      int err = errno;
+      unlink (template);
+      grub_fatal ("Resizing %s failed: %s", template, strerror (err));
+    }
+
+  data->raw = mmap (NULL, DISK_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, data->fd, 0);
+  if (data->raw == MAP_FAILED)
+    {
+      int err = errno;
+      unlink (template);
+      grub_fatal ("Maping %s failed: %s", template, strerror (err));
+    }
+
+  snprintf (host, sizeof (host), "(host)%s", template);
+  if (execute_command2 ("loopback", loop, host) != GRUB_ERR_NONE)
+    {
+      unlink (template);
+      grub_fatal ("loopback %s %s failed: %s", loop, host, grub_errmsg);
+    }
+
+  if (unlink (template) < 0)
+    grub_fatal ("Unlinking %s failed: %s", template, strerror (errno));
+}
+
+static void
+close_disk (struct test_data *data)
+{
+  if (munmap (data->raw, DISK_SIZE) || close (data->fd))
+    grub_fatal ("Closing disk image failed: %s", strerror (errno));
+
+  grub_test_assert (execute_command2 ("loopback", "-d", "loop0") ==
+		    GRUB_ERR_NONE, "loopback -d loop0 failed: %s",
+		    grub_errmsg);
+}
+
+/* The size of the metadata text recorded by LVM includes its terminating
+   NUL.  */
+static void
+trailing_nul_test (void)
+{
+  struct test_data data;
+  grub_disk_t disk;
+  grub_uint8_t buf[GRUB_DISK_SECTOR_SIZE];
+
+  open_disk (&data);
+  write_pv (&data, metadata, sizeof (metadata));
+
+  disk = grub_disk_open ("lvm/testvg-testlv");
+  grub_test_assert (disk != NULL, "opening the LV failed: %s", grub_errmsg);
+  if (disk)
+    {
+      grub_test_assert (grub_disk_get_size (disk)
+			== LV_EXTENTS * EXTENT_SECTORS,
+			"unexpected LV size: %llu sectors",
+			(unsigned long long) grub_disk_get_size (disk));
+
+      grub_test_assert (grub_disk_read (disk, 1, 0, sizeof (buf), buf)
+			== GRUB_ERR_NONE, "reading the LV failed: %s",
+			grub_errmsg);
+      grub_test_assert (buf[0] == (grub_uint8_t)
+			(PE_START / GRUB_DISK_SECTOR_SIZE + 1),
+			"unexpected LV data: 0x%02x", buf[0]);
+      grub_disk_close (disk);
+    }
+  grub_errno = GRUB_ERR_NONE;
+
+  close_disk (&data);
+}
+
+void
+grub_unit_test_init (void)
+{
+  grub_init_all ();
+  grub_hostfs_init ();
+  grub_host_init ();
+  grub_test_register ("lvm_trailing_nul_test", trailing_nul_test);
+}
+
+void
+grub_unit_test_fini (void)
+{
+  grub_test_unregister ("lvm_trailing_nul_test");
+  grub_fini_all ();
+}
@@ -386,6 +386,16 @@ grub_install_parse (int key, char *arg)
 	  compress_func = grub_install_compress_lzop;
 	  return 1;
 	}
+      if (strcmp (arg, "zstd") == 0)
+	{
+	  compress_func = grub_install_compress_zstd;
+	  return 1;
+	}
+      if (strcmp (arg, "lz4") == 0)
+	{
+	  compress_func = grub_install_compress_lz4;
+	  return 1;
+	}
       grub_util_error (_("Unrecognized compression `%s'"), arg);
     case GRUB_INSTALL_OPTIONS_GRUB_MKIMAGE:
       return 1;
@@ -415,6 +425,17 @@ decompressors (void)
       grub_install_push_module ("gcry_crc");
       return 3;
     }
+  if (compress_func == grub_install_compress_zstd)
+    {
+      grub_install_push_module ("zstdio");
+      return 1;
+    }
+  if (compress_func == grub_install_compress_lz4)
+    {
+      grub_install_push_module ("lz4io");
+      grub_install_push_module ("lz4");
+      return 2;
+    }
   return 0;
 }
 
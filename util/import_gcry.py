@@ -95,6 +95,15 @@ cryptolist.write ("AES128: gcry_rijndael\n");
 cryptolist.write ("AES-128: gcry_rijndael\n");
 cryptolist.write ("AES-192: gcry_rijndael\n");
 cryptolist.write ("AES-256: gcry_rijndael\n");
+# Hardware AES, preferred over gcry_rijndael when the CPU has it.  Like
+# all entries, these are left out of the installed crypto.lst on platforms
+# that do not build the module.
+for name in ["RIJNDAEL", "RIJNDAEL192", "RIJNDAEL256", "AES", "AES128",
+             "AES-128", "AES192", "AES-192", "AES256", "AES-256"]:
+    cryptolist.write ("%s: hwaes\n" % name);
+# Likewise for hardware SHA over gcry_sha1 and gcry_sha256.
+cryptolist.write ("SHA1: hwsha\n");
+cryptolist.write ("SHA256: hwsha\n");
 
 cryptolist.write ("ADLER32: adler32\n");
 cryptolist.write ("CRC64: crc64\n");
@@ -502,6 +511,101 @@ for cipher_file in cipher_files:
 
 cryptolist.close ()
 
+# Local changes to the imported files, as (file, old text, new text).
+# Every replacement must apply, so that a new libgcrypt import is
+# rechecked by hand rather than silently losing them.
+rol_asm = ("#if defined(__GNUC__) && defined(__i386__)\n"
+           "static inline u32\n"
+           "%s\n"
+           "{\n"
+           "\t__asm__(\"%sl %%%%cl,%%0\"\n"
+           "\t\t:\"=r\" (x)\n"
+           "\t\t:\"0\" (x),\"c\" (n));\n"
+           "\treturn x;\n"
+           "}\n"
+           "#else\n"
+           "%s"
+           "#endif\n")
+rol_c = "#define rol(x,n) ( ((x) << (n)) | ((x) >> (32-(n))) )\n"
+ror_c = "#define ror(x,n) ( ((x) >> (n)) | ((x) << (32-(n))) )\n"
+cipher_fixups = [
+    # The i386 assembly forces the count into %cl, which keeps the
+    # compiler from rotating by the constant counts all callers use.
+    ("bithelp.h", rol_asm % ("rol( u32 x, int n)", "rol", rol_c), rol_c,
+     "(rol): Use the C macro on i386 too."),
+    ("bithelp.h", rol_asm % ("ror(u32 x, int n)", "ror", ror_c), ror_c,
+     "(ror): Likewise."),
+    # Wipe the stack only when a block was compressed, not each time a
+    # few bytes are buffered.
+    ("sha1.c",
+     "      inbuf += nblocks * 64;\n"
+     "    }\n"
+     "  _gcry_burn_stack (88+4*sizeof(void*));\n",
+     "      inbuf += nblocks * 64;\n"
+     "      _gcry_burn_stack (88+4*sizeof(void*));\n"
+     "    }\n",
+     "(sha1_write): Burn the stack only after a transform."),
+    ("sha256.c",
+     "  while (inlen >= 64)\n"
+     "    {\n"
+     "      transform (hd, inbuf);\n"
+     "      hd->count = 0;\n"
+     "      hd->nblocks++;\n"
+     "      inlen -= 64;\n"
+     "      inbuf += 64;\n"
+     "    }\n"
+     "  _gcry_burn_stack (74*4+32);\n",
+     "  if (inlen >= 64)\n"
+     "    {\n"
+     "      while (inlen >= 64)\n"
+     "        {\n"
+     "          transform (hd, inbuf);\n"
+     "          hd->count = 0;\n"
+     "          hd->nblocks++;\n"
+     "          inlen -= 64;\n"
+     "          inbuf += 64;\n"
+     "        }\n"
+     "      _gcry_burn_stack (74*4+32);\n"
+     "    }\n",
+     "(sha256_write): Likewise."),
+    ("sha512.c",
+     "  while (inlen >= 128)\n"
+     "    {\n"
+     "      transform (hd, inbuf);\n"
+     "      hd->count = 0;\n"
+     "      hd->nblocks++;\n"
+     "      inlen -= 128;\n"
+     "      inbuf += 128;\n"
+     "    }\n"
+     "  _gcry_burn_stack (768);\n",
+     "  if (inlen >= 128)\n"
+     "    {\n"
+     "      while (inlen >= 128)\n"
+     "\t{\n"
+     "\t  transform (hd, inbuf);\n"
+     "\t  hd->count = 0;\n"
+     "\t  hd->nblocks++;\n"
+     "\t  inlen -= 128;\n"
+     "\t  inbuf += 128;\n"
+     "\t}\n"
+     "      _gcry_burn_stack (768);\n"
+     "    }\n",
+     "(sha512_write): Likewise."),
+]
+
+for (cipher_file, old, new, chmsg) in cipher_fixups:
+    outfile = os.path.join (cipher_dir_out, cipher_file)
+    f = codecs.open (outfile, "r", "utf-8")
+    text = f.read ()
+    f.close ()
+    if text.count (old) != 1:
+        print ("ERROR: fixup for %s does not apply: %s" % (cipher_file, chmsg))
+        exit (1)
+    fw = codecs.open (outfile, "w", "utf-8")
+    fw.write (text.replace (old, new))
+    fw.close ()
+    chlog = "%s	* %s %s\n" % (chlog, cipher_file, chmsg)
+
 for src in sorted (os.listdir (os.path.join (indir, "src"))):
     if src == "versioninfo.rc.in" or src == "ath.c" or src == "ChangeLog-2011" \
             or src == "dumpsexp.c" or src == "fips.c" or src == "gcrypt.h.in" \